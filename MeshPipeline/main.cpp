@@ -0,0 +1,204 @@
+#include <argh.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cassert>
+#include <cfloat>
+#include "../ShaderPipeline/filesystem_utils.h"
+#include "../VkMaterialSystem/mesh_asset_format.h"
+#include "../VkMaterialSystem/vertex_encoding.h"
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlet_builder.h"
+
+//each lod aims for this fraction of the previous lod's triangles
+const float LOD_REDUCTION = 0.5f;
+const uint32_t LOD_MIN_TRIANGLES = 64;
+
+//lods are always simplified from the full mesh, so their errors are relative to it
+void buildLodChain(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, std::vector<std::vector<uint32_t>>& outLods, std::vector<float>& outErrors)
+{
+	outLods.push_back(indices);
+	outErrors.push_back(0.0f);
+
+	while (outLods.size() < MeshFormat::MAX_LODS)
+	{
+		size_t prevCount = outLods.back().size();
+		uint32_t target = (uint32_t)(prevCount * LOD_REDUCTION) / 3 * 3;
+		if (target < LOD_MIN_TRIANGLES * 3) break;
+
+		std::vector<uint32_t> lodIndices;
+		float error = simplifyMesh(vertices, indices, target, FLT_MAX, lodIndices);
+
+		//locked borders and seams can stop the simplifier well short of the target, a lod that barely changed isn't worth keeping
+		if (lodIndices.size() > prevCount * 0.8f) break;
+
+		outLods.push_back(lodIndices);
+		outErrors.push_back(error);
+	}
+}
+
+void writeMesh(const std::string& filepath, const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshFormat::LodEntry>& lods, const std::vector<MeshFormat::Meshlet>& meshlets, EVertexLayout layout)
+{
+	MeshFormat::Header header = {};
+	header.magic = MeshFormat::MAGIC;
+	header.version = MeshFormat::VERSION;
+	header.vertexCount = (uint32_t)vertices.size();
+	header.indexCount = (uint32_t)indices.size();
+	header.vertexLayout = layout;
+	header.vertexStride = (uint16_t)VertexEncoding::vertexStride(layout);
+	header.indexSize = VertexEncoding::fitsInShortIndices(header.vertexCount) ? sizeof(uint16_t) : sizeof(uint32_t);
+	header.lodCount = (uint32_t)lods.size();
+
+	uint64_t lodTableOffset = MeshFormat::lodTableOffset();
+	uint64_t meshletTableOffset = MeshFormat::meshletTableOffset(header.lodCount);
+	header.vertexOffset = MeshFormat::alignStream(meshletTableOffset + meshlets.size() * sizeof(MeshFormat::Meshlet));
+	header.indexOffset = MeshFormat::alignStream(header.vertexOffset + (uint64_t)header.vertexCount * header.vertexStride);
+
+	VertexEncoding::computeBounds(vertices.data(), header.vertexCount, header.boundsMin, header.boundsMax);
+
+	//the padding between streams is written as zeroes, so the file is the same every time it's cooked
+	size_t fileSize = (size_t)header.indexOffset + indices.size() * header.indexSize;
+	std::vector<uint8_t> fileData(fileSize, 0);
+
+	memcpy(&fileData[0], &header, sizeof(MeshFormat::Header));
+	memcpy(&fileData[(size_t)lodTableOffset], lods.data(), lods.size() * sizeof(MeshFormat::LodEntry));
+	if (meshlets.size() > 0)
+	{
+		memcpy(&fileData[(size_t)meshletTableOffset], meshlets.data(), meshlets.size() * sizeof(MeshFormat::Meshlet));
+	}
+
+	uint8_t* vertexDst = &fileData[(size_t)header.vertexOffset];
+	if (layout == EVertexLayout::Compact)
+	{
+		VertexEncoding::encodeCompact(vertices.data(), header.vertexCount, header.boundsMin, header.boundsMax, (VertexEncoding::CompactVertex*)vertexDst);
+	}
+	else
+	{
+		memcpy(vertexDst, vertices.data(), vertices.size() * sizeof(MeshFormat::PackedVertex));
+	}
+
+	uint8_t* indexDst = &fileData[(size_t)header.indexOffset];
+	if (header.indexSize == sizeof(uint16_t))
+	{
+		VertexEncoding::narrowIndices(indices.data(), header.indexCount, (uint16_t*)indexDst);
+	}
+	else
+	{
+		memcpy(indexDst, indices.data(), indices.size() * sizeof(uint32_t));
+	}
+
+	FILE* file;
+	fopen_s(&file, filepath.c_str(), "wb");
+	assert(file);
+
+	size_t written = fwrite(fileData.data(), 1, fileSize, file);
+	assert(written == fileSize);
+
+	fclose(file);
+}
+
+int main(int argc, const char** argv)
+{
+	argh::parser cmdl(argv);
+	if (!cmdl(2)) printf("MeshPipeline: usage: MeshPipeline <path to mesh folder> <path to output folder> [-compact] [-nooptimize] [-nolods] [-nomeshlets]\n");
+
+	//compact meshes need materials with "vertexLayout": "compact"
+	EVertexLayout layout = cmdl["compact"] ? EVertexLayout::Compact : EVertexLayout::Full;
+	bool optimize = !cmdl["nooptimize"];
+	bool generateLods = !cmdl["nolods"];
+	bool generateMeshlets = !cmdl["nomeshlets"];
+
+	std::string meshInPath = cmdl[1];
+	std::string meshOutPath = cmdl[2];
+
+	makeDirectoryRecursive(makeFullPath(meshOutPath));
+
+	std::vector<std::string> inputMeshes = getFilesInDirectory(meshInPath);
+	for (uint32_t i = 0; i < inputMeshes.size(); ++i)
+	{
+		if (inputMeshes[i].find(".obj") == std::string::npos) continue;
+
+		std::string relPath = meshInPath + inputMeshes[i];
+		std::string fullPath = makeFullPath(relPath);
+
+		std::vector<MeshFormat::PackedVertex> vertices;
+		std::vector<uint32_t> indices;
+
+		if (!loadObj(fullPath.c_str(), vertices, indices))
+		{
+			printf("Skipping %s, couldn't read any faces from it\n", inputMeshes[i].c_str());
+			continue;
+		}
+
+		std::vector<std::vector<uint32_t>> lodIndices;
+		std::vector<float> lodErrors;
+
+		if (generateLods)
+		{
+			buildLodChain(vertices, indices, lodIndices, lodErrors);
+		}
+		else
+		{
+			lodIndices.push_back(indices);
+			lodErrors.push_back(0.0f);
+		}
+
+		if (optimize)
+		{
+			VertexCacheStats before = analyzeVertexCache(lodIndices[0], (uint32_t)vertices.size(), VERTEX_CACHE_SIZE);
+
+			//overdraw reordering works on the chunks the cache optimizer leaves, so the order here matters
+			for (std::vector<uint32_t>& lod : lodIndices)
+			{
+				optimizeVertexCache(lod, (uint32_t)vertices.size(), VERTEX_CACHE_SIZE);
+				optimizeOverdraw(lod, vertices, VERTEX_CACHE_SIZE, 1.05f);
+			}
+
+			VertexCacheStats after = analyzeVertexCache(lodIndices[0], (uint32_t)vertices.size(), VERTEX_CACHE_SIZE);
+
+			printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", inputMeshes[i].c_str(), before.acmr, after.acmr, before.atvr, after.atvr);
+		}
+
+		//every lod goes in the one index buffer, full mesh first
+		std::vector<MeshFormat::LodEntry> lods;
+		std::vector<MeshFormat::Meshlet> meshlets;
+		indices.clear();
+		for (uint32_t l = 0; l < lodIndices.size(); ++l)
+		{
+			MeshFormat::LodEntry lod = {};
+			lod.firstIndex = (uint32_t)indices.size();
+			lod.indexCount = (uint32_t)lodIndices[l].size();
+			lod.error = lodErrors[l];
+			lod.firstMeshlet = (uint32_t)meshlets.size();
+
+			indices.insert(indices.end(), lodIndices[l].begin(), lodIndices[l].end());
+
+			//meshlets are index ranges, so they need building after the final triangle order is known
+			if (generateMeshlets && lod.indexCount / 3 >= MESHLET_MIN_LOD_TRIANGLES)
+			{
+				lod.meshletCount = buildMeshlets(vertices, indices, lod.firstIndex, lod.indexCount, meshlets);
+			}
+
+			lods.push_back(lod);
+
+			if (l > 0) printf("    lod %u: %zu triangles, error %f\n", l, lodIndices[l].size() / 3, lodErrors[l]);
+			if (lod.meshletCount > 0) printf("    lod %u: %u meshlets\n", l, lod.meshletCount);
+		}
+
+		//fetch order follows the full mesh, since it's the one that pulls in every vertex
+		if (optimize)
+		{
+			optimizeVertexFetch(vertices, indices);
+		}
+
+		std::string outName = inputMeshes[i].substr(0, inputMeshes[i].find_last_of('.')) + ".vkmesh";
+		std::string outPath = makeFullPath(meshOutPath) + "/" + outName;
+		writeMesh(outPath, vertices, indices, lods, meshlets, layout);
+
+		printf("%s -> %s (%zu vertices, %u triangles, %zu lods)\n", inputMeshes[i].c_str(), outName.c_str(), vertices.size(), lods[0].indexCount / 3, lods.size());
+	}
+
+	return 0;
+}
\ No newline at end of file
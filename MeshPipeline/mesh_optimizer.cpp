@@ -0,0 +1,309 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	//a vertex is in the cache if it was added within the last cacheSize misses
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t uniqueVertices = 0;
+
+	VertexCacheStats stats = {};
+
+	for (uint32_t idx : indices)
+	{
+		if (!referenced[idx])
+		{
+			referenced[idx] = true;
+			uniqueVertices++;
+		}
+
+		if (timestamp - cacheTimestamps[idx] > cacheSize)
+		{
+			cacheTimestamps[idx] = timestamp++;
+			stats.misses++;
+		}
+	}
+
+	size_t triCount = indices.size() / 3;
+	stats.acmr = triCount > 0 ? (float)stats.misses / triCount : 0.0f;
+	stats.atvr = uniqueVertices > 0 ? (float)stats.misses / uniqueVertices : 0.0f;
+	return stats;
+}
+
+struct TriangleAdjacency
+{
+	std::vector<uint32_t> offsets;		//per vertex, into triangles
+	std::vector<uint32_t> counts;
+	std::vector<uint32_t> triangles;
+};
+
+void buildTriangleAdjacency(const std::vector<uint32_t>& indices, uint32_t vertexCount, TriangleAdjacency& outAdjacency)
+{
+	outAdjacency.offsets.assign(vertexCount, 0);
+	outAdjacency.counts.assign(vertexCount, 0);
+	outAdjacency.triangles.resize(indices.size());
+
+	for (uint32_t idx : indices) outAdjacency.counts[idx]++;
+
+	uint32_t offset = 0;
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		outAdjacency.offsets[v] = offset;
+		offset += outAdjacency.counts[v];
+	}
+
+	std::vector<uint32_t> fill = outAdjacency.offsets;
+	for (uint32_t i = 0; i < indices.size(); ++i)
+	{
+		outAdjacency.triangles[fill[indices[i]]++] = i / 3;
+	}
+}
+
+//Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw". Fans
+//around one vertex at a time, then moves to whichever vertex from the last fan will still be in the
+//cache once its remaining triangles are emitted, or back through recently used vertices if none will
+void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	uint32_t triCount = (uint32_t)(indices.size() / 3);
+	if (triCount == 0) return;
+
+	TriangleAdjacency adjacency;
+	buildTriangleAdjacency(indices, vertexCount, adjacency);
+
+	std::vector<uint32_t> liveTriangles = adjacency.counts;
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	std::vector<bool> emitted(triCount, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t cursor = 0;
+
+	int64_t fanVertex = -1;
+	while (cursor < vertexCount && liveTriangles[cursor] == 0) cursor++;
+	if (cursor < vertexCount) fanVertex = cursor;
+
+	while (fanVertex >= 0)
+	{
+		candidates.clear();
+
+		uint32_t first = adjacency.offsets[(uint32_t)fanVertex];
+		uint32_t count = adjacency.counts[(uint32_t)fanVertex];
+
+		for (uint32_t a = first; a < first + count; ++a)
+		{
+			uint32_t tri = adjacency.triangles[a];
+			if (emitted[tri]) continue;
+
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				uint32_t v = indices[tri * 3 + c];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+
+				if (timestamp - cacheTimestamps[v] > cacheSize)
+				{
+					cacheTimestamps[v] = timestamp++;
+				}
+			}
+
+			emitted[tri] = true;
+		}
+
+		//prefer the candidate that's been in the cache longest, as long as its whole fan still fits
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+
+		for (uint32_t v : candidates)
+		{
+			if (liveTriangles[v] == 0) continue;
+
+			int64_t priority = 0;
+			if (timestamp - cacheTimestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+			{
+				priority = timestamp - cacheTimestamps[v];
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		if (best == -1)
+		{
+			while (deadEnd.size() > 0)
+			{
+				uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveTriangles[v] > 0)
+				{
+					best = v;
+					break;
+				}
+			}
+		}
+
+		if (best == -1)
+		{
+			while (cursor < vertexCount && liveTriangles[cursor] == 0) cursor++;
+			if (cursor < vertexCount) best = cursor;
+		}
+
+		fanVertex = best;
+	}
+
+	indices.swap(result);
+}
+
+struct TriangleCluster
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float sortKey;
+};
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshFormat::PackedVertex>& vertices, uint32_t cacheSize, float threshold)
+{
+	uint32_t triCount = (uint32_t)(indices.size() / 3);
+	uint32_t vertexCount = (uint32_t)vertices.size();
+	if (triCount == 0) return;
+
+	VertexCacheStats before = analyzeVertexCache(indices, vertexCount, cacheSize);
+
+	//a triangle that misses on all 3 vertices doesn't benefit from anything before it, so
+	//the triangles can be moved around in those chunks without hurting the cache much
+	std::vector<TriangleCluster> clusters;
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	uint32_t timestamp = cacheSize + 1;
+
+	for (uint32_t tri = 0; tri < triCount; ++tri)
+	{
+		uint32_t misses = 0;
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			uint32_t v = indices[tri * 3 + c];
+			if (timestamp - cacheTimestamps[v] > cacheSize)
+			{
+				cacheTimestamps[v] = timestamp++;
+				misses++;
+			}
+		}
+
+		if (tri == 0 || misses == 3)
+		{
+			clusters.push_back({ tri * 3, 0, 0.0f });
+		}
+		clusters.back().indexCount += 3;
+	}
+
+	if (clusters.size() < 2) return;
+
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+
+	std::vector<float> clusterCentroids(clusters.size() * 3, 0.0f);
+	std::vector<float> clusterNormals(clusters.size() * 3, 0.0f);
+
+	for (uint32_t c = 0; c < clusters.size(); ++c)
+	{
+		float clusterArea = 0.0f;
+
+		for (uint32_t i = clusters[c].firstIndex; i < clusters[c].firstIndex + clusters[c].indexCount; i += 3)
+		{
+			const float* a = vertices[indices[i]].pos;
+			const float* b = vertices[indices[i + 1]].pos;
+			const float* d = vertices[indices[i + 2]].pos;
+
+			float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e1[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+			float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				float centre = (a[k] + b[k] + d[k]) / 3.0f;
+				clusterCentroids[c * 3 + k] += centre * area;
+				clusterNormals[c * 3 + k] += n[k];
+				meshCentroid[k] += centre * area;
+			}
+
+			clusterArea += area;
+		}
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			clusterCentroids[c * 3 + k] = clusterArea > 0.0f ? clusterCentroids[c * 3 + k] / clusterArea : 0.0f;
+		}
+
+		meshArea += clusterArea;
+	}
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		meshCentroid[k] = meshArea > 0.0f ? meshCentroid[k] / meshArea : 0.0f;
+	}
+
+	//clusters on the outside facing away from the centre are the ones most likely to hide
+	//the rest of the mesh, so they go first
+	for (uint32_t c = 0; c < clusters.size(); ++c)
+	{
+		const float* n = &clusterNormals[c * 3];
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0.0f) continue;
+
+		float key = 0.0f;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			key += (clusterCentroids[c * 3 + k] - meshCentroid[k]) * (n[k] / len);
+		}
+		clusters[c].sortKey = key;
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const TriangleCluster& a, const TriangleCluster& b)
+	{
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (const TriangleCluster& cluster : clusters)
+	{
+		result.insert(result.end(), indices.begin() + cluster.firstIndex, indices.begin() + cluster.firstIndex + cluster.indexCount);
+	}
+
+	VertexCacheStats after = analyzeVertexCache(result, vertexCount, cacheSize);
+	if (after.acmr <= before.acmr * threshold)
+	{
+		indices.swap(result);
+	}
+}
+
+void optimizeVertexFetch(std::vector<MeshFormat::PackedVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	const uint32_t unused = ~0u;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<MeshFormat::PackedVertex> result;
+	result.reserve(vertices.size());
+
+	for (uint32_t& idx : indices)
+	{
+		if (remap[idx] == unused)
+		{
+			remap[idx] = (uint32_t)result.size();
+			result.push_back(vertices[idx]);
+		}
+		idx = remap[idx];
+	}
+
+	vertices.swap(result);
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "../VkMaterialSystem/mesh_asset_format.h"
+
+//size of the fifo the optimizer and the stats below assume the gpu's post transform cache has.
+//Real hardware varies, but anything tuned for 16 does fine on bigger caches too
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+	uint32_t misses;
+	float acmr;	//misses per triangle, 0.5 is the best a regular grid can do, 3 is no reuse at all
+	float atvr;	//misses per referenced vertex, 1 means every vertex is only transformed once
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize);
+
+//reorders triangles so vertices are reused while they're still in the post transform cache (Tipsify)
+void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize);
+
+//splits the cache optimized triangles into clusters at the points where the cache starts over, then
+//sorts the clusters so ones facing out from the middle of the mesh draw first, which cuts overdraw
+//from most view directions. If that costs more than threshold times the original acmr, nothing changes
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshFormat::PackedVertex>& vertices, uint32_t cacheSize, float threshold);
+
+//puts vertices in the order the index buffer first uses them, so vertex fetch walks forward through 
+//memory, and drops any that aren't referenced. Do this last, it doesn't change the triangle order
+void optimizeVertexFetch(std::vector<MeshFormat::PackedVertex>& vertices, std::vector<uint32_t>& indices);
\ No newline at end of file
@@ -0,0 +1,303 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+//the upper triangle of a symmetric 4x4 plane matrix, plus the total area that went into it so
+//the error can be normalized back into a squared distance
+struct Quadric
+{
+	double a2, b2, c2, d2;
+	double ab, ac, ad;
+	double bc, bd;
+	double cd;
+	double weight;
+};
+
+void addQuadric(Quadric& dst, const Quadric& src)
+{
+	dst.a2 += src.a2; dst.b2 += src.b2; dst.c2 += src.c2; dst.d2 += src.d2;
+	dst.ab += src.ab; dst.ac += src.ac; dst.ad += src.ad;
+	dst.bc += src.bc; dst.bd += src.bd;
+	dst.cd += src.cd;
+	dst.weight += src.weight;
+}
+
+Quadric planeQuadric(double a, double b, double c, double d, double weight)
+{
+	Quadric q;
+	q.a2 = a * a * weight; q.b2 = b * b * weight; q.c2 = c * c * weight; q.d2 = d * d * weight;
+	q.ab = a * b * weight; q.ac = a * c * weight; q.ad = a * d * weight;
+	q.bc = b * c * weight; q.bd = b * d * weight;
+	q.cd = c * d * weight;
+	q.weight = weight;
+	return q;
+}
+
+//squared distance from p to the planes in q, averaged by area
+float quadricError(const Quadric& q, const float* p)
+{
+	double x = p[0], y = p[1], z = p[2];
+
+	double err =
+		q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2 +
+		2.0 * (q.ab * x * y + q.ac * x * z + q.ad * x + q.bc * y * z + q.bd * y + q.cd * z);
+
+	return q.weight > 0.0 ? (float)(fabs(err) / q.weight) : 0.0f;
+}
+
+void triangleNormal(const float* a, const float* b, const float* c, float* outNormal)
+{
+	float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	outNormal[0] = e0[1] * e1[2] - e0[2] * e1[1];
+	outNormal[1] = e0[2] * e1[0] - e0[0] * e1[2];
+	outNormal[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+struct PositionHash
+{
+	size_t operator()(const MeshFormat::PackedVertex* v) const
+	{
+		uint32_t bits[3];
+		memcpy(bits, v->pos, sizeof(bits));
+		return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+	}
+};
+
+struct PositionEqual
+{
+	bool operator()(const MeshFormat::PackedVertex* a, const MeshFormat::PackedVertex* b) const
+	{
+		return memcmp(a->pos, b->pos, sizeof(a->pos)) == 0;
+	}
+};
+
+//vertices that share a position with another vertex (uv / normal seams), or sit on an edge with only
+//one triangle, can't move without tearing a hole in the mesh
+void findLockedVertices(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, std::vector<bool>& outLocked)
+{
+	uint32_t vertexCount = (uint32_t)vertices.size();
+	outLocked.assign(vertexCount, false);
+
+	std::vector<uint32_t> positionId(vertexCount);
+	std::unordered_map<const MeshFormat::PackedVertex*, uint32_t, PositionHash, PositionEqual> firstWithPosition;
+
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		auto inserted = firstWithPosition.insert(std::make_pair(&vertices[v], v));
+		positionId[v] = inserted.first->second;
+
+		if (!inserted.second)
+		{
+			outLocked[v] = true;
+			outLocked[inserted.first->second] = true;
+		}
+	}
+
+	std::unordered_map<uint64_t, uint32_t> edgeUses;
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			uint32_t a = positionId[indices[i + e]];
+			uint32_t b = positionId[indices[i + (e + 1) % 3]];
+			uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+			edgeUses[key]++;
+		}
+	}
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			uint32_t va = indices[i + e];
+			uint32_t vb = indices[i + (e + 1) % 3];
+			uint32_t a = positionId[va];
+			uint32_t b = positionId[vb];
+			uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+
+			if (edgeUses[key] == 1)
+			{
+				outLocked[va] = true;
+				outLocked[vb] = true;
+			}
+		}
+	}
+}
+
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	float error;
+};
+
+//collapsing from onto to mustn't turn any of from's other triangles inside out
+bool collapseFlipsTriangle(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices,
+	const std::vector<uint32_t>& adjOffsets, const std::vector<uint32_t>& adjTriangles, uint32_t from, uint32_t to)
+{
+	for (uint32_t a = adjOffsets[from]; a < adjOffsets[from + 1]; ++a)
+	{
+		const uint32_t* tri = &indices[adjTriangles[a] * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+
+		const float* before[3];
+		const float* after[3];
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			before[c] = vertices[tri[c]].pos;
+			after[c] = tri[c] == from ? vertices[to].pos : before[c];
+		}
+
+		float n0[3];
+		float n1[3];
+		triangleNormal(before[0], before[1], before[2], n0);
+		triangleNormal(after[0], after[1], after[2], n1);
+
+		float dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+		float len0 = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+		float len1 = n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2];
+
+		if (dot < 0.25f * sqrtf(len0 * len1)) return true;
+	}
+
+	return false;
+}
+
+float simplifyMesh(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& outIndices)
+{
+	uint32_t vertexCount = (uint32_t)vertices.size();
+	outIndices = indices;
+
+	std::vector<bool> locked;
+	findLockedVertices(vertices, indices, locked);
+
+	std::vector<Quadric> quadrics(vertexCount);
+	memset(quadrics.data(), 0, sizeof(Quadric) * vertexCount);
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const float* p0 = vertices[indices[i]].pos;
+		float n[3];
+		triangleNormal(p0, vertices[indices[i + 1]].pos, vertices[indices[i + 2]].pos, n);
+
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0.0f) continue;
+
+		n[0] /= len;
+		n[1] /= len;
+		n[2] /= len;
+
+		float d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		Quadric q = planeQuadric(n[0], n[1], n[2], d, len * 0.5f);
+
+		for (uint32_t c = 0; c < 3; ++c) addQuadric(quadrics[indices[i + c]], q);
+	}
+
+	float maxErrorSq = maxError * maxError;
+	float resultErrorSq = 0.0f;
+
+	std::vector<uint32_t> adjOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjTriangles;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+
+	//each pass collapses a batch of edges that don't share any triangles, then rebuilds everything
+	while (outIndices.size() > targetIndexCount)
+	{
+		uint32_t triCount = (uint32_t)(outIndices.size() / 3);
+
+		std::fill(adjOffsets.begin(), adjOffsets.end(), 0);
+		for (uint32_t idx : outIndices) adjOffsets[idx + 1]++;
+		for (uint32_t v = 0; v < vertexCount; ++v) adjOffsets[v + 1] += adjOffsets[v];
+
+		adjTriangles.resize(outIndices.size());
+		std::vector<uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+		for (uint32_t i = 0; i < outIndices.size(); ++i) adjTriangles[fill[outIndices[i]]++] = i / 3;
+
+		collapses.clear();
+		for (uint32_t t = 0; t < triCount; ++t)
+		{
+			for (uint32_t e = 0; e < 3; ++e)
+			{
+				uint32_t a = outIndices[t * 3 + e];
+				uint32_t b = outIndices[t * 3 + (e + 1) % 3];
+
+				//the error of moving a to b is measured against the planes around both of them
+				if (!locked[a])
+				{
+					Quadric q = quadrics[a];
+					addQuadric(q, quadrics[b]);
+					collapses.push_back({ a, b, quadricError(q, vertices[b].pos) });
+				}
+
+				if (!locked[b])
+				{
+					Quadric q = quadrics[b];
+					addQuadric(q, quadrics[a]);
+					collapses.push_back({ b, a, quadricError(q, vertices[a].pos) });
+				}
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y)
+		{
+			return x.error < y.error;
+		});
+
+		for (uint32_t v = 0; v < vertexCount; ++v) remap[v] = v;
+		std::fill(touched.begin(), touched.end(), false);
+
+		//every collapse removes about 2 triangles
+		uint32_t trianglesToRemove = (uint32_t)(outIndices.size() - targetIndexCount) / 3;
+		uint32_t trianglesRemoved = 0;
+		uint32_t collapseCount = 0;
+
+		for (const Collapse& c : collapses)
+		{
+			if (c.error > maxErrorSq) break;
+			if (touched[c.from] || touched[c.to]) continue;
+			if (collapseFlipsTriangle(vertices, outIndices, adjOffsets, adjTriangles, c.from, c.to)) continue;
+
+			remap[c.from] = c.to;
+			addQuadric(quadrics[c.to], quadrics[c.from]);
+
+			//the adjacency is stale for everything around from now, so leave its neighbours until the next pass
+			for (uint32_t a = adjOffsets[c.from]; a < adjOffsets[c.from + 1]; ++a)
+			{
+				const uint32_t* tri = &outIndices[adjTriangles[a] * 3];
+				touched[tri[0]] = true;
+				touched[tri[1]] = true;
+				touched[tri[2]] = true;
+			}
+
+			resultErrorSq = c.error > resultErrorSq ? c.error : resultErrorSq;
+			collapseCount++;
+
+			trianglesRemoved += 2;
+			if (trianglesRemoved >= trianglesToRemove) break;
+		}
+
+		if (collapseCount == 0) break;
+
+		//drop the triangles that collapsed down to a line
+		size_t writeIdx = 0;
+		for (size_t i = 0; i < outIndices.size(); i += 3)
+		{
+			uint32_t a = remap[outIndices[i]];
+			uint32_t b = remap[outIndices[i + 1]];
+			uint32_t c = remap[outIndices[i + 2]];
+			if (a == b || b == c || a == c) continue;
+
+			outIndices[writeIdx++] = a;
+			outIndices[writeIdx++] = b;
+			outIndices[writeIdx++] = c;
+		}
+		outIndices.resize(writeIdx);
+	}
+
+	return sqrtf(resultErrorSq);
+}
\ No newline at end of file
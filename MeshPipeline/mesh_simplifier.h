@@ -0,0 +1,10 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "../VkMaterialSystem/mesh_asset_format.h"
+
+//collapses edges in order of quadric error (Garland and Heckbert) until there are targetIndexCount
+//indices left, or the next collapse would be worse than maxError. Vertices only ever collapse onto
+//other vertices, so the result indexes the same vertex buffer and every lod can share it. Vertices
+//on a border or an attribute seam never move. Returns the error of the result, in mesh units
+float simplifyMesh(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& outIndices);
\ No newline at end of file
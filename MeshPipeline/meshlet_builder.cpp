@@ -0,0 +1,144 @@
+#include "meshlet_builder.h"
+#include <cfloat>
+#include <cmath>
+
+void computeMeshletBounds(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, MeshFormat::Meshlet& meshlet)
+{
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+	{
+		const float* p = vertices[indices[i]].pos;
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			boundsMin[c] = p[c] < boundsMin[c] ? p[c] : boundsMin[c];
+			boundsMax[c] = p[c] > boundsMax[c] ? p[c] : boundsMax[c];
+		}
+	}
+
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		meshlet.center[c] = (boundsMin[c] + boundsMax[c]) * 0.5f;
+	}
+
+	float radiusSq = 0.0f;
+	for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+	{
+		const float* p = vertices[indices[i]].pos;
+		float dx = p[0] - meshlet.center[0];
+		float dy = p[1] - meshlet.center[1];
+		float dz = p[2] - meshlet.center[2];
+		float distSq = dx * dx + dy * dy + dz * dz;
+		radiusSq = distSq > radiusSq ? distSq : radiusSq;
+	}
+	meshlet.radius = sqrtf(radiusSq);
+
+	//the cone axis is the average triangle normal, and the cutoff comes from the normal furthest from it
+	float normals[MeshFormat::MESHLET_MAX_TRIANGLES][3];
+	uint32_t normalCount = 0;
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+	{
+		const float* a = vertices[indices[i]].pos;
+		const float* b = vertices[indices[i + 1]].pos;
+		const float* c = vertices[indices[i + 2]].pos;
+
+		float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0.0f) continue;
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			normals[normalCount][k] = n[k] / len;
+			axis[k] += n[k] / len;
+		}
+		normalCount++;
+	}
+
+	float axisLen = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+	float minDot = 1.0f;
+	for (uint32_t t = 0; t < normalCount && axisLen > 0.0f; ++t)
+	{
+		float d = (normals[t][0] * axis[0] + normals[t][1] * axis[1] + normals[t][2] * axis[2]) / axisLen;
+		minDot = d < minDot ? d : minDot;
+	}
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		meshlet.coneAxis[k] = axisLen > 0.0f ? axis[k] / axisLen : 0.0f;
+	}
+
+	//the triangles span more than a hemisphere, there's no view they all face away from
+	if (axisLen == 0.0f || minDot <= 0.0f)
+	{
+		meshlet.coneCutoff = 1.0f;
+	}
+	else
+	{
+		meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+	}
+}
+
+uint32_t buildMeshlets(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, std::vector<MeshFormat::Meshlet>& outMeshlets)
+{
+	size_t firstMeshlet = outMeshlets.size();
+
+	//vertexCount is tiny, so a linear search over the meshlet's vertices beats anything fancier
+	uint32_t meshletVertices[MeshFormat::MESHLET_MAX_VERTICES];
+	uint32_t vertexCount = 0;
+
+	MeshFormat::Meshlet meshlet = {};
+	meshlet.firstIndex = firstIndex;
+
+	for (uint32_t i = firstIndex; i < firstIndex + indexCount; i += 3)
+	{
+		uint32_t newVertices[3];
+		uint32_t newCount = 0;
+
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			uint32_t v = indices[i + c];
+			bool found = false;
+			for (uint32_t k = 0; k < vertexCount && !found; ++k) found = meshletVertices[k] == v;
+			for (uint32_t k = 0; k < newCount && !found; ++k) found = newVertices[k] == v;
+			if (!found) newVertices[newCount++] = v;
+		}
+
+		bool full = vertexCount + newCount > MeshFormat::MESHLET_MAX_VERTICES || meshlet.indexCount / 3 == MeshFormat::MESHLET_MAX_TRIANGLES;
+		if (full)
+		{
+			computeMeshletBounds(vertices, indices, meshlet);
+			outMeshlets.push_back(meshlet);
+
+			meshlet = {};
+			meshlet.firstIndex = i;
+			vertexCount = 0;
+
+			//every vertex of the triangle is new to the fresh meshlet
+			newCount = 0;
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				uint32_t v = indices[i + c];
+				bool found = false;
+				for (uint32_t k = 0; k < newCount && !found; ++k) found = newVertices[k] == v;
+				if (!found) newVertices[newCount++] = v;
+			}
+		}
+
+		for (uint32_t k = 0; k < newCount; ++k) meshletVertices[vertexCount++] = newVertices[k];
+		meshlet.indexCount += 3;
+	}
+
+	if (meshlet.indexCount > 0)
+	{
+		computeMeshletBounds(vertices, indices, meshlet);
+		outMeshlets.push_back(meshlet);
+	}
+
+	return (uint32_t)(outMeshlets.size() - firstMeshlet);
+}
\ No newline at end of file
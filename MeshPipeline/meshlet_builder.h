@@ -0,0 +1,13 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "../VkMaterialSystem/mesh_asset_format.h"
+
+//lods with fewer triangles than this are drawn whole, culling them in pieces isn't worth it
+const uint32_t MESHLET_MIN_LOD_TRIANGLES = 4096;
+
+//splits indices[firstIndex, firstIndex + indexCount) into runs of at most MESHLET_MAX_VERTICES unique
+//vertices and MESHLET_MAX_TRIANGLES triangles, without reordering anything, so meshlets are just index
+//ranges the runtime can draw directly. Run it after the vertex cache optimizer, whose order already keeps
+//neighbouring triangles together. Returns how many meshlets were added to outMeshlets
+uint32_t buildMeshlets(const std::vector<MeshFormat::PackedVertex>& vertices, const std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, std::vector<MeshFormat::Meshlet>& outMeshlets);
\ No newline at end of file
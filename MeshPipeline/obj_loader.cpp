@@ -0,0 +1,216 @@
+#include "obj_loader.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unordered_map>
+
+struct ObjCorner
+{
+	int32_t position;
+	int32_t uv;
+	int32_t normal;
+
+	bool operator==(const ObjCorner& other) const
+	{
+		return position == other.position && uv == other.uv && normal == other.normal;
+	}
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner& corner) const
+	{
+		uint64_t h = (uint64_t)(uint32_t)corner.position * 0x9E3779B97F4A7C15ull;
+		h ^= (uint64_t)(uint32_t)corner.uv * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+		h ^= (uint64_t)(uint32_t)corner.normal * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+		return (size_t)h;
+	}
+};
+
+//obj indices are 1 based, and negative ones count back from the end of the list
+int32_t resolveObjIndex(long index, size_t count)
+{
+	if (index > 0) return (int32_t)(index - 1);
+	if (index < 0) return (int32_t)(count + index);
+	return -1;
+}
+
+//parses "v", "v/vt", "v//vn" or "v/vt/vn"
+bool parseCorner(const char*& cursor, size_t positionCount, size_t uvCount, size_t normalCount, ObjCorner& outCorner)
+{
+	char* end;
+	long position = strtol(cursor, &end, 10);
+	if (end == cursor) return false;
+
+	outCorner.position = resolveObjIndex(position, positionCount);
+	outCorner.uv = -1;
+	outCorner.normal = -1;
+	cursor = end;
+
+	if (*cursor == '/')
+	{
+		cursor++;
+		if (*cursor != '/')
+		{
+			long uv = strtol(cursor, &end, 10);
+			if (end != cursor) outCorner.uv = resolveObjIndex(uv, uvCount);
+			cursor = end;
+		}
+
+		if (*cursor == '/')
+		{
+			cursor++;
+			long normal = strtol(cursor, &end, 10);
+			if (end != cursor) outCorner.normal = resolveObjIndex(normal, normalCount);
+			cursor = end;
+		}
+	}
+
+	return outCorner.position >= 0 && (size_t)outCorner.position < positionCount;
+}
+
+bool loadObj(const char* filepath, std::vector<MeshFormat::PackedVertex>& outVertices, std::vector<uint32_t>& outIndices)
+{
+	FILE* file;
+	fopen_s(&file, filepath, "r");
+	if (!file) return false;
+
+	std::vector<float> positions;	//xyz rgba
+	std::vector<float> uvs;
+	std::vector<float> normals;
+	std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> cornerToVertex;
+	std::vector<bool> missingNormal;
+	std::vector<uint32_t> faceVertices;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), file))
+	{
+		const char* cursor = line;
+		while (*cursor == ' ' || *cursor == '\t') cursor++;
+
+		if (cursor[0] == 'v' && cursor[1] == ' ')
+		{
+			float v[7] = { 0, 0, 0, 1, 1, 1, 1 };
+			char* end = (char*)cursor + 1;
+			for (uint32_t i = 0; i < 6; ++i)
+			{
+				const char* start = end;
+				float f = strtof(start, &end);
+				if (end == start) break;
+				v[i] = f;
+			}
+			positions.insert(positions.end(), v, v + 7);
+		}
+		else if (cursor[0] == 'v' && cursor[1] == 't')
+		{
+			char* end;
+			float u = strtof(cursor + 2, &end);
+			float v = strtof(end, &end);
+
+			//obj puts v = 0 at the bottom of the image, vulkan samples with 0 at the top
+			uvs.push_back(u);
+			uvs.push_back(1.0f - v);
+		}
+		else if (cursor[0] == 'v' && cursor[1] == 'n')
+		{
+			char* end;
+			float n[3];
+			n[0] = strtof(cursor + 2, &end);
+			n[1] = strtof(end, &end);
+			n[2] = strtof(end, &end);
+			normals.insert(normals.end(), n, n + 3);
+		}
+		else if (cursor[0] == 'f' && cursor[1] == ' ')
+		{
+			cursor += 2;
+			faceVertices.clear();
+
+			size_t positionCount = positions.size() / 7;
+			size_t uvCount = uvs.size() / 2;
+			size_t normalCount = normals.size() / 3;
+
+			ObjCorner corner;
+			while (true)
+			{
+				while (*cursor == ' ' || *cursor == '\t') cursor++;
+				if (!parseCorner(cursor, positionCount, uvCount, normalCount, corner)) break;
+
+				auto found = cornerToVertex.find(corner);
+				if (found != cornerToVertex.end())
+				{
+					faceVertices.push_back(found->second);
+					continue;
+				}
+
+				const float* p = &positions[(size_t)corner.position * 7];
+
+				MeshFormat::PackedVertex vert = {};
+				memcpy(vert.pos, p, sizeof(float) * 3);
+				memcpy(vert.col, p + 3, sizeof(float) * 4);
+				if (corner.uv >= 0 && (size_t)corner.uv < uvCount)
+				{
+					vert.uv[0] = uvs[(size_t)corner.uv * 2];
+					vert.uv[1] = uvs[(size_t)corner.uv * 2 + 1];
+				}
+
+				bool hasNormal = corner.normal >= 0 && (size_t)corner.normal < normalCount;
+				if (hasNormal)
+				{
+					memcpy(vert.normal, &normals[(size_t)corner.normal * 3], sizeof(float) * 3);
+				}
+
+				uint32_t vertIdx = (uint32_t)outVertices.size();
+				outVertices.push_back(vert);
+				missingNormal.push_back(!hasNormal);
+				cornerToVertex[corner] = vertIdx;
+				faceVertices.push_back(vertIdx);
+			}
+
+			for (size_t i = 2; i < faceVertices.size(); ++i)
+			{
+				outIndices.push_back(faceVertices[0]);
+				outIndices.push_back(faceVertices[i - 1]);
+				outIndices.push_back(faceVertices[i]);
+			}
+		}
+	}
+
+	fclose(file);
+
+	//area weighted face normals, summed into every vertex the file didn't give a normal
+	for (size_t i = 0; i + 2 < outIndices.size(); i += 3)
+	{
+		const float* a = outVertices[outIndices[i]].pos;
+		const float* b = outVertices[outIndices[i + 1]].pos;
+		const float* c = outVertices[outIndices[i + 2]].pos;
+
+		float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			uint32_t idx = outIndices[i + corner];
+			if (!missingNormal[idx]) continue;
+
+			for (uint32_t k = 0; k < 3; ++k) outVertices[idx].normal[k] += n[k];
+		}
+	}
+
+	for (size_t i = 0; i < outVertices.size(); ++i)
+	{
+		if (!missingNormal[i]) continue;
+
+		float* n = outVertices[i].normal;
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len > 0.0f)
+		{
+			n[0] /= len;
+			n[1] /= len;
+			n[2] /= len;
+		}
+	}
+
+	return outIndices.size() > 0;
+}
\ No newline at end of file
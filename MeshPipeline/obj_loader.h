@@ -0,0 +1,9 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "../VkMaterialSystem/mesh_asset_format.h"
+
+//reads positions, uvs, normals and faces out of an obj. Faces with more than 3 corners are fanned into 
+//triangles, and corners sharing a position / uv / normal share a vertex. Vertices without a normal in
+//the file get a smoothed one from the faces around them. Supports the common "v x y z r g b" vertex colour extension
+bool loadObj(const char* filepath, std::vector<MeshFormat::PackedVertex>& outVertices, std::vector<uint32_t>& outIndices);
\ No newline at end of file
@@ -1,4 +1,10 @@
 #pragma once
 
 const int GLOBAL_SET = 0;
-const int DYNAMIC_SET = 3;
\ No newline at end of file
+const int DYNAMIC_SET = 3;
+
+//every combination of a material's keywords is built, keep this in sync with the material system
+const int MAX_MATERIAL_KEYWORDS = 8;
+
+//materials with more variants than this get called out in the variant report
+const int VARIANT_WARNING_COUNT = 32;
\ No newline at end of file
@@ -1,11 +1,13 @@
 #include <spirv_glsl.hpp>
 #include <argh.h>
+#include <map>
 #include <string>
 #include <vector>
 #include <stdint.h>
 #include "filesystem_utils.h"
 #include "string_utils.h"
 #include "shaderdata.h"
+#include "variants.h"
 #include "config.h"
 
 std::string baseTypeToString(spirv_cross::SPIRType::BaseType type);
@@ -36,7 +38,7 @@ void createUniformBlockForResource(InputBlock* outBlock, spirv_cross::Resource r
 	outBlock->size = compiler.get_declared_struct_size(ub_type);
 	outBlock->binding = compiler.get_decoration(res.id, spv::DecorationBinding);
 	outBlock->set = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
-	outBlock->isTextureBlock = false;
+	outBlock->type = InputBlockType::Uniform;
 }
 
 void createTextureBlockForResource(InputBlock* outBlock, spirv_cross::Resource res, spirv_cross::CompilerGLSL& compiler)
@@ -47,18 +49,188 @@ void createTextureBlockForResource(InputBlock* outBlock, spirv_cross::Resource r
 	outBlock->name = res.name;
 	outBlock->set = compiler.get_decoration(res.id, spv::DecorationDescriptorSet);
 	outBlock->binding = compiler.get_decoration(res.id, spv::DecorationBinding);
-	outBlock->isTextureBlock = true;
+	outBlock->type = InputBlockType::Sampler;
+}
+
+const char* specConstantTypeToString(spirv_cross::SPIRType::BaseType type)
+{
+	switch (type)
+	{
+	case spirv_cross::SPIRType::Float: return "float";
+	case spirv_cross::SPIRType::Int: return "int";
+	case spirv_cross::SPIRType::UInt: return "uint";
+	case spirv_cross::SPIRType::Boolean: return "bool";
+	default: return nullptr;
+	}
+}
+
+//samplerBuffer / imageBuffer / textureBuffer show up in the same lists as the image types they look like
+bool isTexelBufferResource(spirv_cross::Resource res, spirv_cross::CompilerGLSL& compiler)
+{
+	return compiler.get_type(res.type_id).image.dim == spv::DimBuffer;
+}
+
+ShaderData reflectShader(const std::string& fullPath)
+{
+	ShaderData data = {};
+
+	FILE* shaderFile;
+	fopen_s(&shaderFile, fullPath.c_str(), "rb");
+	assert(shaderFile);
+
+	fseek(shaderFile, 0, SEEK_END);
+	size_t filesize = ftell(shaderFile);
+	size_t wordSize = sizeof(uint32_t);
+	size_t wordCount = filesize / wordSize;
+	rewind(shaderFile);
+
+
+	uint32_t* ir = (uint32_t*)malloc(sizeof(uint32_t) * wordCount);
+
+	fread(ir, filesize, 1, shaderFile);
+	fclose(shaderFile);
+
+	spirv_cross::CompilerGLSL glsl(ir, wordCount);
+
+	spirv_cross::ShaderResources resources = glsl.get_shader_resources();
+
+	for (spirv_cross::Resource res : resources.push_constant_buffers)
+	{
+		createUniformBlockForResource(&data.pushConstants, res, glsl);
+	}
+
+	data.descriptorSets.resize(resources.uniform_buffers.size() + resources.sampled_images.size() + resources.storage_buffers.size() + resources.storage_images.size()
+		+ resources.separate_images.size() + resources.separate_samplers.size());
+
+	uint32_t idx = 0;
+	for (spirv_cross::Resource res : resources.uniform_buffers)
+	{
+		createUniformBlockForResource(&data.descriptorSets[idx++], res, glsl);
+	}
+
+	for (spirv_cross::Resource res : resources.sampled_images)
+	{
+		createTextureBlockForResource(&data.descriptorSets[idx], res, glsl);
+		if (isTexelBufferResource(res, glsl)) data.descriptorSets[idx].type = InputBlockType::UniformTexelBuffer;
+		idx++;
+	}
+
+	//storage buffers are laid out like uniform blocks, a trailing runtime array doesn't count towards the size
+	for (spirv_cross::Resource res : resources.storage_buffers)
+	{
+		createUniformBlockForResource(&data.descriptorSets[idx], res, glsl);
+		data.descriptorSets[idx++].type = InputBlockType::StorageBuffer;
+	}
+
+	for (spirv_cross::Resource res : resources.storage_images)
+	{
+		createTextureBlockForResource(&data.descriptorSets[idx], res, glsl);
+		data.descriptorSets[idx++].type = isTexelBufferResource(res, glsl) ? InputBlockType::StorageTexelBuffer : InputBlockType::StorageImage;
+	}
+
+	for (spirv_cross::Resource res : resources.separate_images)
+	{
+		createTextureBlockForResource(&data.descriptorSets[idx], res, glsl);
+		data.descriptorSets[idx++].type = isTexelBufferResource(res, glsl) ? InputBlockType::UniformTexelBuffer : InputBlockType::SeparateImage;
+	}
+
+	for (spirv_cross::Resource res : resources.separate_samplers)
+	{
+		createTextureBlockForResource(&data.descriptorSets[idx], res, glsl);
+		data.descriptorSets[idx++].type = InputBlockType::SeparateSampler;
+	}
+
+	if (glsl.get_execution_model() == spv::ExecutionModelGLCompute)
+	{
+		data.isCompute = true;
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			data.workgroupSize[i] = glsl.get_execution_mode_argument(spv::ExecutionModeLocalSize, i);
+		}
+	}
+
+	//composites built out of specialization constants (like a local_size_x_id workgroup size) follow the scalars they're made from
+	for (spirv_cross::SpecializationConstant spec : glsl.get_specialization_constants())
+	{
+		const spirv_cross::SPIRConstant& constant = glsl.get_constant(spec.id);
+		const spirv_cross::SPIRType& type = glsl.get_type(constant.constant_type);
+		if (type.vecsize > 1 || type.columns > 1) continue;
+
+		const char* typeString = specConstantTypeToString(type.basetype);
+		if (!typeString)
+		{
+			printf("ShaderPipeline: %s - specialization constant %s isn't a 32 bit scalar, it can't be set by materials\n", fullPath.c_str(), glsl.get_name(spec.id).c_str());
+			continue;
+		}
+
+		SpecConstant sc;
+		sc.name = glsl.get_name(spec.id);
+		sc.constantId = spec.constant_id;
+		sc.type = typeString;
+		sc.defaultValue = constant.scalar();
+		data.specConstants.push_back(sc);
+	}
+
+	std::sort(data.descriptorSets.begin(), data.descriptorSets.end(), [](const InputBlock& lhs, const InputBlock& rhs)
+	{
+		if (lhs.set != rhs.set) return lhs.set < rhs.set;
+		return lhs.binding < rhs.binding;
+	});
+
+
+	for (uint32_t blockIdx = 0; blockIdx < data.descriptorSets.size(); ++blockIdx)
+	{
+		InputBlock& b = data.descriptorSets[blockIdx];
+
+		if (b.type == InputBlockType::StorageBuffer) data.numStorageBuffers++;
+		if (b.type == InputBlockType::StorageImage) data.numStorageImages++;
+		//only uniforms and combined samplers are part of the set sizes the material lays out memory with
+		bool isResourceInput = b.type != InputBlockType::Uniform && b.type != InputBlockType::Sampler;
+
+		if (b.set == GLOBAL_SET) data.globalSets.push_back(b.set);
+		else if (b.set == DYNAMIC_SET)
+		{
+			if (b.type == InputBlockType::Sampler) data.numDynamicTextures++;
+			else if (b.type == InputBlockType::Uniform) data.numDynamicUniforms++;
+
+			if (std::find(data.dynamicSets.begin(), data.dynamicSets.end(), b.set) == data.dynamicSets.end())
+			{
+				data.dynamicSets.push_back(b.set);
+			}
+			if (!isResourceInput) data.dynamicSetSize += b.size;
+		}
+		else
+		{
+			if (b.type == InputBlockType::Sampler) data.numStaticTextures++;
+			else if (b.type == InputBlockType::Uniform) data.numStaticUniforms++;
+
+			if (std::find(data.staticSets.begin(), data.staticSets.end(), b.set) == data.staticSets.end())
+			{
+				data.staticSets.push_back(b.set);
+			}
+
+			if (!isResourceInput) data.staticSetSize += b.size;
+		}
+	}
+
+	return data;
 }
 
 int main(int argc, const char** argv)
 {
 	argh::parser cmdl(argv);
-	if (!cmdl(3)) printf("ShaderPipeline: usage: ShaderPipeline <path to shader folder> <path to output shader folder> <path to output reflection folder> \n");
+	if (!cmdl(3)) printf("ShaderPipeline: usage: ShaderPipeline <path to shader folder> <path to output shader folder> <path to output reflection folder> [path to material folder]\n");
 
 	std::string shaderInPath = cmdl[1];
 	std::string shaderOutPath = cmdl[2];
 	std::string reflOutPath = cmdl[3];
 
+	//without a material folder no keyword variants are built
+	std::string materialPath = cmdl(4) ? cmdl[4] : "";
+
+	//-nopause is for running as a build step, where nobody is there to read the errors before exiting
+	bool pauseOnError = !cmdl["nopause"];
+
 	makeDirectoryRecursive(makeFullPath(shaderOutPath));
 	makeDirectoryRecursive(makeFullPath(reflOutPath));
 
@@ -80,6 +252,13 @@ int main(int argc, const char** argv)
 
 	uint32_t compileErr = 0;
 
+	ShaderVariantMap shaderVariants;
+	std::vector<MaterialVariantReport> variantReport;
+	if (materialPath.size() > 0 && !collectMaterialVariants(materialPath, shaderVariants, variantReport))
+	{
+		compileErr = 1;
+	}
+
 	//next, compile all input shaders into spv
 	{
 		std::vector<std::string> inputShaders = getFilesInDirectory(shaderInPath);
@@ -97,114 +276,70 @@ int main(int argc, const char** argv)
 
 			std::string compilecommand = pathToShaderCompile+" -V -o " + fileOut + " " + fullPath; 
 			printf("%s\n", compilecommand.c_str());
-			compileErr = system(compilecommand.c_str());
+			compileErr |= system(compilecommand.c_str());
+
+			auto variants = shaderVariants.find(inputShaders[i]);
+			if (variants == shaderVariants.end()) continue;
+
+			for (const std::vector<std::string>& keywords : variants->second)
+			{
+				std::string defines;
+				for (const std::string& k : keywords) defines += " -D" + k;
+
+				std::string variantOut = shaderOutFull + "/" + variantFileName(inputShaders[i], keywords) + ".spv";
+				std::string variantCommand = pathToShaderCompile + " -V" + defines + " -o " + variantOut + " " + fullPath;
+				printf("%s\n", variantCommand.c_str());
+				if (system(variantCommand.c_str())) compileErr = 1;
+			}
 		}
 	}
 
-	//finally, generate reflection files for all built shaders
+	//next, generate reflection for all built shaders. Variants are checked against (and merged into) their plain shader first
 	{
+		std::map<std::string, ShaderData> reflected;
+
 		std::vector<std::string> builtFiles = getFilesInDirectory(shaderOutPath);
 		for (uint32_t i = 0; i < builtFiles.size(); ++i)
 		{
-
 			if (builtFiles[i].find(".refl") != std::string::npos) continue;
 
-			ShaderData data = {};
-
 			std::string relPath = shaderOutPath + "\\" +builtFiles[i];
-			std::string fullPath = makeFullPath(relPath);
-
-			std::string reflPath = reflOutPath + "\\" + builtFiles[i];
-			findReplace(reflPath, std::string(".spv"), std::string(".refl"));
-			std::string reflFullPath = makeFullPath(reflPath);
-
-			FILE* shaderFile;
-			fopen_s(&shaderFile, fullPath.c_str(), "rb");
-			assert(shaderFile);
-
-			fseek(shaderFile, 0, SEEK_END);
-			size_t filesize = ftell(shaderFile);
-			size_t wordSize = sizeof(uint32_t);
-			size_t wordCount = filesize / wordSize;
-			rewind(shaderFile);
-
-
-			uint32_t* ir = (uint32_t*)malloc(sizeof(uint32_t) * wordCount);
-
-			fread(ir, filesize, 1, shaderFile);
-			fclose(shaderFile);
-
-			spirv_cross::CompilerGLSL glsl(ir, wordCount);
-
-			spirv_cross::ShaderResources resources = glsl.get_shader_resources();
-
-			for (spirv_cross::Resource res : resources.push_constant_buffers)
-			{
-				createUniformBlockForResource(&data.pushConstants, res, glsl);
-			}
-
-			data.descriptorSets.resize(resources.uniform_buffers.size() + resources.sampled_images.size());
+			reflected[builtFiles[i]] = reflectShader(makeFullPath(relPath));
+		}
 
-			uint32_t idx = 0;
-			for (spirv_cross::Resource res : resources.uniform_buffers)
-			{
-				createUniformBlockForResource(&data.descriptorSets[idx++], res, glsl);
-			}
+		for (auto& shader : reflected)
+		{
+			std::string baseName = variantBaseFileName(shader.first);
+			if (baseName.empty()) continue;
 
-			for (spirv_cross::Resource res : resources.sampled_images)
+			auto base = reflected.find(baseName);
+			if (base == reflected.end() || !mergeVariantInputs(base->second, shader.second, shader.first))
 			{
-				createTextureBlockForResource(&data.descriptorSets[idx++], res, glsl);
+				compileErr = 1;
 			}
+		}
 
-			std::sort(data.descriptorSets.begin(), data.descriptorSets.end(), [](const InputBlock& lhs, const InputBlock& rhs)
-			{
-				if (lhs.set != rhs.set) return lhs.set < rhs.set;
-				return lhs.binding < rhs.binding;
-			});
-
-
-			for (uint32_t blockIdx = 0; blockIdx < data.descriptorSets.size(); ++blockIdx)
-			{
-				InputBlock& b = data.descriptorSets[blockIdx];
-
-				if (b.set == GLOBAL_SET) data.globalSets.push_back(b.set);
-				else if (b.set == DYNAMIC_SET)
-				{
-					if (b.isTextureBlock) data.numDynamicTextures++;
-					else data.numDynamicUniforms++;
-
-					if (std::find(data.dynamicSets.begin(), data.dynamicSets.end(), b.set) == data.dynamicSets.end())
-					{
-						data.dynamicSets.push_back(b.set);
-					}
-					data.dynamicSetSize += b.size;
-				}
-				else
-				{
-					if (b.isTextureBlock) data.numStaticTextures++;
-					else data.numStaticUniforms++;
-
-					if (std::find(data.staticSets.begin(), data.staticSets.end(), b.set) == data.staticSets.end())
-					{
-						data.staticSets.push_back(b.set);
-					}
-
-					data.staticSetSize += b.size;
-				}
-			}
+		//finally, write out reflection files
+		for (auto& shader : reflected)
+		{
+			std::string reflPath = reflOutPath + "\\" + shader.first;
+			findReplace(reflPath, std::string(".spv"), std::string(".refl"));
+			std::string reflFullPath = makeFullPath(reflPath);
 
 			//write out material
-			std::string shader = getReflectionString(data);
+			std::string reflection = getReflectionString(shader.second);
 			FILE *file;
 			fopen_s(&file, reflFullPath.c_str(), "w");
-			int results = fputs(shader.c_str(), file);
+			int results = fputs(reflection.c_str(), file);
 			assert(results != EOF);
 			fclose(file);
 		}
 	}
 
-	if (compileErr) getchar();
-	return 0;
+	if (materialPath.size() > 0) printVariantReport(variantReport, shaderVariants);
+
+	if (compileErr && pauseOnError) getchar();
+	return compileErr ? 1 : 0;
 }
 
 std::string baseTypeToString(spirv_cross::SPIRType::BaseType type)
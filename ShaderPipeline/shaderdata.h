@@ -11,6 +11,35 @@ struct BlockMember
 	uint32_t offset;
 };
 
+enum class InputBlockType
+{
+	Uniform,
+	Sampler,
+	StorageBuffer,
+	StorageImage,
+	UniformTexelBuffer,
+	StorageTexelBuffer,
+	SeparateImage,
+	SeparateSampler
+};
+
+//these are the type strings the material loader expects
+const char* inputBlockTypeToString(InputBlockType type)
+{
+	switch (type)
+	{
+	case InputBlockType::Uniform: return "UNIFORM";
+	case InputBlockType::Sampler: return "SAMPLER";
+	case InputBlockType::StorageBuffer: return "STORAGE_BUFFER";
+	case InputBlockType::StorageImage: return "STORAGE_IMAGE";
+	case InputBlockType::UniformTexelBuffer: return "UNIFORM_TEXEL_BUFFER";
+	case InputBlockType::StorageTexelBuffer: return "STORAGE_TEXEL_BUFFER";
+	case InputBlockType::SeparateImage: return "SEPARATE_IMAGE";
+	case InputBlockType::SeparateSampler: return "SEPARATE_SAMPLER";
+	}
+	return "";
+}
+
 struct InputBlock
 {
 	std::string name;
@@ -18,7 +47,16 @@ struct InputBlock
 	std::vector<BlockMember> members;
 	uint32_t set;
 	uint32_t binding;
-	bool isTextureBlock;
+	InputBlockType type;
+};
+
+//only scalar constants can be set by the material, their values are always 4 bytes
+struct SpecConstant
+{
+	std::string name;
+	uint32_t constantId;
+	std::string type;	//"float", "int", "uint" or "bool"
+	uint32_t defaultValue;	//raw bits of the shader's default
 };
 
 struct ShaderData
@@ -36,6 +74,16 @@ struct ShaderData
 	uint32_t numDynamicTextures;
 	uint32_t numStaticUniforms;
 	uint32_t numStaticTextures;
+
+	//storage inputs are counted separately from uniforms and textures, whatever set they're in. 
+	//Texel buffers and separate images / samplers aren't counted at all
+	uint32_t numStorageBuffers;
+	uint32_t numStorageImages;
+
+	bool isCompute;
+	uint32_t workgroupSize[3];
+
+	std::vector<SpecConstant> specConstants;
 };
 
 
@@ -56,7 +104,7 @@ void writeInputGroup(rapidjson::PrettyWriter<rapidjson::StringBuffer>& writer, s
 		writer.Key("size");
 		writer.Int(block.size);
 		writer.Key("type");
-		writer.String(block.isTextureBlock ? "SAMPLER" : "UNIFORM");
+		writer.String(inputBlockTypeToString(block.type));
 
 		writer.Key("members");
 		writer.StartArray();
@@ -144,6 +192,39 @@ std::string getReflectionString(ShaderData& data)
 	writer.Key("num_dynamic_textures");
 	writer.Int(data.numDynamicTextures);
 
+	writer.Key("num_storage_buffers");
+	writer.Int(data.numStorageBuffers);
+	writer.Key("num_storage_images");
+	writer.Int(data.numStorageImages);
+
+	if (data.specConstants.size() > 0)
+	{
+		writer.Key("specialization_constants");
+		writer.StartArray();
+		for (const SpecConstant& sc : data.specConstants)
+		{
+			writer.StartObject();
+			writer.Key("name");
+			writer.String(sc.name.c_str());
+			writer.Key("constant_id");
+			writer.Int(sc.constantId);
+			writer.Key("type");
+			writer.String(sc.type.c_str());
+			writer.Key("default");
+			writer.Uint(sc.defaultValue);
+			writer.EndObject();
+		}
+		writer.EndArray();
+	}
+
+	if (data.isCompute)
+	{
+		writer.Key("workgroup_size");
+		writer.StartArray();
+		for (uint32_t i = 0; i < 3; ++i) writer.Int(data.workgroupSize[i]);
+		writer.EndArray();
+	}
+
 	writer.EndObject();
 	return s.GetString();
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+#pragma once
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <rapidjson\document.h>
+#include "filesystem_utils.h"
+#include "shaderdata.h"
+#include "config.h"
+
+//a material's "keywords" are #defines that its shaders are built with every combination of. Each combination
+//is a variant, written next to the plain shader with its keywords (sorted) after the shader's name:
+//fragment_passthrough.frag + {TINT, FOG} -> fragment_passthrough__FOG__TINT.frag.spv
+//the material system builds the same names when it loads a variant
+
+const std::string VARIANT_SEPARATOR = "__";
+
+//the keyword sets to build each shader file with (ie/ "fragment_passthrough.frag"), not including the empty set
+typedef std::map<std::string, std::set<std::vector<std::string>>> ShaderVariantMap;
+
+struct MaterialVariantReport
+{
+	std::string material;
+	uint32_t numKeywords;
+	uint32_t numVariants; //including the one with no keywords
+	uint32_t numStages;
+};
+
+std::string variantFileName(const std::string& shaderFile, const std::vector<std::string>& keywords)
+{
+	//the suffix goes before the stage extension, so the built file still ends in .vert / .frag / .comp
+	size_t extStart = shaderFile.find('.');
+
+	std::string name = shaderFile.substr(0, extStart);
+	for (const std::string& k : keywords) name += VARIANT_SEPARATOR + k;
+	return name + shaderFile.substr(extStart);
+}
+
+//returns the plain shader's name if builtFile is a variant, or an empty string if it isn't
+std::string variantBaseFileName(const std::string& builtFile)
+{
+	size_t sep = builtFile.find(VARIANT_SEPARATOR);
+	if (sep == std::string::npos) return "";
+
+	return builtFile.substr(0, sep) + builtFile.substr(builtFile.find('.', sep));
+}
+
+const char* shaderExtensionForStage(const std::string& stage)
+{
+	if (stage == "vertex") return ".vert";
+	if (stage == "fragment") return ".frag";
+	if (stage == "compute") return ".comp";
+	return nullptr;
+}
+
+std::string loadTextFile(const std::string& path)
+{
+	FILE* file;
+	fopen_s(&file, path.c_str(), "rb");
+	if (!file) return "";
+
+	fseek(file, 0, SEEK_END);
+	size_t filesize = ftell(file);
+	rewind(file);
+
+	std::string text(filesize, '\0');
+	fread(&text[0], filesize, 1, file);
+	fclose(file);
+
+	return text;
+}
+
+bool collectMaterialVariants(const std::string& materialPath, ShaderVariantMap& outVariants, std::vector<MaterialVariantReport>& outReport)
+{
+	using namespace rapidjson;
+
+	bool ok = true;
+	std::vector<std::string> materials = getFilesInDirectory(materialPath);
+
+	for (const std::string& matFile : materials)
+	{
+		if (matFile.find(".mat") == std::string::npos) continue;
+
+		Document doc;
+		doc.Parse(loadTextFile(makeFullPath(materialPath + "\\" + matFile)).c_str());
+		if (doc.HasParseError() || !doc.IsObject())
+		{
+			printf("ShaderPipeline: could not parse material %s\n", matFile.c_str());
+			ok = false;
+			continue;
+		}
+
+		if (!doc.HasMember("keywords")) continue;
+
+		std::vector<std::string> keywords;
+		const Value& keywordArray = doc["keywords"];
+		for (SizeType i = 0; i < keywordArray.Size(); ++i)
+		{
+			std::string k = keywordArray[i].GetString();
+			if (k.find(VARIANT_SEPARATOR) != std::string::npos || std::find(keywords.begin(), keywords.end(), k) != keywords.end())
+			{
+				printf("ShaderPipeline: %s - keyword %s is a duplicate or contains \"%s\"\n", matFile.c_str(), k.c_str(), VARIANT_SEPARATOR.c_str());
+				ok = false;
+				continue;
+			}
+			keywords.push_back(k);
+		}
+
+		if (keywords.size() > MAX_MATERIAL_KEYWORDS)
+		{
+			printf("ShaderPipeline: %s has %zu keywords, the limit is %i\n", matFile.c_str(), keywords.size(), MAX_MATERIAL_KEYWORDS);
+			ok = false;
+			continue;
+		}
+
+		std::vector<std::string> shaderFiles;
+		const Value& shaders = doc["shaders"];
+		for (SizeType i = 0; i < shaders.Size(); ++i)
+		{
+			const char* ext = shaderExtensionForStage(shaders[i]["stage"].GetString());
+			if (ext) shaderFiles.push_back(std::string(shaders[i]["shader"].GetString()) + ext);
+		}
+
+		uint32_t numVariants = 1u << keywords.size();
+		for (uint32_t key = 1; key < numVariants; ++key)
+		{
+			std::vector<std::string> enabled;
+			for (uint32_t k = 0; k < keywords.size(); ++k)
+			{
+				if (key & (1u << k)) enabled.push_back(keywords[k]);
+			}
+			std::sort(enabled.begin(), enabled.end());
+
+			for (const std::string& shader : shaderFiles)
+			{
+				outVariants[shader].insert(enabled);
+			}
+		}
+
+		outReport.push_back({ matFile, (uint32_t)keywords.size(), numVariants, (uint32_t)shaderFiles.size() });
+	}
+
+	return ok;
+}
+
+void mergeMembers(std::vector<BlockMember>& base, const std::vector<BlockMember>& variant)
+{
+	for (const BlockMember& mem : variant)
+	{
+		auto found = std::find_if(base.begin(), base.end(), [&mem](const BlockMember& m) { return m.name == mem.name; });
+		if (found == base.end()) base.push_back(mem);
+	}
+}
+
+//keywords can change what a shader does, but not what it takes as input, since the material lays out memory
+//and descriptors from the plain shader's reflection. Block members that only a variant reads are added to the
+//plain shader's blocks so they can still be set
+bool mergeVariantInputs(ShaderData& base, const ShaderData& variant, const std::string& variantName)
+{
+	bool sameInputs = base.descriptorSets.size() == variant.descriptorSets.size() && base.pushConstants.size == variant.pushConstants.size;
+
+	for (uint32_t i = 0; sameInputs && i < base.descriptorSets.size(); ++i)
+	{
+		const InputBlock& b = base.descriptorSets[i];
+		const InputBlock& v = variant.descriptorSets[i];
+		sameInputs = b.set == v.set && b.binding == v.binding && b.type == v.type && b.size == v.size;
+	}
+
+	if (!sameInputs)
+	{
+		printf("ShaderPipeline: %s doesn't have the same inputs as the shader without keywords\n", variantName.c_str());
+		return false;
+	}
+
+	for (uint32_t i = 0; i < base.descriptorSets.size(); ++i)
+	{
+		mergeMembers(base.descriptorSets[i].members, variant.descriptorSets[i].members);
+	}
+	mergeMembers(base.pushConstants.members, variant.pushConstants.members);
+
+	for (const SpecConstant& sc : variant.specConstants)
+	{
+		auto found = std::find_if(base.specConstants.begin(), base.specConstants.end(), [&sc](const SpecConstant& s) { return s.name == sc.name; });
+		if (found == base.specConstants.end()) base.specConstants.push_back(sc);
+	}
+
+	return true;
+}
+
+void printVariantReport(const std::vector<MaterialVariantReport>& report, const ShaderVariantMap& variants)
+{
+	for (const MaterialVariantReport& r : report)
+	{
+		uint32_t numShaders = (r.numVariants - 1) * r.numStages;
+		printf("ShaderPipeline: %s - %u keywords, %u variants, %u extra shaders%s\n", r.material.c_str(), r.numKeywords, r.numVariants, numShaders,
+			r.numVariants > VARIANT_WARNING_COUNT ? " (consider splitting this material)" : "");
+	}
+
+	//materials that share a shader and keywords share its variants too
+	size_t totalShaders = 0;
+	for (auto& shader : variants) totalShaders += shader.second.size();
+
+	printf("ShaderPipeline: %zu materials with keywords, %zu variant shaders built\n", report.size(), totalShaders);
+}
\ No newline at end of file
@@ -0,0 +1,398 @@
+#include "bc_encoder.h"
+#include <cassert>
+#include <cstring>
+#include <emmintrin.h>
+
+namespace BCEncoder
+{
+	//per channel min and max over the 16 texels of a block
+	void blockBounds(const uint8_t* block, uint8_t* outMin, uint8_t* outMax)
+	{
+		__m128i row0 = _mm_loadu_si128((const __m128i*)(block + 0));
+		__m128i row1 = _mm_loadu_si128((const __m128i*)(block + 16));
+		__m128i row2 = _mm_loadu_si128((const __m128i*)(block + 32));
+		__m128i row3 = _mm_loadu_si128((const __m128i*)(block + 48));
+
+		__m128i mn = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+		__m128i mx = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+
+		//each register still holds 4 texels, fold them down to one
+		mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+		mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+		mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+		mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+
+		uint32_t packedMin = (uint32_t)_mm_cvtsi128_si32(mn);
+		uint32_t packedMax = (uint32_t)_mm_cvtsi128_si32(mx);
+		memcpy(outMin, &packedMin, 4);
+		memcpy(outMax, &packedMax, 4);
+	}
+
+	//the bounding box corners only lie along the texels if every channel increases together.
+	//Flip any channel that moves against the widest one so the endpoints end up on the right diagonal
+	void selectDiagonal(const uint8_t* block, uint32_t channelCount, uint8_t* ep0, uint8_t* ep1)
+	{
+		uint32_t ref = 0;
+		for (uint32_t c = 1; c < channelCount; ++c)
+		{
+			if (ep1[c] - ep0[c] > ep1[ref] - ep0[ref]) ref = c;
+		}
+
+		int32_t refCenter = (ep0[ref] + ep1[ref] + 1) >> 1;
+
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			if (c == ref) continue;
+
+			int32_t center = (ep0[c] + ep1[c] + 1) >> 1;
+			int32_t covariance = 0;
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				covariance += (block[i * 4 + c] - center) * (block[i * 4 + ref] - refCenter);
+			}
+
+			if (covariance < 0)
+			{
+				uint8_t tmp = ep0[c];
+				ep0[c] = ep1[c];
+				ep1[c] = tmp;
+			}
+		}
+	}
+
+	//pulls both endpoints in by 1/16th of the range, so a single outlier doesn't waste most of the palette
+	void insetEndpoints(uint8_t* ep0, uint8_t* ep1, uint32_t channelCount)
+	{
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			int32_t inset = ((int32_t)ep1[c] - (int32_t)ep0[c]) / 16;
+			ep0[c] = (uint8_t)(ep0[c] + inset);
+			ep1[c] = (uint8_t)(ep1[c] - inset);
+		}
+	}
+
+	//writes dot(texel - origin, dir) for every texel in the block, 2 texels per madd
+	void projectBlock(const uint8_t* block, const int16_t* origin, const int16_t* dir, int32_t* outDots)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i o = _mm_setr_epi16(origin[0], origin[1], origin[2], origin[3], origin[0], origin[1], origin[2], origin[3]);
+		const __m128i d = _mm_setr_epi16(dir[0], dir[1], dir[2], dir[3], dir[0], dir[1], dir[2], dir[3]);
+
+		for (uint32_t row = 0; row < 4; ++row)
+		{
+			__m128i texels = _mm_loadu_si128((const __m128i*)(block + row * 16));
+
+			__m128i lo = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(texels, zero), o), d);
+			__m128i hi = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(texels, zero), o), d);
+
+			//each texel's rg and ba products are in adjacent lanes, add them so the full dot lands in lanes 0 and 2
+			lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+			hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+
+			__m128i dots = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_si128((__m128i*)(outDots + row * 4), dots);
+		}
+	}
+
+	//maps a projected texel to the nearest of maxIndex+1 evenly spaced steps between the endpoints
+	uint32_t quantizeIndex(int32_t dot, int32_t lengthSq, uint32_t maxIndex)
+	{
+		if (dot <= 0) return 0;
+		if (dot >= lengthSq) return maxIndex;
+		return (uint32_t)((dot * (int32_t)maxIndex * 2 + lengthSq) / (2 * lengthSq));
+	}
+
+	void writeLE16(uint8_t* out, uint16_t value)
+	{
+		out[0] = (uint8_t)(value & 0xFF);
+		out[1] = (uint8_t)(value >> 8);
+	}
+
+	void writeLE32(uint8_t* out, uint32_t value)
+	{
+		for (uint32_t i = 0; i < 4; ++i) out[i] = (uint8_t)(value >> (i * 8));
+	}
+
+	uint16_t packRGB565(const uint8_t* c)
+	{
+		uint32_t r = (c[0] * 31 + 127) / 255;
+		uint32_t g = (c[1] * 63 + 127) / 255;
+		uint32_t b = (c[2] * 31 + 127) / 255;
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRGB565(uint16_t packed, uint8_t* out)
+	{
+		uint32_t r = (packed >> 11) & 31;
+		uint32_t g = (packed >> 5) & 63;
+		uint32_t b = packed & 31;
+		out[0] = (uint8_t)((r << 3) | (r >> 2));
+		out[1] = (uint8_t)((g << 2) | (g >> 4));
+		out[2] = (uint8_t)((b << 3) | (b >> 2));
+		out[3] = 255;
+	}
+
+	//8 byte colour block, shared by BC1 and BC3. Always uses the 4 colour mode, so alpha is ignored
+	void encodeColorBlock(const uint8_t* block, uint8_t* out)
+	{
+		uint8_t ep0[4], ep1[4];
+		blockBounds(block, ep0, ep1);
+		selectDiagonal(block, 3, ep0, ep1);
+		insetEndpoints(ep0, ep1, 3);
+
+		uint16_t c0 = packRGB565(ep1);
+		uint16_t c1 = packRGB565(ep0);
+		uint32_t indices = 0;
+
+		//if both endpoints quantize to the same colour every texel is index 0
+		if (c0 != c1)
+		{
+			//c0 > c1 selects the 4 colour mode
+			if (c0 < c1)
+			{
+				uint16_t tmp = c0;
+				c0 = c1;
+				c1 = tmp;
+			}
+
+			uint8_t p0[4], p1[4];
+			unpackRGB565(c0, p0);
+			unpackRGB565(c1, p1);
+
+			int16_t origin[4] = { p0[0], p0[1], p0[2], 0 };
+			int16_t dir[4] = { (int16_t)(p1[0] - p0[0]), (int16_t)(p1[1] - p0[1]), (int16_t)(p1[2] - p0[2]), 0 };
+			int32_t lengthSq = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+
+			int32_t dots[16];
+			projectBlock(block, origin, dir, dots);
+
+			//palette order along the line is c0, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1, c1
+			static const uint32_t remap[4] = { 0, 2, 3, 1 };
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				indices |= remap[quantizeIndex(dots[i], lengthSq, 3)] << (i * 2);
+			}
+		}
+
+		writeLE16(out, c0);
+		writeLE16(out + 2, c1);
+		writeLE32(out + 4, indices);
+	}
+
+	//8 byte single channel block, used for BC3 alpha and both BC5 channels
+	void encodeChannelBlock(const uint8_t* block, uint32_t channel, uint8_t* out)
+	{
+		int32_t mn = 255;
+		int32_t mx = 0;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			int32_t v = block[i * 4 + channel];
+			mn = v < mn ? v : mn;
+			mx = v > mx ? v : mx;
+		}
+
+		//a0 > a1 selects the 8 value mode
+		out[0] = (uint8_t)mx;
+		out[1] = (uint8_t)mn;
+
+		uint64_t indices = 0;
+		if (mx > mn)
+		{
+			int32_t range = mx - mn;
+
+			//palette is a0, a1, then 6 steps from a0 towards a1
+			static const uint32_t remap[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				int32_t step = ((mx - block[i * 4 + channel]) * 14 + range) / (2 * range);
+				indices |= (uint64_t)remap[step] << (i * 3);
+			}
+		}
+
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			out[2 + i] = (uint8_t)(indices >> (i * 8));
+		}
+	}
+
+	void encodeBC1(const uint8_t* block, uint8_t* out)
+	{
+		encodeColorBlock(block, out);
+	}
+
+	void encodeBC3(const uint8_t* block, uint8_t* out)
+	{
+		encodeChannelBlock(block, 3, out);
+		encodeColorBlock(block, out + 8);
+	}
+
+	void encodeBC5(const uint8_t* block, uint8_t* out)
+	{
+		encodeChannelBlock(block, 0, out);
+		encodeChannelBlock(block, 1, out + 8);
+	}
+
+	//mode 6 endpoints are 7 bits per channel plus one shared low bit per endpoint. Picks the low bit
+	//that reconstructs the endpoint with the least error, and returns it
+	uint32_t quantizeBC7Endpoint(const uint8_t* ep, uint8_t* outQuantized, uint8_t* outReconstructed)
+	{
+		uint32_t bestError = UINT32_MAX;
+		uint32_t bestPBit = 0;
+
+		for (uint32_t pBit = 0; pBit < 2; ++pBit)
+		{
+			uint8_t quantized[4];
+			uint8_t reconstructed[4];
+			uint32_t error = 0;
+
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				int32_t q = ((int32_t)ep[c] - (int32_t)pBit + 1) >> 1;
+				q = q > 127 ? 127 : q;
+
+				quantized[c] = (uint8_t)q;
+				reconstructed[c] = (uint8_t)((q << 1) | pBit);
+
+				int32_t diff = (int32_t)reconstructed[c] - (int32_t)ep[c];
+				error += diff * diff;
+			}
+
+			if (error < bestError)
+			{
+				bestError = error;
+				bestPBit = pBit;
+				memcpy(outQuantized, quantized, 4);
+				memcpy(outReconstructed, reconstructed, 4);
+			}
+		}
+
+		return bestPBit;
+	}
+
+	struct BitWriter
+	{
+		uint8_t* out;
+		uint32_t pos;
+	};
+
+	void writeBits(BitWriter& writer, uint32_t value, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; ++i, ++writer.pos)
+		{
+			if ((value >> i) & 1) writer.out[writer.pos >> 3] |= (uint8_t)(1 << (writer.pos & 7));
+		}
+	}
+
+	void encodeBC7(const uint8_t* block, uint8_t* out)
+	{
+		uint8_t ep0[4], ep1[4];
+		blockBounds(block, ep0, ep1);
+		selectDiagonal(block, 4, ep0, ep1);
+		insetEndpoints(ep0, ep1, 4);
+
+		uint8_t quantized[2][4];
+		uint8_t reconstructed[2][4];
+		uint32_t pBits[2];
+		pBits[0] = quantizeBC7Endpoint(ep0, quantized[0], reconstructed[0]);
+		pBits[1] = quantizeBC7Endpoint(ep1, quantized[1], reconstructed[1]);
+
+		int16_t origin[4];
+		int16_t dir[4];
+		int32_t lengthSq = 0;
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			origin[c] = reconstructed[0][c];
+			dir[c] = (int16_t)(reconstructed[1][c] - reconstructed[0][c]);
+			lengthSq += dir[c] * dir[c];
+		}
+
+		uint32_t indices[16] = {};
+		if (lengthSq > 0)
+		{
+			int32_t dots[16];
+			projectBlock(block, origin, dir, dots);
+
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				indices[i] = quantizeIndex(dots[i], lengthSq, 15);
+			}
+		}
+
+		//the first texel's index is stored without its top bit, which is implied to be 0. 
+		//If it isn't, swap the endpoints and flip every index
+		if (indices[0] & 8)
+		{
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				uint8_t tmp = quantized[0][c];
+				quantized[0][c] = quantized[1][c];
+				quantized[1][c] = tmp;
+			}
+
+			uint32_t tmpBit = pBits[0];
+			pBits[0] = pBits[1];
+			pBits[1] = tmpBit;
+
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				indices[i] = 15 - indices[i];
+			}
+		}
+
+		memset(out, 0, 16);
+		BitWriter writer = { out, 0 };
+
+		//mode 6 is 6 zero bits followed by a 1
+		writeBits(writer, 1 << 6, 7);
+
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			writeBits(writer, quantized[0][c], 7);
+			writeBits(writer, quantized[1][c], 7);
+		}
+
+		writeBits(writer, pBits[0], 1);
+		writeBits(writer, pBits[1], 1);
+
+		writeBits(writer, indices[0], 3);
+		for (uint32_t i = 1; i < 16; ++i)
+		{
+			writeBits(writer, indices[i], 4);
+		}
+	}
+
+	void encodeImage(DDS::Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* out)
+	{
+		uint32_t blockBytes = DDS::bytesPerBlock(format);
+		assert(blockBytes > 0);
+
+		uint8_t block[64];
+
+		for (uint32_t by = 0; by < height; by += 4)
+		{
+			for (uint32_t bx = 0; bx < width; bx += 4)
+			{
+				for (uint32_t y = 0; y < 4; ++y)
+				{
+					uint32_t srcY = by + y < height ? by + y : height - 1;
+					for (uint32_t x = 0; x < 4; ++x)
+					{
+						uint32_t srcX = bx + x < width ? bx + x : width - 1;
+						memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)srcY * width + srcX) * 4, 4);
+					}
+				}
+
+				switch (format)
+				{
+					case DDS::FORMAT_BC1_UNORM: encodeBC1(block, out); break;
+					case DDS::FORMAT_BC3_UNORM: encodeBC3(block, out); break;
+					case DDS::FORMAT_BC5_UNORM: encodeBC5(block, out); break;
+					case DDS::FORMAT_BC7_UNORM: encodeBC7(block, out); break;
+					default: assert(0);
+				}
+
+				out += blockBytes;
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include "../VkMaterialSystem/dds_format.h"
+
+//block compression encoders. These are built for speed over quality - endpoints come from 
+//the (inset) bounding box of each block rather than an iterative fit, and BC7 only uses mode 6
+namespace BCEncoder
+{
+	//block is 16 rgba8 texels, row major. out receives DDS::bytesPerBlock(format) bytes
+	void encodeBC1(const uint8_t* block, uint8_t* out);
+	void encodeBC3(const uint8_t* block, uint8_t* out);
+	void encodeBC5(const uint8_t* block, uint8_t* out);	//red and green only, for normal maps
+	void encodeBC7(const uint8_t* block, uint8_t* out);
+
+	//encodes a whole rgba8 image, edge blocks are padded by clamping to the last row / column.
+	//out needs DDS::mipSize(format, width, height) bytes
+	void encodeImage(DDS::Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* out);
+}
\ No newline at end of file
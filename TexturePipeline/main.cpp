@@ -0,0 +1,152 @@
+#include <argh.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cassert>
+#include "../ShaderPipeline/filesystem_utils.h"
+#include "../VkMaterialSystem/dds_format.h"
+#include "../VkMaterialSystem/image_utils.h"
+#include "bc_encoder.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb\stb_image.h>
+
+//normal maps only need x and y, the shader rebuilds z
+bool isNormalMap(const std::string& filename)
+{
+	return filename.find("_n.") != std::string::npos || filename.find("_normal.") != std::string::npos;
+}
+
+bool hasTransparency(const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+	for (size_t i = 0; i < (size_t)width * height; ++i)
+	{
+		if (rgba[i * 4 + 3] != 255) return true;
+	}
+	return false;
+}
+
+DDS::Format chooseFormat(const std::string& filename, const uint8_t* rgba, uint32_t width, uint32_t height, bool highQuality)
+{
+	if (isNormalMap(filename)) return DDS::FORMAT_BC5_UNORM;
+	if (highQuality) return DDS::FORMAT_BC7_UNORM;
+	return hasTransparency(rgba, width, height) ? DDS::FORMAT_BC3_UNORM : DDS::FORMAT_BC1_UNORM;
+}
+
+uint32_t mipCountForExtent(uint32_t width, uint32_t height)
+{
+	uint32_t largest = width > height ? width : height;
+	uint32_t levels = 1;
+	while (largest > 1)
+	{
+		largest >>= 1;
+		levels++;
+	}
+	return levels;
+}
+
+void writeDDS(const std::string& filepath, DDS::Format format, uint32_t width, uint32_t height, uint32_t mipCount, const uint8_t* data, size_t dataSize)
+{
+	DDS::Header header = {};
+	header.size = sizeof(DDS::Header);
+	header.flags = DDS::DDSD_CAPS | DDS::DDSD_HEIGHT | DDS::DDSD_WIDTH | DDS::DDSD_PIXELFORMAT | DDS::DDSD_MIPMAPCOUNT | DDS::DDSD_LINEARSIZE;
+	header.height = height;
+	header.width = width;
+	header.pitchOrLinearSize = (uint32_t)DDS::mipSize(format, width, height);
+	header.mipMapCount = mipCount;
+	header.pixelFormat.size = sizeof(DDS::PixelFormat);
+	header.pixelFormat.flags = DDS::DDPF_FOURCC;
+	header.pixelFormat.fourCC = DDS::FOURCC_DX10;
+	header.caps = DDS::DDSCAPS_TEXTURE | (mipCount > 1 ? DDS::DDSCAPS_MIPMAP | DDS::DDSCAPS_COMPLEX : 0);
+
+	DDS::HeaderDX10 headerDX10 = {};
+	headerDX10.format = format;
+	headerDX10.resourceDimension = DDS::RESOURCE_DIMENSION_TEXTURE2D;
+	headerDX10.arraySize = 1;
+
+	FILE* file;
+	fopen_s(&file, filepath.c_str(), "wb");
+	assert(file);
+
+	fwrite(&DDS::MAGIC, sizeof(uint32_t), 1, file);
+	fwrite(&header, sizeof(DDS::Header), 1, file);
+	fwrite(&headerDX10, sizeof(DDS::HeaderDX10), 1, file);
+	size_t written = fwrite(data, 1, dataSize, file);
+	assert(written == dataSize);
+
+	fclose(file);
+}
+
+int main(int argc, const char** argv)
+{
+	argh::parser cmdl(argv);
+	if (!cmdl(2)) printf("TexturePipeline: usage: TexturePipeline <path to texture folder> <path to output folder> [-bc7]\n");
+
+	std::string texInPath = cmdl[1];
+	std::string texOutPath = cmdl[2];
+
+	//colour textures default to BC1 / BC3 (8:1 / 4:1), -bc7 trades cook time for quality at 4:1
+	bool highQuality = cmdl["bc7"];
+
+	makeDirectoryRecursive(makeFullPath(texOutPath));
+
+	std::vector<std::string> inputTextures = getFilesInDirectory(texInPath);
+	for (uint32_t i = 0; i < inputTextures.size(); ++i)
+	{
+		std::string relPath = texInPath + inputTextures[i];
+		std::string fullPath = makeFullPath(relPath);
+
+		int texWidth, texHeight, texChannels;
+		stbi_uc* pixels = stbi_load(fullPath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			printf("Skipping %s, not an image stb_image can load\n", inputTextures[i].c_str());
+			continue;
+		}
+
+		uint32_t width = texWidth;
+		uint32_t height = texHeight;
+		uint32_t mipCount = mipCountForExtent(width, height);
+		DDS::Format format = chooseFormat(inputTextures[i], pixels, width, height, highQuality);
+
+		size_t rgbaSize = 0;
+		size_t blocksSize = 0;
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			uint32_t mipWidth = ImageUtils::mipDimension(width, mip);
+			uint32_t mipHeight = ImageUtils::mipDimension(height, mip);
+			rgbaSize += ImageUtils::rgba8MipSize(width, height, mip);
+			blocksSize += DDS::mipSize(format, mipWidth, mipHeight);
+		}
+
+		uint8_t* rgbaMips = (uint8_t*)malloc(rgbaSize);
+		uint8_t* blocks = (uint8_t*)malloc(blocksSize);
+
+		ImageUtils::buildRGBA8MipChain(pixels, width, height, 0, mipCount - 1, rgbaMips);
+		stbi_image_free(pixels);
+
+		const uint8_t* rgbaMip = rgbaMips;
+		uint8_t* blockMip = blocks;
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			uint32_t mipWidth = ImageUtils::mipDimension(width, mip);
+			uint32_t mipHeight = ImageUtils::mipDimension(height, mip);
+
+			BCEncoder::encodeImage(format, rgbaMip, mipWidth, mipHeight, blockMip);
+
+			rgbaMip += ImageUtils::rgba8MipSize(width, height, mip);
+			blockMip += DDS::mipSize(format, mipWidth, mipHeight);
+		}
+
+		std::string outName = inputTextures[i].substr(0, inputTextures[i].find_last_of('.')) + ".dds";
+		std::string outPath = makeFullPath(texOutPath) + "/" + outName;
+		writeDDS(outPath, format, width, height, mipCount, blocks, blocksSize);
+
+		printf("%s -> %s (%zu KB, was %zu KB as rgba8)\n", inputTextures[i].c_str(), outName.c_str(), blocksSize / 1024, rgbaSize / 1024);
+
+		free(rgbaMips);
+		free(blocks);
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "stdafx.h"
+#include "arena.h"
+#include "frame_allocator.h"
+#include <cstdlib>
+
+namespace arena
+{
+	void init(Arena& a, size_t size)
+	{
+		a.base = size > 0 ? (uint8_t*)calloc(1, size) : nullptr;
+		if (a.base) frame::countHeapAllocation();
+
+		a.size = size;
+		a.used = 0;
+	}
+
+	void free(Arena& a)
+	{
+		::free(a.base);
+		a = {};
+	}
+
+	void reset(Arena& a)
+	{
+		if (a.base) memset(a.base, 0, a.used);
+		a.used = 0;
+	}
+
+	void* alloc(Arena& a, size_t size, size_t alignment)
+	{
+		//alignment is relative to the start of the block, calloc's alignment covers anything we store
+		size_t start = (a.used + alignment - 1) & ~(alignment - 1);
+		a.used = start + size;
+
+		if (!a.base) return nullptr;
+
+		checkf(a.used <= a.size, "Arena is out of space");
+		return a.base + start;
+	}
+
+	bool fits(const Arena& a, size_t size, size_t alignment)
+	{
+		size_t start = (a.used + alignment - 1) & ~(alignment - 1);
+		return a.base && start + size <= a.size;
+	}
+}
\ No newline at end of file
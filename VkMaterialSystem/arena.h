@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+//a block of memory that's handed out front to back. Nothing in it is freed individually, 
+//the whole arena is reset or freed at once. An arena with no memory (zero initialized) 
+//still counts how much it would have handed out, so the same code can size a block 
+//before filling it in
+struct Arena
+{
+	uint8_t* base;
+	size_t size;
+	size_t used;
+};
+
+namespace arena
+{
+	//the memory is zeroed
+	void init(Arena& a, size_t size);
+	void free(Arena& a);
+	void reset(Arena& a);
+
+	//returns nullptr for arenas that are only measuring
+	void* alloc(Arena& a, size_t size, size_t alignment);
+	bool fits(const Arena& a, size_t size, size_t alignment);
+
+	template<typename T> inline T* allocArray(Arena& a, size_t count)
+	{
+		if (count == 0) return nullptr;
+		return (T*)alloc(a, sizeof(T) * count, alignof(T));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "stdafx.h"
+#include "array.h"
+#include "frame_allocator.h"
+#include <malloc.h>
+
+namespace array
+{
+	void* heapAlloc(void* userData, size_t size, size_t alignment)
+	{
+		frame::countHeapAllocation();
+		return _aligned_malloc(size, alignment);
+	}
+
+	void heapFree(void* userData, void* ptr)
+	{
+		_aligned_free(ptr);
+	}
+
+	void* arenaAlloc(void* userData, size_t size, size_t alignment)
+	{
+		return arena::alloc(*(Arena*)userData, size, alignment);
+	}
+
+	ArrayAllocator heapAllocator()
+	{
+		return { heapAlloc, heapFree, nullptr };
+	}
+
+	ArrayAllocator arenaAllocator(Arena& a)
+	{
+		return { arenaAlloc, nullptr, &a };
+	}
+}
\ No newline at end of file
@@ -1,111 +1,189 @@
 #pragma once
 #include <cstdint>
-
-#if _DEBUG
+#include <cstring>
+#include <new>
 #include <type_traits>
-#endif
+#include <utility>
+#include "arena.h"
+
+//where an array's memory comes from. Allocators that can't give back individual blocks
+//(arenas) leave free null, their memory comes back when the whole arena is reset
+struct ArrayAllocator
+{
+	void* (*alloc)(void* userData, size_t size, size_t alignment);
+	void (*free)(void* userData, void* ptr);
+	void* userData;
+};
+
+namespace array
+{
+	//the default, everything goes through _aligned_malloc / _aligned_free
+	ArrayAllocator heapAllocator();
+
+	//growing an array in an arena leaves its old storage behind, so reserve up front where possible.
+	//The arena has to have memory, measuring arenas hand back nullptr
+	ArrayAllocator arenaAllocator(Arena& a);
+}
 
+//arrays own their elements and can only be moved, copies have to be asked for with array::copy
 template <class T>
 struct Array
 {
 	T* data;
 	uint32_t num;
 	uint32_t capacity;
+	ArrayAllocator allocator;
+
+	//SmallArrays point this at their inline storage, which never goes to the allocator
+	T* inlineData;
+	uint32_t inlineCapacity;
+
+	Array();
+	explicit Array(const ArrayAllocator& alloc);
+	Array(Array&& other);
+	~Array();
+
+	Array& operator=(Array&& other);
+	Array(const Array&) = delete;
+	Array& operator=(const Array&) = delete;
 
 	T &operator[](uint32_t i);
 	const T &operator[](uint32_t i) const;
 
-	//Array &operator=(const Array &other);
+	uint32_t size() const;
+	T* begin();
+	T* end();
+	const T* begin() const;
+	const T* end() const;
+
+protected:
+	Array(const ArrayAllocator& alloc, T* inlineStorage, uint32_t inlineCount);
+	void takeFrom(Array& other);
 };
 
-template <typename T> inline T & Array<T>::operator[](uint32_t i)
+//the first N elements live inside the array itself, it only goes to its allocator once it grows past them
+template <class T, uint32_t N>
+struct SmallArray : public Array<T>
 {
-#if _DEBUG
-	static_assert(std::is_pod<T>::value, "T must be POD");
-	checkf(i < num, "Attempting to read past end of array");
-#endif
-	return data[i];
-}
+	SmallArray();
+	explicit SmallArray(const ArrayAllocator& alloc);
+	SmallArray(SmallArray&& other);
 
-template <typename T> inline const T & Array<T>::operator[](uint32_t i) const
-{
-#if _DEBUG
-	static_assert(std::is_pod<T>::value, "T must be POD");
-	checkf(i < num, "Attempting to read past end of array");
-#endif
-	return data[i];
-}
+	SmallArray& operator=(SmallArray&& other);
+
+private:
+	alignas(T) uint8_t inlineStorage[sizeof(T) * N];
+};
 
 namespace array
 {
-	template <typename T> inline void initialize(Array<T>& arr)
+	namespace detail
 	{
-		arr.capacity = 0;
-		arr.data = 0;
-		arr.num = 0;
-	}
+		//move constructs count elements from src into uninitialized dst, and destroys the originals
+		template <typename T> inline void moveElements(T* dst, T* src, uint32_t count)
+		{
+			if (std::is_trivially_copyable<T>::value)
+			{
+				if (count > 0) memcpy(dst, src, sizeof(T) * count);
+				return;
+			}
 
-	template <typename T> inline void copy(const Array<T> &src, Array<T>& dst)
-	{
-		const uint32_t n = src.size;
-		array::resize(dst, n);
-		memcpy(src.data, dst.data, sizeof(T)*n);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				new (&dst[i]) T(std::move(src[i]));
+				src[i].~T();
+			}
+		}
+
+		template <typename T> inline void destroyElements(T* items, uint32_t count)
+		{
+			if (std::is_trivially_destructible<T>::value) return;
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				items[i].~T();
+			}
+		}
+
+		template <typename T> inline void releaseStorage(Array<T>& a)
+		{
+			if (a.data && a.data != a.inlineData && a.allocator.free)
+			{
+				a.allocator.free(a.allocator.userData, a.data);
+			}
+
+			a.data = a.inlineData;
+			a.capacity = a.inlineCapacity;
+		}
 	}
 
+	template<typename T> void setCapacity(Array<T> &a, uint32_t newCapacity);
+	template<typename T> void grow(Array<T> &a, uint32_t minCapacity);
 
 	template<typename T> inline void resize(Array<T>& arr, uint32_t newCount)
 	{
-
-#if _DEBUG
-		static_assert(std::is_pod<T>::value, "T must be POD");
-#endif
-
 		if (newCount > arr.capacity)
 		{
 			grow(arr, newCount);
 		}
-		
+
+		//new elements are value initialized, so POD types come back zeroed
+		for (uint32_t i = arr.num; i < newCount; ++i)
+		{
+			new (&arr.data[i]) T();
+		}
+
+		if (newCount < arr.num)
+		{
+			detail::destroyElements(&arr.data[newCount], arr.num - newCount);
+		}
+
 		arr.num = newCount;
 	}
 
-	template<typename T> void setCapacity(Array<T> &a, uint32_t newCapacity)
+	template <typename T> inline void copy(const Array<T> &src, Array<T>& dst)
 	{
-#if _DEBUG
-		static_assert(std::is_pod<T>::value, "T must be POD");
-#endif
+		static_assert(std::is_trivially_copyable<T>::value, "array::copy only works on trivially copyable types");
 
+		const uint32_t n = src.num;
+		array::resize(dst, n);
+		if (n > 0) memcpy(dst.data, src.data, sizeof(T)*n);
+	}
+
+	template<typename T> void setCapacity(Array<T> &a, uint32_t newCapacity)
+	{
 		if (newCapacity == a.capacity) return;
 
 		if (newCapacity < a.num) resize(a, newCapacity);
 
-		T *newData = 0;
-		
-		if (newCapacity > 0)
+		//shrinking back down to a small array's inline storage doesn't need the allocator
+		T* newData = a.inlineData;
+		uint32_t newDataCapacity = a.inlineCapacity;
+
+		if (newCapacity > a.inlineCapacity)
 		{
-			newData = (T *)_aligned_malloc(sizeof(T)*newCapacity, alignof(T));
-			memcpy(newData, a.data, sizeof(T)*a.num);
+			newData = (T*)a.allocator.alloc(a.allocator.userData, sizeof(T)*newCapacity, alignof(T));
+			newDataCapacity = newCapacity;
+			checkf(newData, "Array allocator returned null");
 		}
-	
-		::free(a.data);
+
+		if (newData == a.data) return;
+
+		detail::moveElements(newData, a.data, a.num);
+		detail::releaseStorage(a);
+
 		a.data = newData;
-		a.capacity = newCapacity;
+		a.capacity = newDataCapacity;
 	}
 
 	template <typename T> inline void reserve(Array<T> &a, uint32_t new_capacity)
 	{
-#if _DEBUG
-		static_assert(std::is_pod<T>::value, "T must be POD");
-#endif
 		if (new_capacity > a.capacity)
 			setCapacity(a, new_capacity);
 	}
 
 	template<typename T> void grow(Array<T> &a, uint32_t minCapacity)
 	{
-#if _DEBUG
-		static_assert(std::is_pod<T>::value, "T must be POD");
-#endif
-
 		uint32_t newCapacity = a.capacity * 2 + 8;
 
 		if (newCapacity < minCapacity)
@@ -123,16 +201,158 @@ namespace array
 			grow(a, a.num+1);
 		}
 
-		a.data[a.num++] = item;
+		new (&a.data[a.num++]) T(item);
+	}
+
+	template<typename T> inline void push_back(Array<T> &a, T &&item)
+	{
+		if (a.num + 1 > a.capacity)
+		{
+			grow(a, a.num+1);
+		}
+
+		new (&a.data[a.num++]) T(std::move(item));
 	}
 
 	template<typename T> inline void pop_back(Array<T> &a)
 	{
 		a.num--;
+		detail::destroyElements(&a.data[a.num], 1);
+	}
+
+	template<typename T> inline void clear(Array<T> &a)
+	{
+		detail::destroyElements(a.data, a.num);
+		a.num = 0;
 	}
 
+	//destroys the elements and gives the memory back, the array can still be used afterwards
 	template<typename T> inline void free(Array<T> &a)
 	{
-		::free(a.data);
+		clear(a);
+		detail::releaseStorage(a);
 	}
+}
+
+template <typename T> inline Array<T>::Array()
+	: Array(array::heapAllocator())
+{
+}
+
+template <typename T> inline Array<T>::Array(const ArrayAllocator& alloc)
+	: data(nullptr), num(0), capacity(0), allocator(alloc), inlineData(nullptr), inlineCapacity(0)
+{
+}
+
+template <typename T> inline Array<T>::Array(const ArrayAllocator& alloc, T* inlineStorage, uint32_t inlineCount)
+	: data(inlineStorage), num(0), capacity(inlineCount), allocator(alloc), inlineData(inlineStorage), inlineCapacity(inlineCount)
+{
+}
+
+template <typename T> inline Array<T>::Array(Array&& other)
+	: Array(other.allocator)
+{
+	takeFrom(other);
+}
+
+template <typename T> inline Array<T>::~Array()
+{
+	array::free(*this);
+}
+
+template <typename T> inline Array<T>& Array<T>::operator=(Array&& other)
+{
+	if (this != &other)
+	{
+		array::free(*this);
+		takeFrom(other);
+	}
+	return *this;
+}
+
+//expects this array to be empty. Elements in inline storage have to be moved one by one,
+//anything else can just have its pointer taken, along with the allocator it came from
+template <typename T> inline void Array<T>::takeFrom(Array& other)
+{
+	if (other.data == other.inlineData)
+	{
+		array::reserve(*this, other.num);
+		array::detail::moveElements(data, other.data, other.num);
+		num = other.num;
+	}
+	else
+	{
+		data = other.data;
+		num = other.num;
+		capacity = other.capacity;
+		allocator = other.allocator;
+
+		other.data = other.inlineData;
+		other.capacity = other.inlineCapacity;
+	}
+
+	other.num = 0;
+}
+
+template <typename T> inline T & Array<T>::operator[](uint32_t i)
+{
+#if _DEBUG
+	checkf(i < num, "Attempting to read past end of array");
+#endif
+	return data[i];
+}
+
+template <typename T> inline const T & Array<T>::operator[](uint32_t i) const
+{
+#if _DEBUG
+	checkf(i < num, "Attempting to read past end of array");
+#endif
+	return data[i];
+}
+
+template <typename T> inline uint32_t Array<T>::size() const
+{
+	return num;
+}
+
+template <typename T> inline T* Array<T>::begin()
+{
+	return data;
+}
+
+template <typename T> inline T* Array<T>::end()
+{
+	return data + num;
+}
+
+template <typename T> inline const T* Array<T>::begin() const
+{
+	return data;
+}
+
+template <typename T> inline const T* Array<T>::end() const
+{
+	return data + num;
+}
+
+template <typename T, uint32_t N> inline SmallArray<T, N>::SmallArray()
+	: SmallArray(array::heapAllocator())
+{
+}
+
+template <typename T, uint32_t N> inline SmallArray<T, N>::SmallArray(const ArrayAllocator& alloc)
+	: Array<T>(alloc, (T*)inlineStorage, N)
+{
+}
+
+template <typename T, uint32_t N> inline SmallArray<T, N>::SmallArray(SmallArray&& other)
+	: SmallArray(other.allocator)
+{
+	this->takeFrom(other);
+}
+
+template <typename T, uint32_t N> inline SmallArray<T, N>& SmallArray<T, N>::operator=(SmallArray&& other)
+{
+	Array<T>::operator=(std::move(other));
+	return *this;
 }
\ No newline at end of file
@@ -1,15 +1,48 @@
 #pragma once
 #include "vkh.h"
+#include "mesh_asset_format.h"
+#include "pipeline_compiler.h"
 
+//ShaderPipeline builds every combination of a material's keywords, keep this in sync with its config.h
+const uint32_t MAX_MATERIAL_KEYWORDS = 8;
+
+struct MeshLod
+{
+	uint32_t firstIndex;	//relative to iOffset
+	uint32_t indexCount;
+	float error;
+
+	//lods without meshlets can only be drawn whole
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+//meshes don't own their buffers, vBuffer and iBuffer are shared with other meshes and
+//the offsets need to be passed to vkCmdDrawIndexed as vertexOffset and firstIndex
 struct MeshRenderData
 {
 	VkBuffer vBuffer;
 	VkBuffer iBuffer;
-	vkh::Allocation vBufferMemory;
-	vkh::Allocation iBufferMemory;
+	uint32_t vOffset;
+	uint32_t iOffset;
 
 	uint32_t vCount;
 	uint32_t iCount;
+
+	uint32_t lodCount;
+	MeshLod lods[MeshFormat::MAX_LODS];
+
+	EVertexLayout layout;
+	VkIndexType indexType;
+
+	//compact positions are stored in [-1, 1], pos * posScale + posBias gets them back to mesh space. 
+	//These are 1 and 0 for full meshes, so shaders can apply them either way
+	float posScale[3];
+	float posBias[3];
+
+	//mesh space sphere around the bounds, lod selection measures the view distance to its surface
+	float boundsCenter[3];
+	float boundsRadius;
 };
 
 struct UniformBlockDef
@@ -21,6 +54,35 @@ struct UniformBlockDef
 	VkShaderStageFlags visibleStages;
 };
 
+//where a uniform buffer is bound in a material's descriptor sets, so the descriptor
+//can be rewritten if the buffer gets moved by the defragmenter
+struct BufferDescriptorBinding
+{
+	VkDescriptorSet set;
+	uint32_t binding;
+	uint32_t range;
+};
+
+//same as above, but for textures, which can be moved independently of the material
+struct ImageDescriptorBinding
+{
+	VkDescriptorSet set;
+	uint32_t binding;
+	uint32_t texId;
+	VkDescriptorType type;	//combined image samplers or separate sampled images
+};
+
+//inputs that are pointed at resources from outside the material (storage buffers / images, texel buffers
+//and separate images / samplers). These can be in any set, and are found by hashed name when set
+struct ResourceDescriptorBinding
+{
+	uint32_t nameHash;
+	VkDescriptorSet set;
+	uint32_t binding;
+	VkDescriptorType type;
+	bool written;	//storage images and texel buffers have nothing to point at until they're set
+};
+
 struct MaterialDynamicData
 {
 	uint32_t numInputs;
@@ -29,16 +91,38 @@ struct MaterialDynamicData
 	// for images- hasehd name / textureViewPtr index / desc set write idx / padding 
 	uint32_t* layout;
 	VkBuffer* buffers;
+	BufferDescriptorBinding* bufferBindings;
+	uint32_t numBuffers;
 	vkh::Allocation uniformMem;
 
 	VkWriteDescriptorSet* descriptorSetWrites;
 };
 
+//materials with keywords have a pipeline for every combination of them they've been drawn with. A key has
+//a bit set for each enabled keyword, in the order they're listed in the material file
+struct MaterialVariantData
+{
+	uint32_t key;
+	uint32_t numKeywords;
+	uint32_t keywordHashes[MAX_MATERIAL_KEYWORDS];
+	char keywords[MAX_MATERIAL_KEYWORDS][32];
+
+	//everything a variant's pipeline needs besides its shader modules, which are loaded when it's made
+	PipelineCompiler::GraphicsPipelineDesc desc;
+	char shaderPaths[PipelineCompiler::MAX_GRAPHICS_STAGES][256];
+
+	uint32_t* pipelines;	//one per key, INVALID_PIPELINE until that variant is first drawn
+};
+
 struct MaterialRenderData
 {
 	//general material data
 	VkPipeline pipeline;
+	EVertexLayout vertexLayout;	//meshes drawn with this material need to match
 	VkPipelineLayout pipelineLayout;
+	VkPipelineBindPoint bindPoint;	//compute materials are dispatched instead of drawn
+	uint32_t sharedPipeline;	//graphics pipelines belong to the PipelineCompiler, pipeline is VK_NULL_HANDLE until it's built
+	uint32_t workgroupSize[3];
 
 	uint32_t layoutCount;
 	VkDescriptorSetLayout* descriptorSetLayouts;
@@ -54,13 +138,29 @@ struct MaterialRenderData
 	//we don't need a layout for static data since it cannot be 
 	//changed after initialization
 	VkBuffer* staticBuffers;
+	BufferDescriptorBinding* staticBufferBindings;
 	vkh::Allocation staticUniformMem;
 	uint32_t numStaticBuffers;
 
+	ImageDescriptorBinding* imageBindings;
+	uint32_t numImageBindings;
+
+	//storage buffers are owned by the material, and aren't registered with the defragmenter 
+	//since a dispatch could be writing to them at any time
+	VkBuffer* storageBuffers;
+	vkh::Allocation storageMem;
+	uint32_t numStorageBuffers;
+
+	ResourceDescriptorBinding* resourceBindings;
+	uint32_t numResourceBindings;
+
 	//for now, just add buffers here to modify. when this
 	//is modified to support material instances, we'll change it 
 	//to something more sane. 
 	MaterialDynamicData dynamic;
+
+	//null for materials without keywords. When there is one, sharedPipeline is the current key's entry in it
+	MaterialVariantData* variants;
 };
 
 struct TextureRenderData
@@ -70,10 +170,13 @@ struct TextureRenderData
 	VkImageView view;
 	VkFormat format;
 	VkSampler sampler;
+	uint32_t mipLevels;	//levels actually in the image, streamed textures may have fewer than their full chain
+	VkImageLayout layout;	//what descriptors need to say the image is in when it's read
 };
 
 struct VertexRenderData
 {
 	VkVertexInputAttributeDescription* attrDescriptions;
 	uint32_t attrCount;
+	uint32_t stride;
 };
\ No newline at end of file
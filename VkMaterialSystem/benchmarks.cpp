@@ -0,0 +1,715 @@
+#include "stdafx.h"
+
+#include "benchmarks.h"
+#include "asset_rdata_types.h"
+#include "culling.h"
+#include "frame_allocator.h"
+#include "hash.h"
+#include "material.h"
+#include "mesh.h"
+#include "mesh_asset_format.h"
+#include "pipeline_compiler.h"
+#include "procedural_geo.h"
+#include "rendering.h"
+#include "timing.h"
+#include "vertex_encoding.h"
+#include "vkh.h"
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+//what hash() uses, declared here so it can be timed on binary data
+unsigned int MurmurHash2(const void* key, int len, unsigned int seed);
+
+namespace Benchmarks
+{
+	const uint32_t MESH_BENCH_COUNT = 10000;
+
+	//a grid this size is 1M vertices and 6M indices, about 60 MB on disk
+	const uint32_t MESH_LOAD_BENCH_GRID_SIZE = 1024;
+	const uint32_t MESH_LOAD_BENCH_ITERATIONS = 5;
+	const char* MESH_LOAD_BENCH_PATH = "../data/_generated/bench_grid.vkmesh";
+	const char* MESH_LOAD_BENCH_COMPACT_PATH = "../data/_generated/bench_grid_compact.vkmesh";
+
+	const uint32_t CULL_BENCH_ITERATIONS = 20;
+
+	//every size hashes this many bytes in total, so they all take a similar amount of time
+	const size_t HASH_BENCH_TOTAL_BYTES = 256 * 1024 * 1024;
+
+	//the first few frames are allowed to allocate, while caches / the frame allocator grow to size
+	const uint32_t FRAME_ALLOC_BENCH_WARMUP_FRAMES = 16;
+	const uint32_t FRAME_ALLOC_BENCH_FRAMES = 256;
+
+	const uint32_t PIPELINE_SHARE_BENCH_MATERIALS = 64;
+
+	//257 vertices a side leaves 256 cells, which halves evenly for every lod
+	const uint32_t LOD_BENCH_GRID_SIZE = 257;
+	const uint32_t LOD_BENCH_LODS = 5;
+	const char* LOD_BENCH_PATH = "../data/_generated/bench_grid_lods.vkmesh";
+
+	//16x16 cell tiles leave a 256 cell grid with 256 meshlets
+	const uint32_t MESHLET_BENCH_TILE_SIZE = 16;
+	const uint32_t MESHLET_BENCH_FRAMES = 64;
+	const char* MESHLET_BENCH_PATH = "../data/_generated/bench_grid_meshlets.vkmesh";
+
+	//a unit cube with its own vertices per face, about the smallest mesh that's still a real mesh
+	void makeCube(std::vector<Vertex>& outVerts, std::vector<uint32_t>& outIndices, glm::vec3 offset)
+	{
+		static const glm::vec3 normals[6] = { {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1} };
+
+		for (uint32_t face = 0; face < 6; ++face)
+		{
+			glm::vec3 n = normals[face];
+			glm::vec3 u = glm::vec3(n.y, n.z, n.x);
+			glm::vec3 v = glm::cross(n, u);
+
+			uint32_t base = static_cast<uint32_t>(outVerts.size());
+			outVerts.push_back({ offset + (n - u - v) * 0.5f, glm::vec2(0, 0), glm::vec4(1, 1, 1, 1), n });
+			outVerts.push_back({ offset + (n + u - v) * 0.5f, glm::vec2(1, 0), glm::vec4(1, 1, 1, 1), n });
+			outVerts.push_back({ offset + (n + u + v) * 0.5f, glm::vec2(1, 1), glm::vec4(1, 1, 1, 1), n });
+			outVerts.push_back({ offset + (n - u + v) * 0.5f, glm::vec2(0, 1), glm::vec4(1, 1, 1, 1), n });
+
+			uint32_t faceIndices[6] = { 0, 1, 2, 2, 3, 0 };
+			for (uint32_t i = 0; i < 6; ++i) outIndices.push_back(base + faceIndices[i]);
+		}
+	}
+
+	//draws every mesh in one frame, and returns the vkCmdBindVertexBuffers + vkCmdBindIndexBuffer calls that were recorded.
+	//They all sit at the origin, inside an identity view matrix's frustum, so none are culled
+	uint32_t countBufferBinds(const std::vector<uint32_t>& meshIds)
+	{
+		uint32_t matId = Material::make("../data/materials/raymarch_primitives.mat");
+		Material::setGlobalMatrix("viewMatrix", glm::mat4(1.0f));
+
+		Culling::ObjectBoundsSet bounds;
+		Culling::allocObjectBounds(bounds, static_cast<uint32_t>(meshIds.size()));
+		for (uint32_t i = 0; i < meshIds.size(); ++i)
+		{
+			Culling::addObject(bounds, glm::vec3(-0.5f), glm::vec3(0.5f));
+		}
+
+		uint32_t drawn = Rendering::drawObjects(matId, meshIds.data(), bounds, Culling::EBoundsTest::Box);
+		checkf(drawn == meshIds.size(), "Bind counting frame didn't draw every mesh");
+
+		//the frame could still be in flight
+		vkDeviceWaitIdle(vkh::GContext.device);
+		Material::destroy(matId);
+		Culling::freeObjectBounds(bounds);
+
+		return Rendering::lastFrameStats().bufferBinds;
+	}
+
+	void meshCreation()
+	{
+		std::vector<Vertex> verts;
+		std::vector<uint32_t> indices;
+		makeCube(verts, indices, glm::vec3(0, 0, 0));
+
+		std::vector<uint32_t> meshIds;
+		meshIds.reserve(MESH_BENCH_COUNT);
+
+		uint32_t allocsBefore = vkh::GContext.allocator.numAllocs();
+
+		TimeSpan createTime;
+		startTiming(createTime);
+
+		for (uint32_t i = 0; i < MESH_BENCH_COUNT; ++i)
+		{
+			meshIds.push_back(Mesh::make(verts.data(), static_cast<uint32_t>(verts.size()), indices.data(), static_cast<uint32_t>(indices.size())));
+		}
+		Mesh::flushUploads();
+
+		double createMs = endTiming(createTime);
+		uint32_t allocsAfter = vkh::GContext.allocator.numAllocs();
+
+		uint32_t binds = countBufferBinds(meshIds);
+
+		TimeSpan destroyTime;
+		startTiming(destroyTime);
+
+		for (uint32_t id : meshIds)
+		{
+			Mesh::destroy(id);
+		}
+
+		double destroyMs = endTiming(destroyTime);
+
+		printf("[BENCH] mesh creation: %u meshes (%zu verts, %zu indices each)\n", MESH_BENCH_COUNT, verts.size(), indices.size());
+		printf("[BENCH]     create + upload: %.3f ms (%.3f us per mesh)\n", createMs, createMs * 1000.0 / MESH_BENCH_COUNT);
+		printf("[BENCH]     destroy: %.3f ms\n", destroyMs);
+		printf("[BENCH]     device allocations: %i (one buffer per mesh would need %u)\n", (int)(allocsAfter - allocsBefore), MESH_BENCH_COUNT * 2);
+		printf("[BENCH]     buffer binds recorded drawing all: %u (one buffer per mesh would need %u)\n", binds, MESH_BENCH_COUNT * 2);
+	}
+
+	//triangulates every step'th row and column of a grid's vertices, so coarser steps make coarser lods of the same grid
+	void appendGridIndices(std::vector<uint32_t>& outIndices, uint32_t gridSize, uint32_t step)
+	{
+		checkf((gridSize - 1) % step == 0, "Grid lod step has to divide the grid evenly");
+
+		for (uint32_t y = 0; y < gridSize - 1; y += step)
+		{
+			for (uint32_t x = 0; x < gridSize - 1; x += step)
+			{
+				uint32_t i = y * gridSize + x;
+				uint32_t down = step * gridSize;
+				uint32_t quad[6] = { i, i + down, i + step, i + step, i + down, i + down + step };
+				outIndices.insert(outIndices.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	//triangulates a tileSize square of a grid's cells, starting at cell x, y
+	void appendGridTileIndices(std::vector<uint32_t>& outIndices, uint32_t gridSize, uint32_t x, uint32_t y, uint32_t tileSize)
+	{
+		for (uint32_t ty = y; ty < y + tileSize; ++ty)
+		{
+			for (uint32_t tx = x; tx < x + tileSize; ++tx)
+			{
+				uint32_t i = ty * gridSize + tx;
+				uint32_t quad[6] = { i, i + gridSize, i + 1, i + 1, i + gridSize, i + gridSize + 1 };
+				outIndices.insert(outIndices.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	void makeGrid(std::vector<Vertex>& outVerts, std::vector<uint32_t>& outIndices, uint32_t gridSize)
+	{
+		outVerts.reserve(gridSize * gridSize);
+		outIndices.reserve((gridSize - 1) * (gridSize - 1) * 6);
+
+		for (uint32_t y = 0; y < gridSize; ++y)
+		{
+			for (uint32_t x = 0; x < gridSize; ++x)
+			{
+				glm::vec2 uv = glm::vec2(x, y) / (float)(gridSize - 1);
+				outVerts.push_back({ glm::vec3(uv.x, 0.0f, uv.y), uv, glm::vec4(uv.x, uv.y, 1, 1), glm::vec3(0, 1, 0) });
+			}
+		}
+
+		appendGridIndices(outIndices, gridSize, 1);
+	}
+
+	//writes a flat grid out as a .vkmesh, the same way MeshPipeline would. Each lod after the first skips every
+	//other row and column of the one before it, and its error is its cell size, since a flat grid loses no shape.
+	//With a meshlet tile size, lod 0 is split into square meshlets of that many cells a side
+	size_t writeGridMeshFile(const char* filepath, uint32_t gridSize, EVertexLayout layout, uint32_t lodCount = 1, uint32_t meshletTileSize = 0)
+	{
+		std::vector<Vertex> verts;
+		std::vector<uint32_t> indices;
+		makeGrid(verts, indices, gridSize);
+
+		checkf(lodCount > 0 && lodCount <= MeshFormat::MAX_LODS, "Invalid grid lod count");
+
+		std::vector<MeshFormat::Meshlet> meshlets;
+		if (meshletTileSize > 0)
+		{
+			checkf((gridSize - 1) % meshletTileSize == 0, "Grid meshlet tiles have to divide the grid evenly");
+
+			//rebuilt a tile at a time, so each tile's indices are contiguous
+			indices.clear();
+
+			float tileExtent = (float)meshletTileSize / (gridSize - 1);
+			for (uint32_t y = 0; y < gridSize - 1; y += meshletTileSize)
+			{
+				for (uint32_t x = 0; x < gridSize - 1; x += meshletTileSize)
+				{
+					MeshFormat::Meshlet meshlet = {};
+					meshlet.firstIndex = static_cast<uint32_t>(indices.size());
+					appendGridTileIndices(indices, gridSize, x, y, meshletTileSize);
+					meshlet.indexCount = static_cast<uint32_t>(indices.size()) - meshlet.firstIndex;
+
+					meshlet.center[0] = ((float)x / (gridSize - 1)) + tileExtent * 0.5f;
+					meshlet.center[2] = ((float)y / (gridSize - 1)) + tileExtent * 0.5f;
+					meshlet.radius = tileExtent * 0.5f * sqrtf(2.0f);
+
+					//every triangle faces straight up
+					meshlet.coneAxis[1] = 1.0f;
+					meshlet.coneCutoff = 0.0f;
+					meshlets.push_back(meshlet);
+				}
+			}
+		}
+
+		MeshFormat::LodEntry lods[MeshFormat::MAX_LODS] = {};
+		lods[0].indexCount = static_cast<uint32_t>(indices.size());
+		lods[0].meshletCount = static_cast<uint32_t>(meshlets.size());
+
+		for (uint32_t i = 1; i < lodCount; ++i)
+		{
+			uint32_t step = 1u << i;
+			lods[i].firstIndex = static_cast<uint32_t>(indices.size());
+			appendGridIndices(indices, gridSize, step);
+			lods[i].indexCount = static_cast<uint32_t>(indices.size()) - lods[i].firstIndex;
+			lods[i].error = (float)step / (gridSize - 1);
+
+			//the meshlet table's size comes from the last lod's range, so the ones without meshlets still point past the end
+			lods[i].firstMeshlet = static_cast<uint32_t>(meshlets.size());
+		}
+
+		MeshFormat::Header header = {};
+		header.magic = MeshFormat::MAGIC;
+		header.version = MeshFormat::VERSION;
+		header.vertexCount = static_cast<uint32_t>(verts.size());
+		header.indexCount = static_cast<uint32_t>(indices.size());
+		header.vertexLayout = layout;
+		header.vertexStride = static_cast<uint16_t>(VertexEncoding::vertexStride(layout));
+		header.indexSize = sizeof(uint32_t);
+		header.lodCount = lodCount;
+		header.vertexOffset = MeshFormat::alignStream(MeshFormat::meshletTableOffset(header.lodCount) + meshlets.size() * sizeof(MeshFormat::Meshlet));
+		header.indexOffset = MeshFormat::alignStream(header.vertexOffset + verts.size() * header.vertexStride);
+		header.boundsMax[0] = 1.0f;
+		header.boundsMax[2] = 1.0f;
+
+		size_t fileSize = (size_t)header.indexOffset + indices.size() * sizeof(uint32_t);
+		std::vector<uint8_t> fileData(fileSize, 0);
+		memcpy(&fileData[0], &header, sizeof(header));
+
+		memcpy(&fileData[(size_t)MeshFormat::lodTableOffset()], lods, lodCount * sizeof(MeshFormat::LodEntry));
+		if (meshlets.size() > 0)
+		{
+			memcpy(&fileData[(size_t)MeshFormat::meshletTableOffset(lodCount)], meshlets.data(), meshlets.size() * sizeof(MeshFormat::Meshlet));
+		}
+
+		if (layout == EVertexLayout::Compact)
+		{
+			VertexEncoding::encodeCompact((const MeshFormat::PackedVertex*)verts.data(), header.vertexCount, header.boundsMin, header.boundsMax,
+				(VertexEncoding::CompactVertex*)&fileData[(size_t)header.vertexOffset]);
+		}
+		else
+		{
+			memcpy(&fileData[(size_t)header.vertexOffset], verts.data(), verts.size() * sizeof(Vertex));
+		}
+
+		memcpy(&fileData[(size_t)header.indexOffset], indices.data(), indices.size() * sizeof(uint32_t));
+
+		FILE* file;
+		fopen_s(&file, filepath, "wb");
+		checkf(file, "Could not open benchmark mesh file for writing");
+		fwrite(fileData.data(), 1, fileSize, file);
+		fclose(file);
+
+		return fileSize;
+	}
+
+	double timeMeshLoads(const char* filepath)
+	{
+		//the first load pulls the file into the os cache, only time the ones after it
+		Mesh::destroy(Mesh::load(filepath));
+
+		double totalMs = 0.0;
+		for (uint32_t i = 0; i < MESH_LOAD_BENCH_ITERATIONS; ++i)
+		{
+			TimeSpan loadTime;
+			startTiming(loadTime);
+
+			uint32_t meshId = Mesh::load(filepath);
+			Mesh::flushUploads();
+
+			totalMs += endTiming(loadTime);
+			Mesh::destroy(meshId);
+		}
+
+		return totalMs / MESH_LOAD_BENCH_ITERATIONS;
+	}
+
+	void meshLoading()
+	{
+		const char* paths[2] = { MESH_LOAD_BENCH_PATH, MESH_LOAD_BENCH_COMPACT_PATH };
+		const char* names[2] = { "full", "compact" };
+		EVertexLayout layouts[2] = { EVertexLayout::Full, EVertexLayout::Compact };
+
+		printf("[BENCH] mesh loading: %ux%u grid, %u iterations\n", MESH_LOAD_BENCH_GRID_SIZE, MESH_LOAD_BENCH_GRID_SIZE, MESH_LOAD_BENCH_ITERATIONS);
+
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			size_t fileSize = writeGridMeshFile(paths[i], MESH_LOAD_BENCH_GRID_SIZE, layouts[i]);
+			double avgMs = timeMeshLoads(paths[i]);
+			double megabytes = fileSize / (1024.0 * 1024.0);
+
+			printf("[BENCH]     %s: %.1f MB file, load + upload: %.3f ms (%.1f MB/s)\n", names[i], megabytes, avgMs, megabytes / (avgMs / 1000.0));
+		}
+	}
+
+	//how many bytes the vertex shader has to pull in to draw the same mesh with each layout / index size,
+	//and how far the compact encoding moves any vertex. A 256x256 grid still fits in 16 bit indices
+	void vertexBandwidth()
+	{
+		const uint32_t gridSizes[2] = { 256, MESH_LOAD_BENCH_GRID_SIZE };
+
+		for (uint32_t g = 0; g < 2; ++g)
+		{
+			std::vector<Vertex> verts;
+			std::vector<uint32_t> indices;
+			makeGrid(verts, indices, gridSizes[g]);
+
+			uint32_t vertexCount = static_cast<uint32_t>(verts.size());
+			uint32_t indexCount = static_cast<uint32_t>(indices.size());
+
+			printf("[BENCH] vertex bandwidth: %ux%u grid (%u verts, %u indices)\n", gridSizes[g], gridSizes[g], vertexCount, indexCount);
+
+			uint64_t fullBytes = 0;
+			EVertexLayout layouts[2] = { EVertexLayout::Full, EVertexLayout::Compact };
+			for (EVertexLayout layout : layouts)
+			{
+				TimeSpan makeTime;
+				startTiming(makeTime);
+
+				uint32_t meshId = Mesh::make(verts.data(), vertexCount, indices.data(), indexCount, layout);
+				Mesh::flushUploads();
+
+				double makeMs = endTiming(makeTime);
+
+				MeshRenderData rData = Mesh::getRenderData(meshId);
+				uint32_t indexSize = rData.indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+				uint64_t bytes = (uint64_t)vertexCount * VertexEncoding::vertexStride(layout) + (uint64_t)indexCount * indexSize;
+				if (layout == EVertexLayout::Full) fullBytes = bytes;
+
+				printf("[BENCH]     %s: %u byte vertices, %u byte indices, %.2f MB per draw (%.0f%% of full), encode + upload %.3f ms\n",
+					layout == EVertexLayout::Full ? "full" : "compact",
+					VertexEncoding::vertexStride(layout),
+					indexSize,
+					bytes / (1024.0 * 1024.0),
+					100.0 * bytes / fullBytes,
+					makeMs);
+
+				Mesh::destroy(meshId);
+			}
+
+			float boundsMin[3];
+			float boundsMax[3];
+			float scale[3];
+			float bias[3];
+			VertexEncoding::computeBounds((const MeshFormat::PackedVertex*)verts.data(), vertexCount, boundsMin, boundsMax);
+			VertexEncoding::positionScaleBias(boundsMin, boundsMax, scale, bias);
+
+			std::vector<VertexEncoding::CompactVertex> compact(vertexCount);
+			VertexEncoding::encodeCompact((const MeshFormat::PackedVertex*)verts.data(), vertexCount, boundsMin, boundsMax, compact.data());
+
+			float maxError = 0.0f;
+			for (uint32_t i = 0; i < vertexCount; ++i)
+			{
+				for (uint32_t c = 0; c < 3; ++c)
+				{
+					float decoded = (compact[i].pos[c] / 32767.0f) * scale[c] + bias[c];
+					maxError = glm::max(maxError, fabsf(decoded - verts[i].pos[c]));
+				}
+			}
+
+			printf("[BENCH]     compact max position error: %f (mesh extent %f)\n", maxError, boundsMax[0] - boundsMin[0]);
+		}
+	}
+
+	//random boxes spread through a cube the camera is looking into, about a quarter end up visible
+	void objectCulling(uint32_t objectCount)
+	{
+		Culling::ObjectBoundsSet bounds;
+		Culling::allocObjectBounds(bounds, objectCount);
+
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> size(0.1f, 3.0f);
+
+		for (uint32_t i = 0; i < objectCount; ++i)
+		{
+			glm::vec3 center = glm::vec3(position(rng), position(rng), position(rng));
+			glm::vec3 extent = glm::vec3(size(rng), size(rng), size(rng));
+			Culling::addObject(bounds, center - extent, center + extent);
+		}
+
+		glm::mat4 proj = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 200.0f);
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -50.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 viewProj = proj * view;
+		Material::setGlobalMatrix("viewMatrix", viewProj);
+
+		glm::vec4 planes[6];
+		Culling::extractGlobalFrustumPlanes(planes);
+
+		std::vector<uint32_t> visible(objectCount);
+
+		uint32_t hwThreads = std::thread::hardware_concurrency();
+		uint32_t threadCounts[2] = { 1, hwThreads > 1 ? hwThreads : 1 };
+		const char* testNames[2] = { "sphere", "box" };
+		Culling::EBoundsTest tests[2] = { Culling::EBoundsTest::Sphere, Culling::EBoundsTest::Box };
+
+		printf("[BENCH] object culling: %u objects, %u iterations\n", objectCount, CULL_BENCH_ITERATIONS);
+
+		for (uint32_t avx = 0; avx < 2; ++avx)
+		{
+			if (avx && !Culling::cpuSupportsAVX()) continue;
+			Culling::setAllowAVX(avx == 1);
+
+			for (uint32_t t = 0; t < 2; ++t)
+			{
+				for (uint32_t threads : threadCounts)
+				{
+					//warm up, so the first iteration isn't paying for page faults on the output
+					uint32_t visibleCount = Culling::cullObjects(bounds, tests[t], planes, visible.data(), threads);
+
+					TimeSpan cullTime;
+					startTiming(cullTime);
+
+					for (uint32_t i = 0; i < CULL_BENCH_ITERATIONS; ++i)
+					{
+						visibleCount = Culling::cullObjects(bounds, tests[t], planes, visible.data(), threads);
+					}
+
+					double avgMs = endTiming(cullTime) / CULL_BENCH_ITERATIONS;
+					printf("[BENCH]     %s %s, %u thread(s): %.3f ms (%.2f ns per object), %u visible\n",
+						avx ? "avx" : "sse", testNames[t], threads, avgMs, avgMs * 1000000.0 / objectCount, visibleCount);
+
+					if (threadCounts[0] == threadCounts[1]) break;
+				}
+			}
+		}
+
+		Culling::setAllowAVX(true);
+		Culling::freeObjectBounds(bounds);
+	}
+
+	//from property name sized inputs up to whole files, the result is summed so nothing gets optimized out. Inputs 
+	//start at a different offset each iteration, since neither hash gets to assume its input is aligned
+	void hashing()
+	{
+		const size_t sizes[] = { 16, 64, 256, 4096, 1024 * 1024 };
+		std::vector<uint8_t> data(1024 * 1024 + 8);
+		for (size_t i = 0; i < data.size(); ++i)
+		{
+			data[i] = (uint8_t)(i * 31 + 7);
+		}
+
+		printf("[BENCH] hashing: %zu MB per size\n", HASH_BENCH_TOTAL_BYTES / (1024 * 1024));
+
+		for (size_t size : sizes)
+		{
+			size_t iterations = HASH_BENCH_TOTAL_BYTES / size;
+			uint64_t sum = 0;
+
+			TimeSpan murmurTime;
+			startTiming(murmurTime);
+			for (size_t i = 0; i < iterations; ++i)
+			{
+				sum += MurmurHash2(data.data() + (i & 7), static_cast<int>(size), 255);
+			}
+			double murmurMs = endTiming(murmurTime);
+
+			TimeSpan xxhTime;
+			startTiming(xxhTime);
+			for (size_t i = 0; i < iterations; ++i)
+			{
+				sum += hashBytes64(data.data() + (i & 7), size);
+			}
+			double xxhMs = endTiming(xxhTime);
+
+			//a struct hashed field by field, the way pipeline state gets hashed
+			TimeSpan streamTime;
+			startTiming(streamTime);
+			for (size_t i = 0; i < iterations; ++i)
+			{
+				Hash64State state;
+				hash64Begin(state);
+				for (size_t offset = 0; offset < size; offset += 8)
+				{
+					hash64Update(state, data.data() + (i & 7) + offset, 8);
+				}
+				sum += hash64End(state);
+			}
+			double streamMs = endTiming(streamTime);
+
+			double gigabytes = (double)size * iterations / (1024.0 * 1024.0 * 1024.0);
+			printf("[BENCH]     %zu bytes: murmur2 %.2f GB/s, xxh64 %.2f GB/s, xxh64 streamed 8 bytes at a time %.2f GB/s (%llu)\n",
+				size, gigabytes / (murmurMs / 1000.0), gigabytes / (xxhMs / 1000.0), gigabytes / (streamMs / 1000.0), (unsigned long long)(sum & 0xff));
+		}
+	}
+
+	//once things have warmed up, drawing a frame shouldn't touch the heap at all. This fails the run in every build, not
+	//just debug. The counter is thread_local, so only the render thread's allocations are counted, not the culling
+	//worker pool's, the pipeline compile thread's or the texture streaming thread's
+	bool frameAllocations()
+	{
+		uint32_t matId = Material::make("../data/materials/raymarch_primitives.mat");
+		uint32_t meshId = Mesh::quad(2.0f, 2.0f);
+
+		for (uint32_t i = 0; i < FRAME_ALLOC_BENCH_WARMUP_FRAMES; ++i)
+		{
+			Rendering::draw(matId, meshId);
+		}
+
+		uint32_t totalAllocs = 0;
+		uint32_t maxAllocs = 0;
+		uint32_t framesWithAllocs = 0;
+
+		TimeSpan frameTime;
+		startTiming(frameTime);
+		for (uint32_t i = 0; i < FRAME_ALLOC_BENCH_FRAMES; ++i)
+		{
+			Rendering::draw(matId, meshId);
+
+			uint32_t allocs = frame::heapAllocationsLastFrame();
+			totalAllocs += allocs;
+			maxAllocs = std::max(maxAllocs, allocs);
+			if (allocs > 0) framesWithAllocs++;
+		}
+		double frameMs = endTiming(frameTime);
+
+		printf("[BENCH] frame allocations: %u frames after %u warmup frames, %.3f ms per frame\n", FRAME_ALLOC_BENCH_FRAMES, FRAME_ALLOC_BENCH_WARMUP_FRAMES, frameMs / FRAME_ALLOC_BENCH_FRAMES);
+		printf("[BENCH]     render thread heap allocations: %u total, %u max in a frame, %u frames allocated\n", totalAllocs, maxAllocs, framesWithAllocs);
+		if (totalAllocs > 0)
+		{
+			printf("[BENCH] ERROR: steady state frames are allocating from the heap\n");
+		}
+
+		//the last frames could still be in flight
+		vkDeviceWaitIdle(vkh::GContext.device);
+		Material::destroy(matId);
+		Mesh::destroy(meshId);
+
+		return totalAllocs == 0;
+	}
+
+	//backs the camera away from a grid with a full lod chain, every draw should pick a coarser lod once
+	//the finer one's cells get smaller than the lod pixel error
+	void lodSelection()
+	{
+		writeGridMeshFile(LOD_BENCH_PATH, LOD_BENCH_GRID_SIZE, EVertexLayout::Full, LOD_BENCH_LODS);
+
+		uint32_t matId = Material::make("../data/materials/raymarch_primitives.mat");
+		uint32_t meshId = Mesh::load(LOD_BENCH_PATH);
+
+		printf("[BENCH] lod selection: %ux%u grid with %u lods\n", LOD_BENCH_GRID_SIZE, LOD_BENCH_GRID_SIZE, LOD_BENCH_LODS);
+
+		const float heights[] = { 0.5f, 2.0f, 8.0f, 32.0f, 128.0f, 512.0f };
+		uint32_t firstLod = 0;
+		uint32_t lastLod = 0;
+
+		for (uint32_t i = 0; i < sizeof(heights) / sizeof(heights[0]); ++i)
+		{
+			//straight above the middle of the grid
+			Rendering::setLodViewPosition(glm::vec3(0.5f, heights[i], 0.5f));
+			uint32_t lod = Rendering::draw(matId, meshId);
+
+			uint32_t indexCount = Mesh::getRenderData(meshId).lods[lod].indexCount;
+			printf("[BENCH]     %.1f units above: lod %u, %u indices\n", heights[i], lod, indexCount);
+
+			checkf(i == 0 || lod >= lastLod, "Moving away from a mesh picked a finer lod");
+			if (i == 0) firstLod = lod;
+			lastLod = lod;
+		}
+
+		checkf(firstLod == 0 && lastLod > 0, "Lod selection didn't switch lods over the whole distance range");
+
+		//the last frames could still be in flight
+		vkDeviceWaitIdle(vkh::GContext.device);
+		Material::destroy(matId);
+		Mesh::destroy(meshId);
+	}
+
+	//looks down at the middle of a meshlet grid from close enough that only some of it is in view, then up at
+	//it from underneath, where every meshlet faces away. Both views go through Rendering's meshlet culling
+	void meshletCulling()
+	{
+		writeGridMeshFile(MESHLET_BENCH_PATH, LOD_BENCH_GRID_SIZE, EVertexLayout::Full, 1, MESHLET_BENCH_TILE_SIZE);
+
+		uint32_t matId = Material::make("../data/materials/raymarch_primitives.mat");
+		uint32_t meshId = Mesh::load(MESHLET_BENCH_PATH);
+
+		const MeshLod& lod = Mesh::getRenderData(meshId).lods[0];
+		std::vector<MeshLod> ranges(lod.meshletCount);
+
+		printf("[BENCH] meshlet culling: %ux%u grid, %u meshlets, %u frames per view\n", LOD_BENCH_GRID_SIZE, LOD_BENCH_GRID_SIZE, lod.meshletCount, MESHLET_BENCH_FRAMES);
+
+		const char* names[2] = { "above", "below" };
+		const float heights[2] = { 0.25f, -0.25f };
+		glm::mat4 proj = glm::perspective(glm::radians(60.0f), 1.0f, 0.01f, 10.0f);
+
+		for (uint32_t v = 0; v < 2; ++v)
+		{
+			glm::vec3 eye = glm::vec3(0.5f, heights[v], 0.5f);
+			glm::mat4 viewProj = proj * glm::lookAt(eye, glm::vec3(0.5f, 0.0f, 0.5f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+			Rendering::setMeshletCullView(viewProj, eye);
+
+			TimeSpan frameTime;
+			startTiming(frameTime);
+			for (uint32_t i = 0; i < MESHLET_BENCH_FRAMES; ++i)
+			{
+				Rendering::draw(matId, meshId, 0.0f);
+			}
+			double frameMs = endTiming(frameTime);
+
+			//the same cull the draws did, to see what they ended up drawing
+			glm::vec4 planes[6];
+			Culling::extractFrustumPlanes(viewProj, planes);
+			uint32_t rangeCount = Mesh::cullMeshlets(meshId, 0, planes, eye, ranges.data());
+
+			uint32_t indexCount = 0;
+			for (uint32_t r = 0; r < rangeCount; ++r)
+			{
+				indexCount += ranges[r].indexCount;
+			}
+
+			printf("[BENCH]     %s: %u of %u indices in %u draws, %.3f ms per frame\n", names[v], indexCount, lod.indexCount, rangeCount, frameMs / MESHLET_BENCH_FRAMES);
+
+			if (v == 0)
+			{
+				checkf(indexCount > 0 && indexCount < lod.indexCount, "Meshlet frustum culling didn't cull part of the grid");
+			}
+			else
+			{
+				checkf(indexCount == 0, "Meshlet cone culling drew meshlets facing away from the camera");
+			}
+		}
+
+		//the last frames could still be in flight
+		vkDeviceWaitIdle(vkh::GContext.device);
+		Material::destroy(matId);
+		Mesh::destroy(meshId);
+	}
+
+	//copies of one material all describe the same pipeline, so only the first should build one
+	void pipelineSharing()
+	{
+		PipelineCompiler::CacheStats before = PipelineCompiler::cacheStats();
+		std::vector<uint32_t> mats;
+
+		TimeSpan makeTime;
+		startTiming(makeTime);
+		for (uint32_t i = 0; i < PIPELINE_SHARE_BENCH_MATERIALS; ++i)
+		{
+			mats.push_back(Material::make("../data/materials/raymarch_primitives.mat"));
+		}
+		double makeMs = endTiming(makeTime);
+
+		PipelineCompiler::CacheStats after = PipelineCompiler::cacheStats();
+		uint32_t requests = after.requests - before.requests;
+		uint32_t hits = after.hits - before.hits;
+		uint32_t created = after.created - before.created;
+
+		printf("[BENCH] pipeline sharing: %u copies of one material, make: %.3f ms (%.3f ms each)\n", PIPELINE_SHARE_BENCH_MATERIALS, makeMs, makeMs / PIPELINE_SHARE_BENCH_MATERIALS);
+		printf("[BENCH]     pipeline requests: %u, hits: %u (%.1f%%), pipelines built: %u, live: %u\n", requests, hits, 100.0 * hits / requests, created, after.live);
+		checkf(created <= 1, "Identical materials built more than one pipeline");
+
+		for (uint32_t matId : mats)
+		{
+			Material::destroy(matId);
+		}
+	}
+
+	bool run()
+	{
+		bool passed = true;
+
+		meshCreation();
+		meshLoading();
+		vertexBandwidth();
+		objectCulling(100000);
+		objectCulling(1000000);
+		hashing();
+		passed &= frameAllocations();
+		pipelineSharing();
+		lodSelection();
+		meshletCulling();
+
+		return passed;
+	}
+}
\ No newline at end of file
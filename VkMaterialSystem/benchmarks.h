@@ -0,0 +1,9 @@
+#pragma once
+
+//run with -bench on the command line instead of the normal main loop. Everything
+//here expects App::init to have already been called. Returns false if a benchmark
+//that checks a result failed (in any build), and the program exits with 1
+namespace Benchmarks
+{
+	bool run();
+}
\ No newline at end of file
@@ -0,0 +1,472 @@
+#include "stdafx.h"
+#include "culling.h"
+#include "material.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <intrin.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Culling
+{
+	void extractFrustumPlanes(const glm::mat4& viewProj, glm::vec4* outPlanes)
+	{
+		//glm is column major, so the rows of the matrix are spread across the columns
+		glm::vec4 rows[4];
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+		}
+
+		outPlanes[0] = rows[3] + rows[0];	//left
+		outPlanes[1] = rows[3] - rows[0];	//right
+		outPlanes[2] = rows[3] + rows[1];	//bottom
+		outPlanes[3] = rows[3] - rows[1];	//top
+		outPlanes[4] = rows[2];				//near
+		outPlanes[5] = rows[3] - rows[2];	//far
+
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			float len = glm::length(glm::vec3(outPlanes[i]));
+			outPlanes[i] /= len;
+		}
+	}
+
+	void allocMeshletSet(MeshletSet& outSet, uint32_t count)
+	{
+		//one block for every array, with each array padded out so the last group of 4 can be loaded whole
+		uint32_t padded = (count + 3) & ~3u;
+		uint8_t* block = (uint8_t*)_aligned_malloc(padded * 10 * sizeof(float) + 3 * sizeof(float), 16);
+		memset(block, 0, padded * 10 * sizeof(float) + 3 * sizeof(float));
+
+		float* floats = (float*)block;
+		outSet.centerX = floats + padded * 0;
+		outSet.centerY = floats + padded * 1;
+		outSet.centerZ = floats + padded * 2;
+		outSet.radius = floats + padded * 3;
+		outSet.coneAxisX = floats + padded * 4;
+		outSet.coneAxisY = floats + padded * 5;
+		outSet.coneAxisZ = floats + padded * 6;
+		outSet.coneCutoff = floats + padded * 7;
+		outSet.firstIndex = (uint32_t*)(floats + padded * 8);
+		outSet.indexCount = (uint32_t*)(floats + padded * 9);
+		outSet.count = count;
+	}
+
+	void freeMeshletSet(MeshletSet& set)
+	{
+		_aligned_free(set.centerX);
+		set = {};
+	}
+
+	uint32_t cullMeshlets(const MeshletSet& set, uint32_t first, uint32_t count, const glm::vec4* frustumPlanes, const glm::vec3& cameraPos, uint32_t* outVisible)
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm_set1_ps(frustumPlanes[p].x);
+			planeY[p] = _mm_set1_ps(frustumPlanes[p].y);
+			planeZ[p] = _mm_set1_ps(frustumPlanes[p].z);
+			planeW[p] = _mm_set1_ps(frustumPlanes[p].w);
+		}
+
+		__m128 camX = _mm_set1_ps(cameraPos.x);
+		__m128 camY = _mm_set1_ps(cameraPos.y);
+		__m128 camZ = _mm_set1_ps(cameraPos.z);
+		__m128 zero = _mm_setzero_ps();
+
+		uint32_t visibleCount = 0;
+
+		for (uint32_t i = 0; i < count; i += 4)
+		{
+			uint32_t m = first + i;
+
+			__m128 cx = _mm_loadu_ps(set.centerX + m);
+			__m128 cy = _mm_loadu_ps(set.centerY + m);
+			__m128 cz = _mm_loadu_ps(set.centerZ + m);
+			__m128 r = _mm_loadu_ps(set.radius + m);
+			__m128 negR = _mm_sub_ps(zero, r);
+
+			//inside (or touching) every plane
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)), _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(d, negR));
+			}
+
+			//and not entirely facing away from the camera
+			__m128 dx = _mm_sub_ps(cx, camX);
+			__m128 dy = _mm_sub_ps(cy, camY);
+			__m128 dz = _mm_sub_ps(cz, camZ);
+			__m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+			__m128 axisDot = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(dx, _mm_loadu_ps(set.coneAxisX + m)),
+				_mm_mul_ps(dy, _mm_loadu_ps(set.coneAxisY + m))),
+				_mm_mul_ps(dz, _mm_loadu_ps(set.coneAxisZ + m)));
+
+			__m128 backfacing = _mm_cmpge_ps(axisDot, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(set.coneCutoff + m), dist), r));
+			visible = _mm_andnot_ps(backfacing, visible);
+
+			uint32_t mask = (uint32_t)_mm_movemask_ps(visible);
+			uint32_t lanes = count - i < 4 ? count - i : 4;
+
+			for (uint32_t lane = 0; lane < lanes; ++lane)
+			{
+				outVisible[visibleCount] = m + lane;
+				visibleCount += (mask >> lane) & 1;
+			}
+		}
+
+		return visibleCount;
+	}
+
+	void allocObjectBounds(ObjectBoundsSet& outSet, uint32_t capacity)
+	{
+		uint32_t padded = (capacity + 7) & ~7u;
+		size_t bytes = padded * 7 * sizeof(float);
+
+		float* block = (float*)_aligned_malloc(bytes, 32);
+		memset(block, 0, bytes);
+
+		outSet.centerX = block + padded * 0;
+		outSet.centerY = block + padded * 1;
+		outSet.centerZ = block + padded * 2;
+		outSet.extentX = block + padded * 3;
+		outSet.extentY = block + padded * 4;
+		outSet.extentZ = block + padded * 5;
+		outSet.radius = block + padded * 6;
+		outSet.count = 0;
+		outSet.capacity = padded;
+	}
+
+	void freeObjectBounds(ObjectBoundsSet& set)
+	{
+		_aligned_free(set.centerX);
+		set = {};
+	}
+
+	void setObjectBounds(ObjectBoundsSet& set, uint32_t objectIdx, const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		glm::vec3 center = (boxMin + boxMax) * 0.5f;
+		glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+
+		set.centerX[objectIdx] = center.x;
+		set.centerY[objectIdx] = center.y;
+		set.centerZ[objectIdx] = center.z;
+		set.extentX[objectIdx] = extent.x;
+		set.extentY[objectIdx] = extent.y;
+		set.extentZ[objectIdx] = extent.z;
+		set.radius[objectIdx] = glm::length(extent);
+	}
+
+	uint32_t addObject(ObjectBoundsSet& set, const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		checkf(set.count < set.capacity, "Object bounds set is full");
+
+		uint32_t objectIdx = set.count++;
+		setObjectBounds(set, objectIdx, boxMin, boxMax);
+		return objectIdx;
+	}
+
+	void extractGlobalFrustumPlanes(glm::vec4* outPlanes)
+	{
+		extractFrustumPlanes(Material::getGlobalViewMatrix(), outPlanes);
+	}
+
+	bool cpuSupportsAVX()
+	{
+		int info[4];
+		__cpuid(info, 1);
+
+		//the cpu has to support it, and the os has to save the ymm registers on a context switch
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!avx || !osxsave) return false;
+
+		return (_xgetbv(0) & 0x6) == 0x6;
+	}
+
+	static bool allowAVX = true;
+
+	void setAllowAVX(bool allow)
+	{
+		allowAVX = allow;
+	}
+
+	//each lane's visible bit either advances the output or leaves the slot to be overwritten,
+	//so there's no branch per object
+	inline uint32_t appendVisible(uint32_t mask, uint32_t firstObject, uint32_t lanes, uint32_t* outVisible, uint32_t visibleCount)
+	{
+		for (uint32_t lane = 0; lane < lanes; ++lane)
+		{
+			outVisible[visibleCount] = firstObject + lane;
+			visibleCount += (mask >> lane) & 1;
+		}
+		return visibleCount;
+	}
+
+	//the box test pushes each plane out by the box's extent along the plane normal, so a box
+	//is visible if d >= -(|n.x| * e.x + |n.y| * e.y + |n.z| * e.z) for every plane
+	uint32_t cullObjectsSSE(const ObjectBoundsSet& set, EBoundsTest test, const glm::vec4* frustumPlanes, uint32_t first, uint32_t end, uint32_t* outVisible)
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		__m128 absX[6], absY[6], absZ[6];
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm_set1_ps(frustumPlanes[p].x);
+			planeY[p] = _mm_set1_ps(frustumPlanes[p].y);
+			planeZ[p] = _mm_set1_ps(frustumPlanes[p].z);
+			planeW[p] = _mm_set1_ps(frustumPlanes[p].w);
+			absX[p] = _mm_set1_ps(fabsf(frustumPlanes[p].x));
+			absY[p] = _mm_set1_ps(fabsf(frustumPlanes[p].y));
+			absZ[p] = _mm_set1_ps(fabsf(frustumPlanes[p].z));
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		uint32_t visibleCount = 0;
+
+		for (uint32_t i = first; i < end; i += 8)
+		{
+			uint32_t mask = 0;
+
+			//8 objects per iteration to match the AVX path, as two halves of 4
+			for (uint32_t half = 0; half < 8; half += 4)
+			{
+				uint32_t o = i + half;
+				__m128 cx = _mm_load_ps(set.centerX + o);
+				__m128 cy = _mm_load_ps(set.centerY + o);
+				__m128 cz = _mm_load_ps(set.centerZ + o);
+
+				__m128 ex, ey, ez, r;
+				if (test == EBoundsTest::Box)
+				{
+					ex = _mm_load_ps(set.extentX + o);
+					ey = _mm_load_ps(set.extentY + o);
+					ez = _mm_load_ps(set.extentZ + o);
+				}
+				else
+				{
+					r = _mm_sub_ps(zero, _mm_load_ps(set.radius + o));
+				}
+
+				__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (uint32_t p = 0; p < 6; ++p)
+				{
+					__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)), _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+
+					if (test == EBoundsTest::Box)
+					{
+						r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+						r = _mm_sub_ps(zero, r);
+					}
+
+					visible = _mm_and_ps(visible, _mm_cmpge_ps(d, r));
+				}
+
+				mask |= (uint32_t)_mm_movemask_ps(visible) << half;
+			}
+
+			uint32_t lanes = end - i < 8 ? end - i : 8;
+			visibleCount = appendVisible(mask, i, lanes, outVisible, visibleCount);
+		}
+
+		return visibleCount;
+	}
+
+	uint32_t cullObjectsAVX(const ObjectBoundsSet& set, EBoundsTest test, const glm::vec4* frustumPlanes, uint32_t first, uint32_t end, uint32_t* outVisible)
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		__m256 absX[6], absY[6], absZ[6];
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm256_set1_ps(frustumPlanes[p].x);
+			planeY[p] = _mm256_set1_ps(frustumPlanes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustumPlanes[p].z);
+			planeW[p] = _mm256_set1_ps(frustumPlanes[p].w);
+			absX[p] = _mm256_set1_ps(fabsf(frustumPlanes[p].x));
+			absY[p] = _mm256_set1_ps(fabsf(frustumPlanes[p].y));
+			absZ[p] = _mm256_set1_ps(fabsf(frustumPlanes[p].z));
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+		uint32_t visibleCount = 0;
+
+		for (uint32_t i = first; i < end; i += 8)
+		{
+			__m256 cx = _mm256_load_ps(set.centerX + i);
+			__m256 cy = _mm256_load_ps(set.centerY + i);
+			__m256 cz = _mm256_load_ps(set.centerZ + i);
+
+			__m256 ex, ey, ez, r;
+			if (test == EBoundsTest::Box)
+			{
+				ex = _mm256_load_ps(set.extentX + i);
+				ey = _mm256_load_ps(set.extentY + i);
+				ez = _mm256_load_ps(set.extentZ + i);
+			}
+			else
+			{
+				r = _mm256_sub_ps(zero, _mm256_load_ps(set.radius + i));
+			}
+
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+
+				if (test == EBoundsTest::Box)
+				{
+					r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)), _mm256_mul_ps(absZ[p], ez));
+					r = _mm256_sub_ps(zero, r);
+				}
+
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(d, r, _CMP_GE_OQ));
+			}
+
+			uint32_t mask = (uint32_t)_mm256_movemask_ps(visible);
+			uint32_t lanes = end - i < 8 ? end - i : 8;
+			visibleCount = appendVisible(mask, i, lanes, outVisible, visibleCount);
+		}
+
+		return visibleCount;
+	}
+
+	uint32_t cullObjectRange(const ObjectBoundsSet& set, EBoundsTest test, const glm::vec4* frustumPlanes, uint32_t first, uint32_t end, uint32_t* outVisible)
+	{
+		static bool hasAVX = cpuSupportsAVX();
+
+		if (hasAVX && allowAVX)
+		{
+			return cullObjectsAVX(set, test, frustumPlanes, first, end, outVisible);
+		}
+		return cullObjectsSSE(set, test, frustumPlanes, first, end, outVisible);
+	}
+
+	//the workers stay around between culls, waiting for the next one's chunks. Everything here is only
+	//touched with the lock held, the job's inputs are read only while chunks are being culled
+	struct WorkerPool
+	{
+		std::mutex lock;
+		std::condition_variable wake;
+		std::condition_variable chunksFinished;
+		std::vector<std::thread> workers;
+		bool stopping;
+
+		const ObjectBoundsSet* set;
+		EBoundsTest test;
+		const glm::vec4* frustumPlanes;
+		uint32_t* outVisible;
+		uint32_t chunkSize;
+		uint32_t chunkCount;
+		uint32_t nextChunk;
+		uint32_t chunksDone;
+		std::vector<uint32_t> chunkVisible;
+	};
+
+	WorkerPool pool;
+
+	//each chunk writes its visible list into its own part of outVisible, which can't overflow
+	//since a chunk can't have more visible objects than it has objects
+	void cullChunks(std::unique_lock<std::mutex>& guard)
+	{
+		while (pool.nextChunk < pool.chunkCount)
+		{
+			uint32_t c = pool.nextChunk++;
+			uint32_t first = c * pool.chunkSize;
+			uint32_t end = first + pool.chunkSize < pool.set->count ? first + pool.chunkSize : pool.set->count;
+
+			guard.unlock();
+			uint32_t visibleCount = cullObjectRange(*pool.set, pool.test, pool.frustumPlanes, first, end, pool.outVisible + first);
+			guard.lock();
+
+			pool.chunkVisible[c] = visibleCount;
+			if (++pool.chunksDone == pool.chunkCount)
+			{
+				pool.chunksFinished.notify_one();
+			}
+		}
+	}
+
+	void cullWorker()
+	{
+		std::unique_lock<std::mutex> guard(pool.lock);
+
+		while (true)
+		{
+			pool.wake.wait(guard, []() { return pool.stopping || pool.nextChunk < pool.chunkCount; });
+			if (pool.stopping) break;
+
+			cullChunks(guard);
+		}
+	}
+
+	uint32_t cullObjects(const ObjectBoundsSet& set, EBoundsTest test, const glm::vec4* frustumPlanes, uint32_t* outVisible, uint32_t threadCount)
+	{
+		//chunks start on a multiple of 8 so every load stays aligned
+		uint32_t chunkSize = threadCount > 1 ? (((set.count + threadCount - 1) / threadCount) + 7) & ~7u : set.count;
+		if (threadCount <= 1 || chunkSize >= set.count)
+		{
+			return cullObjectRange(set, test, frustumPlanes, 0, set.count, outVisible);
+		}
+
+		uint32_t chunkCount = (set.count + chunkSize - 1) / chunkSize;
+
+		std::unique_lock<std::mutex> guard(pool.lock);
+		checkf(pool.chunksDone == pool.chunkCount, "Only one thread can cull objects on the worker pool at a time");
+
+		//the calling thread culls chunks too, so it only needs the rest in workers. Workers are only ever
+		//added, for the most threads any cull so far has asked for
+		while (pool.workers.size() < chunkCount - 1)
+		{
+			pool.stopping = false;
+			pool.workers.push_back(std::thread(cullWorker));
+		}
+
+		if (pool.chunkVisible.size() < chunkCount)
+		{
+			pool.chunkVisible.resize(chunkCount);
+		}
+
+		pool.set = &set;
+		pool.test = test;
+		pool.frustumPlanes = frustumPlanes;
+		pool.outVisible = outVisible;
+		pool.chunkSize = chunkSize;
+		pool.chunkCount = chunkCount;
+		pool.nextChunk = 0;
+		pool.chunksDone = 0;
+		pool.wake.notify_all();
+
+		cullChunks(guard);
+		pool.chunksFinished.wait(guard, []() { return pool.chunksDone == pool.chunkCount; });
+
+		//then the chunks get packed down into one list
+		uint32_t visibleCount = pool.chunkVisible[0];
+		for (uint32_t c = 1; c < chunkCount; ++c)
+		{
+			memmove(outVisible + visibleCount, outVisible + c * chunkSize, pool.chunkVisible[c] * sizeof(uint32_t));
+			visibleCount += pool.chunkVisible[c];
+		}
+
+		return visibleCount;
+	}
+
+	void shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> guard(pool.lock);
+			pool.stopping = true;
+			pool.wake.notify_all();
+		}
+
+		for (std::thread& worker : pool.workers)
+		{
+			worker.join();
+		}
+		pool.workers.clear();
+	}
+}
\ No newline at end of file
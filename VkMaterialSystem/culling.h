@@ -0,0 +1,86 @@
+#pragma once
+#include "stdafx.h"
+
+namespace Culling
+{
+	//planes point inwards, a point is inside when dot(plane.xyz, p) + plane.w >= 0. Expects a 
+	//vulkan style projection, with depth going from 0 to 1
+	void extractFrustumPlanes(const glm::mat4& viewProj, glm::vec4* outPlanes);
+
+	//bounding spheres and backface cones for a mesh's meshlets, kept as separate arrays so they
+	//can be tested 4 at a time. Every array is padded so reading 4 past any index is safe
+	struct MeshletSet
+	{
+		float* centerX;
+		float* centerY;
+		float* centerZ;
+		float* radius;
+
+		//a meshlet faces away from the camera when dot(center - camera, axis) >= cutoff * |center - camera| + radius
+		float* coneAxisX;
+		float* coneAxisY;
+		float* coneAxisZ;
+		float* coneCutoff;
+
+		uint32_t* firstIndex;
+		uint32_t* indexCount;
+
+		uint32_t count;
+	};
+
+	void allocMeshletSet(MeshletSet& outSet, uint32_t count);
+	void freeMeshletSet(MeshletSet& set);
+
+	//writes the indices of the visible meshlets in [first, first + count) to outVisible, in order, 
+	//and returns how many there were. Planes and camera position are in the meshlets' space
+	uint32_t cullMeshlets(const MeshletSet& set, uint32_t first, uint32_t count, const glm::vec4* frustumPlanes, const glm::vec3& cameraPos, uint32_t* outVisible);
+
+	//OBJECTS
+
+	//world space bounds for everything that might be drawn. Every object has both a box (centre and
+	//half extents) and a sphere (same centre), so either test can be run over the same set. Arrays
+	//are 32 byte aligned and padded to a multiple of 8
+	struct ObjectBoundsSet
+	{
+		float* centerX;
+		float* centerY;
+		float* centerZ;
+		float* extentX;
+		float* extentY;
+		float* extentZ;
+		float* radius;
+
+		uint32_t count;
+		uint32_t capacity;
+	};
+
+	enum class EBoundsTest : uint8_t
+	{
+		Sphere,
+		Box
+	};
+
+	void allocObjectBounds(ObjectBoundsSet& outSet, uint32_t capacity);
+	void freeObjectBounds(ObjectBoundsSet& set);
+
+	//returns the new object's index
+	uint32_t addObject(ObjectBoundsSet& set, const glm::vec3& boxMin, const glm::vec3& boxMax);
+	void setObjectBounds(ObjectBoundsSet& set, uint32_t objectIdx, const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+	//tests 8 objects per iteration (AVX where the cpu has it, two SSE halves where it doesn't) and writes
+	//the indices of the visible ones to outVisible, in order, ready for draw submission. outVisible needs
+	//room for set.count indices. With threadCount > 1 the set is split into that many chunks, culled by the
+	//calling thread and a pool of worker threads that's kept between calls. Only one thread can be using the
+	//pool at a time. Returns the number of visible objects
+	uint32_t cullObjects(const ObjectBoundsSet& set, EBoundsTest test, const glm::vec4* frustumPlanes, uint32_t* outVisible, uint32_t threadCount = 1);
+
+	//joins the worker threads, the next threaded cull starts them again
+	void shutdown();
+
+	//the frustum of the view projection matrix shaders are currently using (GlobalShaderData::viewMatrix)
+	void extractGlobalFrustumPlanes(glm::vec4* outPlanes);
+
+	//the AVX path is picked automatically, this is for comparing the two
+	bool cpuSupportsAVX();
+	void setAllowAVX(bool allow);
+}
\ No newline at end of file
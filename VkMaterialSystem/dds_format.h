@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+//the subset of the DDS container that TexturePipeline writes and Texture::make reads. Files
+//are always written with the DX10 extended header, so the format is always a DXGI_FORMAT, and 
+//every mip follows the headers tightly packed, largest first
+namespace DDS
+{
+	const uint32_t MAGIC = 0x20534444;			//"DDS "
+	const uint32_t FOURCC_DX10 = 0x30315844;	//"DX10"
+
+	const uint32_t DDSD_CAPS = 0x1;
+	const uint32_t DDSD_HEIGHT = 0x2;
+	const uint32_t DDSD_WIDTH = 0x4;
+	const uint32_t DDSD_PIXELFORMAT = 0x1000;
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDSD_LINEARSIZE = 0x80000;
+
+	const uint32_t DDPF_FOURCC = 0x4;
+
+	const uint32_t DDSCAPS_COMPLEX = 0x8;
+	const uint32_t DDSCAPS_TEXTURE = 0x1000;
+	const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+	const uint32_t RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+	//values match DXGI_FORMAT
+	enum Format : uint32_t
+	{
+		FORMAT_UNKNOWN = 0,
+		FORMAT_BC1_UNORM = 71,
+		FORMAT_BC3_UNORM = 77,
+		FORMAT_BC5_UNORM = 83,
+		FORMAT_BC7_UNORM = 98,
+	};
+
+	struct PixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct Header
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		PixelFormat pixelFormat;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	struct HeaderDX10
+	{
+		Format format;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	static_assert(sizeof(Header) == 124, "DDS header must match the on disk layout");
+	static_assert(sizeof(HeaderDX10) == 20, "DDS DX10 header must match the on disk layout");
+
+	//every BC format encodes 4x4 blocks of texels
+	inline uint32_t bytesPerBlock(Format format)
+	{
+		switch (format)
+		{
+			case FORMAT_BC1_UNORM: return 8;
+			case FORMAT_BC3_UNORM:
+			case FORMAT_BC5_UNORM:
+			case FORMAT_BC7_UNORM: return 16;
+			default: return 0;
+		}
+	}
+
+	inline size_t mipSize(Format format, uint32_t width, uint32_t height)
+	{
+		size_t blocksWide = (width + 3) / 4;
+		size_t blocksHigh = (height + 3) / 4;
+		return blocksWide * blocksHigh * bytesPerBlock(format);
+	}
+}
\ No newline at end of file
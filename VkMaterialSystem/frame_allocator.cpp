@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "frame_allocator.h"
+#include "arena.h"
+#include <cstdlib>
+#include <new>
+
+namespace frame
+{
+	//allocations that didn't fit in the arena, freed at the next reset
+	struct OverflowBlock
+	{
+		OverflowBlock* next;
+	};
+
+	struct FrameAllocatorState
+	{
+		Arena arena;
+		OverflowBlock* overflow;
+		size_t overflowBytes;
+
+		uint32_t heapAllocations;
+		uint32_t heapAllocationsLastFrame;
+	};
+
+	thread_local FrameAllocatorState state;
+
+	void* alloc(size_t size, size_t alignment)
+	{
+		if (!state.arena.base)
+		{
+			arena::init(state.arena, DEFAULT_FRAME_ALLOCATOR_SIZE);
+		}
+
+		if (arena::fits(state.arena, size, alignment))
+		{
+			return arena::alloc(state.arena, size, alignment);
+		}
+
+		//the header is padded out to the alignment so the allocation after it stays aligned
+		size_t headerSize = (sizeof(OverflowBlock) + alignment - 1) & ~(alignment - 1);
+		OverflowBlock* block = (OverflowBlock*)_aligned_malloc(headerSize + size, alignment < alignof(OverflowBlock) ? alignof(OverflowBlock) : alignment);
+		countHeapAllocation();
+
+		block->next = state.overflow;
+		state.overflow = block;
+		state.overflowBytes += size + alignment;
+
+		return (uint8_t*)block + headerSize;
+	}
+
+	void reset()
+	{
+		while (state.overflow)
+		{
+			OverflowBlock* next = state.overflow->next;
+			_aligned_free(state.overflow);
+			state.overflow = next;
+		}
+
+		//grow to fit everything the last frame needed, so a frame like it doesn't overflow again
+		if (state.overflowBytes > 0)
+		{
+			size_t newSize = state.arena.size + state.overflowBytes;
+			arena::free(state.arena);
+			arena::init(state.arena, newSize);
+			state.overflowBytes = 0;
+		}
+		else
+		{
+			//frame allocations aren't expected to be zeroed, so this skips the clear arena::reset does
+			state.arena.used = 0;
+		}
+
+		state.heapAllocationsLastFrame = state.heapAllocations;
+		state.heapAllocations = 0;
+	}
+
+	void* arrayAlloc(void* userData, size_t size, size_t alignment)
+	{
+		return alloc(size, alignment);
+	}
+
+	ArrayAllocator arrayAllocator()
+	{
+		return { arrayAlloc, nullptr, nullptr };
+	}
+
+	void countHeapAllocation()
+	{
+		state.heapAllocations++;
+	}
+
+	uint32_t heapAllocationCount()
+	{
+		return state.heapAllocations;
+	}
+
+	uint32_t heapAllocationsLastFrame()
+	{
+		return state.heapAllocationsLastFrame;
+	}
+}
+
+//every new / delete in the program goes through here, only so they can be counted
+void* operator new(size_t size)
+{
+	frame::countHeapAllocation();
+
+	void* ptr = malloc(size > 0 ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <vector>
+#include "array.h"
+
+//a linear allocator for anything that only needs to live until the end of the frame. Every thread
+//has its own, and nothing in it is freed individually. The render thread's is reset at the end of 
+//Rendering::endFrame, anything allocated from it can't be held on to past that
+namespace frame
+{
+	//when a frame runs out of space, the rest of it comes from the heap, and the allocator
+	//grows at the next reset so that frame would have fit
+	const size_t DEFAULT_FRAME_ALLOCATOR_SIZE = 1024 * 1024;
+
+	void* alloc(size_t size, size_t alignment);
+	void reset();
+
+	template<typename T> inline T* allocArray(size_t count)
+	{
+		if (count == 0) return nullptr;
+		return (T*)alloc(sizeof(T) * count, alignof(T));
+	}
+
+	//for Arrays that don't outlive the frame
+	ArrayAllocator arrayAllocator();
+
+	//heap allocations made by this thread, through new / delete, the Array heap allocator or
+	//arenas. lastFrame is the count between the last two resets
+	void countHeapAllocation();
+	uint32_t heapAllocationCount();
+	uint32_t heapAllocationsLastFrame();
+
+	//lets std containers use the frame allocator, deallocating does nothing
+	template <class T>
+	struct StlAllocator
+	{
+		typedef T value_type;
+
+		StlAllocator()
+		{
+		}
+
+		template <class U> StlAllocator(const StlAllocator<U>&)
+		{
+		}
+
+		T* allocate(size_t count)
+		{
+			return (T*)alloc(sizeof(T) * count, alignof(T));
+		}
+
+		void deallocate(T*, size_t)
+		{
+		}
+	};
+
+	template <class T, class U> inline bool operator==(const StlAllocator<T>&, const StlAllocator<U>&)
+	{
+		return true;
+	}
+
+	template <class T, class U> inline bool operator!=(const StlAllocator<T>&, const StlAllocator<U>&)
+	{
+		return false;
+	}
+
+	template <class T> using Vector = std::vector<T, StlAllocator<T>>;
+	template <class K, class V> using Map = std::map<K, V, std::less<K>, StlAllocator<std::pair<const K, V>>>;
+}
\ No newline at end of file
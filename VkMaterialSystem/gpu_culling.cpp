@@ -0,0 +1,640 @@
+#include "stdafx.h"
+#include "gpu_culling.h"
+#include "vkh_initializers.h"
+#include "asset_rdata_types.h"
+#include "culling.h"
+#include "image_utils.h"
+#include "mesh.h"
+
+namespace GpuCulling
+{
+	using vkh::GContext;
+
+	//built from data/shaders by the ShaderPipeline pre-build step, like material shaders
+	const char* CULL_SHADER_PATH = "../data/_generated/builtshaders/cull_objects.comp.spv";
+	const char* REDUCE_SHADER_PATH = "../data/_generated/builtshaders/depth_reduce.comp.spv";
+
+	//must match local_size in the shaders
+	const uint32_t CULL_GROUP_SIZE = 64;
+	const uint32_t REDUCE_GROUP_SIZE = 8;
+
+	const uint32_t MAX_PYRAMID_LEVELS = 16;
+
+	//matches CULL_DATA in cull_objects.comp
+	struct CullData
+	{
+		glm::mat4 viewProj;
+		glm::mat4 prevViewProj;
+		glm::vec4 frustumPlanes[6];
+		glm::vec2 pyramidSize;
+		uint32_t objectCount;
+		uint32_t occlusionEnabled;
+	};
+
+	//matches REDUCE_DATA in depth_reduce.comp
+	struct ReduceData
+	{
+		int32_t inSize[2];
+		int32_t outSize[2];
+	};
+
+	struct CullBuffer
+	{
+		VkBuffer buffer;
+		vkh::Allocation memory;
+	};
+
+	//everything the cpu writes while earlier frames can still be reading it, one per swap chain image
+	struct CullFrame
+	{
+		CullBuffer staging;
+		glm::vec4* stagedBounds;
+		VkDrawIndexedIndirectCommand* stagedDraws;
+
+		CullBuffer uniforms;
+		CullData* mappedUniforms;
+
+		VkDescriptorSet cullSet;
+	};
+
+	struct CullState
+	{
+		uint32_t maxObjects;
+		uint32_t objectCount;
+		bool dirty;
+
+		//objects are written to these, and copied through the recording frame's staging
+		//buffer to the gpu side buffers the next time a cull is recorded
+		std::vector<glm::vec4> objectBounds;
+		std::vector<VkDrawIndexedIndirectCommand> objectDraws;
+
+		CullBuffer bounds;
+		CullBuffer draws;
+		CullBuffer visibleDraws;
+		CullBuffer visibleCount;
+
+		//every object's mesh has to be in these
+		VkBuffer vBuffer;
+		VkBuffer iBuffer;
+		VkIndexType indexType;
+		EVertexLayout vertexLayout;
+
+		VkDescriptorSetLayout cullSetLayout;
+		VkPipelineLayout cullPipelineLayout;
+		VkPipeline cullPipeline;
+		std::vector<CullFrame> frames;
+
+		VkImage depthImage;
+		uint32_t depthWidth;
+		uint32_t depthHeight;
+
+		VkImage pyramid;
+		vkh::Allocation pyramidMemory;
+		VkImageView pyramidView;
+		VkImageView pyramidLevelViews[MAX_PYRAMID_LEVELS];
+		VkSampler pyramidSampler;
+		uint32_t pyramidWidth;
+		uint32_t pyramidHeight;
+		uint32_t pyramidLevels;
+
+		VkDescriptorSetLayout reduceSetLayout;
+		VkPipelineLayout reducePipelineLayout;
+		VkPipeline reducePipeline;
+		VkDescriptorSet reduceSets[MAX_PYRAMID_LEVELS];
+
+		//occlusion has to be tested with the matrix the pyramid was rendered with
+		glm::mat4 cullViewProj;
+		glm::mat4 pyramidViewProj;
+		bool pyramidValid;
+		bool occlusionEnabled;
+	};
+
+	CullState state;
+
+	uint32_t previousPow2(uint32_t v)
+	{
+		uint32_t result = 1;
+		while (result * 2 <= v) result *= 2;
+		return result;
+	}
+
+	void memoryBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+	{
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, VkImageAspectFlags aspect, uint32_t baseMip, uint32_t mipCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = aspect;
+		barrier.subresourceRange.baseMipLevel = baseMip;
+		barrier.subresourceRange.levelCount = mipCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	void writeBufferDescriptor(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize range)
+	{
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = range;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = binding;
+		write.descriptorCount = 1;
+		write.descriptorType = type;
+		write.pBufferInfo = &bufferInfo;
+
+		vkUpdateDescriptorSets(GContext.device, 1, &write, 0, nullptr);
+	}
+
+	void writeImageDescriptor(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkSampler sampler, VkImageLayout layout)
+	{
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageView = view;
+		imageInfo.sampler = sampler;
+		imageInfo.imageLayout = layout;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = binding;
+		write.descriptorCount = 1;
+		write.descriptorType = type;
+		write.pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets(GContext.device, 1, &write, 0, nullptr);
+	}
+
+	void createBuffers()
+	{
+		VkDeviceSize boundsSize = sizeof(glm::vec4) * state.maxObjects;
+		VkDeviceSize drawsSize = sizeof(VkDrawIndexedIndirectCommand) * state.maxObjects;
+
+		vkh::createBuffer(state.bounds.buffer, state.bounds.memory, boundsSize,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		vkh::createBuffer(state.draws.buffer, state.draws.memory, drawsSize,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		//both get cleared with vkCmdFillBuffer at the start of every cull
+		vkh::createBuffer(state.visibleDraws.buffer, state.visibleDraws.memory, drawsSize,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		vkh::createBuffer(state.visibleCount.buffer, state.visibleCount.memory, sizeof(uint32_t),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	void createPyramid()
+	{
+		//level 0 is the largest power of two that fits in the depth buffer, so every level
+		//after it is exactly half the one before and covers the same area of the screen
+		state.pyramidWidth = previousPow2(state.depthWidth);
+		state.pyramidHeight = previousPow2(state.depthHeight);
+		state.pyramidLevels = vkh::mipLevelsForExtent(state.pyramidWidth, state.pyramidHeight);
+		checkf(state.pyramidLevels <= MAX_PYRAMID_LEVELS, "Depth buffer is too large for the depth pyramid");
+
+		vkh::createImage(state.pyramid, state.pyramidWidth, state.pyramidHeight, state.pyramidLevels, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+		vkh::allocBindImageToMem(state.pyramidMemory, state.pyramid, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		vkh::createImageViewForMips(state.pyramidView, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, state.pyramidLevels, state.pyramid);
+		for (uint32_t i = 0; i < state.pyramidLevels; ++i)
+		{
+			vkh::createImageViewForMips(state.pyramidLevelViews[i], VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1, state.pyramid);
+		}
+
+		//culling reads 4 texels itself and takes the max, filtering would blend in nearer depths
+		VkSamplerCreateInfo samplerInfo = {};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = (float)state.pyramidLevels;
+
+		VkResult res = vkCreateSampler(GContext.device, &samplerInfo, nullptr, &state.pyramidSampler);
+		assert(res == VK_SUCCESS);
+	}
+
+	void createCullPipeline()
+	{
+		VkDescriptorSetLayoutBinding bindings[6] =
+		{
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+		};
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vkh::descriptorSetLayoutCreateInfo(bindings, 6);
+		VkResult res = vkCreateDescriptorSetLayout(GContext.device, &layoutInfo, nullptr, &state.cullSetLayout);
+		assert(res == VK_SUCCESS);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkh::pipelineLayoutCreateInfo(&state.cullSetLayout, 1);
+		res = vkCreatePipelineLayout(GContext.device, &pipelineLayoutInfo, nullptr, &state.cullPipelineLayout);
+		assert(res == VK_SUCCESS);
+
+		vkh::createComputePipeline(state.cullPipeline, state.cullPipelineLayout, CULL_SHADER_PATH, GContext.device);
+	}
+
+	//the gpu side buffers are shared, frames are kept off each other's copies of them by barriers
+	void createFrame(CullFrame& frame)
+	{
+		VkDeviceSize boundsSize = sizeof(glm::vec4) * state.maxObjects;
+		VkDeviceSize drawsSize = sizeof(VkDrawIndexedIndirectCommand) * state.maxObjects;
+
+		vkh::createBuffer(frame.staging.buffer, frame.staging.memory, boundsSize + drawsSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		uint8_t* mappedStaging = (uint8_t*)frame.staging.memory.mapped;
+		frame.stagedBounds = (glm::vec4*)mappedStaging;
+		frame.stagedDraws = (VkDrawIndexedIndirectCommand*)(mappedStaging + boundsSize);
+
+		vkh::createBuffer(frame.uniforms.buffer, frame.uniforms.memory, sizeof(CullData),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		frame.mappedUniforms = (CullData*)frame.uniforms.memory.mapped;
+
+		VkDescriptorSetAllocateInfo allocInfo = vkh::descriptorSetAllocateInfo(&state.cullSetLayout, 1, GContext.descriptorPool);
+		VkResult res = vkAllocateDescriptorSets(GContext.device, &allocInfo, &frame.cullSet);
+		assert(res == VK_SUCCESS);
+
+		writeBufferDescriptor(frame.cullSet, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame.uniforms.buffer, sizeof(CullData));
+		writeBufferDescriptor(frame.cullSet, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, state.bounds.buffer, VK_WHOLE_SIZE);
+		writeBufferDescriptor(frame.cullSet, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, state.draws.buffer, VK_WHOLE_SIZE);
+		writeBufferDescriptor(frame.cullSet, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, state.visibleDraws.buffer, VK_WHOLE_SIZE);
+		writeBufferDescriptor(frame.cullSet, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, state.visibleCount.buffer, VK_WHOLE_SIZE);
+		writeImageDescriptor(frame.cullSet, 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, state.pyramidView, state.pyramidSampler, VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	//a recreated swap chain can have more images than the last one
+	void createFrames()
+	{
+		size_t frameCount = GContext.swapChain.imageViews.size();
+		while (state.frames.size() < frameCount)
+		{
+			state.frames.push_back({});
+			createFrame(state.frames.back());
+		}
+	}
+
+	void writeReduceSets(VkImageView depthView);
+
+	void createReducePipeline(VkImageView depthView)
+	{
+		VkDescriptorSetLayoutBinding bindings[2] =
+		{
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vkh::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		};
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vkh::descriptorSetLayoutCreateInfo(bindings, 2);
+		VkResult res = vkCreateDescriptorSetLayout(GContext.device, &layoutInfo, nullptr, &state.reduceSetLayout);
+		assert(res == VK_SUCCESS);
+
+		VkPushConstantRange pushConstantRange = vkh::pushConstantRange(0, sizeof(ReduceData), VK_SHADER_STAGE_COMPUTE_BIT);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkh::pipelineLayoutCreateInfo(&state.reduceSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		res = vkCreatePipelineLayout(GContext.device, &pipelineLayoutInfo, nullptr, &state.reducePipelineLayout);
+		assert(res == VK_SUCCESS);
+
+		vkh::createComputePipeline(state.reducePipeline, state.reducePipelineLayout, REDUCE_SHADER_PATH, GContext.device);
+
+		//one set per level. There are enough for the largest pyramid, since the pool can't give sets back
+		//and a resized depth buffer can need more levels than the first one did
+		VkDescriptorSetLayout setLayouts[MAX_PYRAMID_LEVELS];
+		for (uint32_t i = 0; i < MAX_PYRAMID_LEVELS; ++i) setLayouts[i] = state.reduceSetLayout;
+
+		VkDescriptorSetAllocateInfo allocInfo = vkh::descriptorSetAllocateInfo(setLayouts, MAX_PYRAMID_LEVELS, GContext.descriptorPool);
+		res = vkAllocateDescriptorSets(GContext.device, &allocInfo, state.reduceSets);
+		assert(res == VK_SUCCESS);
+
+		writeReduceSets(depthView);
+	}
+
+	//each level reads the level above it (or the depth buffer) and writes itself
+	void writeReduceSets(VkImageView depthView)
+	{
+		for (uint32_t i = 0; i < state.pyramidLevels; ++i)
+		{
+			if (i == 0)
+			{
+				writeImageDescriptor(state.reduceSets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthView, state.pyramidSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+			else
+			{
+				writeImageDescriptor(state.reduceSets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, state.pyramidLevelViews[i - 1], state.pyramidSampler, VK_IMAGE_LAYOUT_GENERAL);
+			}
+
+			writeImageDescriptor(state.reduceSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, state.pyramidLevelViews[i], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL);
+		}
+	}
+
+	void init(uint32_t maxObjects, const vkh::VkhRenderBuffer& depth, uint32_t depthWidth, uint32_t depthHeight)
+	{
+		//everything is recorded into the frame's graphics command buffer
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(GContext.gpu.device, &queueFamilyCount, nullptr);
+
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(GContext.gpu.device, &queueFamilyCount, queueFamilies.data());
+		checkf(queueFamilies[GContext.gpu.graphicsQueueFamilyIdx].queueFlags & VK_QUEUE_COMPUTE_BIT, "Gpu culling needs a graphics queue that supports compute");
+
+		state = {};
+		state.maxObjects = maxObjects;
+		state.depthImage = depth.handle;
+		state.depthWidth = depthWidth;
+		state.depthHeight = depthHeight;
+		state.occlusionEnabled = true;
+		state.objectBounds.resize(maxObjects);
+		state.objectDraws.resize(maxObjects);
+
+		createBuffers();
+		createPyramid();
+		createCullPipeline();
+		createReducePipeline(depth.view);
+		createFrames();
+	}
+
+	void destroyPyramid()
+	{
+		vkDestroySampler(GContext.device, state.pyramidSampler, nullptr);
+		for (uint32_t i = 0; i < state.pyramidLevels; ++i)
+		{
+			vkDestroyImageView(GContext.device, state.pyramidLevelViews[i], nullptr);
+		}
+		vkDestroyImageView(GContext.device, state.pyramidView, nullptr);
+		vkDestroyImage(GContext.device, state.pyramid, nullptr);
+		vkh::freeDeviceMemory(state.pyramidMemory);
+	}
+
+	void setDepthBuffer(const vkh::VkhRenderBuffer& depth, uint32_t depthWidth, uint32_t depthHeight)
+	{
+		destroyPyramid();
+
+		state.depthImage = depth.handle;
+		state.depthWidth = depthWidth;
+		state.depthHeight = depthHeight;
+		createPyramid();
+
+		for (CullFrame& frame : state.frames)
+		{
+			writeImageDescriptor(frame.cullSet, 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, state.pyramidView, state.pyramidSampler, VK_IMAGE_LAYOUT_GENERAL);
+		}
+		writeReduceSets(depth.view);
+
+		//nothing's been rendered into the new depth buffer yet
+		state.pyramidValid = false;
+	}
+
+	uint32_t addObject(uint32_t meshId, const glm::vec3& boundsCenter, float boundsRadius)
+	{
+		checkf(state.objectCount < state.maxObjects, "Too many gpu culled objects");
+
+		MeshRenderData mesh = Mesh::getRenderData(meshId);
+		if (state.objectCount == 0)
+		{
+			state.vBuffer = mesh.vBuffer;
+			state.iBuffer = mesh.iBuffer;
+			state.indexType = mesh.indexType;
+			state.vertexLayout = mesh.layout;
+		}
+
+		checkf(mesh.vBuffer == state.vBuffer && mesh.iBuffer == state.iBuffer, "Gpu culled objects all need to use meshes from the same vertex and index blocks");
+
+		//compact meshes need their own dequantization push constants, which one indirect draw can't provide
+		checkf(mesh.layout == EVertexLayout::Full, "Gpu culled objects need to use full vertex layout meshes");
+
+		uint32_t objectId = state.objectCount++;
+
+		VkDrawIndexedIndirectCommand& draw = state.objectDraws[objectId];
+		draw.indexCount = mesh.lods[0].indexCount;
+		draw.instanceCount = 1;
+		draw.firstIndex = mesh.iOffset + mesh.lods[0].firstIndex;
+		draw.vertexOffset = mesh.vOffset;
+		draw.firstInstance = GContext.gpu.features.drawIndirectFirstInstance ? objectId : 0;
+
+		setObjectBounds(objectId, boundsCenter, boundsRadius);
+		return objectId;
+	}
+
+	void setObjectBounds(uint32_t objectId, const glm::vec3& boundsCenter, float boundsRadius)
+	{
+		state.objectBounds[objectId] = glm::vec4(boundsCenter, boundsRadius);
+		state.dirty = true;
+	}
+
+	uint32_t objectCount()
+	{
+		return state.objectCount;
+	}
+
+	void setOcclusionCulling(bool enabled)
+	{
+		state.occlusionEnabled = enabled;
+	}
+
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProj)
+	{
+		if (state.objectCount == 0) return;
+
+		createFrames();
+		checkf(frameIndex < state.frames.size(), "Gpu culling frame index is past the end of the swap chain");
+
+		//beginFrame waited on this frame's fence, so nothing is still reading its copies
+		CullFrame& frame = state.frames[frameIndex];
+
+		//last frame's cull and draws have to be done with the gpu side buffers before they're written again
+		memoryBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		if (state.dirty)
+		{
+			memcpy(frame.stagedBounds, state.objectBounds.data(), sizeof(glm::vec4) * state.objectCount);
+			memcpy(frame.stagedDraws, state.objectDraws.data(), sizeof(VkDrawIndexedIndirectCommand) * state.objectCount);
+
+			VkBufferCopy boundsCopy = {};
+			boundsCopy.srcOffset = 0;
+			boundsCopy.dstOffset = 0;
+			boundsCopy.size = sizeof(glm::vec4) * state.objectCount;
+			vkCmdCopyBuffer(commandBuffer, frame.staging.buffer, state.bounds.buffer, 1, &boundsCopy);
+
+			VkBufferCopy drawsCopy = {};
+			drawsCopy.srcOffset = sizeof(glm::vec4) * state.maxObjects;
+			drawsCopy.dstOffset = 0;
+			drawsCopy.size = sizeof(VkDrawIndexedIndirectCommand) * state.objectCount;
+			vkCmdCopyBuffer(commandBuffer, frame.staging.buffer, state.draws.buffer, 1, &drawsCopy);
+
+			state.dirty = false;
+		}
+
+		CullData& uniforms = *frame.mappedUniforms;
+		uniforms.viewProj = viewProj;
+		uniforms.prevViewProj = state.pyramidViewProj;
+		Culling::extractFrustumPlanes(viewProj, uniforms.frustumPlanes);
+		uniforms.pyramidSize = glm::vec2((float)state.pyramidWidth, (float)state.pyramidHeight);
+		uniforms.objectCount = state.objectCount;
+		uniforms.occlusionEnabled = state.occlusionEnabled && state.pyramidValid;
+
+		state.cullViewProj = viewProj;
+
+		//without a count buffer every slot gets drawn, so the ones nothing was written to need to be empty draws
+		if (!GContext.extensions.drawIndexedIndirectCount)
+		{
+			vkCmdFillBuffer(commandBuffer, state.visibleDraws.buffer, 0, sizeof(VkDrawIndexedIndirectCommand) * state.objectCount, 0);
+		}
+		vkCmdFillBuffer(commandBuffer, state.visibleCount.buffer, 0, sizeof(uint32_t), 0);
+
+		memoryBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.cullPipelineLayout, 0, 1, &frame.cullSet, 0, nullptr);
+		vkCmdDispatch(commandBuffer, (state.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+		memoryBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+	}
+
+	void recordDraws(VkCommandBuffer commandBuffer, EVertexLayout materialLayout)
+	{
+		if (state.objectCount == 0) return;
+		checkf(state.vertexLayout == materialLayout, "Gpu culled meshes don't match the material's vertex layout");
+
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &state.vBuffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, state.iBuffer, 0, state.indexType);
+
+		uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		if (GContext.extensions.drawIndexedIndirectCount)
+		{
+			GContext.extensions.drawIndexedIndirectCount(commandBuffer, state.visibleDraws.buffer, 0, state.visibleCount.buffer, 0, state.objectCount, stride);
+		}
+		else if (GContext.gpu.features.multiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, state.visibleDraws.buffer, 0, state.objectCount, stride);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < state.objectCount; ++i)
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, state.visibleDraws.buffer, i * stride, 1, stride);
+			}
+		}
+	}
+
+	void recordDepthPyramid(VkCommandBuffer commandBuffer)
+	{
+		imageBarrier(commandBuffer, state.depthImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		//every level is rewritten, so the old contents can go. Culling was the last thing to read them
+		imageBarrier(commandBuffer, state.pyramid, VK_IMAGE_ASPECT_COLOR_BIT, 0, state.pyramidLevels,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			0, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.reducePipeline);
+
+		uint32_t inWidth = state.depthWidth;
+		uint32_t inHeight = state.depthHeight;
+
+		for (uint32_t i = 0; i < state.pyramidLevels; ++i)
+		{
+			uint32_t outWidth = ImageUtils::mipDimension(state.pyramidWidth, i);
+			uint32_t outHeight = ImageUtils::mipDimension(state.pyramidHeight, i);
+
+			ReduceData reduce = { { (int32_t)inWidth, (int32_t)inHeight }, { (int32_t)outWidth, (int32_t)outHeight } };
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.reducePipelineLayout, 0, 1, &state.reduceSets[i], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, state.reducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReduceData), &reduce);
+			vkCmdDispatch(commandBuffer, (outWidth + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, (outHeight + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+
+			//the next level reads this one, and next frame's cull reads them all
+			imageBarrier(commandBuffer, state.pyramid, VK_IMAGE_ASPECT_COLOR_BIT, i, 1,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+				VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+			inWidth = outWidth;
+			inHeight = outHeight;
+		}
+
+		imageBarrier(commandBuffer, state.depthImage, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT);
+
+		state.pyramidViewProj = state.cullViewProj;
+		state.pyramidValid = true;
+	}
+
+	void destroyBuffer(CullBuffer& buffer)
+	{
+		vkDestroyBuffer(GContext.device, buffer.buffer, nullptr);
+		vkh::freeDeviceMemory(buffer.memory);
+	}
+
+	void destroy()
+	{
+		vkDeviceWaitIdle(GContext.device);
+
+		for (CullFrame& frame : state.frames)
+		{
+			destroyBuffer(frame.staging);
+			destroyBuffer(frame.uniforms);
+		}
+
+		destroyBuffer(state.bounds);
+		destroyBuffer(state.draws);
+		destroyBuffer(state.visibleDraws);
+		destroyBuffer(state.visibleCount);
+
+		//the shared pool doesn't allow freeing individual sets, so the descriptor sets are leaked like material ones are
+		vkDestroyPipeline(GContext.device, state.cullPipeline, nullptr);
+		vkDestroyPipeline(GContext.device, state.reducePipeline, nullptr);
+		vkDestroyPipelineLayout(GContext.device, state.cullPipelineLayout, nullptr);
+		vkDestroyPipelineLayout(GContext.device, state.reducePipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(GContext.device, state.cullSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(GContext.device, state.reduceSetLayout, nullptr);
+
+		destroyPyramid();
+
+		state = {};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include "stdafx.h"
+#include "vkh.h"
+#include "mesh_asset_format.h"
+
+//objects are culled by a compute pass against the frustum and last frame's depth pyramid (hi-z), and
+//the survivors' draws are compacted into an indirect buffer so the main pass can draw them all with
+//one call. One draw means one vertex and index buffer bind, so every object's mesh needs to live in
+//the same mesh blocks (true for any meshes of the same layout and index size until a block fills up)
+namespace GpuCulling
+{
+	//depth is the main pass's depth buffer, the pyramid is built from it after the pass
+	void init(uint32_t maxObjects, const vkh::VkhRenderBuffer& depth, uint32_t depthWidth, uint32_t depthHeight);
+
+	//for when the main pass's depth buffer is recreated at a new size. Rebuilds the pyramid, and rewrites descriptors
+	//that were bound in earlier frames, so nothing using them can still be in flight
+	void setDepthBuffer(const vkh::VkhRenderBuffer& depth, uint32_t depthWidth, uint32_t depthHeight);
+
+	//bounds are a world space sphere. Objects always draw their mesh's lod 0, and the mesh has to use the full layout. If the device supports
+	//drawIndirectFirstInstance, the draw's firstInstance is the returned id, for looking up per object data
+	uint32_t addObject(uint32_t meshId, const glm::vec3& boundsCenter, float boundsRadius);
+	void setObjectBounds(uint32_t objectId, const glm::vec3& boundsCenter, float boundsRadius);
+	uint32_t objectCount();
+
+	//occlusion culling is on by default, but only kicks in once a pyramid has been built
+	void setOcclusionCulling(bool enabled);
+
+	//records the upload of any changed objects and the culling dispatch. Has to be outside a render pass.
+	//frameIndex is the swap chain image being recorded, whose fence has to have been waited on
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProj);
+
+	//inside the main pass, after the material's pipeline and descriptor sets are bound. The material
+	//has to use the same vertex layout as the objects' meshes
+	void recordDraws(VkCommandBuffer commandBuffer, EVertexLayout materialLayout);
+
+	//after the main pass, which needs to store depth and leave it in DEPTH_STENCIL_ATTACHMENT_OPTIMAL.
+	//The depth buffer is back in that layout when this returns
+	void recordDepthPyramid(VkCommandBuffer commandBuffer);
+
+	void destroy();
+}
\ No newline at end of file
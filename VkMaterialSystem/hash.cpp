@@ -4,6 +4,11 @@
 unsigned int MurmurHash2(const void * key, int len, unsigned int seed);
 uint64_t MurmurHash64A(const void * key, int len, unsigned int seed);
 
+//if these ever fail, "name"_h and hash("name") have drifted apart and every setter taking a hash will silently miss
+static_assert(""_h == 0x76174744, "constexpr hash doesn't match MurmurHash2");
+static_assert("abc"_h == 0xe1a1bc0f, "constexpr hash doesn't match MurmurHash2");
+static_assert("global.mouse"_h == 0xe215e48b, "constexpr hash doesn't match MurmurHash2");
+
 uint32_t hash(const char* str)
 {
 	return MurmurHash2(str, static_cast<int>(strlen(str)), 255);
@@ -12,7 +17,176 @@ uint32_t hash(const char* str)
 
 uint64_t hash64(const char* str)
 {
-	return MurmurHash64A(str, static_cast<int>(strlen(str)), 255);
+	return hashBytes64(str, strlen(str));
+}
+
+//-----------------------------------------------------------------------------
+// XXH64, by Yann Collet. Reads go through memcpy so the input doesn't need to be aligned,
+// and the compiler turns them into plain loads. 
+
+namespace XXH64
+{
+	const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+	const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+	inline uint64_t rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t read64(const uint8_t* p)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t read32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t round(uint64_t acc, uint64_t input)
+	{
+		acc += input * PRIME2;
+		acc = rotl(acc, 31);
+		return acc * PRIME1;
+	}
+
+	inline uint64_t mergeRound(uint64_t h, uint64_t acc)
+	{
+		h ^= round(0, acc);
+		return h * PRIME1 + PRIME4;
+	}
+
+	//consumes as many 32 byte stripes as fit in len, returns the number of bytes used
+	size_t consumeStripes(uint64_t* acc, const uint8_t* p, size_t len)
+	{
+		const uint8_t* start = p;
+		const uint8_t* limit = p + (len & ~(size_t)31);
+
+		uint64_t v0 = acc[0], v1 = acc[1], v2 = acc[2], v3 = acc[3];
+		while (p < limit)
+		{
+			v0 = round(v0, read64(p));
+			v1 = round(v1, read64(p + 8));
+			v2 = round(v2, read64(p + 16));
+			v3 = round(v3, read64(p + 24));
+			p += 32;
+		}
+		acc[0] = v0; acc[1] = v1; acc[2] = v2; acc[3] = v3;
+
+		return p - start;
+	}
+
+	//folds the accumulators together, inputs shorter than a stripe never touched them
+	uint64_t converge(const uint64_t* v, uint64_t totalLen, uint64_t seed)
+	{
+		uint64_t h = seed + PRIME5;
+		if (totalLen >= 32)
+		{
+			h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+			h = mergeRound(h, v[0]);
+			h = mergeRound(h, v[1]);
+			h = mergeRound(h, v[2]);
+			h = mergeRound(h, v[3]);
+		}
+		return h + totalLen;
+	}
+
+	uint64_t finish(uint64_t h, const uint8_t* p, size_t len)
+	{
+		while (len >= 8)
+		{
+			h ^= round(0, read64(p));
+			h = rotl(h, 27) * PRIME1 + PRIME4;
+			p += 8;
+			len -= 8;
+		}
+
+		if (len >= 4)
+		{
+			h ^= (uint64_t)read32(p) * PRIME1;
+			h = rotl(h, 23) * PRIME2 + PRIME3;
+			p += 4;
+			len -= 4;
+		}
+
+		while (len > 0)
+		{
+			h ^= (*p) * PRIME5;
+			h = rotl(h, 11) * PRIME1;
+			p++;
+			len--;
+		}
+
+		h ^= h >> 33;
+		h *= PRIME2;
+		h ^= h >> 29;
+		h *= PRIME3;
+		h ^= h >> 32;
+		return h;
+	}
+}
+
+void hash64Begin(Hash64State& state, uint64_t seed)
+{
+	state.acc[0] = seed + XXH64::PRIME1 + XXH64::PRIME2;
+	state.acc[1] = seed + XXH64::PRIME2;
+	state.acc[2] = seed;
+	state.acc[3] = seed - XXH64::PRIME1;
+	state.seed = seed;
+	state.totalLen = 0;
+	state.bufferSize = 0;
+}
+
+void hash64Update(Hash64State& state, const void* data, size_t len)
+{
+	const uint8_t* p = (const uint8_t*)data;
+	state.totalLen += len;
+
+	//top up a partial stripe from the last update first
+	if (state.bufferSize > 0)
+	{
+		size_t fill = sizeof(state.buffer) - state.bufferSize;
+		if (len < fill)
+		{
+			memcpy(state.buffer + state.bufferSize, p, len);
+			state.bufferSize += static_cast<uint32_t>(len);
+			return;
+		}
+
+		memcpy(state.buffer + state.bufferSize, p, fill);
+		XXH64::consumeStripes(state.acc, state.buffer, sizeof(state.buffer));
+		p += fill;
+		len -= fill;
+		state.bufferSize = 0;
+	}
+
+	size_t used = XXH64::consumeStripes(state.acc, p, len);
+	memcpy(state.buffer, p + used, len - used);
+	state.bufferSize = static_cast<uint32_t>(len - used);
+}
+
+uint64_t hash64End(const Hash64State& state)
+{
+	return XXH64::finish(XXH64::converge(state.acc, state.totalLen, state.seed), state.buffer, state.bufferSize);
+}
+
+uint64_t hashBytes64(const void* data, size_t len, uint64_t seed)
+{
+	//same as going through the streaming functions, minus the copies into the state's buffer
+	Hash64State state;
+	hash64Begin(state, seed);
+
+	const uint8_t* p = (const uint8_t*)data;
+	size_t used = XXH64::consumeStripes(state.acc, p, len);
+	return XXH64::finish(XXH64::converge(state.acc, len, seed), p + used, len - used);
 }
 
 //-----------------------------------------------------------------------------
@@ -1,4 +1,76 @@
 #pragma once
 
 uint32_t hash(const char* str);
-uint64_t hash64(const char* str);
\ No newline at end of file
+
+//64 bit hashes are XXH64, much faster than hash() on anything longer than a short name and 
+//with few enough collisions to use as content / path keys
+uint64_t hash64(const char* str);
+uint64_t hashBytes64(const void* data, size_t len, uint64_t seed = 0);
+
+//streaming version of hashBytes64, for hashing structs or several buffers without copying them
+//into one block first. The result is the same as hashBytes64 over all the updates back to back
+struct Hash64State
+{
+	uint64_t acc[4];
+	uint64_t seed;
+	uint64_t totalLen;
+	uint8_t buffer[32];
+	uint32_t bufferSize;
+};
+
+void hash64Begin(Hash64State& state, uint64_t seed = 0);
+void hash64Update(Hash64State& state, const void* data, size_t len);
+uint64_t hash64End(const Hash64State& state);
+
+//only for structs without padding, or whose padding is always zeroed
+template<typename T>
+void hash64Update(Hash64State& state, const T& pod)
+{
+	hash64Update(state, &pod, sizeof(T));
+}
+
+//compile time version of hash(), it has to give exactly the same result as the MurmurHash2 in hash.cpp 
+//(reading 4 byte blocks little endian) so these can be compared against names hashed when loading materials. 
+//Written as single expression functions since VS2015's constexpr doesn't allow loops
+namespace HashDetail
+{
+	const uint32_t MURMUR_M = 0x5bd1e995;
+	const uint32_t MURMUR_SEED = 255;
+
+	constexpr uint32_t mixBlock(uint32_t k)
+	{
+		return ((k * MURMUR_M) ^ ((k * MURMUR_M) >> 24)) * MURMUR_M;
+	}
+
+	constexpr uint32_t readBlock(const char* str, uint32_t i)
+	{
+		return (uint32_t)(uint8_t)str[i] | ((uint32_t)(uint8_t)str[i + 1] << 8) | ((uint32_t)(uint8_t)str[i + 2] << 16) | ((uint32_t)(uint8_t)str[i + 3] << 24);
+	}
+
+	constexpr uint32_t mixTail(const char* str, uint32_t i, uint32_t remaining, uint32_t h)
+	{
+		return remaining == 0 ? h : (h ^ (remaining > 2 ? (uint32_t)(uint8_t)str[i + 2] << 16 : 0) ^ (remaining > 1 ? (uint32_t)(uint8_t)str[i + 1] << 8 : 0) ^ (uint32_t)(uint8_t)str[i]) * MURMUR_M;
+	}
+
+	constexpr uint32_t finalMix(uint32_t h)
+	{
+		return ((h ^ (h >> 13)) * MURMUR_M) ^ (((h ^ (h >> 13)) * MURMUR_M) >> 15);
+	}
+
+	constexpr uint32_t murmur2(const char* str, uint32_t i, uint32_t len, uint32_t h)
+	{
+		return len - i >= 4 ? murmur2(str, i + 4, len, (h * MURMUR_M) ^ mixBlock(readBlock(str, i))) : finalMix(mixTail(str, i, len - i, h));
+	}
+}
+
+constexpr uint32_t hashConstexpr(const char* str, uint32_t len)
+{
+	return HashDetail::murmur2(str, 0, len, HashDetail::MURMUR_SEED ^ len);
+}
+
+//"name"_h hashes a literal at compile time (as long as it's used somewhere that needs a constant, 
+//or the optimizer folds it), for passing to the setters that take a name hash
+constexpr uint32_t operator"" _h(const char* str, size_t len)
+{
+	return hashConstexpr(str, static_cast<uint32_t>(len));
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+//doesn't include stdafx.h so TexturePipeline can build this file too
+#include "image_utils.h"
+#include <cstdlib>
+#include <cstring>
+#include <emmintrin.h>
+
+namespace ImageUtils
+{
+	uint32_t mipDimension(uint32_t baseDimension, uint32_t mipLevel)
+	{
+		uint32_t dim = baseDimension >> mipLevel;
+		return dim > 0 ? dim : 1;
+	}
+
+	size_t rgba8MipSize(uint32_t baseWidth, uint32_t baseHeight, uint32_t mipLevel)
+	{
+		return (size_t)mipDimension(baseWidth, mipLevel) * (size_t)mipDimension(baseHeight, mipLevel) * 4;
+	}
+
+	void downsampleRGBA8(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst)
+	{
+		uint32_t dstWidth = mipDimension(srcWidth, 1);
+		uint32_t dstHeight = mipDimension(srcHeight, 1);
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rounding = _mm_set1_epi16(2);
+
+		for (uint32_t y = 0; y < dstHeight; ++y)
+		{
+			uint32_t srcY0 = y * 2;
+			uint32_t srcY1 = srcY0 + 1 < srcHeight ? srcY0 + 1 : srcHeight - 1;
+
+			const uint8_t* row0 = src + (size_t)srcY0 * srcWidth * 4;
+			const uint8_t* row1 = src + (size_t)srcY1 * srcWidth * 4;
+			uint8_t* dstRow = dst + (size_t)y * dstWidth * 4;
+
+			uint32_t x = 0;
+
+			//each iteration reads 4 source pixels from both rows and writes 2 destination pixels
+			for (; x + 1 < dstWidth && (x * 2 + 3) < srcWidth; x += 2)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+				__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+
+				//widen to 16 bits so the sums don't overflow, lo holds pixels 0 + 1, hi holds 2 + 3
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+				//add horizontally adjacent pixels, the result ends up in the low 64 bits of each
+				lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+				hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+				__m128i sum = _mm_unpacklo_epi64(lo, hi);
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+
+				_mm_storel_epi64((__m128i*)(dstRow + x * 4), _mm_packus_epi16(sum, zero));
+			}
+
+			for (; x < dstWidth; ++x)
+			{
+				uint32_t srcX0 = x * 2;
+				uint32_t srcX1 = srcX0 + 1 < srcWidth ? srcX0 + 1 : srcWidth - 1;
+
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					uint32_t sum = row0[srcX0 * 4 + c] + row0[srcX1 * 4 + c] + row1[srcX0 * 4 + c] + row1[srcX1 * 4 + c];
+					dstRow[x * 4 + c] = (uint8_t)((sum + 2) >> 2);
+				}
+			}
+		}
+	}
+
+	size_t buildRGBA8MipChain(const uint8_t* src, uint32_t width, uint32_t height, uint32_t firstMip, uint32_t lastMip, uint8_t* dst)
+	{
+		//we need somewhere to put the intermediate mips above firstMip, these
+		//ping pong between two scratch buffers the size of mip 1
+		uint8_t* scratch[2] = { nullptr, nullptr };
+		if (firstMip > 1)
+		{
+			scratch[0] = (uint8_t*)malloc(rgba8MipSize(width, height, 1));
+			scratch[1] = (uint8_t*)malloc(rgba8MipSize(width, height, 1));
+		}
+
+		const uint8_t* prev = src;
+		size_t bytesWritten = 0;
+
+		for (uint32_t mip = 0; mip <= lastMip; ++mip)
+		{
+			uint8_t* cur;
+
+			if (mip == 0)
+			{
+				cur = (uint8_t*)src;
+			}
+			else
+			{
+				cur = mip >= firstMip ? dst + bytesWritten : scratch[mip & 1];
+				downsampleRGBA8(prev, mipDimension(width, mip - 1), mipDimension(height, mip - 1), cur);
+			}
+
+			if (mip >= firstMip)
+			{
+				size_t mipSize = rgba8MipSize(width, height, mip);
+				if (mip == 0) memcpy(dst, src, mipSize);
+				bytesWritten += mipSize;
+			}
+
+			prev = cur;
+		}
+
+		free(scratch[0]);
+		free(scratch[1]);
+
+		return bytesWritten;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+//cpu side image processing, used when the gpu can't generate mips for us
+//(the format doesn't support blitting) and for streaming mips in at runtime
+namespace ImageUtils
+{
+	uint32_t mipDimension(uint32_t baseDimension, uint32_t mipLevel);
+	size_t rgba8MipSize(uint32_t baseWidth, uint32_t baseHeight, uint32_t mipLevel);
+
+	//2x2 box filter, dst must be big enough for one rgba8 mip of src. odd dimensions
+	//clamp to the last row / column. Uses SSE2 for everything but the edges
+	void downsampleRGBA8(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst);
+
+	//writes every mip from firstMip to lastMip (inclusive) tightly packed into dst,
+	//src is mip 0. Returns the number of bytes written
+	size_t buildRGBA8MipChain(const uint8_t* src, uint32_t width, uint32_t height, uint32_t firstMip, uint32_t lastMip, uint8_t* dst);
+}
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "timing.h"
 
 #include "shader_viewer_app.h"
+#include "benchmarks.h"
 
 void mainLoop();
 void shutdown();
@@ -18,10 +19,19 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE pInstance, LPSTR cmdLine, int
 
 	App::init();
 
-	mainLoop();
+	int exitCode = 0;
+	if (strstr(cmdLine, "-bench"))
+	{
+		if (!Benchmarks::run()) exitCode = 1;
+	}
+	else
+	{
+		mainLoop();
+	}
+
 	shutdown();
 
-	return 0;
+	return exitCode;
 }
 
 
@@ -4,10 +4,12 @@
 #include "asset_rdata_types.h"
 #include "hash.h"
 #include "vkh.h"
+#include "vkh_allocator_pool.h"
 #include <vector>
 #include "texture.h"
 #include <map>
 #include "material_creation.h"
+#include "pipeline_compiler.h"
 
 struct MaterialStorage
 {
@@ -18,6 +20,9 @@ struct MaterialStorage
 
 MaterialStorage matStorage;
 
+bool hasFallbackMaterial = false;
+uint32_t fallbackMaterial;
+
 
 struct GlobalShaderData
 {
@@ -35,11 +40,12 @@ namespace Material
 	GlobalShaderData globalShaderData;
 	void* mappedMemory;
 	uint32_t globalSize;
+	VkSampler defaultSampler;
+	bool globalsInitialized = false;
 
 	void initGlobalShaderData()
 	{
-		static bool isInitialized = false;
-		if (!isInitialized)
+		if (!globalsInitialized)
 		{
 			uint32_t structSize = static_cast<uint32_t>(sizeof(GlobalShaderData));
 			size_t uboAlignment = vkh::GContext.gpu.deviceProps.limits.minUniformBufferOffsetAlignment;
@@ -59,11 +65,19 @@ namespace Material
 				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-			vkMapMemory(vkh::GContext.device, globalMem.handle, globalMem.offset, globalSize, 0, &mappedMemory);
-			isInitialized = true;
+			mappedMemory = globalMem.mapped;
+
+			vkh::createTexSampler(defaultSampler, 32);
+			globalsInitialized = true;
 		}
 	}
 
+	VkSampler getDefaultSampler()
+	{
+		initGlobalShaderData();
+		return defaultSampler;
+	}
+
 	uint32_t make(const char* materialPath)
 	{
 		uint32_t newId = reserve(materialPath);
@@ -71,6 +85,62 @@ namespace Material
 		return newId;
 	}
 
+	bool materialForDraw(uint32_t matId, uint32_t& outDrawMatId)
+	{
+		MaterialRenderData& rData = *matStorage.data[matId].rData;
+		outDrawMatId = matId;
+		if (rData.pipeline != VK_NULL_HANDLE) return true;
+
+		//the first draw with a set of keywords has to make their variant's pipeline
+		if (rData.sharedPipeline == PipelineCompiler::INVALID_PIPELINE && rData.variants)
+		{
+			MaterialVariantData& variants = *rData.variants;
+			variants.pipelines[variants.key] = makeVariantPipeline(variants, variants.key);
+			rData.sharedPipeline = variants.pipelines[variants.key];
+		}
+
+		checkf(rData.sharedPipeline != PipelineCompiler::INVALID_PIPELINE, "Material has no pipeline and isn't waiting on one");
+		PipelineCompiler::requestCompile(rData.sharedPipeline);
+
+		if (PipelineCompiler::getPipeline(rData.sharedPipeline, rData.pipeline)) return true;
+
+		outDrawMatId = fallbackMaterial;
+		return hasFallbackMaterial;
+	}
+
+	void setFallbackMaterial(uint32_t matId)
+	{
+		checkf(matStorage.data[matId].rData->pipeline != VK_NULL_HANDLE, "The fallback material can't have a deferred pipeline");
+		fallbackMaterial = matId;
+		hasFallbackMaterial = true;
+	}
+
+	void setKeyword(uint32_t matId, const char* keyword, bool enabled)
+	{
+		setKeyword(matId, hash(keyword), enabled);
+	}
+
+	void setKeyword(uint32_t matId, uint32_t keywordHash, bool enabled)
+	{
+		MaterialRenderData& rData = *matStorage.data[matId].rData;
+		if (!rData.variants) return;
+
+		MaterialVariantData& variants = *rData.variants;
+		uint32_t key = variants.key;
+		for (uint32_t i = 0; i < variants.numKeywords; ++i)
+		{
+			if (variants.keywordHashes[i] != keywordHash) continue;
+			key = enabled ? (key | (1u << i)) : (key & ~(1u << i));
+		}
+
+		if (key == variants.key) return;
+
+		//the new variant's pipeline is looked up (or made) by materialForDraw
+		variants.key = key;
+		rData.sharedPipeline = variants.pipelines[key];
+		rData.pipeline = VK_NULL_HANDLE;
+	}
+
 	uint32_t makeInstance(uint32_t parentId)
 	{
 		return 0;
@@ -90,12 +160,10 @@ namespace Material
 		return hashedName;
 	}
 
-	void setPushConstantData(uint32_t matId, const char* var, void* data, uint32_t size)
+	void setPushConstantData(uint32_t matId, uint32_t varHash, void* data, uint32_t size)
 	{
 		MaterialRenderData& rData = Material::getRenderData(matId);
 
-		uint32_t varHash = hash(var);
-
 		for (uint32_t i = 0; i < rData.pushConstantLayout.memberCount * 2; i += 2)
 		{
 			if (rData.pushConstantLayout.layout[i] == varHash)
@@ -107,12 +175,110 @@ namespace Material
 		}
 	}
 
+	ResourceDescriptorBinding* findResourceBinding(MaterialRenderData& rData, uint32_t varHash, VkDescriptorType type)
+	{
+		for (uint32_t i = 0; i < rData.numResourceBindings; ++i)
+		{
+			if (rData.resourceBindings[i].nameHash == varHash && rData.resourceBindings[i].type == type)
+			{
+				return &rData.resourceBindings[i];
+			}
+		}
+		return nullptr;
+	}
+
+	void writeResourceDescriptor(ResourceDescriptorBinding& binding, const VkDescriptorBufferInfo* bufferInfo, const VkDescriptorImageInfo* imageInfo, const VkBufferView* texelBufferView)
+	{
+		binding.written = true;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = binding.set;
+		write.dstBinding = binding.binding;
+		write.descriptorType = binding.type;
+		write.descriptorCount = 1;
+		write.pBufferInfo = bufferInfo;
+		write.pImageInfo = imageInfo;
+		write.pTexelBufferView = texelBufferView;
+
+		vkUpdateDescriptorSets(vkh::GContext.device, 1, &write, 0, nullptr);
+	}
+
+	void setStorageBuffer(uint32_t matId, uint32_t nameHash, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+	{
+		ResourceDescriptorBinding* binding = findResourceBinding(Material::getRenderData(matId), nameHash, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		checkf(binding, "Material has no storage buffer with name hash %u", nameHash);
+
+		VkDescriptorBufferInfo bufferInfo = { buffer, offset, range };
+		writeResourceDescriptor(*binding, &bufferInfo, nullptr, nullptr);
+	}
+
+	void setStorageImage(uint32_t matId, uint32_t nameHash, uint32_t texId)
+	{
+		ResourceDescriptorBinding* binding = findResourceBinding(Material::getRenderData(matId), nameHash, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		checkf(binding, "Material has no storage image with name hash %u", nameHash);
+
+		TextureRenderData* texData = Texture::getRenderData(texId);
+		checkf(texData->layout == VK_IMAGE_LAYOUT_GENERAL, "Storage images have to be made with Texture::makeStorage");
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = texData->layout;
+		imageInfo.imageView = texData->view;
+		writeResourceDescriptor(*binding, nullptr, &imageInfo, nullptr);
+	}
+
+	void setTexelBuffer(uint32_t matId, uint32_t nameHash, VkBufferView view)
+	{
+		MaterialRenderData& rData = Material::getRenderData(matId);
+
+		ResourceDescriptorBinding* binding = findResourceBinding(rData, nameHash, VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER);
+		if (!binding) binding = findResourceBinding(rData, nameHash, VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER);
+		checkf(binding, "Material has no texel buffer with name hash %u", nameHash);
+
+		writeResourceDescriptor(*binding, nullptr, nullptr, &view);
+	}
+
+	void setSampler(uint32_t matId, uint32_t nameHash, uint32_t texId)
+	{
+		ResourceDescriptorBinding* binding = findResourceBinding(Material::getRenderData(matId), nameHash, VK_DESCRIPTOR_TYPE_SAMPLER);
+		checkf(binding, "Material has no separate sampler with name hash %u", nameHash);
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.sampler = Texture::getRenderData(texId)->sampler;
+		writeResourceDescriptor(*binding, nullptr, &imageInfo, nullptr);
+	}
+
+	void setImageBindingTexture(MaterialRenderData& rData, VkDescriptorSet set, uint32_t binding, uint32_t texId)
+	{
+		for (uint32_t b = 0; b < rData.numImageBindings; ++b)
+		{
+			ImageDescriptorBinding& imageBinding = rData.imageBindings[b];
+			if (imageBinding.set == set && imageBinding.binding == binding)
+			{
+				imageBinding.texId = texId;
+			}
+		}
+	}
+
 	//note: this cannot be done from within a command buffer
-	void setTexture(uint32_t matId, const char* var, uint32_t texId)
+	void setTexture(uint32_t matId, uint32_t varHash, uint32_t texId)
 	{
 		MaterialRenderData& rData = Material::getRenderData(matId);
 
-		uint32_t varHash = hash(var);
+		ResourceDescriptorBinding* separateImage = findResourceBinding(rData, varHash, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+		if (separateImage)
+		{
+			TextureRenderData* texData = Texture::getRenderData(texId);
+
+			VkDescriptorImageInfo imageInfo = {};
+			imageInfo.imageLayout = texData->layout;
+			imageInfo.imageView = texData->view;
+			writeResourceDescriptor(*separateImage, nullptr, &imageInfo, nullptr);
+
+			setImageBindingTexture(rData, separateImage->set, separateImage->binding, texId);
+			return;
+		}
+
 		for (uint32_t i = 0; i < rData.dynamic.numInputs * 4; i += 4)
 		{
 			if (rData.dynamic.layout[i] == varHash)
@@ -123,21 +289,53 @@ namespace Material
 
 				VkWriteDescriptorSet& setWrite = rData.dynamic.descriptorSetWrites[setWriteIdx];
 				VkDescriptorImageInfo imageInfo = {};
-				imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				imageInfo.imageLayout = texData->layout;
 				imageInfo.imageView = texData->view; 
 				imageInfo.sampler = texData->sampler;
 
 				setWrite.pImageInfo = &imageInfo;
 
 				vkUpdateDescriptorSets(vkh::GContext.device, 1, &setWrite, 0, nullptr);
+				setImageBindingTexture(rData, setWrite.dstSet, setWrite.dstBinding, texId);
+			}
+		}
+	}
+
+	void patchImageDescriptors(uint32_t texId)
+	{
+		TextureRenderData* texData = Texture::getRenderData(texId);
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = texData->layout;
+		imageInfo.imageView = texData->view;
+		imageInfo.sampler = texData->sampler;
+
+		for (auto& matPair : matStorage.data)
+		{
+			MaterialRenderData* rData = matPair.second.rData;
+			if (!rData) continue;
+
+			for (uint32_t i = 0; i < rData->numImageBindings; ++i)
+			{
+				ImageDescriptorBinding& binding = rData->imageBindings[i];
+				if (binding.texId != texId) continue;
+
+				VkWriteDescriptorSet write = {};
+				write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				write.dstSet = binding.set;
+				write.dstBinding = binding.binding;
+				write.descriptorType = binding.type;	//the sampler is ignored for separate images
+				write.descriptorCount = 1;
+				write.pImageInfo = &imageInfo;
+
+				vkUpdateDescriptorSets(vkh::GContext.device, 1, &write, 0, nullptr);
 			}
 		}
 	}
 	
-	void setUniformData(uint32_t matId, const char* name, void* data)
+	void setUniformData(uint32_t matId, uint32_t varHash, void* data)
 	{
 		MaterialRenderData& rData = Material::getRenderData(matId);
-		uint32_t varHash = hash(name);
 
 		for (uint32_t i = 0; i < rData.dynamic.numInputs * 4; i += 4)
 		{
@@ -150,44 +348,107 @@ namespace Material
 				vkh::VkhCommandBuffer scratch = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Transfer);
 				vkCmdUpdateBuffer(scratch.buffer, targetBuffer, offset, size, data);
 				vkh::submitScratchCommandBuffer(scratch);
+
+				vkh::allocators::pool::markRelocatableWritten(rData.dynamic.uniformMem);
 				break;
 			}
 		}
 	}
 
-	void setPushConstantVector(uint32_t matId, const char* var, glm::vec4& data)
+	void setPushConstantVector(uint32_t matId, uint32_t varHash, glm::vec4& data)
+	{
+		setPushConstantData(matId, varHash, &data, sizeof(glm::vec4));
+	}
+
+	void setPushConstantMatrix(uint32_t matId, uint32_t varHash, glm::mat4& data)
+	{
+		setPushConstantData(matId, varHash, &data, sizeof(glm::mat4));
+	}
+
+	void setPushConstantFloat(uint32_t matId, uint32_t varHash, float data)
+	{
+		setPushConstantData(matId, varHash, &data, sizeof(float));
+	}
+
+	void setUniformVector4(uint32_t matId, uint32_t nameHash, glm::vec4& data)
+	{
+		setUniformData(matId, nameHash, &data);
+	}
+
+	void setUniformVector2(uint32_t matId, uint32_t nameHash, glm::vec2& data)
+	{
+		setUniformData(matId, nameHash, &data);
+	}
+
+	void setUniformFloat(uint32_t matId, uint32_t nameHash, float data)
 	{
-		setPushConstantData(matId, var, &data, sizeof(glm::vec4));
+		setUniformData(matId, nameHash, &data);
 	}
 
-	void setPushConstantMatrix(uint32_t matId, const char* var, glm::mat4& data)
+	void setUniformMatrix(uint32_t matId, uint32_t nameHash, glm::mat4& data)
 	{
-		setPushConstantData(matId, var, &data, sizeof(glm::mat4));
+		setUniformData(matId, nameHash, &data);
 	}
 
-	void setPushConstantFloat(uint32_t matId, const char* var, float data)
+	//the string versions of the setters just hash the name at runtime
+	void setPushConstantVector(uint32_t matId, const char* name, glm::vec4& data)
 	{
-		setPushConstantData(matId, var, &data, sizeof(float));
+		setPushConstantVector(matId, hash(name), data);
+	}
+
+	void setPushConstantFloat(uint32_t matId, const char* name, float data)
+	{
+		setPushConstantFloat(matId, hash(name), data);
+	}
+
+	void setPushConstantMatrix(uint32_t matId, const char* name, glm::mat4& data)
+	{
+		setPushConstantMatrix(matId, hash(name), data);
 	}
 
 	void setUniformVector4(uint32_t matId, const char* name, glm::vec4& data)
 	{
-		setUniformData(matId, name, &data);
+		setUniformVector4(matId, hash(name), data);
 	}
 
 	void setUniformVector2(uint32_t matId, const char* name, glm::vec2& data)
 	{
-		setUniformData(matId, name, &data);
+		setUniformVector2(matId, hash(name), data);
 	}
 
 	void setUniformFloat(uint32_t matId, const char* name, float data)
 	{
-		setUniformData(matId, name, &data);
+		setUniformFloat(matId, hash(name), data);
 	}
 
 	void setUniformMatrix(uint32_t matId, const char* name, glm::mat4& data)
 	{
-		setUniformData(matId, name, &data);
+		setUniformMatrix(matId, hash(name), data);
+	}
+
+	void setTexture(uint32_t matId, const char* name, uint32_t texId)
+	{
+		setTexture(matId, hash(name), texId);
+	}
+
+	void setStorageBuffer(uint32_t matId, const char* name, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+	{
+		setStorageBuffer(matId, hash(name), buffer, offset, range);
+	}
+
+	void setStorageImage(uint32_t matId, const char* name, uint32_t texId)
+	{
+		setStorageImage(matId, hash(name), texId);
+	}
+
+	void setTexelBuffer(uint32_t matId, const char* name, VkBufferView view)
+	{
+		setTexelBuffer(matId, hash(name), view);
+	}
+
+	void setSampler(uint32_t matId, const char* name, uint32_t texId)
+	{
+		setSampler(matId, hash(name), texId);
 	}
 
 	void setGlobalFloat(const char* name, float data)
@@ -212,14 +473,120 @@ namespace Material
 	}
 
 
+	void setGlobalMatrix(const char* name, glm::mat4& data)
+	{
+		initGlobalShaderData();
+		globalShaderData.viewMatrix = data;
+		memcpy(mappedMemory, &globalShaderData, globalSize);
+	}
+
+	const glm::mat4& getGlobalViewMatrix()
+	{
+		return globalShaderData.viewMatrix;
+	}
+
 	MaterialRenderData& getRenderData(uint32_t matId)
 	{
 		return *matStorage.data[matId].rData;
 	}
 
+	bool resourcesWritten(uint32_t matId)
+	{
+		const MaterialRenderData& rData = Material::getRenderData(matId);
+		for (uint32_t i = 0; i < rData.numResourceBindings; ++i)
+		{
+			if (!rData.resourceBindings[i].written) return false;
+		}
+		return true;
+	}
+
 	void destroy()
 	{
-		assert(0); //unimeplemented
+		if (!globalsInitialized) return;
+
+		vkDeviceWaitIdle(vkh::GContext.device);
+
+		vkDestroyBuffer(vkh::GContext.device, globalBuffer, nullptr);
+		vkh::freeDeviceMemory(globalMem);
+		vkDestroySampler(vkh::GContext.device, defaultSampler, nullptr);
+
+		globalsInitialized = false;
+	}
+
+	void destroyUniformMemory(vkh::Allocation& mem)
+	{
+		if (mem.handle == VK_NULL_HANDLE) return;
+
+		vkh::allocators::pool::unregisterRelocatable(mem);
+		vkh::freeDeviceMemory(mem);
+	}
+
+	void destroy(uint32_t matId)
+	{
+		checkf(matStorage.data.count(matId) > 0, "Destroying an invalid material handle");
+
+		using vkh::GContext;
+		MaterialRenderData& rData = *matStorage.data[matId].rData;
+
+		if (hasFallbackMaterial && fallbackMaterial == matId)
+		{
+			hasFallbackMaterial = false;
+		}
+
+		//other materials can still be using a shared pipeline, so it's only ever released. This has to happen before the 
+		//pipeline layout goes, in case the shared pipeline hasn't been built yet and was going to use it
+		if (rData.variants)
+		{
+			//sharedPipeline is one of these
+			for (uint32_t key = 0; key < (1u << rData.variants->numKeywords); ++key)
+			{
+				uint32_t pipeline = rData.variants->pipelines[key];
+				if (pipeline != PipelineCompiler::INVALID_PIPELINE) PipelineCompiler::release(pipeline, rData.pipelineLayout);
+			}
+		}
+		else if (rData.sharedPipeline != PipelineCompiler::INVALID_PIPELINE)
+		{
+			PipelineCompiler::release(rData.sharedPipeline, rData.pipelineLayout);
+		}
+		else
+		{
+			vkDestroyPipeline(GContext.device, rData.pipeline, nullptr);
+		}
+
+		vkDestroyPipelineLayout(GContext.device, rData.pipelineLayout, nullptr);
+
+		for (uint32_t i = 0; i < rData.layoutCount; ++i)
+		{
+			vkDestroyDescriptorSetLayout(GContext.device, rData.descriptorSetLayouts[i], nullptr);
+		}
+
+		for (uint32_t i = 0; i < rData.numStaticBuffers; ++i)
+		{
+			vkDestroyBuffer(GContext.device, rData.staticBuffers[i], nullptr);
+		}
+
+		for (uint32_t i = 0; i < rData.dynamic.numBuffers; ++i)
+		{
+			vkDestroyBuffer(GContext.device, rData.dynamic.buffers[i], nullptr);
+		}
+
+		destroyUniformMemory(rData.staticUniformMem);
+		destroyUniformMemory(rData.dynamic.uniformMem);
+
+		for (uint32_t i = 0; i < rData.numStorageBuffers; ++i)
+		{
+			vkDestroyBuffer(GContext.device, rData.storageBuffers[i], nullptr);
+		}
+
+		if (rData.storageMem.handle != VK_NULL_HANDLE)
+		{
+			vkh::freeDeviceMemory(rData.storageMem);
+		}
+
+		//the descriptor pool isn't created with the free bit, so the sets stay allocated until the pool goes.
+		//Everything else the material kept is in the same block as its render data
+		free(matStorage.data[matId].rData);
+		matStorage.data.erase(matId);
 	}
 
 	MaterialAsset& getMaterialAsset(uint32_t matId)
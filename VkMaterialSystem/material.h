@@ -1,5 +1,7 @@
 #pragma once
 #include "stdafx.h"
+#include "vkh.h"
+#include "hash.h"
 
 struct MaterialRenderData;
 
@@ -18,15 +20,32 @@ namespace Material
 	MaterialRenderData& getRenderData(uint32_t matId);
 	MaterialAsset& getMaterialAsset(uint32_t matId);
 
+	//creates the global uniform buffer and default sampler, anything that needs them calls this first
 	void initGlobalShaderData();
+
+	//the shared trilinear sampler that separate sampler inputs use until setSampler is called
+	VkSampler getDefaultSampler();
 	uint32_t make(const char* assetPath);
 	uint32_t makeInstance(uint32_t parentId);
 
+	//materials with "deferPipeline" don't build their pipeline until they're first drawn, and draw with the fallback 
+	//material until it's ready. Returns false if there's nothing to draw with yet (no fallback has been set)
+	bool materialForDraw(uint32_t matId, uint32_t& outDrawMatId);
+	void setFallbackMaterial(uint32_t matId);
+
+	//materials with "keywords" draw with the shader variant for whichever of them are enabled, they all start off. A variant's
+	//pipeline is queued on the compile thread the first time the material is drawn with it, and the material draws with the
+	//fallback until it's ready, whether or not the material has "deferPipeline". Unknown keywords are ignored
+	void setKeyword(uint32_t matId, const char* keyword, bool enabled);
+	void setKeyword(uint32_t matId, uint32_t keywordHash, bool enabled);
+
 	//used to create an empty material in material storage, 
 	//only needed if you're creating a material in a way other than
 	//loading the definition file from a path (as above)
 	uint32_t reserve(const char* reserveName);
 
+	//every setter also takes a precomputed name hash, use "name"_h (hash.h) to hash literal names at compile time
+	//instead of on every call. Unknown names are ignored, same as with the string versions
 	void setPushConstantVector(uint32_t matId, const char* name, glm::vec4& data);
 	void setPushConstantFloat(uint32_t matId, const char* name, float data);
 	void setPushConstantMatrix(uint32_t matId, const char* name, glm::mat4& data);
@@ -36,11 +55,48 @@ namespace Material
 	void setUniformFloat(uint32_t matId, const char* name, float data);
 	void setUniformMatrix(uint32_t matId, const char* name, glm::mat4& data);
 
+	void setPushConstantVector(uint32_t matId, uint32_t nameHash, glm::vec4& data);
+	void setPushConstantFloat(uint32_t matId, uint32_t nameHash, float data);
+	void setPushConstantMatrix(uint32_t matId, uint32_t nameHash, glm::mat4& data);
+
+	void setUniformVector4(uint32_t matId, uint32_t nameHash, glm::vec4& data);
+	void setUniformVector2(uint32_t matId, uint32_t nameHash, glm::vec2& data);
+	void setUniformFloat(uint32_t matId, uint32_t nameHash, float data);
+	void setUniformMatrix(uint32_t matId, uint32_t nameHash, glm::mat4& data);
+
+	//works for combined samplers in the dynamic set, and separate images in any set
 	void setTexture(uint32_t matId, const char* name, uint32_t texId);
 
+	//these point storage / texel buffer / separate sampler inputs at resources owned by someone else, and can be used 
+	//on inputs in any set. Like setTexture, they update the descriptor immediately, so not while a frame using it is in flight
+	void setStorageBuffer(uint32_t matId, const char* name, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	void setStorageImage(uint32_t matId, const char* name, uint32_t texId);
+	void setTexelBuffer(uint32_t matId, const char* name, VkBufferView view);
+	void setSampler(uint32_t matId, const char* name, uint32_t texId);	//uses the texture's sampler
+
+	void setTexture(uint32_t matId, uint32_t nameHash, uint32_t texId);
+	void setStorageBuffer(uint32_t matId, uint32_t nameHash, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	void setStorageImage(uint32_t matId, uint32_t nameHash, uint32_t texId);
+	void setTexelBuffer(uint32_t matId, uint32_t nameHash, VkBufferView view);
+	void setSampler(uint32_t matId, uint32_t nameHash, uint32_t texId);
+
+	//false if a storage image or texel buffer input hasn't been set yet, the material can't be drawn or dispatched until it has
+	bool resourcesWritten(uint32_t matId);
+
+	//rewrites every descriptor that samples texId, for when the texture's image or view has been recreated
+	void patchImageDescriptors(uint32_t texId);
+
 	void setGlobalFloat(const char* name, float data);
 	void setGlobalVector4(const char* name, glm::vec4& data);
 	void setGlobalVector2(const char* name, glm::vec2& data);
+	void setGlobalMatrix(const char* name, glm::mat4& data);
 
+	//the view projection matrix shaders see, culling needs the same one
+	const glm::mat4& getGlobalViewMatrix();
+
+	//destroys the global uniform buffer and default sampler, after every material that uses them is gone
 	void destroy();
+
+	//frees everything the material owns except its descriptor sets, which stay allocated until the pool is destroyed
+	void destroy(uint32_t matId);
 }
\ No newline at end of file
@@ -6,9 +6,13 @@
 #include "asset_rdata_types.h"
 #include "vkh_initializers.h"
 #include "vkh.h"
+#include "vkh_allocator_pool.h"
 #include "hash.h"
 #include "mesh.h"
 #include "texture.h"
+#include "arena.h"
+#include "frame_allocator.h"
+#include "pipeline_compiler.h"
 #include <vector>
 #include <algorithm>
 #include <map>
@@ -20,16 +24,129 @@ namespace Material
 {
 	InputType stringToInputType(const char* str);
 	ShaderStage stringToShaderStage(const char* str);
+	EVertexLayout stringToVertexLayout(const char* str)
+	{
+		if (!strcmp(str, "full")) return EVertexLayout::Full;
+		if (!strcmp(str, "compact")) return EVertexLayout::Compact;
+
+		checkf(0, "Could not parse vertex layout when loading material");
+		return EVertexLayout::Count;
+	}
+
+	VkPrimitiveTopology stringToTopology(const char* str)
+	{
+		if (!strcmp(str, "triangle_list")) return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		if (!strcmp(str, "triangle_strip")) return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+		if (!strcmp(str, "line_list")) return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+		if (!strcmp(str, "line_strip")) return VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
+		if (!strcmp(str, "point_list")) return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+
+		checkf(0, "Could not parse topology when loading material");
+		return VK_PRIMITIVE_TOPOLOGY_MAX_ENUM;
+	}
+
+	VkPolygonMode stringToPolygonMode(const char* str)
+	{
+		if (!strcmp(str, "fill")) return VK_POLYGON_MODE_FILL;
+		if (!strcmp(str, "line")) return VK_POLYGON_MODE_LINE;
+		if (!strcmp(str, "point")) return VK_POLYGON_MODE_POINT;
+
+		checkf(0, "Could not parse polygon mode when loading material");
+		return VK_POLYGON_MODE_MAX_ENUM;
+	}
+
+	VkCullModeFlags stringToCullMode(const char* str)
+	{
+		if (!strcmp(str, "none")) return VK_CULL_MODE_NONE;
+		if (!strcmp(str, "back")) return VK_CULL_MODE_BACK_BIT;
+		if (!strcmp(str, "front")) return VK_CULL_MODE_FRONT_BIT;
+
+		checkf(0, "Could not parse cull mode when loading material");
+		return VK_CULL_MODE_FLAG_BITS_MAX_ENUM;
+	}
+
+	VkFrontFace stringToFrontFace(const char* str)
+	{
+		if (!strcmp(str, "ccw")) return VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		if (!strcmp(str, "cw")) return VK_FRONT_FACE_CLOCKWISE;
+
+		checkf(0, "Could not parse front face when loading material");
+		return VK_FRONT_FACE_MAX_ENUM;
+	}
+
+	VkCompareOp stringToCompareOp(const char* str)
+	{
+		if (!strcmp(str, "never")) return VK_COMPARE_OP_NEVER;
+		if (!strcmp(str, "less")) return VK_COMPARE_OP_LESS;
+		if (!strcmp(str, "equal")) return VK_COMPARE_OP_EQUAL;
+		if (!strcmp(str, "less_equal")) return VK_COMPARE_OP_LESS_OR_EQUAL;
+		if (!strcmp(str, "greater")) return VK_COMPARE_OP_GREATER;
+		if (!strcmp(str, "not_equal")) return VK_COMPARE_OP_NOT_EQUAL;
+		if (!strcmp(str, "greater_equal")) return VK_COMPARE_OP_GREATER_OR_EQUAL;
+		if (!strcmp(str, "always")) return VK_COMPARE_OP_ALWAYS;
+
+		checkf(0, "Could not parse depth compare op when loading material");
+		return VK_COMPARE_OP_MAX_ENUM;
+	}
+
+	PipelineCompiler::EBlendMode stringToBlendMode(const char* str)
+	{
+		if (!strcmp(str, "opaque")) return PipelineCompiler::EBlendMode::Opaque;
+		if (!strcmp(str, "alpha")) return PipelineCompiler::EBlendMode::Alpha;
+		if (!strcmp(str, "additive")) return PipelineCompiler::EBlendMode::Additive;
+
+		checkf(0, "Could not parse blend mode when loading material");
+		return PipelineCompiler::EBlendMode::Count;
+	}
+
+	//the bindings a material is made from, split up by how they're stored
+	typedef Array<const DescriptorSetBinding*> BindingList;
+
 	const char* shaderExtensionForStage(ShaderStage stage);
 	const char* shaderReflExtensionForStage(ShaderStage stage);
-	VkShaderStageFlags shaderStageVectorToVkEnum(std::vector<ShaderStage>& vec);
+	VkShaderStageFlags shaderStageVectorToVkEnum(const ShaderStageArray& vec);
 	VkShaderStageFlagBits shaderStageEnumToVkEnum(ShaderStage stage);
 	VkDescriptorType inputTypeEnumToVkEnum(InputType type);
 
+	SpecConstantType stringToSpecConstantType(const char* str)
+	{
+		if (!strcmp(str, "float")) return SpecConstantType::FLOAT;
+		if (!strcmp(str, "int")) return SpecConstantType::INT;
+		if (!strcmp(str, "uint")) return SpecConstantType::UINT;
+		if (!strcmp(str, "bool")) return SpecConstantType::BOOL;
+
+		checkf(0, "Could not parse specialization constant type from reflection file");
+		return SpecConstantType::MAX;
+	}
+
+	//values from the material file and static uniform defaults both show up as numbers, this turns them into what the shader expects
+	uint32_t specConstantBits(double value, SpecConstantType type)
+	{
+		uint32_t bits = 0;
+		float f = static_cast<float>(value);
+
+		switch (type)
+		{
+		case SpecConstantType::FLOAT: memcpy(&bits, &f, sizeof(bits)); break;
+		case SpecConstantType::INT: bits = static_cast<uint32_t>(static_cast<int32_t>(value)); break;
+		case SpecConstantType::UINT: bits = static_cast<uint32_t>(value); break;
+		case SpecConstantType::BOOL: bits = value != 0.0 ? VK_TRUE : VK_FALSE; break;
+		default: checkf(0, "Invalid specialization constant type");
+		}
+
+		return bits;
+	}
+
 	InputType stringToInputType(const char* str)
 	{
 		if (!strcmp(str,"UNIFORM")) return InputType::UNIFORM;
 		if (!strcmp(str,"SAMPLER")) return InputType::SAMPLER;
+		if (!strcmp(str,"STORAGE_BUFFER")) return InputType::STORAGE_BUFFER;
+		if (!strcmp(str,"STORAGE_IMAGE")) return InputType::STORAGE_IMAGE;
+		if (!strcmp(str,"UNIFORM_TEXEL_BUFFER")) return InputType::UNIFORM_TEXEL_BUFFER;
+		if (!strcmp(str,"STORAGE_TEXEL_BUFFER")) return InputType::STORAGE_TEXEL_BUFFER;
+		if (!strcmp(str,"SEPARATE_IMAGE")) return InputType::SEPARATE_IMAGE;
+		if (!strcmp(str,"SEPARATE_SAMPLER")) return InputType::SEPARATE_SAMPLER;
 		 
 		checkf(0, "trying to convert an invalid string to input type");
 		return InputType::MAX;
@@ -39,6 +156,7 @@ namespace Material
 	{
 		if (!strcmp(str,"vertex")) return ShaderStage::VERTEX;
 		if (!strcmp(str,"fragment")) return ShaderStage::FRAGMENT;
+		if (!strcmp(str,"compute")) return ShaderStage::COMPUTE;
 
 		checkf(0, "Could not parse shader stage from input string when loading material");
 		return ShaderStage::MAX;
@@ -48,6 +166,7 @@ namespace Material
 	{
 		if (stage == ShaderStage::VERTEX) return ".vert.spv";
 		if (stage == ShaderStage::FRAGMENT) return ".frag.spv";
+		if (stage == ShaderStage::COMPUTE) return ".comp.spv";
 
 		checkf(0, "Unsupported shader stage passed to function");
 		return "";
@@ -57,12 +176,13 @@ namespace Material
 	{
 		if (stage == ShaderStage::VERTEX) return ".vert.refl";
 		if (stage == ShaderStage::FRAGMENT) return ".frag.refl";
+		if (stage == ShaderStage::COMPUTE) return ".comp.refl";
 
 		checkf(0, "Unsupported shader stage passed to function");
 		return "";
 	}
 
-	VkShaderStageFlags shaderStageVectorToVkEnum(std::vector<ShaderStage>& vec)
+	VkShaderStageFlags shaderStageVectorToVkEnum(const ShaderStageArray& vec)
 	{
 		checkf(vec.size() > 0, "Trying to convert vector of ShaderStages to Vk Enums, but input vector is empty");
 		VkShaderStageFlags outBits = shaderStageEnumToVkEnum(vec[0]);
@@ -80,6 +200,7 @@ namespace Material
 
 		if (stage == ShaderStage::VERTEX) outBits = static_cast<VkShaderStageFlagBits>(outBits | VK_SHADER_STAGE_VERTEX_BIT);
 		if (stage == ShaderStage::FRAGMENT) outBits = static_cast<VkShaderStageFlagBits>(outBits | VK_SHADER_STAGE_FRAGMENT_BIT);
+		if (stage == ShaderStage::COMPUTE) outBits = static_cast<VkShaderStageFlagBits>(outBits | VK_SHADER_STAGE_COMPUTE_BIT);
 
 		checkf((int)outBits > 0, "Error converting ShaderStage to VK Enum");
 		return outBits;
@@ -89,6 +210,12 @@ namespace Material
 	{
 		if (type == InputType::SAMPLER) return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		if (type == InputType::UNIFORM) return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		if (type == InputType::STORAGE_BUFFER) return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		if (type == InputType::STORAGE_IMAGE) return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		if (type == InputType::UNIFORM_TEXEL_BUFFER) return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		if (type == InputType::STORAGE_TEXEL_BUFFER) return VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+		if (type == InputType::SEPARATE_IMAGE) return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		if (type == InputType::SEPARATE_SAMPLER) return VK_DESCRIPTOR_TYPE_SAMPLER;
 
 		checkf(0, "trying to use an unsupported descriptor type in a material");
 		return VK_DESCRIPTOR_TYPE_MAX_ENUM;
@@ -102,6 +229,13 @@ namespace Material
 	}
 
 
+	//everything other than uniform blocks and combined samplers sits outside the static / dynamic
+	//uniform machinery, and is bound through the material's resourceBindings instead
+	bool isResourceInput(InputType type)
+	{
+		return type != InputType::UNIFORM && type != InputType::SAMPLER;
+	}
+
 	bool IsDynamicInput(DescriptorSetBinding binding)
 	{
 		return binding.set == 3;
@@ -123,8 +257,72 @@ namespace Material
 		checkf(!materialDoc.HasParseError(), "Error parsing material file");
 		free((void*)materialString);
 
+		//materials that don't say otherwise take full float vertices
+		if (materialDoc.HasMember("vertexLayout"))
+		{
+			materialDef.vertexLayout = stringToVertexLayout(materialDoc["vertexLayout"].GetString());
+		}
+
+		if (materialDoc.HasMember("deferPipeline"))
+		{
+			materialDef.deferPipeline = materialDoc["deferPipeline"].GetBool();
+		}
+
+		if (materialDoc.HasMember("specializeFromStaticUniforms"))
+		{
+			materialDef.specializeFromStaticUniforms = materialDoc["specializeFromStaticUniforms"].GetBool();
+		}
+
+		//"keywords": ["FOG", "TINT"] - ShaderPipeline needs to be pointed at the material folder to build their variants
+		if (materialDoc.HasMember("keywords"))
+		{
+			const Value& keywords = materialDoc["keywords"];
+			checkf(keywords.Size() <= MAX_MATERIAL_KEYWORDS, "Material has too many keywords");
+
+			for (SizeType i = 0; i < keywords.Size(); ++i)
+			{
+				const char* keyword = keywords[i].GetString();
+				checkf(strlen(keyword) < sizeof(materialDef.keywords[0]) && !strstr(keyword, "__"), "Material keyword %s is too long or contains \"__\"", keyword);
+				snprintf(materialDef.keywords[materialDef.numKeywords++], sizeof(materialDef.keywords[0]), "%s", keyword);
+			}
+		}
+
+		/*
+		render state is optional, and so is everything in it. Anything left out keeps its default: 
+
+		"renderState":
+		{
+			"topology": "triangle_list",
+			"polygonMode": "fill",
+			"cullMode": "back",
+			"frontFace": "ccw",
+			"depthTest": true,
+			"depthWrite": true,
+			"depthCompare": "less",
+			"blend": "opaque"
+		}
+		*/
+
+		materialDef.renderState = PipelineCompiler::defaultRenderState();
+		if (materialDoc.HasMember("renderState"))
+		{
+			const Value& rsValue = materialDoc["renderState"];
+			PipelineCompiler::RenderState& rs = materialDef.renderState;
+
+			if (rsValue.HasMember("topology")) rs.topology = stringToTopology(rsValue["topology"].GetString());
+			if (rsValue.HasMember("polygonMode")) rs.polygonMode = stringToPolygonMode(rsValue["polygonMode"].GetString());
+			if (rsValue.HasMember("cullMode")) rs.cullMode = stringToCullMode(rsValue["cullMode"].GetString());
+			if (rsValue.HasMember("frontFace")) rs.frontFace = stringToFrontFace(rsValue["frontFace"].GetString());
+			if (rsValue.HasMember("depthTest")) rs.depthTest = rsValue["depthTest"].GetBool() ? VK_TRUE : VK_FALSE;
+			if (rsValue.HasMember("depthWrite")) rs.depthWrite = rsValue["depthWrite"].GetBool() ? VK_TRUE : VK_FALSE;
+			if (rsValue.HasMember("depthCompare")) rs.depthCompare = stringToCompareOp(rsValue["depthCompare"].GetString());
+			if (rsValue.HasMember("blend")) rs.blend = stringToBlendMode(rsValue["blend"].GetString());
+
+			checkf(rs.polygonMode == VK_POLYGON_MODE_FILL || vkh::GContext.gpu.features.fillModeNonSolid, "Material uses a line / point polygon mode, which this gpu doesn't support");
+		}
+
 		const Value& shaders = materialDoc["shaders"];
-		materialDef.stages.reserve(shaders.Size());
+		array::reserve(materialDef.stages, shaders.Size());
 
 		/*
 		this will iterate over each shader in a material file
@@ -151,7 +349,7 @@ namespace Material
 			printfErr = snprintf(stageDef.shaderPath, sizeof(stageDef.shaderPath), "%s%s%s", generatedShaderPath, matStage["shader"].GetString(), shaderExtensionForStage(stageDef.stage));
 			checkf(printfErr > -1, "");
 
-			materialDef.stages.push_back(stageDef);
+			array::push_back(materialDef.stages, stageDef);
 
 			//now we need to get information about the layout of the shader inputs
 			//this isn't necessarily known when writing a material file, so we have to 
@@ -193,12 +391,29 @@ namespace Material
 			materialDef.numStaticTextures += reflDoc["num_static_textures"].GetInt();
 			materialDef.numStaticUniforms += reflDoc["num_static_uniforms"].GetInt();
 
+			//older reflection files won't have these
+			if (reflDoc.HasMember("num_storage_buffers"))
+			{
+				materialDef.numStorageBuffers += reflDoc["num_storage_buffers"].GetInt();
+			}
+
+			if (stageDef.stage == ShaderStage::COMPUTE)
+			{
+				checkf(shaders.Size() == 1, "Compute materials can only have a single compute stage");
+				checkf(reflDoc.HasMember("workgroup_size"), "Compute shader reflection is missing a workgroup size, rebuild shaders");
+
+				for (SizeType w = 0; w < 3; ++w)
+				{
+					materialDef.workgroupSize[w] = reflDoc["workgroup_size"][w].GetInt();
+				}
+			}
+
 			for (SizeType setIdx = 0; setIdx < reflDoc["static_sets"].Size(); setIdx++)
 			{
 				uint32_t set = reflDoc["static_sets"][setIdx].GetInt();
 				if (std::find(materialDef.staticSets.begin(), materialDef.staticSets.end(), set) == materialDef.staticSets.end())
 				{
-					materialDef.staticSets.push_back(reflDoc["static_sets"][setIdx].GetInt());
+					array::push_back(materialDef.staticSets, set);
 				}
 			}
 
@@ -207,7 +422,7 @@ namespace Material
 				uint32_t set = reflDoc["global_sets"][setIdx].GetInt();
 				if (std::find(materialDef.globalSets.begin(), materialDef.globalSets.end(), set) == materialDef.globalSets.end())
 				{
-					materialDef.globalSets.push_back(reflDoc["global_sets"][setIdx].GetInt());
+					array::push_back(materialDef.globalSets, set);
 				}
 			}
 			
@@ -217,7 +432,7 @@ namespace Material
 
 				if (std::find(materialDef.dynamicSets.begin(), materialDef.dynamicSets.end(), set) == materialDef.dynamicSets.end())
 				{
-					materialDef.dynamicSets.push_back(reflDoc["dynamic_sets"][setIdx].GetInt());
+					array::push_back(materialDef.dynamicSets, set);
 				}
 			}
 
@@ -227,7 +442,7 @@ namespace Material
 
 				checkf(materialDef.pcBlock.sizeBytes == 0 || materialDef.pcBlock.sizeBytes == pushConstants["size"].GetInt(), "Error loading material: multiple stages use push constant block but expect block of different size");
 
-				materialDef.pcBlock.owningStages.push_back(stageDef.stage);
+				array::push_back(materialDef.pcBlock.owningStages, stageDef.stage);
 				materialDef.pcBlock.sizeBytes = pushConstants["size"].GetInt();
 
 				const Value& elements = pushConstants["elements"];
@@ -257,7 +472,58 @@ namespace Material
 					//we might already have info about this block member. 
 					if (!memberAlreadyExists)
 					{
-						materialDef.pcBlock.blockMembers.push_back(mem);
+						array::push_back(materialDef.pcBlock.blockMembers, mem);
+					}
+				}
+			}
+
+			//specialization constants start out with the shader's value, a default in the material with the same name (a number,
+			//a bool, or an array with one number like uniform members) overrides it. Older reflection files won't have these
+			if (reflDoc.HasMember("specialization_constants"))
+			{
+				const Value& reflSpecConstants = reflDoc["specialization_constants"];
+
+				for (SizeType scIdx = 0; scIdx < reflSpecConstants.Size(); ++scIdx)
+				{
+					const Value& reflSpec = reflSpecConstants[scIdx];
+					checkf(reflSpec["name"].GetStringLength() < 31, "specialization constant names must be less than 32 characters");
+
+					uint32_t constantId = reflSpec["constant_id"].GetUint();
+					SpecConstantType type = stringToSpecConstantType(reflSpec["type"].GetString());
+
+					SpecConstant* sc = nullptr;
+					for (SpecConstant& existing : materialDef.specConstants)
+					{
+						if (!strcmp(existing.name, reflSpec["name"].GetString())) sc = &existing;
+					}
+
+					if (sc)
+					{
+						checkf(sc->constantId == constantId && sc->type == type, "A specialization constant is shared between stages but each stage declares it differently");
+					}
+					else
+					{
+						SpecConstant newConstant = {};
+						snprintf(newConstant.name, sizeof(newConstant.name), "%s", reflSpec["name"].GetString());
+						newConstant.constantId = constantId;
+						newConstant.type = type;
+						newConstant.value = reflSpec["default"].GetUint();
+
+						array::push_back(materialDef.specConstants, std::move(newConstant));
+						sc = &materialDef.specConstants[materialDef.specConstants.size() - 1];
+					}
+
+					array::push_back(sc->owningStages, stageDef.stage);
+
+					for (uint32_t d = 0; d < blocksWithDefaultsPresent.size(); ++d)
+					{
+						if (blocksWithDefaultsPresent[d] != hash(sc->name)) continue;
+
+						const Value& defaultValue = matStage["defaults"][d]["value"];
+						const Value& number = defaultValue.IsArray() ? defaultValue[0] : defaultValue;
+
+						sc->value = specConstantBits(number.IsBool() ? (number.GetBool() ? 1.0 : 0.0) : number.GetDouble(), sc->type);
+						sc->valueFromMaterial = true;
 					}
 				}
 			}
@@ -282,7 +548,11 @@ namespace Material
 					descSetBindingDef.binding = currentInputFromReflData["binding"].GetInt();
 					descSetBindingDef.type = stringToInputType(currentInputFromReflData["type"].GetString());
 
-					if (std::find(materialDef.staticSets.begin(), materialDef.staticSets.end(), descSetBindingDef.set) != materialDef.staticSets.end())
+					if (isResourceInput(descSetBindingDef.type))
+					{
+						//these don't take up any of the uniform memory, see make()
+					}
+					else if (std::find(materialDef.staticSets.begin(), materialDef.staticSets.end(), descSetBindingDef.set) != materialDef.staticSets.end())
 					{
 						materialDef.staticSetsSize += descSetBindingDef.sizeBytes;
 					}
@@ -302,7 +572,7 @@ namespace Material
 							{
 								checkf(descSetItem.sizeBytes == descSetBindingDef.sizeBytes, "A DescriptorSet binding is shared between stages but each stage expects a different size");
 								checkf(descSetItem.type == descSetBindingDef.type, "A DescriptorSet binding is shared between stages but each stage expects a different type");
-								descSetItem.owningStages.push_back(stageDef.stage);
+								array::push_back(descSetItem.owningStages, stageDef.stage);
 								alreadyExists = true;
 							}
 						}
@@ -311,7 +581,7 @@ namespace Material
 					//if not, we have to create it
 					if (!alreadyExists)
 					{
-						descSetBindingDef.owningStages.push_back(stageDef.stage);
+						array::push_back(descSetBindingDef.owningStages, stageDef.stage);
 
 						checkf(currentInputFromReflData["name"].GetStringLength() < 31, "opaque block names must be less than 32 characters");
 						snprintf(descSetBindingDef.name, sizeof(descSetBindingDef.name), "%s", currentInputFromReflData["name"].GetString());
@@ -337,7 +607,7 @@ namespace Material
 
 							checkf(reflBlockMember["name"].GetStringLength() < 31, "opaque block member names must be less than 32 characters");
 							snprintf(mem.name, sizeof(mem.name), "%s", reflBlockMember["name"].GetString());
-							descSetBindingDef.blockMembers.push_back(mem);
+							array::push_back(descSetBindingDef.blockMembers, mem);
 						}
 
 						//if the block member has a default defined in the material
@@ -348,12 +618,21 @@ namespace Material
 							const Value& arrayOfDefaultValuesFromMaterial = matStage["defaults"];
 							const Value& defaultItem = arrayOfDefaultValuesFromMaterial[blockDefaultsIndex];
 
-							if (descSetBindingDef.type == InputType::SAMPLER)
+							if (descSetBindingDef.type == InputType::SAMPLER || descSetBindingDef.type == InputType::SEPARATE_IMAGE)
 							{
 								const Value& defaultValue = defaultItem["value"];
 								snprintf(descSetBindingDef.defaultValue, sizeof(descSetBindingDef.defaultValue), "%s", defaultValue.GetString());
 							}
-							else
+							else if (descSetBindingDef.type == InputType::STORAGE_BUFFER)
+							{
+								//a buffer ending in a runtime array reflects as just its fixed size header, 
+								//so the material has to say how big it really is
+								if (defaultItem.HasMember("size"))
+								{
+									descSetBindingDef.sizeBytes = getGPUAlignedSize(defaultItem["size"].GetInt());
+								}
+							}
+							else if (descSetBindingDef.type == InputType::UNIFORM)
 							{
 								const Value& defaultBlockMembers = defaultItem["members"];
 
@@ -385,7 +664,7 @@ namespace Material
 						}
 
 						//finally, add our bindingDef to the material, and continue to the next input in the reflection file 
-						materialDef.descSets[descSetBindingDef.set].push_back(descSetBindingDef);
+						array::push_back(materialDef.descSets[descSetBindingDef.set], std::move(descSetBindingDef));
 
 					}
 
@@ -394,21 +673,63 @@ namespace Material
 			}
 		}
 
+		//static uniform values are known now and can't change later, so they're safe to bake into the pipeline
+		if (materialDef.specializeFromStaticUniforms)
+		{
+			for (SpecConstant& sc : materialDef.specConstants)
+			{
+				if (sc.valueFromMaterial) continue;
+
+				for (uint32_t set : materialDef.staticSets)
+				{
+					for (const DescriptorSetBinding& binding : materialDef.descSets[set])
+					{
+						if (binding.type != InputType::UNIFORM) continue;
+
+						for (const BlockMember& mem : binding.blockMembers)
+						{
+							if (mem.size != sizeof(float) || strcmp(mem.name, sc.name)) continue;
+							sc.value = specConstantBits(*reinterpret_cast<const float*>(mem.defaultValue), sc.type);
+						}
+					}
+				}
+			}
+		}
+
 		return materialDef;
 	}
 
-	uint32_t createBuffersForDescriptorSetBindingArray(std::vector<DescriptorSetBinding*>& input, VkBuffer* dst, VkMemoryPropertyFlags memFlags)
+	PipelineCompiler::SpecConstants specConstantsForStage(const Definition& def, ShaderStage stage)
+	{
+		PipelineCompiler::SpecConstants out = {};
+
+		for (const SpecConstant& sc : def.specConstants)
+		{
+			if (std::find(sc.owningStages.begin(), sc.owningStages.end(), stage) == sc.owningStages.end()) continue;
+
+			checkf(out.count < PipelineCompiler::MAX_SPEC_CONSTANTS, "Too many specialization constants in one stage");
+			out.ids[out.count] = sc.constantId;
+			out.values[out.count++] = sc.value;
+		}
+
+		return out;
+	}
+
+	//transfer src is only needed so the defragmenter can copy out of these
+	const VkBufferUsageFlags UNIFORM_BUFFER_USAGE = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	uint32_t createBuffersForDescriptorSetBindingArray(const BindingList& input, VkBuffer* dst, VkMemoryPropertyFlags memFlags)
 	{
 		uint32_t curBuffer = 0;
 		VkMemoryRequirements memRequirements;
 
-		for (DescriptorSetBinding* binding : input)
+		for (const DescriptorSetBinding* binding : input)
 		{
 			if (binding->type == InputType::UNIFORM)
 			{
 				vkh::createBuffer(dst[curBuffer],
 					binding->sizeBytes,
-					VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					UNIFORM_BUFFER_USAGE,
 					memFlags);
 
 				vkGetBufferMemoryRequirements(vkh::GContext.device, dst[curBuffer], &memRequirements);
@@ -429,8 +750,9 @@ namespace Material
 			VkMemoryRequirements memRequirements;
 			vkGetBufferMemoryRequirements(vkh::GContext.device, buffers[0], &memRequirements);
 
-			vkh::AllocationCreateInfo createInfo;
+			vkh::AllocationCreateInfo createInfo = {};
 			createInfo.size = size;
+			createInfo.alignment = memRequirements.alignment;
 			createInfo.memoryTypeIndex = vkh::getMemoryType(vkh::GContext.gpu.device, memRequirements.memoryTypeBits, memFlags);
 			createInfo.usage = memFlags;
 			vkh::allocateDeviceMemory(dst,createInfo );
@@ -438,7 +760,7 @@ namespace Material
 
 	}
 
-	void fillBuffersWithDefaultValues(VkBuffer* buffers, uint32_t dataSize, char* defaultData, std::vector<DescriptorSetBinding*> bindings)
+	void fillBuffersWithDefaultValues(VkBuffer* buffers, uint32_t dataSize, char* defaultData, const BindingList& bindings)
 	{
 		if (dataSize <= 0) return;
 
@@ -451,19 +773,15 @@ namespace Material
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-		void* mappedStagingBuffer;
-		vkMapMemory(vkh::GContext.device, stagingMemory.handle, stagingMemory.offset, dataSize, 0, &mappedStagingBuffer);
-
-		memset(mappedStagingBuffer, 0, dataSize);
-		memcpy(mappedStagingBuffer, defaultData, dataSize);
+		memset(stagingMemory.mapped, 0, dataSize);
+		memcpy(stagingMemory.mapped, defaultData, dataSize);
 
-		vkUnmapMemory(vkh::GContext.device, stagingMemory.handle);
 		vkh::VkhCommandBuffer scratch = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Transfer);
 
 		uint32_t curBuffer = 0;
 		uint32_t bufferOffset = 0;
 
-		for (DescriptorSetBinding* binding : bindings)
+		for (const DescriptorSetBinding* binding : bindings)
 		{
 			if (binding->type == InputType::UNIFORM)
 			{
@@ -477,13 +795,15 @@ namespace Material
 		vkh::freeDeviceMemory(stagingMemory);
 	}
 	
-	void collectDefaultValuesIntoBufferAndBuildLayout(char* outBuffer, std::vector<DescriptorSetBinding*> bindings, std::vector<uint32_t>* optionalOutLayout = nullptr)
+	//the layout has to be big enough for 4 entries per uniform block member and per image, returns how many were written
+	uint32_t collectDefaultValuesIntoBufferAndBuildLayout(char* outBuffer, const BindingList& bindings, uint32_t* optionalOutLayout = nullptr)
 	{
+		uint32_t layoutSize = 0;
 		uint32_t bufferOffset = 0;
 		uint32_t curBuffer = 0; //need this number to know the index into our VkBuffer array that a uniform block will be
 		uint32_t curImage = 0;
 		uint32_t total = 0; //eed this number to know the index into the descriptor set write array our image will be
-		for (DescriptorSetBinding* binding : bindings)
+		for (const DescriptorSetBinding* binding : bindings)
 		{
 			if (binding->type == InputType::UNIFORM)
 			{
@@ -492,10 +812,10 @@ namespace Material
 				{
 					if (optionalOutLayout)
 					{
-						optionalOutLayout->push_back(hash(binding->blockMembers[k].name));
-						optionalOutLayout->push_back(curBuffer);
-						optionalOutLayout->push_back(binding->blockMembers[k].size);
-						optionalOutLayout->push_back(binding->blockMembers[k].offset);
+						optionalOutLayout[layoutSize++] = hash(binding->blockMembers[k].name);
+						optionalOutLayout[layoutSize++] = curBuffer;
+						optionalOutLayout[layoutSize++] = binding->blockMembers[k].size;
+						optionalOutLayout[layoutSize++] = binding->blockMembers[k].offset;
 					}
 					memcpy(&outBuffer[0] + bufferOffset + binding->blockMembers[k].offset, binding->blockMembers[k].defaultValue, binding->blockMembers[k].size);
 				}
@@ -504,21 +824,23 @@ namespace Material
 			}
 			else if (optionalOutLayout)
 			{
-				optionalOutLayout->push_back(hash(binding->name));
-				optionalOutLayout->push_back(curImage++);
-				optionalOutLayout->push_back(total);
-				optionalOutLayout->push_back(0);
+				optionalOutLayout[layoutSize++] = hash(binding->name);
+				optionalOutLayout[layoutSize++] = curImage++;
+				optionalOutLayout[layoutSize++] = total;
+				optionalOutLayout[layoutSize++] = 0;
 			}
 			total++;
 
 		}
+
+		return layoutSize;
 	}
 
-	void bindBuffersToMemory(vkh::Allocation& memoryToBind, VkBuffer* buffers,std::vector<DescriptorSetBinding*> bindings)
+	void bindBuffersToMemory(vkh::Allocation& memoryToBind, VkBuffer* buffers, const BindingList& bindings)
 	{
 		uint32_t bufferOffset = memoryToBind.offset;
 		uint32_t curBuffer = 0;
-		for (DescriptorSetBinding* binding : bindings)
+		for (const DescriptorSetBinding* binding : bindings)
 		{
 			if (binding->type == InputType::UNIFORM)
 			{
@@ -528,37 +850,285 @@ namespace Material
 		}
 	}
 
-	void make(uint32_t id, Definition def)
+	void onUniformMemoryRelocated(void* userData, const vkh::allocators::pool::Relocation& relocation)
+	{
+		MaterialRenderData& rData = *(MaterialRenderData*)userData;
+
+		bool isStatic = relocation.oldMemory.handle == rData.staticUniformMem.handle && relocation.oldMemory.offset == rData.staticUniformMem.offset;
+		vkh::Allocation& mem = isStatic ? rData.staticUniformMem : rData.dynamic.uniformMem;
+		VkBuffer* buffers = isStatic ? rData.staticBuffers : rData.dynamic.buffers;
+		BufferDescriptorBinding* bindings = isStatic ? rData.staticBufferBindings : rData.dynamic.bufferBindings;
+
+		mem = relocation.newMemory;
+
+		//this runs mid frame when the defragmenter moves things, so it shouldn't touch the heap
+		frame::Vector<VkDescriptorBufferInfo> bufferInfos;
+		frame::Vector<VkWriteDescriptorSet> writes;
+		bufferInfos.resize(relocation.resourceCount);
+		writes.resize(relocation.resourceCount);
+
+		for (uint32_t i = 0; i < relocation.resourceCount; ++i)
+		{
+			buffers[i] = relocation.newResources[i].buffer;
+
+			bufferInfos[i].buffer = buffers[i];
+			bufferInfos[i].offset = 0;
+			bufferInfos[i].range = bindings[i].range;
+
+			writes[i] = {};
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = bindings[i].set;
+			writes[i].dstBinding = bindings[i].binding;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			writes[i].descriptorCount = 1;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(vkh::GContext.device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+	}
+
+	void registerUniformMemoryForRelocation(MaterialRenderData& rData, vkh::Allocation& mem, VkBuffer* buffers, const BindingList& bindings)
+	{
+		frame::Vector<vkh::allocators::pool::RelocatableResource> resources;
+
+		uint32_t bufferOffset = 0;
+		for (const DescriptorSetBinding* binding : bindings)
+		{
+			if (binding->type == InputType::UNIFORM)
+			{
+				vkh::allocators::pool::RelocatableResource res = {};
+				res.buffer = buffers[resources.size()];
+				res.bufferUsage = UNIFORM_BUFFER_USAGE;
+				res.bufferSize = binding->sizeBytes;
+				res.bufferOffset = bufferOffset;
+				resources.push_back(res);
+
+				bufferOffset += binding->sizeBytes;
+			}
+		}
+
+		if (resources.size() > 0)
+		{
+			vkh::allocators::pool::registerRelocatable(mem, resources.data(), (uint32_t)resources.size(), onUniformMemoryRelocated, &rData);
+		}
+	}
+
+	//storage buffers are written by shaders, so they start zeroed instead of taking defaults from the material
+	const VkBufferUsageFlags STORAGE_BUFFER_USAGE = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	void createStorageBuffers(MaterialRenderData& rData, const BindingList& resourceBindings)
+	{
+		BindingList bindings(frame::arrayAllocator());
+		for (const DescriptorSetBinding* binding : resourceBindings)
+		{
+			if (binding->type == InputType::STORAGE_BUFFER) array::push_back(bindings, binding);
+		}
+
+		rData.numStorageBuffers = static_cast<uint32_t>(bindings.size());
+		if (rData.numStorageBuffers == 0) return;
+
+		//every buffer lives in one allocation, at offsets that satisfy each buffer's alignment
+		frame::Vector<VkDeviceSize> offsets;
+		VkDeviceSize totalSize = 0;
+
+		for (uint32_t i = 0; i < rData.numStorageBuffers; ++i)
+		{
+			checkf(bindings[i]->sizeBytes > 0, "Storage buffer %s has no size, give it one with a \"size\" default in the material", bindings[i]->name);
+			vkh::createBuffer(rData.storageBuffers[i], bindings[i]->sizeBytes, STORAGE_BUFFER_USAGE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			VkMemoryRequirements memRequirements;
+			vkGetBufferMemoryRequirements(vkh::GContext.device, rData.storageBuffers[i], &memRequirements);
+
+			totalSize = (totalSize + memRequirements.alignment - 1) / memRequirements.alignment * memRequirements.alignment;
+			offsets.push_back(totalSize);
+			totalSize += memRequirements.size;
+		}
+
+		allocateDeviceMemoryForBuffers(rData.storageMem, totalSize, rData.storageBuffers, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		//fill buffer isn't guaranteed to work on a transfer queue, so this goes through the graphics pool
+		vkh::VkhCommandBuffer scratch = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Graphics);
+		for (uint32_t i = 0; i < rData.numStorageBuffers; ++i)
+		{
+			vkBindBufferMemory(vkh::GContext.device, rData.storageBuffers[i], rData.storageMem.handle, rData.storageMem.offset + offsets[i]);
+			vkCmdFillBuffer(scratch.buffer, rData.storageBuffers[i], 0, VK_WHOLE_SIZE, 0);
+		}
+		vkh::submitScratchCommandBuffer(scratch);
+	}
+
+	//how many of each thing a material's render data needs to hold
+	struct RenderDataCounts
+	{
+		uint32_t layouts;
+		uint32_t pushConstantMembers;
+		uint32_t pushConstantSize;
+		uint32_t staticUniforms;
+		uint32_t dynamicUniforms;
+		uint32_t dynamicLayout;
+		uint32_t dynamicWrites;
+		uint32_t imageBindings;
+		uint32_t storageBuffers;
+		uint32_t resourceBindings;
+		uint32_t variantKeys;
+	};
+
+	RenderDataCounts countRenderData(const Definition& def, const BindingList& staticBindings, const BindingList& dynamicBindings, const BindingList& resourceBindings)
+	{
+		RenderDataCounts counts = {};
+
+		//set layouts can't have gaps, so every set up to the highest one gets one
+		counts.layouts = def.descSets.size() > 0 ? def.descSets.rbegin()->first + 1 : 0;
+		counts.pushConstantMembers = static_cast<uint32_t>(def.pcBlock.blockMembers.size());
+		counts.pushConstantSize = def.pcBlock.sizeBytes;
+
+		for (const DescriptorSetBinding* binding : staticBindings)
+		{
+			if (binding->type == InputType::UNIFORM) counts.staticUniforms++;
+			else counts.imageBindings++;
+		}
+
+		//the dynamic layout has an entry per uniform block member, and one per image
+		for (const DescriptorSetBinding* binding : dynamicBindings)
+		{
+			if (binding->type == InputType::UNIFORM)
+			{
+				counts.dynamicUniforms++;
+				counts.dynamicLayout += static_cast<uint32_t>(binding->blockMembers.size()) * 4;
+			}
+			else
+			{
+				counts.imageBindings++;
+				counts.dynamicLayout += 4;
+			}
+		}
+		counts.dynamicWrites = static_cast<uint32_t>(dynamicBindings.size());
+
+		for (const DescriptorSetBinding* binding : resourceBindings)
+		{
+			if (binding->type == InputType::STORAGE_BUFFER) counts.storageBuffers++;
+			if (binding->type == InputType::SEPARATE_IMAGE) counts.imageBindings++;
+		}
+		counts.resourceBindings = static_cast<uint32_t>(resourceBindings.size());
+
+		//every combination of keywords gets a pipeline slot, materials without any don't need variant data at all
+		counts.variantKeys = def.numKeywords > 0 ? 1u << def.numKeywords : 0;
+
+		return counts;
+	}
+
+	//points every array in rData at space in the arena. Run against an arena without memory, this 
+	//just measures how big the block needs to be. The arrays a draw reads come first, so they 
+	//share cache lines with the MaterialRenderData at the start of the block
+	void allocRenderDataArrays(Arena& a, MaterialRenderData& rData, const RenderDataCounts& counts)
+	{
+		rData.descSets = arena::allocArray<VkDescriptorSet>(a, counts.layouts);
+		rData.pushConstantData = arena::allocArray<char>(a, counts.pushConstantSize);
+		rData.pushConstantLayout.layout = arena::allocArray<uint32_t>(a, counts.pushConstantMembers * 2);
+		rData.dynamic.layout = arena::allocArray<uint32_t>(a, counts.dynamicLayout);
+		rData.dynamic.buffers = arena::allocArray<VkBuffer>(a, counts.dynamicUniforms);
+		rData.dynamic.descriptorSetWrites = arena::allocArray<VkWriteDescriptorSet>(a, counts.dynamicWrites);
+		rData.resourceBindings = arena::allocArray<ResourceDescriptorBinding>(a, counts.resourceBindings);
+
+		//everything below is only needed when creating / destroying the material, or when something moves
+		rData.descriptorSetLayouts = arena::allocArray<VkDescriptorSetLayout>(a, counts.layouts);
+		rData.staticBuffers = arena::allocArray<VkBuffer>(a, counts.staticUniforms);
+		rData.staticBufferBindings = arena::allocArray<BufferDescriptorBinding>(a, counts.staticUniforms);
+		rData.dynamic.bufferBindings = arena::allocArray<BufferDescriptorBinding>(a, counts.dynamicUniforms);
+		rData.imageBindings = arena::allocArray<ImageDescriptorBinding>(a, counts.imageBindings);
+		rData.storageBuffers = arena::allocArray<VkBuffer>(a, counts.storageBuffers);
+
+		rData.variants = arena::allocArray<MaterialVariantData>(a, counts.variantKeys > 0 ? 1 : 0);
+		uint32_t* variantPipelines = arena::allocArray<uint32_t>(a, counts.variantKeys);
+		if (rData.variants) rData.variants->pipelines = variantPipelines;
+	}
+
+	void make(uint32_t id, const Definition& def)
 	{
 		using vkh::GContext;
 		MaterialAsset& outAsset = Material::getMaterialAsset(id);
-		outAsset.rData = (MaterialRenderData*)calloc(1,sizeof(MaterialRenderData));
-		MaterialRenderData& outMaterial = *outAsset.rData;
 
 		//for convenience, the first thing we want to do is to built arrays of the static and dynamic bindings
 		//saves us having to iterate over the map a bunch later, we still want the map of all of the bindings though, 
 		//since that makes a few things easier for us to do
 
-		std::vector<DescriptorSetBinding*> staticBindings;
-		std::vector<DescriptorSetBinding*> dynamicBindings;
+		BindingList staticBindings(frame::arrayAllocator());
+		BindingList dynamicBindings(frame::arrayAllocator());
+
+		//storage buffers, images etc. can be in static or dynamic sets, but don't have anything to do with the uniform
+		//memory / layouts for those, so they're pulled out into their own array
+		BindingList resourceBindings(frame::arrayAllocator());
 
 		for (uint32_t idx : def.staticSets)
 		{
-			for (DescriptorSetBinding& binding : def.descSets[idx])
+			for (const DescriptorSetBinding& binding : def.descSets.at(idx))
 			{
-				staticBindings.push_back(&binding);
+				if (isResourceInput(binding.type)) array::push_back(resourceBindings, &binding);
+				else array::push_back(staticBindings, &binding);
 			}
 		}
 
 		for (uint32_t idx : def.dynamicSets)
 		{
-			for (DescriptorSetBinding& binding : def.descSets[idx])
+			for (const DescriptorSetBinding& binding : def.descSets.at(idx))
+			{
+				if (isResourceInput(binding.type)) array::push_back(resourceBindings, &binding);
+				else array::push_back(dynamicBindings, &binding);
+			}
+		}
+
+#if _DEBUG
+		//setters find inputs by name hash, so two different names in one material that hash
+		//to the same value would have one silently shadow the other
+		{
+			std::map<uint32_t, const char*> namesByHash;
+			auto checkName = [&namesByHash](const char* name)
+			{
+				auto existing = namesByHash.find(hash(name));
+				checkf(existing == namesByHash.end() || !strcmp(existing->second, name), "Material input names %s and %s have the same hash", name, existing->second);
+				namesByHash[hash(name)] = name;
+			};
+
+			for (const BlockMember& mem : def.pcBlock.blockMembers)
+			{
+				checkName(mem.name);
+			}
+
+			for (auto& set : def.descSets)
 			{
-				dynamicBindings.push_back(&binding);
+				for (const DescriptorSetBinding& binding : set.second)
+				{
+					checkName(binding.name);
+					for (const BlockMember& mem : binding.blockMembers)
+					{
+						checkName(mem.name);
+					}
+				}
 			}
 		}
+#endif
+
+		//everything the material keeps lives in one block, with the MaterialRenderData at the start, so 
+		//destroying the material is a single free of rData. Sized by laying it all out in an empty arena first
+		RenderDataCounts counts = countRenderData(def, staticBindings, dynamicBindings, resourceBindings);
+		{
+			Arena sizing = {};
+			MaterialRenderData sizingData = {};
+			arena::alloc(sizing, sizeof(MaterialRenderData), alignof(MaterialRenderData));
+			allocRenderDataArrays(sizing, sizingData, counts);
+
+			Arena block;
+			arena::init(block, sizing.used);
+			outAsset.rData = arena::allocArray<MaterialRenderData>(block, 1);
+			allocRenderDataArrays(block, *outAsset.rData, counts);
+		}
+
+		MaterialRenderData& outMaterial = *outAsset.rData;
+		outMaterial.vertexLayout = def.vertexLayout;
 
-		outMaterial.dynamic.numInputs = static_cast<uint32_t>(def.dynamicSets.size());
+		bool isCompute = def.stages.size() > 0 && def.stages[0].stage == ShaderStage::COMPUTE;
+		outMaterial.bindPoint = isCompute ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS;
+		memcpy(outMaterial.workgroupSize, def.workgroupSize, sizeof(outMaterial.workgroupSize));
+		outMaterial.sharedPipeline = PipelineCompiler::INVALID_PIPELINE;
 
 		VkResult res;
 
@@ -566,13 +1136,20 @@ namespace Material
 		////build shader stages
 		/////////////////////////////////////////////////////////////////////////////////
 
-		std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+		//the spir-v is hashed on the way in, materials using the same shaders can share a pipeline
+		frame::Vector<VkPipelineShaderStageCreateInfo> shaderStages;
+		uint64_t moduleHashes[(uint32_t)ShaderStage::MAX];
 		{
 			for (uint32_t i = 0; i < def.stages.size(); ++i)
 			{
-				ShaderStageDefinition& stageDef = def.stages[i];
+				const ShaderStageDefinition& stageDef = def.stages[i];
 				VkPipelineShaderStageCreateInfo shaderStageInfo = vkh::shaderPipelineStageCreateInfo(shaderStageEnumToVkEnum(stageDef.stage));
-				vkh::createShaderModule(shaderStageInfo.module, stageDef.shaderPath, GContext.device);
+
+				BinaryBuffer* spirv = loadBinaryFile(stageDef.shaderPath);
+				vkh::createShaderModule(shaderStageInfo.module, spirv->data, spirv->size, GContext.device);
+				moduleHashes[i] = hashBytes64(spirv->data, spirv->size);
+				freeBinaryBuffer(spirv);
+
 				shaderStages.push_back(shaderStageInfo);
 			}
 		}
@@ -583,7 +1160,7 @@ namespace Material
 
 		//The second step of setting up the material is getting an array of VkDescriptorSetLayouts, 
 		//one for each descriptor set in the shaders used by the material. 
-		std::vector<VkDescriptorSetLayout> uniformLayouts;
+		frame::Vector<VkDescriptorSetLayout> uniformLayouts;
 
 		//it's important to note that this array has to have no gaps in set number, so if a set
 		//isn't used by the shaders, we have to add an empty VkDescriptorSetLayout. 
@@ -591,7 +1168,12 @@ namespace Material
 		//VkDescriptorSetLayouts are created from arrays of VkDescriptorSetLayoutBindings, one for each
 		//binding in the set, so first we use the descSets array on our material definition to give us a 
 		//map that has an array of VkDescriptorSetLayoutBindings for each descriptor set index (the key of the map) 
-		std::map<uint32_t, std::vector<VkDescriptorSetLayoutBinding>> uniformSetBindings;
+		frame::Map<uint32_t, frame::Vector<VkDescriptorSetLayoutBinding>> uniformSetBindings;
+
+		//pipelines are only shared between materials whose pipeline layouts are compatible, which means the same set 
+		//layout bindings and push constant range. Those are hashed here as they're built (their handles are different for every material)
+		Hash64State layoutHash;
+		hash64Begin(layoutHash);
 
 		//the rest of this logic can be wrapped in braces so we can collapse it for easier reading
 		//no other vars are declared that need to be visible outside of this block
@@ -611,7 +1193,7 @@ namespace Material
 					if (descSetBindings.first == curSet)
 					{
 						//this is a vector of all the bindings for the curSet
-						std::vector<DescriptorSetBinding>& setBindingCollection = descSetBindings.second;
+						const Array<DescriptorSetBinding>& setBindingCollection = descSetBindings.second;
 						for (auto& binding : setBindingCollection)
 						{
 							VkDescriptorSetLayoutBinding layoutBinding = vkh::descriptorSetLayoutBinding(inputTypeEnumToVkEnum(binding.type), shaderStageVectorToVkEnum(binding.owningStages), binding.binding, 1);
@@ -640,18 +1222,26 @@ namespace Material
 			{
 				uint32_t set = bindingCollection.first;
 
-				std::vector<VkDescriptorSetLayoutBinding>& setBindings = uniformSetBindings[bindingCollection.first];
+				frame::Vector<VkDescriptorSetLayoutBinding>& setBindings = uniformSetBindings[bindingCollection.first];
 				VkDescriptorSetLayoutCreateInfo layoutInfo = vkh::descriptorSetLayoutCreateInfo(setBindings.data(), static_cast<uint32_t>(setBindings.size()));
 
+				hash64Update(layoutHash, set);
+				for (const VkDescriptorSetLayoutBinding& layoutBinding : setBindings)
+				{
+					hash64Update(layoutHash, layoutBinding.binding);
+					hash64Update(layoutHash, layoutBinding.descriptorType);
+					hash64Update(layoutHash, layoutBinding.descriptorCount);
+					hash64Update(layoutHash, layoutBinding.stageFlags);
+				}
+
 				res = vkCreateDescriptorSetLayout(GContext.device, &layoutInfo, nullptr, &uniformLayouts[bindingCollection.first]);
 			}
 
 			//for sanity in storage, we want to keep MaterialAssets and MaterialRenderDatas POD structs, so we need to convert our lovely
-			//containers to arrays. This might change later, if I decide to start using POD arrays. In any case, in a real application you'd
-			//almost certainly want these allocations done with any allocator other than malloc
+			//containers to arrays in the material's block
 			outMaterial.layoutCount = static_cast<uint32_t>(uniformLayouts.size());
+			checkf(outMaterial.layoutCount == counts.layouts, "Material has a different number of set layouts than its render data was sized for");
 
-			outMaterial.descriptorSetLayouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * outMaterial.layoutCount);
 			memcpy(outMaterial.descriptorSetLayouts, uniformLayouts.data(), sizeof(VkDescriptorSetLayout) * outMaterial.layoutCount);
 		}
 		
@@ -674,17 +1264,16 @@ namespace Material
 
 				pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 				pipelineLayoutInfo.pushConstantRangeCount = 1;
+				hash64Update(layoutHash, pushConstantRange);
 
-				outAsset.rData->pushConstantLayout.layout = (uint32_t*)malloc(sizeof(uint32_t) * def.pcBlock.blockMembers.size() * 2);
 				outAsset.rData->pushConstantLayout.blockSize = def.pcBlock.sizeBytes;
 				outAsset.rData->pushConstantLayout.memberCount = static_cast<uint32_t>(def.pcBlock.blockMembers.size());
-				outAsset.rData->pushConstantData = (char*)malloc(def.pcBlock.sizeBytes);
 
 				checkf(def.pcBlock.sizeBytes < 128, "Push constant block is too large in material");
 
 				for (uint32_t i = 0; i < def.pcBlock.blockMembers.size(); ++i)
 				{
-					BlockMember& mem = def.pcBlock.blockMembers[i];
+					const BlockMember& mem = def.pcBlock.blockMembers[i];
 
 					outAsset.rData->pushConstantLayout.layout[i * 2] = hash(&mem.name[0]);
 					outAsset.rData->pushConstantLayout.layout[i * 2 + 1] = mem.offset;
@@ -695,64 +1284,70 @@ namespace Material
 			assert(res == VK_SUCCESS);
 		}
 		///////////////////////////////////////////////////////////////////////////////
+		//set up compute pipeline
+		///////////////////////////////////////////////////////////////////////////////
+		if (isCompute)
+		{
+			checkf(def.numKeywords == 0, "Compute materials can't have keywords");
+
+			//no vertex input or fixed function state to worry about, just the one stage
+			PipelineCompiler::SpecConstants specConstants = specConstantsForStage(def, ShaderStage::COMPUTE);
+			VkSpecializationMapEntry specEntries[PipelineCompiler::MAX_SPEC_CONSTANTS];
+			VkSpecializationInfo specInfo = PipelineCompiler::specializationInfo(specConstants, specEntries);
+
+			vkh::createComputePipeline(outMaterial.pipeline, outMaterial.pipelineLayout, shaderStages[0].module, GContext.device, specConstants.count > 0 ? &specInfo : nullptr);
+		}
+		///////////////////////////////////////////////////////////////////////////////
 		//set up graphics pipeline
 		///////////////////////////////////////////////////////////////////////////////
+		else
 		{
-			//with the pipeline layout all set up, it's time to actually make the pipeline
-			VkVertexInputBindingDescription bindingDescription = vkh::vertexInputBindingDescription(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
-
-			const VertexRenderData* vertexLayout = Mesh::vertexRenderData();
-
-			VkPipelineVertexInputStateCreateInfo vertexInputInfo = vkh::pipelineVertexInputStateCreateInfo();
-			vertexInputInfo.vertexBindingDescriptionCount = 1; 		//todo - what would be the reason for multiple binding?
-			vertexInputInfo.vertexAttributeDescriptionCount = vertexLayout->attrCount;
-			vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-			vertexInputInfo.pVertexAttributeDescriptions = &vertexLayout->attrDescriptions[0];
-
-			//most of this is all boilerplate that will never change over the lifetime of the application
-			//but some of it could conceivably be set by the material
-			VkPipelineInputAssemblyStateCreateInfo inputAssembly = vkh::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
-			VkViewport viewport = vkh::viewport(0, 0, static_cast<float>(GContext.swapChain.extent.width), static_cast<float>(GContext.swapChain.extent.height));
-			VkRect2D scissor = vkh::rect2D(0, 0, GContext.swapChain.extent.width, GContext.swapChain.extent.height);
-			VkPipelineViewportStateCreateInfo viewportState = vkh::pipelineViewportStateCreateInfo(&viewport, 1, &scissor, 1);
-
-			VkPipelineRasterizationStateCreateInfo rasterizer = vkh::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
-			VkPipelineMultisampleStateCreateInfo multisampling = vkh::pipelineMultisampleStateCreateInfo();
-
-			VkPipelineColorBlendAttachmentState colorBlendAttachment = vkh::pipelineColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, VK_FALSE);
-			VkPipelineColorBlendStateCreateInfo colorBlending = vkh::pipelineColorBlendStateCreateInfo(colorBlendAttachment);
-
-			VkPipelineDepthStencilStateCreateInfo depthStencil = vkh::pipelineDepthStencilStateCreateInfo(
-				VK_TRUE,
-				VK_TRUE,
-				VK_COMPARE_OP_LESS);
-
-			VkGraphicsPipelineCreateInfo pipelineInfo = {};
-			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-			pipelineInfo.pStages = shaderStages.data();
-			pipelineInfo.pVertexInputState = &vertexInputInfo;
-			pipelineInfo.pInputAssemblyState = &inputAssembly;
-			pipelineInfo.pViewportState = &viewportState;
-			pipelineInfo.pRasterizationState = &rasterizer;
-			pipelineInfo.pMultisampleState = &multisampling;
-			pipelineInfo.pDepthStencilState = nullptr; // Optional
-			pipelineInfo.pColorBlendState = &colorBlending;
-			pipelineInfo.pDynamicState = nullptr; // Optional
-			pipelineInfo.layout = outMaterial.pipelineLayout;
-			pipelineInfo.renderPass = GContext.mainRenderPass;
-			pipelineInfo.pDepthStencilState = &depthStencil;
-
-			pipelineInfo.subpass = 0;
-
-			//can use this to create new pipelines by deriving from old ones
-			pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-			pipelineInfo.basePipelineIndex = -1; // Optional
-
-			//if you get an error about push constant ranges not being defined for offset, you have too many things defined in the push
-			//constant in the shader itself
-			res = vkCreateGraphicsPipelines(GContext.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &outMaterial.pipeline);
-			assert(res == VK_SUCCESS);
+			//with the pipeline layout all set up, it's time to get a pipeline. If another material already has one with the same
+			//description this one just shares it. Deferred materials that don't find one get theirs compiled in the background the first time they're drawn
+			PipelineCompiler::GraphicsPipelineDesc pipelineDesc = {};
+			checkf(shaderStages.size() <= PipelineCompiler::MAX_GRAPHICS_STAGES, "Too many shader stages for a graphics material");
+
+			for (uint32_t i = 0; i < shaderStages.size(); ++i)
+			{
+				pipelineDesc.modules[i] = shaderStages[i].module;
+				pipelineDesc.stages[i] = shaderStages[i].stage;
+				pipelineDesc.moduleHashes[i] = moduleHashes[i];
+				pipelineDesc.specConstants[i] = specConstantsForStage(def, def.stages[i].stage);
+			}
+			pipelineDesc.stageCount = static_cast<uint32_t>(shaderStages.size());
+			pipelineDesc.vertexLayout = def.vertexLayout;
+			pipelineDesc.renderState = def.renderState;
+			pipelineDesc.layout = outMaterial.pipelineLayout;
+			pipelineDesc.layoutHash = hash64End(layoutHash);
+
+			//keep what the other variants need before the modules are handed off, the one with no keywords enabled is this pipeline
+			if (outMaterial.variants)
+			{
+				MaterialVariantData& variants = *outMaterial.variants;
+				variants.key = 0;
+				variants.numKeywords = def.numKeywords;
+				variants.desc = pipelineDesc;
+
+				for (uint32_t i = 0; i < def.numKeywords; ++i)
+				{
+					snprintf(variants.keywords[i], sizeof(variants.keywords[i]), "%s", def.keywords[i]);
+					variants.keywordHashes[i] = hash(def.keywords[i]);
+				}
+
+				for (uint32_t i = 0; i < pipelineDesc.stageCount; ++i)
+				{
+					variants.desc.modules[i] = VK_NULL_HANDLE;
+					snprintf(variants.shaderPaths[i], sizeof(variants.shaderPaths[i]), "%s", def.stages[i].shaderPath);
+				}
+			}
+
+			outMaterial.sharedPipeline = PipelineCompiler::acquire(pipelineDesc, def.deferPipeline);
+			PipelineCompiler::getPipeline(outMaterial.sharedPipeline, outMaterial.pipeline);
+
+			for (uint32_t key = 0; outMaterial.variants && key < counts.variantKeys; ++key)
+			{
+				outMaterial.variants->pipelines[key] = key == 0 ? outMaterial.sharedPipeline : PipelineCompiler::INVALID_PIPELINE;
+			}
 		}
 
 		///////////////////////////////////////////////////////////////////////////////
@@ -767,13 +1362,15 @@ namespace Material
 			//global buffers come from elsewhere in the application
 
 			//static buffers never change, so we don't need to keep any information around about them
-			outAsset.rData->staticBuffers = (VkBuffer*)malloc(sizeof(VkBuffer) * def.numStaticUniforms);
-			outAsset.rData->numStaticBuffers = def.numStaticTextures + def.numStaticUniforms;
+			outAsset.rData->numStaticBuffers = counts.staticUniforms;
+			outAsset.rData->dynamic.numBuffers = counts.dynamicUniforms;
 
 			//dynamic buffers are a pain in the ass and we need to track a lot of information about them. 
-			outAsset.rData->dynamic.buffers = (VkBuffer*)malloc(sizeof(VkBuffer) * def.numDynamicUniforms);
-			outAsset.rData->dynamic.layout = (uint32_t*)malloc(sizeof(uint32_t) * def.numDynamicUniforms * 3);
-			outAsset.rData->dynamic.numInputs = def.numDynamicUniforms + def.numDynamicTextures;
+			//the dynamic layout has 4 entries for every uniform member and image that can be set
+			outAsset.rData->dynamic.numInputs = counts.dynamicLayout / 4;
+
+			//separate images are tracked with the other image bindings, so they get patched if their texture moves
+			outAsset.rData->numImageBindings = 0;
 
 			//all material mem should be device local, for perf
 			VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
@@ -782,8 +1379,9 @@ namespace Material
 			//the memory for the static buffers
 
 			//start by writing out the default data our material file is providing for these bindings
-			//this can be done basically at any point in the process before we write this data to the buffers
-			char* staticDefaultData = (char*)malloc(def.staticSetsSize);
+			//this can be done basically at any point in the process before we write this data to the buffers.
+			//It's only needed until it's been copied to the gpu, so it comes from the frame allocator
+			char* staticDefaultData = frame::allocArray<char>(def.staticSetsSize);
 			collectDefaultValuesIntoBufferAndBuildLayout(staticDefaultData, staticBindings);
 
 			//then create buffers for each of those bindings
@@ -801,19 +1399,18 @@ namespace Material
 
 
 			//next we do the same for dynamic uniform memory, except we also need to create the layout structure so we can edit this later. 
-			std::vector<uint32_t> layout;
-			char* dynamicDefaultData = (char*)malloc(def.dynamicSetsSize);
-			collectDefaultValuesIntoBufferAndBuildLayout(dynamicDefaultData, dynamicBindings, &layout);
-
-			//we can convert the layout array to a pointer for storage in our POD MaterialRenderData
-			outMaterial.dynamic.layout = (uint32_t*)malloc(sizeof(uint32_t) * layout.size());
-			memcpy(outMaterial.dynamic.layout, layout.data(), sizeof(uint32_t) * layout.size());
+			//the layout goes straight into the material's block, which was sized for it
+			char* dynamicDefaultData = frame::allocArray<char>(def.dynamicSetsSize);
+			uint32_t layoutSize = collectDefaultValuesIntoBufferAndBuildLayout(dynamicDefaultData, dynamicBindings, outMaterial.dynamic.layout);
+			checkf(layoutSize == counts.dynamicLayout, "Dynamic layout doesn't match the size counted for it");
 
 			//same as before, we need to create buffers, alloc memory, bind it to the buffers
 			createBuffersForDescriptorSetBindingArray(dynamicBindings, &outAsset.rData->dynamic.buffers[0], memFlags);
 			allocateDeviceMemoryForBuffers(outAsset.rData->dynamic.uniformMem, def.dynamicSetsSize, &outAsset.rData->dynamic.buffers[0], memFlags);
 			bindBuffersToMemory(outAsset.rData->dynamic.uniformMem, outAsset.rData->dynamic.buffers, dynamicBindings);
 			fillBuffersWithDefaultValues(outAsset.rData->dynamic.buffers, def.dynamicSetsSize, dynamicDefaultData, dynamicBindings);
+
+			createStorageBuffers(outMaterial, resourceBindings);
 		}
 
 		
@@ -825,7 +1422,6 @@ namespace Material
 			//now that everything is set bup with our buffers, we need to set up the descriptor sets that will actually
 			//use those buffers. the first step is allocating them
 
-			outMaterial.descSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * uniformLayouts.size());
 			outMaterial.numDescSets = outMaterial.layoutCount;
 
 			for (uint32_t j = 0; j < uniformLayouts.size(); ++j)
@@ -842,18 +1438,18 @@ namespace Material
 
 		//now we have everything we need to update our VkDescriptorSets with information about what buffers to use 
 		//for their data sources. 
-		std::vector<VkWriteDescriptorSet> descSetWrites;
+		frame::Vector<VkWriteDescriptorSet> descSetWrites;
 
 		//we're going to queue up a bunch of descriptor write objects, and those objects
 		//will store pointers to bufferInfo structs. To make sure those buffer info structs are still
 		//around, we need to make sure this vector has reserved enough size at the beginning to never 
 		//realloc
-		std::vector<VkDescriptorBufferInfo> uniformBufferInfos;
-		uniformBufferInfos.reserve(def.numStaticUniforms + def.numDynamicUniforms); //+1 in case we have global data
+		frame::Vector<VkDescriptorBufferInfo> uniformBufferInfos;
+		uniformBufferInfos.reserve(def.numStaticUniforms + def.numDynamicUniforms + resourceBindings.size()); //+1 in case we have global data
 
 		//same deal here
-		std::vector<VkDescriptorImageInfo> imageInfos;
-		imageInfos.reserve(def.numDynamicTextures + def.numStaticTextures);
+		frame::Vector<VkDescriptorImageInfo> imageInfos;
+		imageInfos.reserve(def.numDynamicTextures + def.numStaticTextures + resourceBindings.size());
 
 		//if we're using global data, we pull the data from wherever our global data has been initialized
 		VkDescriptorBufferInfo globalBufferInfo;
@@ -861,8 +1457,6 @@ namespace Material
 		{
 			checkf(def.globalSets.size() == 1, "using more than 1 global buffer isn't supported right now");
 
-			std::vector<DescriptorSetBinding> globalBindings = def.descSets[def.globalSets[0]];
-		
 			extern VkBuffer globalBuffer;
 			extern uint32_t globalSize;
 
@@ -885,9 +1479,9 @@ namespace Material
 		}
 
 		//static info is a bit more compliated because it might be images as well
-		for (DescriptorSetBinding* bindingPtr : staticBindings)
+		for (const DescriptorSetBinding* bindingPtr : staticBindings)
 		{
-			DescriptorSetBinding& binding = *bindingPtr;
+			const DescriptorSetBinding& binding = *bindingPtr;
 
 			VkWriteDescriptorSet descriptorWrite = {};
 			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -906,6 +1500,8 @@ namespace Material
 				uniformBufferInfo.buffer = outAsset.rData->staticBuffers[uniformBufferInfos.size()];
 				uniformBufferInfo.range = binding.sizeBytes;
 
+				outAsset.rData->staticBufferBindings[uniformBufferInfos.size()] = { descriptorWrite.dstSet, binding.binding, binding.sizeBytes };
+
 				uniformBufferInfos.push_back(uniformBufferInfo);
 				descriptorWrite.pBufferInfo = &uniformBufferInfos[uniformBufferInfos.size() - 1];
 			}
@@ -915,10 +1511,12 @@ namespace Material
 				uint32_t tex = Texture::make(binding.defaultValue);
 
 				TextureRenderData* texData = Texture::getRenderData(tex);
-				imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				imageInfo.imageLayout = texData->layout;
 				imageInfo.imageView = texData->view;
 				imageInfo.sampler = texData->sampler;
 
+				outAsset.rData->imageBindings[outAsset.rData->numImageBindings++] = { descriptorWrite.dstSet, binding.binding, tex, descriptorWrite.descriptorType };
+
 				imageInfos.push_back(imageInfo);
 				descriptorWrite.pImageInfo = &imageInfos[imageInfos.size() - 1];
 
@@ -932,9 +1530,9 @@ namespace Material
 		uint32_t firstDynamicWriteIdx = 0;
 		uint32_t dynamicTextureTotal = 0;
 
-		for (DescriptorSetBinding* bindingPtr : dynamicBindings)
+		for (const DescriptorSetBinding* bindingPtr : dynamicBindings)
 		{
-			DescriptorSetBinding& binding = *bindingPtr;
+			const DescriptorSetBinding& binding = *bindingPtr;
 
 			VkWriteDescriptorSet descriptorWrite = {};
 			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -950,9 +1548,11 @@ namespace Material
 			{
 				VkDescriptorBufferInfo uniformBufferInfo;
 				uniformBufferInfo.offset = 0;
-				uniformBufferInfo.buffer = outAsset.rData->dynamic.buffers[dynamicBufferTotal++];
+				uniformBufferInfo.buffer = outAsset.rData->dynamic.buffers[dynamicBufferTotal];
 				uniformBufferInfo.range = binding.sizeBytes;
 
+				outAsset.rData->dynamic.bufferBindings[dynamicBufferTotal++] = { descriptorWrite.dstSet, binding.binding, binding.sizeBytes };
+
 				uniformBufferInfos.push_back(uniformBufferInfo);
 				descriptorWrite.pBufferInfo = &uniformBufferInfos[uniformBufferInfos.size() - 1];
 			}
@@ -962,12 +1562,14 @@ namespace Material
 				uint32_t tex = Texture::make(binding.defaultValue);
 
 				TextureRenderData* texData = Texture::getRenderData(tex);
-				imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				imageInfo.imageLayout = texData->layout;
 
 				//these have to be pointers to the material, not to a specific tex data? 
 				imageInfo.imageView = texData->view;
 				imageInfo.sampler = texData->sampler;
 
+				outAsset.rData->imageBindings[outAsset.rData->numImageBindings++] = { descriptorWrite.dstSet, binding.binding, tex, descriptorWrite.descriptorType };
+
 				imageInfos.push_back(imageInfo);
 				descriptorWrite.pImageInfo = &imageInfos[imageInfos.size() - 1];
 
@@ -985,25 +1587,143 @@ namespace Material
 			descSetWrites.push_back(descriptorWrite);
 		}
 
-		//save off the descriptor set writes for dynamic data for easier updating later
-		uint32_t numDynamicSetWrites = def.numDynamicTextures + def.numDynamicUniforms;
-		uint32_t numStaticSetWrites = def.numStaticTextures + def.numStaticUniforms;
+		//save off the descriptor set writes for dynamic data for easier updating later. These are counted from the binding 
+		//lists rather than the reflection totals, which count a binding once for every stage that uses it
+		uint32_t numDynamicSetWrites = counts.dynamicWrites;
+		uint32_t numStaticSetWrites = static_cast<uint32_t>(staticBindings.size());
+
+		uint32_t indexOfFirstDynamicSetWrite = (def.globalSets.size() > 0 ? 1 : 0) + numStaticSetWrites;
 
-		uint32_t indexOfFirstDynamicSetWrite = def.globalSets.size() + numStaticSetWrites;
+		if (numDynamicSetWrites > 0)
+		{
+			memcpy(outAsset.rData->dynamic.descriptorSetWrites, &descSetWrites.data()[indexOfFirstDynamicSetWrite], sizeof(VkWriteDescriptorSet) * numDynamicSetWrites);
+		}
 
-		outAsset.rData->dynamic.descriptorSetWrites = (VkWriteDescriptorSet*)malloc(sizeof(VkWriteDescriptorSet) * numDynamicSetWrites);
-		memcpy(outAsset.rData->dynamic.descriptorSetWrites, &descSetWrites.data()[indexOfFirstDynamicSetWrite], sizeof(VkWriteDescriptorSet) * numDynamicSetWrites);
+		//resource writes go after the dynamic writes, so the copy above doesn't pick them up. Storage images
+		//and texel buffers have nothing to point at until they're set, so they're left unwritten
+		outMaterial.numResourceBindings = static_cast<uint32_t>(resourceBindings.size());
+
+		uint32_t storageBufferTotal = 0;
+		for (uint32_t i = 0; i < resourceBindings.size(); ++i)
+		{
+			const DescriptorSetBinding& binding = *resourceBindings[i];
+
+			VkWriteDescriptorSet descriptorWrite = {};
+			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrite.dstSet = outMaterial.descSets[binding.set];
+			descriptorWrite.dstBinding = binding.binding;
+			descriptorWrite.dstArrayElement = 0;
+			descriptorWrite.descriptorType = inputTypeEnumToVkEnum(binding.type);
+			descriptorWrite.descriptorCount = 1;
+
+			outMaterial.resourceBindings[i] = { hash(binding.name), descriptorWrite.dstSet, binding.binding, descriptorWrite.descriptorType, true };
+
+			if (binding.type == InputType::STORAGE_BUFFER)
+			{
+				VkDescriptorBufferInfo storageBufferInfo;
+				storageBufferInfo.offset = 0;
+				storageBufferInfo.buffer = outMaterial.storageBuffers[storageBufferTotal++];
+				storageBufferInfo.range = binding.sizeBytes;
+
+				uniformBufferInfos.push_back(storageBufferInfo);
+				descriptorWrite.pBufferInfo = &uniformBufferInfos[uniformBufferInfos.size() - 1];
+			}
+			else if (binding.type == InputType::SEPARATE_IMAGE)
+			{
+				checkf(binding.defaultValue[0] != 0, "Separate image %s needs a default texture in the material", binding.name);
+				uint32_t tex = Texture::make(binding.defaultValue);
+				TextureRenderData* texData = Texture::getRenderData(tex);
+
+				VkDescriptorImageInfo imageInfo = {};
+				imageInfo.imageLayout = texData->layout;
+				imageInfo.imageView = texData->view;
+
+				outMaterial.imageBindings[outMaterial.numImageBindings++] = { descriptorWrite.dstSet, binding.binding, tex, descriptorWrite.descriptorType };
+
+				imageInfos.push_back(imageInfo);
+				descriptorWrite.pImageInfo = &imageInfos[imageInfos.size() - 1];
+			}
+			else if (binding.type == InputType::SEPARATE_SAMPLER)
+			{
+				//until setSampler is called, separate samplers get a shared trilinear one
+				VkDescriptorImageInfo imageInfo = {};
+				imageInfo.sampler = getDefaultSampler();
+
+				imageInfos.push_back(imageInfo);
+				descriptorWrite.pImageInfo = &imageInfos[imageInfos.size() - 1];
+			}
+			else
+			{
+				//drawing or dispatching before these are set trips a checkf in Rendering
+				outMaterial.resourceBindings[i].written = false;
+				continue;
+			}
+
+			descSetWrites.push_back(descriptorWrite);
+		}
 
 		//it's kinda weird that the order of desc writes has to be the order of sets. 
 		vkUpdateDescriptorSets(GContext.device, descSetWrites.size(), descSetWrites.data(), 0, nullptr);
 
+		//now that we know where every uniform buffer is bound, the defragmenter is allowed to move them
+		registerUniformMemoryForRelocation(outMaterial, outMaterial.staticUniformMem, outMaterial.staticBuffers, staticBindings);
+		registerUniformMemoryForRelocation(outMaterial, outMaterial.dynamic.uniformMem, outMaterial.dynamic.buffers, dynamicBindings);
+
 		///////////////////////////////////////////////////////////////////////////////
 		//cleanup
 		///////////////////////////////////////////////////////////////////////////////
+
+		//graphics materials handed their shader modules to the PipelineCompiler
+		if (!isCompute) return;
+
 		for (uint32_t i = 0; i < shaderStages.size(); ++i)
 		{
 			vkDestroyShaderModule(GContext.device, shaderStages[i].module, nullptr);
 		}
 
 	}
+	//ShaderPipeline names a variant after its plain shader, with the enabled keywords (sorted) inserted before the stage extension:
+	//fragment_passthrough.frag.spv + {TINT, FOG} -> fragment_passthrough__FOG__TINT.frag.spv
+	void variantShaderPath(char* outPath, size_t outSize, const char* shaderPath, const MaterialVariantData& variants, uint32_t key)
+	{
+		const char* enabled[MAX_MATERIAL_KEYWORDS];
+		uint32_t numEnabled = 0;
+		for (uint32_t i = 0; i < variants.numKeywords; ++i)
+		{
+			if (key & (1u << i)) enabled[numEnabled++] = variants.keywords[i];
+		}
+		std::sort(enabled, enabled + numEnabled, [](const char* lhs, const char* rhs) { return strcmp(lhs, rhs) < 0; });
+
+		//the path has dots in it before the file name
+		const char* fileName = strrchr(shaderPath, '/');
+		const char* ext = strchr(fileName ? fileName : shaderPath, '.');
+
+		int written = snprintf(outPath, outSize, "%.*s", (int)(ext - shaderPath), shaderPath);
+		for (uint32_t i = 0; i < numEnabled; ++i)
+		{
+			written += snprintf(outPath + written, outSize - written, "__%s", enabled[i]);
+		}
+		written += snprintf(outPath + written, outSize - written, "%s", ext);
+		checkf(written > -1 && written < (int)outSize, "Variant shader path is too long");
+	}
+
+	uint32_t makeVariantPipeline(const MaterialVariantData& variants, uint32_t key)
+	{
+		using vkh::GContext;
+
+		PipelineCompiler::GraphicsPipelineDesc desc = variants.desc;
+		for (uint32_t i = 0; i < desc.stageCount; ++i)
+		{
+			char path[256];
+			variantShaderPath(path, sizeof(path), variants.shaderPaths[i], variants, key);
+
+			BinaryBuffer* spirv = loadBinaryFile(path);
+			vkh::createShaderModule(desc.modules[i], spirv->data, spirv->size, GContext.device);
+			desc.moduleHashes[i] = hashBytes64(spirv->data, spirv->size);
+			freeBinaryBuffer(spirv);
+		}
+
+		//switching keywords happens mid frame, so even materials that built their first pipeline up front don't wait on a variant's
+		return PipelineCompiler::acquire(desc, true);
+	}
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include "stdafx.h"
-#include <vector>
+#include "mesh_asset_format.h"
+#include "pipeline_compiler.h"
+#include "asset_rdata_types.h"
 #include <map>
 
 //this is in it's own file so that unless you want to manually 
@@ -12,6 +14,7 @@ namespace Material
 	{
 		VERTEX,
 		FRAGMENT,
+		COMPUTE,
 		MAX
 	};
 
@@ -19,6 +22,21 @@ namespace Material
 	{
 		UNIFORM,
 		SAMPLER,
+		STORAGE_BUFFER,
+		STORAGE_IMAGE,
+		UNIFORM_TEXEL_BUFFER,
+		STORAGE_TEXEL_BUFFER,
+		SEPARATE_IMAGE,
+		SEPARATE_SAMPLER,
+		MAX
+	};
+
+	enum class SpecConstantType : uint8_t
+	{
+		FLOAT,
+		INT,
+		UINT,
+		BOOL,
 		MAX
 	};
 
@@ -30,11 +48,14 @@ namespace Material
 		char defaultValue[64];
 	};
 
+	//a stage can only show up once, so these never need to leave their inline storage
+	typedef SmallArray<ShaderStage, (uint32_t)ShaderStage::MAX> ShaderStageArray;
+
 	struct PushConstantBlock
 	{
 		uint32_t sizeBytes;
-		std::vector<ShaderStage> owningStages;
-		std::vector<BlockMember> blockMembers;
+		ShaderStageArray owningStages;
+		Array<BlockMember> blockMembers;
 	};
 
 	struct DescriptorSetBinding
@@ -45,8 +66,19 @@ namespace Material
 		uint32_t sizeBytes;
 		char name[32];
 		char defaultValue[64];
-		std::vector<ShaderStage> owningStages;
-		std::vector<BlockMember> blockMembers;
+		ShaderStageArray owningStages;
+		Array<BlockMember> blockMembers;
+	};
+
+	//a scalar specialization constant, stages that declare one with the same name share its value
+	struct SpecConstant
+	{
+		char name[32];
+		uint32_t constantId;
+		SpecConstantType type;
+		uint32_t value;	//raw bits, bools are VkBool32s
+		bool valueFromMaterial;	//set by a default in the material file, static uniform promotion leaves these alone
+		ShaderStageArray owningStages;
 	};
 
 	struct ShaderStageDefinition
@@ -55,15 +87,17 @@ namespace Material
 		char shaderPath[256];
 	};
 
+	//definitions own all of their arrays, so they can be moved but not copied
 	struct Definition
 	{
 		PushConstantBlock pcBlock;
-		std::vector<ShaderStageDefinition> stages;
-		std::map<uint32_t, std::vector<DescriptorSetBinding>> descSets;
+		SmallArray<ShaderStageDefinition, 2> stages;
+		EVertexLayout vertexLayout;
+		std::map<uint32_t, Array<DescriptorSetBinding>> descSets;
 
-		std::vector<uint32_t> dynamicSets;
-		std::vector<uint32_t> staticSets;
-		std::vector<uint32_t> globalSets;
+		SmallArray<uint32_t, 4> dynamicSets;
+		SmallArray<uint32_t, 4> staticSets;
+		SmallArray<uint32_t, 4> globalSets;
 
 		uint32_t numStaticUniforms;
 		uint32_t numStaticTextures;
@@ -71,13 +105,42 @@ namespace Material
 		uint32_t numDynamicTextures;
 		uint32_t staticSetsSize;
 		uint32_t dynamicSetsSize;
+
+		//storage buffers aren't counted in the static / dynamic numbers or set sizes above
+		uint32_t numStorageBuffers;
+
+		Array<SpecConstant> specConstants;
+
+		//"specializeFromStaticUniforms" - specialization constants named the same as a scalar member of a static set uniform
+		//block take that member's value, unless the material gives them one itself. Nothing is rewritten in the shader, it only
+		//gets the folded value where it reads the constant. Static uniforms never change after load, so the two always agree
+		bool specializeFromStaticUniforms;
+
+		//only set for compute materials, which have a single compute stage and no vertex layout
+		uint32_t workgroupSize[3];
+
+		//graphics materials only. Load starts from PipelineCompiler::defaultRenderState(), the "renderState" 
+		//object in a material file overrides individual members of it
+		PipelineCompiler::RenderState renderState;
+
+		//graphics materials only, the pipeline isn't built until the material is first drawn (see Material::materialForDraw)
+		bool deferPipeline;
+
+		//graphics materials only. Each combination of keywords is a shader variant ShaderPipeline built with those #defines,
+		//picked with Material::setKeyword. A variant's pipeline isn't made until it's drawn with
+		char keywords[MAX_MATERIAL_KEYWORDS][32];
+		uint32_t numKeywords;
 	};
 
 
 	//if you're manually specifying a material definition instead of loading it, 
 	//you need to manually request a key from Material Storage with reserve()
 	//since we don't have a path to hash to use as the (potential) map key
-	void make(uint32_t matId, Material::Definition def);
+	void make(uint32_t matId, const Material::Definition& def);
 
 	Definition load(const char* assetPath);
+
+	//loads the shaders for one of a material's variants and records a deferred pipeline for them with the PipelineCompiler,
+	//it's only built once requestCompile is called on it
+	uint32_t makeVariantPipeline(const MaterialVariantData& variants, uint32_t key);
 }
\ No newline at end of file
@@ -2,129 +2,548 @@
 
 #include "mesh.h"
 #include "vkh.h"
-#include <map>
+#include <vector>
 #include "asset_rdata_types.h"
+#include "mesh_asset_format.h"
+#include "os_support.h"
+#include "vertex_encoding.h"
+#include "culling.h"
+#include "frame_allocator.h"
 
+static_assert(sizeof(Vertex) == sizeof(MeshFormat::PackedVertex), "Vertex no longer matches the .vkmesh vertex layout");
+
+//vertices and indices for every mesh are suballocated out of a few large buffers, so drawing
+//lots of meshes only needs a vertex / index bind when the block changes. There's a set of blocks
+//per vertex layout and per index size, since offsets are in units of the stride
+const VkDeviceSize MESH_VERTEX_BLOCK_SIZE = 16 * 1024 * 1024;
+const VkDeviceSize MESH_INDEX_BLOCK_SIZE = 8 * 1024 * 1024;
+
+//uploads are batched through one persistently mapped staging buffer
+const VkDeviceSize MESH_STAGING_SIZE = 8 * 1024 * 1024;
+
+//offsets and counts are in elements (vertices or indices), not bytes
+struct MeshBufferSpan
+{
+	uint32_t offset;
+	uint32_t count;
+};
+
+struct MeshBufferBlock
+{
+	VkBuffer buffer;
+	vkh::Allocation memory;
+	uint32_t capacity;
+	std::vector<MeshBufferSpan> freeSpans; //sorted by offset
+};
+
+struct MeshBufferPool
+{
+	std::vector<MeshBufferBlock> blocks;
+	VkBufferUsageFlags usage;
+	VkDeviceSize blockSize;
+	uint32_t elementSize;
+};
+
+struct MeshStagedCopy
+{
+	VkBuffer dst;
+	VkBufferCopy region;
+};
+
+struct MeshStagingBuffer
+{
+	VkBuffer buffer;
+	vkh::Allocation memory;
+	uint8_t* mapped;
+	VkDeviceSize used;
+	std::vector<MeshStagedCopy> copies;
+};
 
 struct MeshAsset
 {
 	MeshRenderData rData;
+	uint32_t vBlock;
+	uint32_t iBlock;
+	Culling::MeshletSet meshlets;
+	bool alive;
 };
 
-//eventually this will be expanded to track all meshes
 struct MeshStore
 {
-	MeshAsset fullScreenMesh;
+	std::vector<MeshAsset> meshes;
+	std::vector<uint32_t> freeIds;
+
+	MeshBufferPool vertexPools[(uint32_t)EVertexLayout::Count];
+	MeshBufferPool indexPools[2]; //16 bit, 32 bit
+	MeshStagingBuffer staging;
 };
 
 MeshStore meshStorage;
 
 namespace Mesh
 {
-	void make(Vertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount)
+	using vkh::GContext;
+
+	void initStorage()
 	{
-		using vkh::GContext;
+		static bool isInitialized = false;
+		if (isInitialized) return;
 
-		size_t vBufferSize = sizeof(Vertex) * vertexCount + sizeof(uint32_t) * indexCount;
-		size_t iBufferSize = sizeof(uint32_t) * indexCount;
+		for (uint32_t i = 0; i < (uint32_t)EVertexLayout::Count; ++i)
+		{
+			meshStorage.vertexPools[i].usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+			meshStorage.vertexPools[i].blockSize = MESH_VERTEX_BLOCK_SIZE;
+			meshStorage.vertexPools[i].elementSize = VertexEncoding::vertexStride((EVertexLayout)i);
+		}
 
-		MeshRenderData m;
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			meshStorage.indexPools[i].usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+			meshStorage.indexPools[i].blockSize = MESH_INDEX_BLOCK_SIZE;
+			meshStorage.indexPools[i].elementSize = i == 0 ? sizeof(uint16_t) : sizeof(uint32_t);
+		}
+
+		MeshStagingBuffer& staging = meshStorage.staging;
+		vkh::createBuffer(staging.buffer,
+			staging.memory,
+			MESH_STAGING_SIZE,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		staging.mapped = (uint8_t*)staging.memory.mapped;
+		staging.used = 0;
+
+		isInitialized = true;
+	}
+
+	//first fit out of the existing blocks, a new block is only made when nothing has room
+	void allocSpan(MeshBufferPool& pool, uint32_t count, uint32_t& outBlock, uint32_t& outOffset)
+	{
+		for (uint32_t b = 0; b < pool.blocks.size(); ++b)
+		{
+			std::vector<MeshBufferSpan>& freeSpans = pool.blocks[b].freeSpans;
+			for (uint32_t s = 0; s < freeSpans.size(); ++s)
+			{
+				if (freeSpans[s].count < count) continue;
+
+				outBlock = b;
+				outOffset = freeSpans[s].offset;
+
+				freeSpans[s].offset += count;
+				freeSpans[s].count -= count;
+				if (freeSpans[s].count == 0) freeSpans.erase(freeSpans.begin() + s);
+				return;
+			}
+		}
+
+		uint32_t blockElements = static_cast<uint32_t>(pool.blockSize / pool.elementSize);
+
+		MeshBufferBlock block;
+		block.capacity = count > blockElements ? count : blockElements;
+
+		vkh::createBuffer(block.buffer,
+			block.memory,
+			(VkDeviceSize)block.capacity * pool.elementSize,
+			pool.usage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (block.capacity > count)
+		{
+			block.freeSpans.push_back({ count, block.capacity - count });
+		}
+
+		pool.blocks.push_back(block);
+
+		outBlock = static_cast<uint32_t>(pool.blocks.size() - 1);
+		outOffset = 0;
+	}
+
+	void freeSpan(MeshBufferPool& pool, uint32_t blockIdx, uint32_t offset, uint32_t count)
+	{
+		std::vector<MeshBufferSpan>& freeSpans = pool.blocks[blockIdx].freeSpans;
+
+		uint32_t insertIdx = 0;
+		while (insertIdx < freeSpans.size() && freeSpans[insertIdx].offset < offset) insertIdx++;
+
+		freeSpans.insert(freeSpans.begin() + insertIdx, { offset, count });
+
+		//merge with the neighbouring spans if they touch
+		if (insertIdx + 1 < freeSpans.size() && offset + count == freeSpans[insertIdx + 1].offset)
+		{
+			freeSpans[insertIdx].count += freeSpans[insertIdx + 1].count;
+			freeSpans.erase(freeSpans.begin() + insertIdx + 1);
+		}
+
+		if (insertIdx > 0 && freeSpans[insertIdx - 1].offset + freeSpans[insertIdx - 1].count == offset)
+		{
+			freeSpans[insertIdx - 1].count += freeSpans[insertIdx].count;
+			freeSpans.erase(freeSpans.begin() + insertIdx);
+		}
+	}
+
+	void stageUpload(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset)
+	{
+		MeshStagingBuffer& staging = meshStorage.staging;
+
+		//too big for the shared staging buffer, give it a staging buffer of its own
+		if (size > MESH_STAGING_SIZE)
+		{
+			VkBuffer stagingBuffer;
+			vkh::Allocation stagingMemory;
+
+			vkh::createBuffer(stagingBuffer,
+				stagingMemory,
+				size,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+			memcpy(stagingMemory.mapped, data, (size_t)size);
+
+			vkh::VkhCommandBuffer scratch = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Transfer);
+
+			VkBufferCopy region = {};
+			region.dstOffset = dstOffset;
+			region.size = size;
+			vkCmdCopyBuffer(scratch.buffer, stagingBuffer, dst, 1, &region);
+
+			vkh::submitScratchCommandBuffer(scratch);
+
+			vkDestroyBuffer(GContext.device, stagingBuffer, nullptr);
+			vkh::freeDeviceMemory(stagingMemory);
+			return;
+		}
+
+		if (staging.used + size > MESH_STAGING_SIZE)
+		{
+			flushUploads();
+		}
+
+		memcpy(staging.mapped + staging.used, data, (size_t)size);
+
+		MeshStagedCopy copy;
+		copy.dst = dst;
+		copy.region.srcOffset = staging.used;
+		copy.region.dstOffset = dstOffset;
+		copy.region.size = size;
+		staging.copies.push_back(copy);
+
+		staging.used += size;
+	}
+
+	void flushUploads()
+	{
+		MeshStagingBuffer& staging = meshStorage.staging;
+		if (staging.copies.size() == 0) return;
+
+		vkh::VkhCommandBuffer scratch = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Transfer);
+
+		//copies are recorded in the order meshes were made, so runs going to the same block share a call
+		uint32_t runStart = 0;
+		for (uint32_t i = 1; i <= staging.copies.size(); ++i)
+		{
+			if (i < staging.copies.size() && staging.copies[i].dst == staging.copies[runStart].dst) continue;
+
+			std::vector<VkBufferCopy> regions;
+			regions.reserve(i - runStart);
+			for (uint32_t r = runStart; r < i; ++r) regions.push_back(staging.copies[r].region);
+
+			vkCmdCopyBuffer(scratch.buffer, staging.buffer, staging.copies[runStart].dst, static_cast<uint32_t>(regions.size()), regions.data());
+			runStart = i;
+		}
+
+		//this waits for the copies to finish, so the staging memory can be reused right away
+		vkh::submitScratchCommandBuffer(scratch);
+
+		staging.copies.clear();
+		staging.used = 0;
+	}
+
+	MeshBufferPool& indexPoolFor(VkIndexType indexType)
+	{
+		return meshStorage.indexPools[indexType == VK_INDEX_TYPE_UINT16 ? 0 : 1];
+	}
+
+	uint32_t makeEncoded(EVertexLayout layout, const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexSize, uint32_t indexCount, const float* boundsMin, const float* boundsMax, const MeshFormat::LodEntry* lods, uint32_t lodCount, const MeshFormat::Meshlet* meshlets, uint32_t meshletCount)
+	{
+		checkf(layout < EVertexLayout::Count, "Invalid vertex layout");
+		checkf(indexSize == sizeof(uint16_t) || indexSize == sizeof(uint32_t), "Indices need to be 16 or 32 bit");
+		checkf(lodCount <= MeshFormat::MAX_LODS, "Mesh has too many lods");
+
+		initStorage();
+
+		uint32_t meshId;
+		if (meshStorage.freeIds.size() > 0)
+		{
+			meshId = meshStorage.freeIds.back();
+			meshStorage.freeIds.pop_back();
+		}
+		else
+		{
+			meshId = static_cast<uint32_t>(meshStorage.meshes.size());
+			meshStorage.meshes.push_back({});
+		}
+
+		MeshAsset& asset = meshStorage.meshes[meshId];
+		MeshRenderData& m = asset.rData;
 
-		m.iCount = indexCount;
 		m.vCount = vertexCount;
+		m.iCount = indexCount;
+		m.layout = layout;
+		m.indexType = indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+		if (lodCount == 0)
+		{
+			m.lodCount = 1;
+			m.lods[0] = { 0, indexCount, 0.0f, 0, 0 };
+		}
+		else
+		{
+			m.lodCount = lodCount;
+			for (uint32_t i = 0; i < lodCount; ++i)
+			{
+				checkf(lods[i].firstIndex + lods[i].indexCount <= indexCount, "Mesh lod is outside the index buffer");
+				checkf(lods[i].firstMeshlet + lods[i].meshletCount <= meshletCount, "Mesh lod references missing meshlets");
+				m.lods[i] = { lods[i].firstIndex, lods[i].indexCount, lods[i].error, lods[i].firstMeshlet, lods[i].meshletCount };
+			}
+		}
+
+		//only the cpu needs meshlet bounds, they're kept apart from the render data
+		asset.meshlets = {};
+		if (meshletCount > 0)
+		{
+			Culling::MeshletSet& set = asset.meshlets;
+			Culling::allocMeshletSet(set, meshletCount);
+
+			for (uint32_t i = 0; i < meshletCount; ++i)
+			{
+				const MeshFormat::Meshlet& src = meshlets[i];
+				set.centerX[i] = src.center[0];
+				set.centerY[i] = src.center[1];
+				set.centerZ[i] = src.center[2];
+				set.radius[i] = src.radius;
+				set.coneAxisX[i] = src.coneAxis[0];
+				set.coneAxisY[i] = src.coneAxis[1];
+				set.coneAxisZ[i] = src.coneAxis[2];
+				set.coneCutoff[i] = src.coneCutoff;
+				set.firstIndex[i] = src.firstIndex;
+				set.indexCount[i] = src.indexCount;
+			}
+		}
+
+		float radiusSq = 0.0f;
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			float halfExtent = (boundsMax[c] - boundsMin[c]) * 0.5f;
+			m.boundsCenter[c] = boundsMin[c] + halfExtent;
+			radiusSq += halfExtent * halfExtent;
+		}
+		m.boundsRadius = sqrtf(radiusSq);
+
+		if (layout == EVertexLayout::Compact)
+		{
+			VertexEncoding::positionScaleBias(boundsMin, boundsMax, m.posScale, m.posBias);
+		}
+		else
+		{
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				m.posScale[c] = 1.0f;
+				m.posBias[c] = 0.0f;
+			}
+		}
+
+		MeshBufferPool& vertexPool = meshStorage.vertexPools[(uint32_t)layout];
+		MeshBufferPool& indexPool = indexPoolFor(m.indexType);
+
+		allocSpan(vertexPool, vertexCount, asset.vBlock, m.vOffset);
+		allocSpan(indexPool, indexCount, asset.iBlock, m.iOffset);
+
+		m.vBuffer = vertexPool.blocks[asset.vBlock].buffer;
+		m.iBuffer = indexPool.blocks[asset.iBlock].buffer;
+
+		stageUpload(vertices, (VkDeviceSize)vertexPool.elementSize * vertexCount, m.vBuffer, (VkDeviceSize)m.vOffset * vertexPool.elementSize);
+		stageUpload(indices, (VkDeviceSize)indexSize * indexCount, m.iBuffer, (VkDeviceSize)m.iOffset * indexSize);
+
+		asset.alive = true;
+		return meshId;
+	}
+
+	uint32_t make(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, EVertexLayout layout)
+	{
+		const MeshFormat::PackedVertex* packed = (const MeshFormat::PackedVertex*)vertices;
+
+		float boundsMin[3];
+		float boundsMax[3];
+
+		//every layout needs bounds for lod selection, compact meshes also quantize to them
+		VertexEncoding::computeBounds(packed, vertexCount, boundsMin, boundsMax);
+
+		const void* vertexData = vertices;
+		std::vector<VertexEncoding::CompactVertex> compactVertices;
+
+		if (layout == EVertexLayout::Compact)
+		{
+			compactVertices.resize(vertexCount);
+			VertexEncoding::encodeCompact(packed, vertexCount, boundsMin, boundsMax, compactVertices.data());
+			vertexData = compactVertices.data();
+		}
 
-		//TODO - find a better way to structure this
-		extern vkh::VkhContext GContext;
-
-		vkh::createBuffer(m.vBuffer,
-			m.vBufferMemory,
-			vBufferSize,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			GContext.gpu.device,
-			GContext.device
-		);
-
-		vkh::createBuffer(m.iBuffer,
-			m.iBufferMemory,
-			iBufferSize,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			GContext.gpu.device,
-			GContext.device
-		);
-
-
-		//transfer data to the above buffers
-
-		VkBuffer stagingBuffer;
-		vkh::Allocation stagingMemory;
-
-		vkh::createBuffer(stagingBuffer,
-			stagingMemory,
-			vBufferSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			GContext.gpu.device,
-			GContext.device
-		);
-
-		void* data;
-		vkMapMemory(GContext.device, stagingMemory.handle, stagingMemory.offset, vBufferSize, 0, &data);
-		memcpy(data, vertices, (size_t)vBufferSize);
-		vkUnmapMemory(GContext.device, stagingMemory.handle);
-
-		//copy to device local here
-		vkh::copyBuffer(stagingBuffer, m.vBuffer, vBufferSize);
-		vkh::freeDeviceMemory(stagingMemory);
-		vkDestroyBuffer(GContext.device, stagingBuffer, nullptr);
-
-		vkh::createBuffer(stagingBuffer,
-			stagingMemory,
-			iBufferSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			GContext.gpu.device,
-			GContext.device
-		);
-
-		vkMapMemory(GContext.device, stagingMemory.handle, stagingMemory.offset, iBufferSize, 0, &data);
-		memcpy(data, indices, (size_t)iBufferSize);
-		vkUnmapMemory(GContext.device, stagingMemory.handle);
-
-
-
-		vkh::copyBuffer(stagingBuffer, m.iBuffer, iBufferSize);
-		vkh::freeDeviceMemory(stagingMemory);
-		vkDestroyBuffer(GContext.device, stagingBuffer, nullptr);
-
-		meshStorage.fullScreenMesh.rData = m;
+		const void* indexData = indices;
+		uint32_t indexSize = sizeof(uint32_t);
+		std::vector<uint16_t> shortIndices;
+
+		if (VertexEncoding::fitsInShortIndices(vertexCount))
+		{
+			shortIndices.resize(indexCount);
+			VertexEncoding::narrowIndices(indices, indexCount, shortIndices.data());
+			indexData = shortIndices.data();
+			indexSize = sizeof(uint16_t);
+		}
+
+		return makeEncoded(layout, vertexData, vertexCount, indexData, indexSize, indexCount, boundsMin, boundsMax);
 	}
 	
-	const VertexRenderData* vertexRenderData()
+	uint32_t load(const char* filepath)
 	{
-		static VertexRenderData* vkRenderData = nullptr;
-		if (!vkRenderData)
+		MappedFile file;
+		bool mapped = os_mapFile(file, filepath);
+		checkf(mapped, "Could not open mesh file");
+
+		checkf(file.size >= sizeof(MeshFormat::Header), "Mesh file is truncated");
+
+		const uint8_t* fileData = (const uint8_t*)file.data;
+		const MeshFormat::Header* header = (const MeshFormat::Header*)fileData;
+
+		checkf(header->magic == MeshFormat::MAGIC, "File is not a .vkmesh");
+		checkf(header->version == MeshFormat::VERSION, "Mesh file was written by a different version of MeshPipeline");
+		checkf(header->vertexLayout < EVertexLayout::Count, "Mesh file has an unknown vertex layout");
+		checkf(header->vertexStride == VertexEncoding::vertexStride(header->vertexLayout), "Mesh file stride doesn't match its vertex layout");
+		checkf(header->lodCount > 0 && header->lodCount <= MeshFormat::MAX_LODS, "Mesh file has an invalid lod count");
+
+		const MeshFormat::LodEntry* lods = (const MeshFormat::LodEntry*)(fileData + MeshFormat::lodTableOffset());
+		checkf(MeshFormat::lodTableOffset() + header->lodCount * sizeof(MeshFormat::LodEntry) <= header->vertexOffset, "Mesh file lod table overlaps its vertices");
+
+		//the lods' meshlet ranges are back to back, so the last one says how big the table is
+		uint32_t meshletCount = lods[header->lodCount - 1].firstMeshlet + lods[header->lodCount - 1].meshletCount;
+		uint64_t meshletTableOffset = MeshFormat::meshletTableOffset(header->lodCount);
+		checkf(meshletTableOffset + meshletCount * sizeof(MeshFormat::Meshlet) <= header->vertexOffset, "Mesh file meshlet table overlaps its vertices");
+
+		checkf(header->vertexOffset + (uint64_t)header->vertexCount * header->vertexStride <= file.size, "Mesh file is truncated");
+		checkf(header->indexOffset + (uint64_t)header->indexCount * header->indexSize <= file.size, "Mesh file is truncated");
+
+		uint32_t meshId = makeEncoded(header->vertexLayout,
+			fileData + header->vertexOffset, header->vertexCount,
+			fileData + header->indexOffset, header->indexSize, header->indexCount,
+			header->boundsMin, header->boundsMax,
+			lods, header->lodCount,
+			(const MeshFormat::Meshlet*)(fileData + meshletTableOffset), meshletCount);
+
+		//makeEncoded has already copied everything into staging, so the mapping can go right away
+		os_unmapFile(file);
+
+		return meshId;
+	}
+
+	//every layout puts the same data at the same locations, so shaders only need to know whether
+	//they're reading quantized positions / octahedral normals, not where anything is
+	const VertexRenderData* vertexRenderData(EVertexLayout layout)
+	{
+		static VertexRenderData* vkRenderData[(uint32_t)EVertexLayout::Count] = {};
+
+		VertexRenderData*& rData = vkRenderData[(uint32_t)layout];
+		if (!rData)
 		{
-			vkRenderData = (VertexRenderData*)malloc(sizeof(VertexRenderData));
-			vkRenderData->attrCount = 3;
+			rData = (VertexRenderData*)malloc(sizeof(VertexRenderData));
+			rData->attrCount = 4;
+			rData->stride = VertexEncoding::vertexStride(layout);
+			rData->attrDescriptions = (VkVertexInputAttributeDescription*)malloc(sizeof(VkVertexInputAttributeDescription) * rData->attrCount);
+
+			if (layout == EVertexLayout::Compact)
+			{
+				using VertexEncoding::CompactVertex;
+				rData->attrDescriptions[0] = { 0,0,VK_FORMAT_R16G16B16A16_SNORM, offsetof(CompactVertex, pos) };
+				rData->attrDescriptions[1] = { 1,0,VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv) };
+				rData->attrDescriptions[2] = { 2,0,VK_FORMAT_R8G8B8A8_UNORM, offsetof(CompactVertex, col) };
+				rData->attrDescriptions[3] = { 3,0,VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal) };
+			}
+			else
+			{
+				rData->attrDescriptions[0] = { 0,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) };
+				rData->attrDescriptions[1] = { 1,0,VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) };
+				rData->attrDescriptions[2] = { 2,0,VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, col) };
+				rData->attrDescriptions[3] = { 3,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) };
+			}
+		}
+
+		return rData;
+	}
 
-			vkRenderData->attrDescriptions = (VkVertexInputAttributeDescription*)malloc(sizeof(VkVertexInputAttributeDescription) * vkRenderData->attrCount);
-			vkRenderData->attrDescriptions[0] = { 0,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) };
-			vkRenderData->attrDescriptions[1] = { 1,0,VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) };
-			vkRenderData->attrDescriptions[2] = { 2,0,VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, pos) };
+	MeshRenderData getRenderData(uint32_t meshId)
+	{
+		checkf(meshId < meshStorage.meshes.size() && meshStorage.meshes[meshId].alive, "Invalid mesh handle");
+		return meshStorage.meshes[meshId].rData;
+	}
+
+	uint32_t selectLod(const MeshRenderData& mesh, float viewDistance, float projScale, float pixelError)
+	{
+		//closer than this and we're probably inside the mesh, the full mesh is the only safe choice
+		if (viewDistance <= 0.0001f) return 0;
+
+		float pixelsPerUnit = projScale / viewDistance;
+		for (uint32_t lod = mesh.lodCount - 1; lod > 0; --lod)
+		{
+			if (mesh.lods[lod].error * pixelsPerUnit <= pixelError) return lod;
 		}
 
-		return vkRenderData;
+		return 0;
 	}
 
-	MeshRenderData getRenderData()
+	uint32_t cullMeshlets(uint32_t meshId, uint32_t lod, const glm::vec4* frustumPlanes, const glm::vec3& cameraPos, MeshLod* outRanges)
 	{
-		return meshStorage.fullScreenMesh.rData;
+		const MeshAsset& asset = meshStorage.meshes[meshId];
+		const MeshLod& lodData = asset.rData.lods[lod];
+		const Culling::MeshletSet& set = asset.meshlets;
+
+		//only needed until the survivors are merged into ranges
+		uint32_t* visible = frame::allocArray<uint32_t>(lodData.meshletCount);
+
+		uint32_t visibleCount = Culling::cullMeshlets(set, lodData.firstMeshlet, lodData.meshletCount, frustumPlanes, cameraPos, visible);
+
+		uint32_t rangeCount = 0;
+		for (uint32_t i = 0; i < visibleCount; ++i)
+		{
+			uint32_t m = visible[i];
+
+			if (rangeCount > 0 && outRanges[rangeCount - 1].firstIndex + outRanges[rangeCount - 1].indexCount == set.firstIndex[m])
+			{
+				outRanges[rangeCount - 1].indexCount += set.indexCount[m];
+				continue;
+			}
+
+			outRanges[rangeCount++] = { set.firstIndex[m], set.indexCount[m], lodData.error, 0, 0 };
+		}
+
+		return rangeCount;
 	}
 
-	void destroy()
+	void destroy(uint32_t meshId)
 	{
-		assert(0); //unimplemented
+		checkf(meshId < meshStorage.meshes.size() && meshStorage.meshes[meshId].alive, "Destroying an invalid mesh handle");
+
+		MeshAsset& asset = meshStorage.meshes[meshId];
+
+		//anything still waiting in staging would land on top of whatever reuses this space
+		flushUploads();
+
+		freeSpan(meshStorage.vertexPools[(uint32_t)asset.rData.layout], asset.vBlock, asset.rData.vOffset, asset.rData.vCount);
+		freeSpan(indexPoolFor(asset.rData.indexType), asset.iBlock, asset.rData.iOffset, asset.rData.iCount);
+
+		if (asset.meshlets.count > 0)
+		{
+			Culling::freeMeshletSet(asset.meshlets);
+		}
+
+		asset = {};
+		meshStorage.freeIds.push_back(meshId);
 	}
-}
+}
\ No newline at end of file
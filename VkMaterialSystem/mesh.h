@@ -1,8 +1,10 @@
 #pragma once
 #include "stdafx.h"
+#include "mesh_asset_format.h"
 
 struct MeshAsset;
 struct MeshRenderData;
+struct MeshLod;
 struct VertexRenderData;
 
 struct Vertex
@@ -10,14 +12,41 @@ struct Vertex
 	glm::vec3 pos;
 	glm::vec2 uv;
 	glm::vec4 col;
+	glm::vec3 normal;
 };
 
 namespace Mesh
 {
-	void make(Vertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount);
+	//returns a handle to the new mesh. The data is converted to the requested layout and copied into
+	//a shared staging buffer, and only reaches the gpu on the next flushUploads, which Rendering::draw
+	//calls before recording. Meshes with few enough vertices get 16 bit indices automatically
+	uint32_t make(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, EVertexLayout layout = EVertexLayout::Full);
 
-	MeshRenderData getRenderData();
-	const VertexRenderData* vertexRenderData();
+	//same as above, for data that's already in its final layout (ie/ straight out of a .vkmesh). 
+	//bounds are what lod selection measures the view distance against, compact meshes also use them
+	//to undo the position quantization. Without a lod table the mesh gets a single lod covering every index. Meshlets are referenced by the lods
+	uint32_t makeEncoded(EVertexLayout layout, const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexSize, uint32_t indexCount, const float* boundsMin, const float* boundsMax, 
+		const MeshFormat::LodEntry* lods = nullptr, uint32_t lodCount = 0, const MeshFormat::Meshlet* meshlets = nullptr, uint32_t meshletCount = 0);
+	void flushUploads();
 
-	void destroy();
+	//loads a .vkmesh made by MeshPipeline. The file is memory mapped and its streams are
+	//copied straight into staging, there's no per vertex work
+	uint32_t load(const char* filepath);
+
+	MeshRenderData getRenderData(uint32_t meshId);
+
+	//picks the coarsest lod whose error is still under pixelError pixels on screen. projScale is
+	//the number of pixels one mesh unit covers at a distance of one unit from the camera
+	uint32_t selectLod(const MeshRenderData& mesh, float viewDistance, float projScale, float pixelError);
+
+	//frustum and backface cone culls the lod's meshlets, then merges the survivors into as few index
+	//ranges as possible (meshlets are contiguous in the index buffer). outRanges needs room for the
+	//lod's meshletCount ranges. Planes and camera position are in mesh space. Returns the range count.
+	//Scratch space comes from the calling thread's frame allocator
+	uint32_t cullMeshlets(uint32_t meshId, uint32_t lod, const glm::vec4* frustumPlanes, const glm::vec3& cameraPos, MeshLod* outRanges);
+	const VertexRenderData* vertexRenderData(EVertexLayout layout);
+
+	//the caller needs to make sure the gpu is done with the mesh first, since its space in
+	//the shared buffers can be handed to the next mesh that's made
+	void destroy(uint32_t meshId);
 }
\ No newline at end of file
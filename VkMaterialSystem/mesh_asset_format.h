@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+
+//every layout uses the same attribute locations (0 position, 1 uv, 2 colour, 3 normal)
+enum class EVertexLayout : uint8_t
+{
+	Full,		//48 bytes, float everything
+	Compact,	//20 bytes, see VertexEncoding::CompactVertex
+	Count
+};
+
+//the .vkmesh format written by MeshPipeline. Everything after the header is already in the 
+//layout the gpu wants, so loading is just mapping the file and copying the streams to staging.
+//The header is followed by the lod table, the meshlet table, then the vertex and index streams
+namespace MeshFormat
+{
+	const uint32_t MAGIC = 0x48534D56;	//"VMSH"
+	const uint32_t VERSION = 4;
+	const uint32_t MAX_LODS = 8;
+
+	//meshlets are small enough that culling one is worth more than the cost of testing it
+	const uint32_t MESHLET_MAX_VERTICES = 64;
+	const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+	//vertex and index streams start on this alignment, relative to the start of the file
+	const uint32_t STREAM_ALIGNMENT = 16;
+
+	//matches Vertex in mesh.h, the tools don't link against glm
+	struct PackedVertex
+	{
+		float pos[3];
+		float uv[2];
+		float col[4];
+		float normal[3];
+	};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint16_t vertexStride;
+		EVertexLayout vertexLayout;
+		uint8_t indexSize;	//2 or 4
+		uint32_t lodCount;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+
+		//compact positions are quantized to these bounds
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	static_assert(sizeof(Header) == 64, "Mesh header should stay a cache line");
+
+	//every lod indexes the same vertices, lod 0 is the full mesh and each one after it is coarser.
+	//error is how far the lod's surface can be from the full mesh's, in mesh units. Lods that are
+	//too small to be worth culling in pieces have no meshlets
+	struct LodEntry
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float error;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		uint32_t reserved[3];
+	};
+
+	//a contiguous run of a lod's indices, with the bounds needed to cull it
+	struct Meshlet
+	{
+		float center[3];
+		float radius;
+
+		//the meshlet faces away from the camera when dot(center - camera, coneAxis) >= coneCutoff * |center - camera| + radius,
+		//meshlets whose triangles face too many directions to ever pass that have a cutoff of 1
+		float coneAxis[3];
+		float coneCutoff;
+
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t reserved[2];
+	};
+
+	inline uint64_t alignStream(uint64_t offset)
+	{
+		return (offset + STREAM_ALIGNMENT - 1) & ~(uint64_t)(STREAM_ALIGNMENT - 1);
+	}
+
+	inline uint64_t lodTableOffset()
+	{
+		return alignStream(sizeof(Header));
+	}
+
+	inline uint64_t meshletTableOffset(uint32_t lodCount)
+	{
+		return alignStream(lodTableOffset() + lodCount * sizeof(LodEntry));
+	}
+}
\ No newline at end of file
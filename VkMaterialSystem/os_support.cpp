@@ -114,3 +114,48 @@ double os_getMilliseconds()
 		return GetTickCount64() - initialMS;
 	}
 }
+
+
+bool os_mapFile(MappedFile& outFile, const char* filepath)
+{
+	outFile = {};
+
+	HANDLE file = CreateFile(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	outFile.data = view;
+	outFile.size = (size_t)fileSize.QuadPart;
+	outFile.fileHandle = file;
+	outFile.mappingHandle = mapping;
+	return true;
+}
+
+void os_unmapFile(MappedFile& file)
+{
+	UnmapViewOfFile(file.data);
+	CloseHandle((HANDLE)file.mappingHandle);
+	CloseHandle((HANDLE)file.fileHandle);
+	file = {};
+}
\ No newline at end of file
@@ -14,9 +14,21 @@ struct AppInfo
 
 extern AppInfo GAppInfo;
 
+//a read only view of an entire file
+struct MappedFile
+{
+	const void* data;
+	size_t size;
+	void* fileHandle;
+	void* mappingHandle;
+};
+
 struct HWND__* os_makeWindow(struct HINSTANCE__* Instance, const char* title, unsigned int width, unsigned int height);
 void		os_setResizeCallback(void (*cb)(int, int));
 void		os_handleEvents();
 
 void		os_pollInput();
-double		os_getMilliseconds();
\ No newline at end of file
+double		os_getMilliseconds();
+
+bool		os_mapFile(MappedFile& outFile, const char* filepath);
+void		os_unmapFile(MappedFile& file);
\ No newline at end of file
@@ -0,0 +1,438 @@
+#include "stdafx.h"
+#include "pipeline_compiler.h"
+#include "asset_rdata_types.h"
+#include "hash.h"
+#include "mesh.h"
+#include "vkh_initializers.h"
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PipelineCompiler
+{
+	using vkh::GContext;
+
+	enum class EPipelineState : uint8_t
+	{
+		Free,
+		Recorded,
+		Queued,
+		Compiling,
+		Done
+	};
+
+	//until a pipeline is built it owns its desc's shader modules, they're destroyed as soon as it's Done
+	struct SharedPipeline
+	{
+		GraphicsPipelineDesc desc;
+		uint64_t key;
+		VkPipeline pipeline;
+		uint32_t refCount;
+		EPipelineState state;
+	};
+
+	//everything here is shared with the compile thread, and is only touched with the lock held. Pipelines are 
+	//referred to by index, so nothing holds a pointer into pipelines while the lock is released
+	struct CompilerState
+	{
+		std::mutex lock;
+		std::condition_variable wake;
+		std::condition_variable compiled;
+		std::thread thread;
+		bool threadRunning;
+		bool stopping;
+
+		std::vector<SharedPipeline> pipelines;
+		std::vector<uint32_t> freePipelines;
+		std::vector<uint32_t> queue;
+		std::map<uint64_t, uint32_t> pipelinesByKey;
+
+		CacheStats stats;
+	};
+
+	CompilerState state;
+
+	RenderState defaultRenderState()
+	{
+		RenderState rs;
+		rs.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		rs.polygonMode = VK_POLYGON_MODE_FILL;
+		rs.cullMode = VK_CULL_MODE_BACK_BIT;
+		rs.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		rs.depthTest = VK_TRUE;
+		rs.depthWrite = VK_TRUE;
+		rs.depthCompare = VK_COMPARE_OP_LESS;
+		rs.blend = EBlendMode::Opaque;
+		return rs;
+	}
+
+	uint64_t hashDesc(const GraphicsPipelineDesc& desc)
+	{
+		Hash64State h;
+		hash64Begin(h);
+
+		//the modules themselves are different objects for every material, only what's in them matters
+		hash64Update(h, desc.stageCount);
+		for (uint32_t i = 0; i < desc.stageCount; ++i)
+		{
+			hash64Update(h, desc.stages[i]);
+			hash64Update(h, desc.moduleHashes[i]);
+
+			//the same spir-v specialized differently is a different pipeline
+			const SpecConstants& sc = desc.specConstants[i];
+			hash64Update(h, sc.count);
+			for (uint32_t c = 0; c < sc.count; ++c)
+			{
+				hash64Update(h, sc.ids[c]);
+				hash64Update(h, sc.values[c]);
+			}
+		}
+
+		hash64Update(h, desc.vertexLayout);
+		hash64Update(h, desc.renderState);
+		hash64Update(h, desc.layoutHash);
+		hash64Update(h, GContext.mainRenderPass);
+
+		return hash64End(h);
+	}
+
+	void destroyModules(const GraphicsPipelineDesc& desc)
+	{
+		for (uint32_t i = 0; i < desc.stageCount; ++i)
+		{
+			vkDestroyShaderModule(GContext.device, desc.modules[i], nullptr);
+		}
+	}
+
+	VkSpecializationInfo specializationInfo(const SpecConstants& constants, VkSpecializationMapEntry* outEntries)
+	{
+		checkf(constants.count <= MAX_SPEC_CONSTANTS, "Too many specialization constants in one stage");
+
+		for (uint32_t i = 0; i < constants.count; ++i)
+		{
+			outEntries[i].constantID = constants.ids[i];
+			outEntries[i].offset = i * sizeof(uint32_t);
+			outEntries[i].size = sizeof(uint32_t);
+		}
+
+		VkSpecializationInfo info = {};
+		info.mapEntryCount = constants.count;
+		info.pMapEntries = outEntries;
+		info.dataSize = constants.count * sizeof(uint32_t);
+		info.pData = constants.values;
+		return info;
+	}
+
+	void createGraphicsPipeline(const GraphicsPipelineDesc& desc, VkPipeline& outPipeline)
+	{
+		VkPipelineShaderStageCreateInfo shaderStages[MAX_GRAPHICS_STAGES];
+		VkSpecializationMapEntry specEntries[MAX_GRAPHICS_STAGES][MAX_SPEC_CONSTANTS];
+		VkSpecializationInfo specInfos[MAX_GRAPHICS_STAGES];
+		for (uint32_t i = 0; i < desc.stageCount; ++i)
+		{
+			shaderStages[i] = vkh::shaderPipelineStageCreateInfo(desc.stages[i]);
+			shaderStages[i].module = desc.modules[i];
+
+			if (desc.specConstants[i].count == 0) continue;
+
+			specInfos[i] = specializationInfo(desc.specConstants[i], specEntries[i]);
+			shaderStages[i].pSpecializationInfo = &specInfos[i];
+		}
+
+		const VertexRenderData* vertexLayout = Mesh::vertexRenderData(desc.vertexLayout);
+		const RenderState& rs = desc.renderState;
+
+		VkVertexInputBindingDescription bindingDescription = vkh::vertexInputBindingDescription(0, vertexLayout->stride, VK_VERTEX_INPUT_RATE_VERTEX);
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo = vkh::pipelineVertexInputStateCreateInfo();
+		vertexInputInfo.vertexBindingDescriptionCount = 1; 		//todo - what would be the reason for multiple binding?
+		vertexInputInfo.vertexAttributeDescriptionCount = vertexLayout->attrCount;
+		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.pVertexAttributeDescriptions = &vertexLayout->attrDescriptions[0];
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly = vkh::pipelineInputAssemblyStateCreateInfo(rs.topology, VK_FALSE);
+
+		//viewport and scissor are set when the main pass begins, so the window can change size without touching any pipelines
+		VkPipelineViewportStateCreateInfo viewportState = vkh::pipelineViewportStateCreateInfo(nullptr, 1, nullptr, 1);
+		VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamicState = {};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = 2;
+		dynamicState.pDynamicStates = dynamicStates;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer = vkh::pipelineRasterizationStateCreateInfo(rs.polygonMode);
+		rasterizer.cullMode = rs.cullMode;
+		rasterizer.frontFace = rs.frontFace;
+
+		VkPipelineMultisampleStateCreateInfo multisampling = vkh::pipelineMultisampleStateCreateInfo();
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment = vkh::pipelineColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, rs.blend != EBlendMode::Opaque);
+		if (rs.blend != EBlendMode::Opaque)
+		{
+			colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+			colorBlendAttachment.dstColorBlendFactor = rs.blend == EBlendMode::Alpha ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+			colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+			colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+			colorBlendAttachment.dstAlphaBlendFactor = rs.blend == EBlendMode::Alpha ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+			colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		}
+		VkPipelineColorBlendStateCreateInfo colorBlending = vkh::pipelineColorBlendStateCreateInfo(colorBlendAttachment);
+
+		VkPipelineDepthStencilStateCreateInfo depthStencil = vkh::pipelineDepthStencilStateCreateInfo(
+			rs.depthTest,
+			rs.depthWrite,
+			rs.depthCompare);
+
+		VkGraphicsPipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = desc.stageCount;
+		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssembly;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		pipelineInfo.pMultisampleState = &multisampling;
+		pipelineInfo.pColorBlendState = &colorBlending;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.layout = desc.layout;
+		pipelineInfo.renderPass = GContext.mainRenderPass;
+		pipelineInfo.pDepthStencilState = &depthStencil;
+
+		pipelineInfo.subpass = 0;
+
+		//can use this to create new pipelines by deriving from old ones
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+		pipelineInfo.basePipelineIndex = -1; // Optional
+
+		//if you get an error about push constant ranges not being defined for offset, you have too many things defined in the push
+		//constant in the shader itself
+		VkResult res = vkCreateGraphicsPipelines(GContext.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &outPipeline);
+		checkf(res == VK_SUCCESS, "Error creating graphics pipeline");
+	}
+
+	void removeFromQueue(uint32_t pipeline)
+	{
+		for (uint32_t i = 0; i < state.queue.size(); ++i)
+		{
+			if (state.queue[i] == pipeline)
+			{
+				state.queue.erase(state.queue.begin() + i);
+				return;
+			}
+		}
+	}
+
+	//called without the lock held. Once it's built nothing needs the modules anymore
+	VkPipeline build(const GraphicsPipelineDesc& desc)
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		createGraphicsPipeline(desc, pipeline);
+		destroyModules(desc);
+		return pipeline;
+	}
+
+	void markDone(uint32_t pipeline, VkPipeline built)
+	{
+		state.pipelines[pipeline].pipeline = built;
+		state.pipelines[pipeline].state = EPipelineState::Done;
+		state.stats.created++;
+		state.compiled.notify_all();
+	}
+
+	//makes sure a pipeline is built before returning, either on this thread, or by waiting on the compile thread if it already has it
+	void finishPipeline(std::unique_lock<std::mutex>& guard, uint32_t pipeline)
+	{
+		state.compiled.wait(guard, [pipeline]() { return state.pipelines[pipeline].state != EPipelineState::Compiling; });
+		if (state.pipelines[pipeline].state == EPipelineState::Done) return;
+
+		if (state.pipelines[pipeline].state == EPipelineState::Queued)
+		{
+			removeFromQueue(pipeline);
+		}
+
+		state.pipelines[pipeline].state = EPipelineState::Compiling;
+		GraphicsPipelineDesc desc = state.pipelines[pipeline].desc;
+
+		guard.unlock();
+		VkPipeline built = build(desc);
+		guard.lock();
+
+		markDone(pipeline, built);
+	}
+
+	//if the pipeline is being built this has to wait for it, since the build uses a material's pipeline layout
+	void destroyPipeline(std::unique_lock<std::mutex>& guard, uint32_t pipeline)
+	{
+		state.compiled.wait(guard, [pipeline]() { return state.pipelines[pipeline].state != EPipelineState::Compiling; });
+
+		SharedPipeline& shared = state.pipelines[pipeline];
+		if (shared.state == EPipelineState::Queued)
+		{
+			removeFromQueue(pipeline);
+		}
+
+		if (shared.state == EPipelineState::Done)
+		{
+			vkDestroyPipeline(GContext.device, shared.pipeline, nullptr);
+		}
+		else
+		{
+			destroyModules(shared.desc);
+		}
+
+		state.pipelinesByKey.erase(shared.key);
+		state.stats.live--;
+
+		shared.state = EPipelineState::Free;
+		state.freePipelines.push_back(pipeline);
+	}
+
+	//pipeline creation doesn't need any external synchronization without a pipeline cache, so
+	//the only thing shared with the render thread is the pipeline list
+	void compileThread()
+	{
+		std::unique_lock<std::mutex> guard(state.lock);
+
+		while (true)
+		{
+			state.wake.wait(guard, []() { return state.stopping || state.queue.size() > 0; });
+			if (state.stopping) break;
+
+			uint32_t pipeline = state.queue.front();
+			state.queue.erase(state.queue.begin());
+			state.pipelines[pipeline].state = EPipelineState::Compiling;
+			GraphicsPipelineDesc desc = state.pipelines[pipeline].desc;
+
+			guard.unlock();
+			VkPipeline built = build(desc);
+			guard.lock();
+
+			markDone(pipeline, built);
+		}
+	}
+
+	uint32_t acquire(const GraphicsPipelineDesc& desc, bool deferred)
+	{
+		uint64_t key = hashDesc(desc);
+
+		std::unique_lock<std::mutex> guard(state.lock);
+		state.stats.requests++;
+
+		uint32_t pipeline;
+		auto existing = state.pipelinesByKey.find(key);
+		if (existing != state.pipelinesByKey.end())
+		{
+			pipeline = existing->second;
+			state.pipelines[pipeline].refCount++;
+			state.stats.hits++;
+
+			//the shared pipeline was (or will be) built from the first material's copies of these
+			destroyModules(desc);
+		}
+		else
+		{
+			if (state.freePipelines.size() > 0)
+			{
+				pipeline = state.freePipelines.back();
+				state.freePipelines.pop_back();
+			}
+			else
+			{
+				pipeline = static_cast<uint32_t>(state.pipelines.size());
+				state.pipelines.push_back({});
+			}
+
+			state.pipelines[pipeline] = {};
+			state.pipelines[pipeline].desc = desc;
+			state.pipelines[pipeline].key = key;
+			state.pipelines[pipeline].refCount = 1;
+			state.pipelines[pipeline].state = EPipelineState::Recorded;
+			state.pipelinesByKey[key] = pipeline;
+			state.stats.live++;
+		}
+
+		//a deferred material can share a pipeline that's already built, but one that isn't deferred can't wait on one that is
+		if (!deferred)
+		{
+			finishPipeline(guard, pipeline);
+		}
+
+		return pipeline;
+	}
+
+	void release(uint32_t pipeline, VkPipelineLayout layout)
+	{
+		std::unique_lock<std::mutex> guard(state.lock);
+		checkf(state.pipelines[pipeline].refCount > 0, "Releasing a pipeline with no references");
+
+		state.pipelines[pipeline].refCount--;
+		if (state.pipelines[pipeline].refCount == 0)
+		{
+			destroyPipeline(guard, pipeline);
+		}
+		else if (state.pipelines[pipeline].desc.layout == layout)
+		{
+			finishPipeline(guard, pipeline);
+		}
+	}
+
+	void requestCompile(uint32_t pipeline)
+	{
+		std::lock_guard<std::mutex> guard(state.lock);
+		if (state.pipelines[pipeline].state != EPipelineState::Recorded) return;
+
+		//nothing runs on the thread until something actually needs compiling
+		if (!state.threadRunning)
+		{
+			state.stopping = false;
+			state.threadRunning = true;
+			state.thread = std::thread(compileThread);
+		}
+
+		state.pipelines[pipeline].state = EPipelineState::Queued;
+		state.queue.push_back(pipeline);
+		state.wake.notify_one();
+	}
+
+	bool getPipeline(uint32_t pipeline, VkPipeline& outPipeline)
+	{
+		std::lock_guard<std::mutex> guard(state.lock);
+		if (state.pipelines[pipeline].state != EPipelineState::Done) return false;
+
+		outPipeline = state.pipelines[pipeline].pipeline;
+		return true;
+	}
+
+	CacheStats cacheStats()
+	{
+		std::lock_guard<std::mutex> guard(state.lock);
+		return state.stats;
+	}
+
+	void shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> guard(state.lock);
+			state.stopping = true;
+			state.wake.notify_one();
+		}
+
+		if (state.threadRunning)
+		{
+			state.thread.join();
+			state.threadRunning = false;
+		}
+
+		std::unique_lock<std::mutex> guard(state.lock);
+		for (uint32_t i = 0; i < state.pipelines.size(); ++i)
+		{
+			if (state.pipelines[i].state != EPipelineState::Free)
+			{
+				destroyPipeline(guard, i);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#include "stdafx.h"
+#include "vkh.h"
+#include "mesh_asset_format.h"
+
+//graphics pipelines are shared by every material that would build the same one, and can be built on a background 
+//thread instead of when their material is made. A material that's never drawn never pays for driver shader 
+//compilation, and one that is doesn't stall the frame it first shows up in
+namespace PipelineCompiler
+{
+	const uint32_t INVALID_PIPELINE = ~0u;
+	const uint32_t MAX_GRAPHICS_STAGES = 2;
+	const uint32_t MAX_SPEC_CONSTANTS = 16;
+
+	enum class EBlendMode : uint32_t
+	{
+		Opaque,
+		Alpha,		//src * srcAlpha + dst * (1 - srcAlpha)
+		Additive,	//src * srcAlpha + dst
+		Count
+	};
+
+	//the fixed function state a material can set. Every member is 4 bytes so there's no padding, and the whole thing can be hashed as is
+	struct RenderState
+	{
+		VkPrimitiveTopology topology;
+		VkPolygonMode polygonMode;
+		VkCullModeFlags cullMode;
+		VkFrontFace frontFace;
+		VkBool32 depthTest;
+		VkBool32 depthWrite;
+		VkCompareOp depthCompare;
+		EBlendMode blend;
+	};
+
+	//opaque, back face culled triangles with depth test and write, what every material got before they could set it
+	RenderState defaultRenderState();
+
+	//the specialization constants set for one stage. Materials only set scalars, so every value is 4 bytes (bools are VkBool32s).
+	//Only the first count entries are used, or hashed
+	struct SpecConstants
+	{
+		uint32_t count;
+		uint32_t ids[MAX_SPEC_CONSTANTS];
+		uint32_t values[MAX_SPEC_CONSTANTS];
+	};
+
+	//outEntries needs room for constants.count entries, and has to outlive the returned info along with constants
+	VkSpecializationInfo specializationInfo(const SpecConstants& constants, VkSpecializationMapEntry* outEntries);
+
+	//everything needed to build a material's graphics pipeline
+	struct GraphicsPipelineDesc
+	{
+		VkShaderModule modules[MAX_GRAPHICS_STAGES];
+		VkShaderStageFlagBits stages[MAX_GRAPHICS_STAGES];
+		uint64_t moduleHashes[MAX_GRAPHICS_STAGES];	//of the module's spir-v
+		uint32_t stageCount;
+		EVertexLayout vertexLayout;
+		RenderState renderState;
+		SpecConstants specConstants[MAX_GRAPHICS_STAGES];
+
+		//a shared pipeline is built with the layout of the first material that needed it. Layouts made from the same 
+		//set layout bindings and push constant range (same layoutHash) are compatible, so any of them can use it
+		VkPipelineLayout layout;
+		uint64_t layoutHash;
+	};
+
+	struct CacheStats
+	{
+		uint32_t requests;	//calls to acquire
+		uint32_t hits;		//acquires that found a matching pipeline already there
+		uint32_t created;	//pipelines actually built
+		uint32_t live;		//pipelines still used by at least one material
+	};
+
+	//the key pipelines are shared by. Covers the render pass too, since pipelines are built against it. Viewport and scissor are
+	//dynamic state, so they aren't part of it
+	uint64_t hashDesc(const GraphicsPipelineDesc& desc);
+
+	//builds the pipeline right away, the shader modules are left for the caller to destroy
+	void createGraphicsPipeline(const GraphicsPipelineDesc& desc, VkPipeline& outPipeline);
+
+	//finds the pipeline matching desc, or records a new one, and adds a reference to it. Always takes ownership of the desc's
+	//shader modules. Unless deferred, the pipeline is built (or waited for) before this returns 
+	uint32_t acquire(const GraphicsPipelineDesc& desc, bool deferred);
+
+	//the pipeline is destroyed along with its last reference. Pass the layout of the material letting go, if the pipeline
+	//was going to be built with it and other materials still need it, it's built now, before the layout is destroyed
+	void release(uint32_t pipeline, VkPipelineLayout layout);
+
+	//sends a deferred pipeline to the background thread, only the first call for a pipeline does anything
+	void requestCompile(uint32_t pipeline);
+
+	//returns true once the pipeline is built
+	bool getPipeline(uint32_t pipeline, VkPipeline& outPipeline);
+
+	CacheStats cacheStats();
+
+	//waits for the pipeline being built, if any, and destroys anything still around
+	void shutdown();
+}
\ No newline at end of file
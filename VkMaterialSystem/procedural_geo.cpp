@@ -6,7 +6,7 @@
 
 namespace Mesh
 {
-	void quad(float width, float height, float xOffset, float yOffset)
+	uint32_t quad(float width, float height, float xOffset, float yOffset)
 	{
 		std::vector<Vertex> verts;
 
@@ -18,13 +18,13 @@ namespace Mesh
 		glm::vec3 rbCorner = glm::vec3(wComp + xOffset, lbCorner.y, 0.0f);
 		glm::vec3 rtCorner = glm::vec3(rbCorner.x, ltCorner.y, 0.0f);
 
-		verts.push_back({ rtCorner,  glm::vec2(1.0f,1.0f), glm::vec4(1.0f,1.0f,1.0f,1.0f) });
-		verts.push_back({ ltCorner, glm::vec2(0.0f,1.0f), glm::vec4(0.0f,1.0f,1.0f,1.0f) });
-		verts.push_back({ lbCorner,glm::vec2(0.0f,0.0f), glm::vec4(1.0f,1.0f,1.0f,1.0f) });
-		verts.push_back({ rbCorner, glm::vec2(1.0f,0.0f), glm::vec4(1.0f,1.0f,1.0f,1.0f) });
+		verts.push_back({ rtCorner,  glm::vec2(1.0f,1.0f), glm::vec4(1.0f,1.0f,1.0f,1.0f), glm::vec3(0.0f,0.0f,1.0f) });
+		verts.push_back({ ltCorner, glm::vec2(0.0f,1.0f), glm::vec4(0.0f,1.0f,1.0f,1.0f), glm::vec3(0.0f,0.0f,1.0f) });
+		verts.push_back({ lbCorner,glm::vec2(0.0f,0.0f), glm::vec4(1.0f,1.0f,1.0f,1.0f), glm::vec3(0.0f,0.0f,1.0f) });
+		verts.push_back({ rbCorner, glm::vec2(1.0f,0.0f), glm::vec4(1.0f,1.0f,1.0f,1.0f), glm::vec3(0.0f,0.0f,1.0f) });
 
 		uint32_t indices[6] = { 0,2,1,2,0,3 };
 
-		make(&verts[0], static_cast<uint32_t>(verts.size()), &indices[0], 6);
+		return make(&verts[0], static_cast<uint32_t>(verts.size()), &indices[0], 6);
 	}
 }
\ No newline at end of file
@@ -2,5 +2,5 @@
 
 namespace Mesh
 {
-	void quad(float width = 2.0f, float height = 2.0f, float xOffset = 0.0f, float yOffset = 0.0f);
+	uint32_t quad(float width = 2.0f, float height = 2.0f, float xOffset = 0.0f, float yOffset = 0.0f);
 };
\ No newline at end of file
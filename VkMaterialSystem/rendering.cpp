@@ -1,11 +1,15 @@
 #include "stdafx.h"
 #include "rendering.h"
 #include "vkh.h"
+#include "vkh_initializers.h"
 #include "os_support.h"
 #include "os_input.h"
 #include "mesh.h"
 #include "asset_rdata_types.h"
 #include "material.h"
+#include "culling.h"
+#include "gpu_culling.h"
+#include "frame_allocator.h"
 
 namespace Rendering
 {
@@ -15,24 +19,131 @@ namespace Rendering
 	vkh::VkhRenderBuffer			depthBuffer;
 	std::vector<VkCommandBuffer>	commandBuffers;
 
+	float							lodVerticalFov = glm::radians(60.0f);
+	float							lodPixelError = 1.0f;
+	bool							lodViewSet = false;
+	glm::vec3						lodViewPos;
+
+	bool							meshletCulling = false;
+	glm::vec4						meshletFrustumPlanes[6];
+	glm::vec3						meshletCameraPos;
+	std::vector<MeshLod>			meshletRanges;
+
+	bool							gpuCulling = false;
+
+	//set by the window's resize callback, the swap chain is rebuilt at the start of the next frame
+	bool							swapChainDirty = false;
+
+	struct PendingDispatch
+	{
+		uint32_t materialId;
+		uint32_t groupCount[3];
+	};
+	std::vector<PendingDispatch>	pendingDispatches;
+
+	//meshes from the same blocks share buffers, so they're only bound when the next mesh's are different
+	VkBuffer						boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer						boundIndexBuffer = VK_NULL_HANDLE;
+	VkIndexType						boundIndexType;
+
+	FrameStats						frameStats = {};
+	FrameStats						lastStats = {};
+
+	//frames are presented from the transfer queue, anything that has to wait for a present waits on this
+	VkQueue presentingQueue()
+	{
+		return GContext.deviceQueues.transferQueue;
+	}
+
 	void createMainRenderPass();
+	void recordDispatches(uint32_t imageIndex);
+	void endFrame(uint32_t imageIndex);
+
+	//WM_SIZE comes in over and over while the window is being dragged, so all this does is flag the swap chain
+	void onWindowResized(int width, int height)
+	{
+		swapChainDirty = true;
+	}
+
+	//one command buffer per swap chain image, a recreated swap chain can have more images than the last one
+	void createCommandBuffers()
+	{
+		uint32_t swapChainImageCount = static_cast<uint32_t>(GContext.swapChain.imageViews.size());
+		while (commandBuffers.size() < swapChainImageCount)
+		{
+			VkCommandBuffer buffer;
+			vkh::createCommandBuffer(buffer, GContext.gfxCommandPool, GContext.device);
+			commandBuffers.push_back(buffer);
+		}
+	}
 
 	void init()
 	{
 		vkh::createWin32Context(GContext, GAppInfo.curW, GAppInfo.curH, GAppInfo.instance, GAppInfo.wndHdl, APP_NAME);
-		vkh::createDepthBuffer(depthBuffer, GAppInfo.curW, GAppInfo.curH, GContext.device, GContext.gpu.device);
+		vkh::createDepthBuffer(depthBuffer, GContext.swapChain.extent.width, GContext.swapChain.extent.height, GContext.device, GContext.gpu.device);
 
 		createMainRenderPass();
 
 		vkh::createFrameBuffers(frameBuffers, GContext.swapChain, &depthBuffer.view, GContext.mainRenderPass, GContext.device);
+		createCommandBuffers();
 
-		uint32_t swapChainImageCount = static_cast<uint32_t>(GContext.swapChain.imageViews.size());
-		commandBuffers.resize(swapChainImageCount);
-		for (uint32_t i = 0; i < swapChainImageCount; ++i)
+		os_setResizeCallback(onWindowResized);
+	}
+
+	//only what's sized to the swap chain gets rebuilt. Pipelines take their viewport and scissor as dynamic state, 
+	//and the render pass only depends on formats, so every material keeps what it has. Returns false while the 
+	//window is minimized, since there's nothing to render into until it comes back
+	bool recreateSwapChain()
+	{
+		VkSurfaceCapabilitiesKHR capabilities;
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(GContext.gpu.device, GContext.surface.surface, &capabilities);
+		if (capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0) return false;
+
+		//frames still in flight are rendering into the old framebuffers and depth buffer, and the old swap chain is
+		//destroyed below, so nothing can still be queued to present from it either
+		vkQueueWaitIdle(GContext.deviceQueues.graphicsQueue);
+		vkQueueWaitIdle(presentingQueue());
+
+		for (VkFramebuffer frameBuffer : frameBuffers)
 		{
-			vkh::createCommandBuffer(commandBuffers[i], GContext.gfxCommandPool, GContext.device);
+			vkDestroyFramebuffer(GContext.device, frameBuffer, nullptr);
 		}
+		vkh::destroyRenderBuffer(depthBuffer, GContext.device);
+
+		vkh::recreateSwapchain(GContext);
+
+		uint32_t width = GContext.swapChain.extent.width;
+		uint32_t height = GContext.swapChain.extent.height;
+		vkh::createDepthBuffer(depthBuffer, width, height, GContext.device, GContext.gpu.device);
+		vkh::createFrameBuffers(frameBuffers, GContext.swapChain, &depthBuffer.view, GContext.mainRenderPass, GContext.device);
+		createCommandBuffers();
+
+		if (gpuCulling)
+		{
+			GpuCulling::setDepthBuffer(depthBuffer, width, height);
+		}
+
+		swapChainDirty = false;
+		return true;
+	}
+
+	void setLodProjection(float verticalFovRadians, float pixelError)
+	{
+		lodVerticalFov = verticalFovRadians;
+		lodPixelError = pixelError;
+	}
+
+	void setLodViewPosition(const glm::vec3& viewPos)
+	{
+		lodViewPos = viewPos;
+		lodViewSet = true;
+	}
 
+	void setMeshletCullView(const glm::mat4& viewProj, const glm::vec3& cameraPos)
+	{
+		Culling::extractFrustumPlanes(viewProj, meshletFrustumPlanes);
+		meshletCameraPos = cameraPos;
+		meshletCulling = true;
 	}
 
 	void createMainRenderPass()
@@ -51,7 +162,7 @@ namespace Rendering
 		depthAttachment.format = vkh::depthFormat(); //common, no stencil though
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; //gpu culling builds its depth pyramid from this
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -65,16 +176,46 @@ namespace Rendering
 	}
 
 
-	void draw(uint32_t materialId)
+	void initGpuCulling(uint32_t maxObjects)
 	{
-		//acquire an image from the swap chain
-		uint32_t imageIndex;
+		GpuCulling::init(maxObjects, depthBuffer, GContext.swapChain.extent.width, GContext.swapChain.extent.height);
+		gpuCulling = true;
+	}
+
+	//gets the swap chain image to render to, with its command buffer ready for recording. Returns 
+	//false if there isn't one (the window is minimized), in which case the frame is skipped
+	bool beginFrame(uint32_t& imageIndex)
+	{
+		//any meshes made since last frame need to be on the gpu before we record
+		Mesh::flushUploads();
+
+		if (swapChainDirty && !recreateSwapChain())
+		{
+			frame::reset();
+			return false;
+		}
 
-		//using uint64 max for timeout disables it
+		//acquire an image from the swap chain, using uint64 max for timeout disables it. If the surface changed size 
+		//before the resize message got here, the swap chain is out of date and has to be rebuilt before it can be used
 		VkResult res = vkAcquireNextImageKHR(GContext.device, GContext.swapChain.swapChain, UINT64_MAX, GContext.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		if (res == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			if (!recreateSwapChain())
+			{
+				swapChainDirty = true;
+				frame::reset();
+				return false;
+			}
+
+			res = vkAcquireNextImageKHR(GContext.device, GContext.swapChain.swapChain, UINT64_MAX, GContext.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		}
+		checkf(res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR, "Failed to acquire a swap chain image");
 
-		vkh::waitForFence(GContext.frameFences[imageIndex], GContext.device);
-		vkResetFences(GContext.device, 1, &GContext.frameFences[imageIndex]);
+		//a suboptimal swap chain still works, it gets replaced next frame
+		if (res == VK_SUBOPTIMAL_KHR) swapChainDirty = true;
+
+		//the last frame recorded into this image's command buffer has to be done with it before it's recorded again
+		vkh::waitForFrame(GContext, imageIndex);
 
 		//record drawing
 		VkCommandBufferBeginInfo beginInfo = {};
@@ -83,8 +224,16 @@ namespace Rendering
 		beginInfo.pInheritanceInfo = nullptr; // Optional
 		vkResetCommandBuffer(commandBuffers[imageIndex], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 		res = vkBeginCommandBuffer(commandBuffers[imageIndex], &beginInfo);
+		assert(res == VK_SUCCESS);
 
+		recordDispatches(imageIndex);
+		frameStats = {};
+
+		return true;
+	}
 
+	void beginMainPass(uint32_t imageIndex)
+	{
 		VkRenderPassBeginInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		renderPassInfo.renderPass = GContext.mainRenderPass;
@@ -92,73 +241,280 @@ namespace Rendering
 		renderPassInfo.renderArea.offset = { 0, 0 };
 		renderPassInfo.renderArea.extent = GContext.swapChain.extent;
 
-		std::vector<VkClearValue> clearColors;
+		//color, then depth
+		VkClearValue clearColors[2];
+		clearColors[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearColors[1].depthStencil = { 1.0f, 0 };
 
-		//color
-		clearColors.push_back({ 0.0f, 0.0f, 0.0f, 1.0f });
+		renderPassInfo.clearValueCount = 2;
+		renderPassInfo.pClearValues = clearColors;
+		vkCmdBeginRenderPass(commandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		//depth
-		clearColors.push_back({ 1.0f, 1.0f, 1.0f, 1.0f });
+		//every material pipeline leaves these as dynamic state
+		VkViewport viewport = vkh::viewport(0, 0, static_cast<float>(GContext.swapChain.extent.width), static_cast<float>(GContext.swapChain.extent.height));
+		VkRect2D scissor = vkh::rect2D(0, 0, GContext.swapChain.extent.width, GContext.swapChain.extent.height);
+		vkCmdSetViewport(commandBuffers[imageIndex], 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffers[imageIndex], 0, 1, &scissor);
 
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearColors.size());
-		renderPassInfo.pClearValues = &clearColors[0];
-		vkCmdBeginRenderPass(commandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		boundVertexBuffer = VK_NULL_HANDLE;
+		boundIndexBuffer = VK_NULL_HANDLE;
+	}
+
+	void dispatch(uint32_t materialId, uint32_t threadsX, uint32_t threadsY, uint32_t threadsZ)
+	{
+		const MaterialRenderData& mat = Material::getRenderData(materialId);
+		checkf(mat.bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE, "Trying to dispatch a material that doesn't have a compute stage");
+
+		PendingDispatch pending = { materialId };
+		uint32_t threads[3] = { threadsX, threadsY, threadsZ };
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			pending.groupCount[i] = (threads[i] + mat.workgroupSize[i] - 1) / mat.workgroupSize[i];
+		}
+
+		pendingDispatches.push_back(pending);
+	}
+
+	//has to be outside a render pass, so this runs right after the command buffer begins
+	void recordDispatches(uint32_t imageIndex)
+	{
+		for (const PendingDispatch& pending : pendingDispatches)
+		{
+			const MaterialRenderData& mat = Material::getRenderData(pending.materialId);
+			checkf(Material::resourcesWritten(pending.materialId), "Dispatching a material with a storage image / texel buffer input that was never set");
+			vkCmdBindPipeline(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_COMPUTE, mat.pipeline);
+
+			if (mat.pushConstantLayout.blockSize > 0)
+			{
+				vkCmdPushConstants(commandBuffers[imageIndex], mat.pipelineLayout, mat.pushConstantLayout.visibleStages, 0, mat.pushConstantLayout.blockSize, mat.pushConstantData);
+			}
+
+			if (mat.numDescSets > 0)
+				vkCmdBindDescriptorSets(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_COMPUTE, mat.pipelineLayout, 0, mat.numDescSets, mat.descSets, 0, 0);
 
-		//eventually this will have to iterate over multiple objects/materials
+			vkCmdDispatch(commandBuffers[imageIndex], pending.groupCount[0], pending.groupCount[1], pending.groupCount[2]);
+
+			//later dispatches and this frame's draws can read whatever this one wrote, 
+			//whether that's as a storage buffer, vertex data or indirect draw args
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+			VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			vkCmdPipelineBarrier(commandBuffers[imageIndex], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		pendingDispatches.clear();
+	}
+
+	//binds the material and sets the per frame globals and push constants every material gets
+	void bindMaterial(uint32_t imageIndex, uint32_t materialId, const MeshRenderData* mesh)
+	{
+		const MaterialRenderData& mat = Material::getRenderData(materialId);
+		checkf(mat.bindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS, "Compute materials can't be drawn with, use Rendering::dispatch");
+		checkf(Material::resourcesWritten(materialId), "Drawing with a material that has a storage image / texel buffer input that was never set");
+		vkCmdBindPipeline(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mat.pipeline);
+
+		glm::vec4 mouseData = glm::vec4(0, 0, 0, 0);
+		mouseData.x = (float)getMouseX();
+		mouseData.y = (float)getMouseY();
+		mouseData.z = (float)getMouseLeftButton();
+		mouseData.w = (float)getMouseRightButton();
+
+		glm::vec2 resolution = glm::vec2(100, 100);
+
+
+		Material::setGlobalVector2("resolution", resolution);
+		Material::setGlobalVector4("mouse", mouseData);
+		Material::setGlobalFloat("time", (float)(os_getMilliseconds() / 1000.0f));
+
+		Material::setUniformVector4(materialId, "global.mouse"_h, mouseData);
+		Material::setUniformFloat(materialId, "test"_h, 1.0f);
+		if (mat.pushConstantLayout.blockSize > 0)
 		{
+			//push constant data is completely set up for every object 
+			Material::setPushConstantVector(materialId, "col"_h, glm::vec4(0.0, 1.0, 1.0, 1.0));
+			Material::setPushConstantFloat(materialId, "time"_h, (float)(os_getMilliseconds() / 1000.0f));
+
+			//only materials reading compact vertices will have these. Indirect draws don't have a 
+			//single mesh, but they only draw full meshes, which don't need rescaling
+			glm::vec4 posScale = mesh ? glm::vec4(mesh->posScale[0], mesh->posScale[1], mesh->posScale[2], 0.0f) : glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+			glm::vec4 posBias = mesh ? glm::vec4(mesh->posBias[0], mesh->posBias[1], mesh->posBias[2], 0.0f) : glm::vec4(0.0f);
+			Material::setPushConstantVector(materialId, "posScale"_h, posScale);
+			Material::setPushConstantVector(materialId, "posBias"_h, posBias);
+
+			vkCmdPushConstants(
+				commandBuffers[imageIndex],
+				mat.pipelineLayout,
+				mat.pushConstantLayout.visibleStages,
+				0,
+				mat.pushConstantLayout.blockSize,
+				mat.pushConstantData);
+		}
+
+		if (mat.numDescSets > 0)
+			vkCmdBindDescriptorSets(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mat.pipelineLayout, 0, mat.numDescSets, mat.descSets, 0, 0);
+	}
+
+	//a negative viewDistance is measured from the lod view position to the mesh's bounds
+	uint32_t selectLod(const MeshRenderData& mesh, float viewDistance)
+	{
+		if (viewDistance < 0.0f)
+		{
+			glm::vec3 center = glm::vec3(mesh.boundsCenter[0], mesh.boundsCenter[1], mesh.boundsCenter[2]);
+			viewDistance = lodViewSet ? glm::max(0.0f, glm::length(lodViewPos - center) - mesh.boundsRadius) : 0.0f;
+		}
 
-			const MeshRenderData& mesh = Mesh::getRenderData();
-			const MaterialRenderData& mat = Material::getRenderData(materialId);
+		float projScale = GContext.swapChain.extent.height / (2.0f * tanf(lodVerticalFov * 0.5f));
+		return Mesh::selectLod(mesh, viewDistance, projScale, lodPixelError);
+	}
+
+	//inside the main pass, with a material for the mesh's layout already bound
+	void recordMesh(uint32_t imageIndex, uint32_t meshId, const MeshRenderData& mesh, uint32_t lodIdx)
+	{
+		const MeshLod& lod = mesh.lods[lodIdx];
 
+		//meshlets that survive culling come back as merged index ranges, one draw each
+		const MeshLod* ranges = &lod;
+		uint32_t rangeCount = 1;
+		if (meshletCulling && lod.meshletCount > 0)
+		{
+			meshletRanges.resize(lod.meshletCount);
+			rangeCount = Mesh::cullMeshlets(meshId, lodIdx, meshletFrustumPlanes, meshletCameraPos, meshletRanges.data());
+			ranges = meshletRanges.data();
+		}
 
-			vkCmdBindPipeline(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mat.pipeline);
+		if (mesh.vBuffer != boundVertexBuffer)
+		{
 			VkBuffer vertexBuffers[] = { mesh.vBuffer };
 			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffers[imageIndex], 0, 1, vertexBuffers, offsets);
+			boundVertexBuffer = mesh.vBuffer;
+			frameStats.bufferBinds++;
+		}
+
+		if (mesh.iBuffer != boundIndexBuffer || mesh.indexType != boundIndexType)
+		{
+			vkCmdBindIndexBuffer(commandBuffers[imageIndex], mesh.iBuffer, 0, mesh.indexType);
+			boundIndexBuffer = mesh.iBuffer;
+			boundIndexType = mesh.indexType;
+			frameStats.bufferBinds++;
+		}
+
+		for (uint32_t r = 0; r < rangeCount; ++r)
+		{
+			vkCmdDrawIndexed(commandBuffers[imageIndex], ranges[r].indexCount, 1, mesh.iOffset + ranges[r].firstIndex, mesh.vOffset, 0);
+		}
+		frameStats.draws += rangeCount;
+	}
+
+	uint32_t draw(uint32_t materialId, uint32_t meshId, float viewDistance)
+	{
+		uint32_t imageIndex;
+		if (!beginFrame(imageIndex)) return 0;
+		beginMainPass(imageIndex);
+
+		const MeshRenderData& mesh = Mesh::getRenderData(meshId);
+		const MaterialRenderData& mat = Material::getRenderData(materialId);
+		checkf(mesh.layout == mat.vertexLayout, "Mesh vertex layout doesn't match the material's pipeline");
 
-			glm::vec4 mouseData = glm::vec4(0, 0, 0, 0);
-			mouseData.x = (float)getMouseX();
-			mouseData.y = (float)getMouseY();
-			mouseData.z = (float)getMouseLeftButton();
-			mouseData.w = (float)getMouseRightButton();
+		//a material still waiting on its pipeline draws with the fallback, which can only stand in for
+		//meshes of its own vertex layout. Without one, the mesh just isn't drawn this frame
+		uint32_t drawMaterialId;
+		bool canDraw = Material::materialForDraw(materialId, drawMaterialId);
+		canDraw = canDraw && Material::getRenderData(drawMaterialId).vertexLayout == mesh.layout;
 
-			glm::vec2 resolution = glm::vec2(100, 100);
+		uint32_t lodIdx = selectLod(mesh, viewDistance);
 
+		if (canDraw)
+		{
+			bindMaterial(imageIndex, drawMaterialId, &mesh);
+			recordMesh(imageIndex, meshId, mesh, lodIdx);
+		}
+
+		vkCmdEndRenderPass(commandBuffers[imageIndex]);
+		endFrame(imageIndex);
+
+		return lodIdx;
+	}
+
+	uint32_t drawObjects(uint32_t materialId, const uint32_t* meshIds, const Culling::ObjectBoundsSet& bounds, Culling::EBoundsTest test, uint32_t threadCount)
+	{
+		uint32_t imageIndex;
+		if (!beginFrame(imageIndex)) return 0;
+
+		//the visible list only has to last until the draws are recorded
+		glm::vec4 planes[6];
+		Culling::extractGlobalFrustumPlanes(planes);
+		uint32_t* visible = frame::allocArray<uint32_t>(bounds.count);
+		uint32_t visibleCount = Culling::cullObjects(bounds, test, planes, visible, threadCount);
 
-			Material::setGlobalVector2("resolution", resolution);
-			Material::setGlobalVector4("mouse", mouseData);
-			Material::setGlobalFloat("time", (float)(os_getMilliseconds() / 1000.0f));
+		beginMainPass(imageIndex);
 
-			Material::setUniformVector4(materialId, "global.mouse", mouseData);
-			Material::setUniformFloat(materialId, "test", 1.0f);
-			if (Material::getRenderData(materialId).pushConstantLayout.blockSize > 0)
+		const MaterialRenderData& mat = Material::getRenderData(materialId);
+		uint32_t drawMaterialId;
+		if (Material::materialForDraw(materialId, drawMaterialId) && Material::getRenderData(drawMaterialId).vertexLayout == mat.vertexLayout)
+		{
+			for (uint32_t i = 0; i < visibleCount; ++i)
 			{
-				//push constant data is completely set up for every object 
-				Material::setPushConstantVector(materialId, "col", glm::vec4(0.0, 1.0, 1.0, 1.0));
-				Material::setPushConstantFloat(materialId, "time", (float)(os_getMilliseconds() / 1000.0f));
-
-				vkCmdPushConstants(
-					commandBuffers[imageIndex],
-					mat.pipelineLayout,
-					mat.pushConstantLayout.visibleStages,
-					0,
-					mat.pushConstantLayout.blockSize,
-					mat.pushConstantData);
+				uint32_t meshId = meshIds[visible[i]];
+				const MeshRenderData& mesh = Mesh::getRenderData(meshId);
+				checkf(mesh.layout == mat.vertexLayout, "Mesh vertex layout doesn't match the material's pipeline");
+
+				//compact meshes each need their own dequantization push constants
+				if (i == 0 || mesh.layout == EVertexLayout::Compact)
+				{
+					bindMaterial(imageIndex, drawMaterialId, &mesh);
+				}
+
+				recordMesh(imageIndex, meshId, mesh, selectLod(mesh, -1.0f));
 			}
+		}
 
-			if (mat.numDescSets > 0)
-				vkCmdBindDescriptorSets(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mat.pipelineLayout, 0, mat.numDescSets, mat.descSets, 0, 0);
+		vkCmdEndRenderPass(commandBuffers[imageIndex]);
+		endFrame(imageIndex);
 
-			vkCmdBindVertexBuffers(commandBuffers[imageIndex], 0, 1, vertexBuffers, offsets);
-			vkCmdBindIndexBuffer(commandBuffers[imageIndex], mesh.iBuffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(commandBuffers[imageIndex], static_cast<uint32_t>(mesh.iCount), 1, 0, 0, 0);
+		return visibleCount;
+	}
 
-		}
+	void drawGpuCulled(uint32_t materialId, const glm::mat4& viewProj)
+	{
+		checkf(gpuCulling, "initGpuCulling needs to be called before drawing gpu culled objects");
+
+		uint32_t imageIndex;
+		if (!beginFrame(imageIndex)) return;
 
+		GpuCulling::recordCull(commandBuffers[imageIndex], imageIndex, viewProj);
 
+		beginMainPass(imageIndex);
+
+		uint32_t drawMaterialId;
+		if (Material::materialForDraw(materialId, drawMaterialId) && Material::getRenderData(drawMaterialId).vertexLayout == Material::getRenderData(materialId).vertexLayout)
+		{
+			bindMaterial(imageIndex, drawMaterialId, nullptr);
+			GpuCulling::recordDraws(commandBuffers[imageIndex], Material::getRenderData(drawMaterialId).vertexLayout);
+		}
 		vkCmdEndRenderPass(commandBuffers[imageIndex]);
-		res = vkEndCommandBuffer(commandBuffers[imageIndex]);
+
+		//next frame's occlusion culling tests against what was just drawn
+		GpuCulling::recordDepthPyramid(commandBuffers[imageIndex]);
+
+		endFrame(imageIndex);
+	}
+
+	FrameStats lastFrameStats()
+	{
+		return lastStats;
+	}
+
+	void endFrame(uint32_t imageIndex)
+	{
+		VkResult res = vkEndCommandBuffer(commandBuffers[imageIndex]);
 		assert(res == VK_SUCCESS);
 
+		lastStats = frameStats;
+
 
 		//submit
 
@@ -181,6 +537,7 @@ namespace Rendering
 
 		res = vkQueueSubmit(GContext.deviceQueues.graphicsQueue, 1, &submitInfo, GContext.frameFences[imageIndex]);
 		assert(res == VK_SUCCESS);
+		vkh::markFrameSubmitted(GContext, imageIndex);
 
 		//present
 
@@ -195,6 +552,15 @@ namespace Rendering
 		presentInfo.pSwapchains = swapChains;
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.pResults = nullptr; // Optional
-		res = vkQueuePresentKHR(GContext.deviceQueues.transferQueue, &presentInfo);
+		res = vkQueuePresentKHR(presentingQueue(), &presentInfo);
+
+		//the window changed size since the image was acquired, the frame still went through
+		if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR)
+		{
+			swapChainDirty = true;
+		}
+
+		//nothing recorded this frame needs its transient cpu data anymore
+		frame::reset();
 	}
 }
\ No newline at end of file
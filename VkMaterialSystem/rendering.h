@@ -1,7 +1,47 @@
 #pragma once
+#include "culling.h"
 
 namespace Rendering
 {
+	//what the last submitted frame's mesh draws recorded. Gpu culled draws are recorded by GpuCulling, and aren't counted
+	struct FrameStats
+	{
+		uint32_t draws;			//vkCmdDrawIndexed calls
+		uint32_t bufferBinds;	//vkCmdBindVertexBuffers + vkCmdBindIndexBuffer calls
+	};
+
 	void init();
-	void draw(uint32_t materialId);
+
+	//lod selection needs to know how big a mesh's error ends up on screen. Defaults to a 60 degree
+	//vertical fov and a 1 pixel error
+	void setLodProjection(float verticalFovRadians, float pixelError);
+
+	//meshes with meshlets only draw the ones that pass frustum and backface cone culling against this
+	//view. Both need to be in the space of the meshes being drawn. Meshlet culling is off until this is called
+	void setMeshletCullView(const glm::mat4& viewProj, const glm::vec3& cameraPos);
+
+	//where lod selection measures each mesh's distance from, in the space of the meshes being drawn
+	void setLodViewPosition(const glm::vec3& viewPos);
+
+	//viewDistance is how far the mesh is from the camera, 0 always draws lod 0. Left negative it's the distance from the 
+	//lod view position to the mesh's bounds, which is lod 0 until setLodViewPosition is called. Returns the lod that was drawn
+	uint32_t draw(uint32_t materialId, uint32_t meshId, float viewDistance = -1.0f);
+
+	//culls bounds against the global view matrix (see Culling::cullObjects for threadCount), then draws the mesh of every
+	//object that's visible in one frame, each at the lod for its distance from the lod view position. meshIds is indexed
+	//by object, and every mesh has to use the material's vertex layout. Returns the number of objects drawn
+	uint32_t drawObjects(uint32_t materialId, const uint32_t* meshIds, const Culling::ObjectBoundsSet& bounds, Culling::EBoundsTest test, uint32_t threadCount = 1);
+
+	FrameStats lastFrameStats();
+
+	//sets up gpu culling for up to maxObjects objects, which are added with GpuCulling::addObject
+	void initGpuCulling(uint32_t maxObjects);
+
+	//culls every GpuCulling object in a compute pass against viewProj and last frame's depth, 
+	//then draws whatever survived with one indirect draw using the given material
+	void drawGpuCulled(uint32_t materialId, const glm::mat4& viewProj);
+
+	//queues a compute material to run at the start of the next frame, before anything is drawn. The thread
+	//counts are rounded up to whole workgroups, and the material's storage writes are visible to every draw after it
+	void dispatch(uint32_t materialId, uint32_t threadsX, uint32_t threadsY = 1, uint32_t threadsZ = 1);
 }
\ No newline at end of file
@@ -8,32 +8,62 @@
 #include "material_creation.h"
 #include "texture.h"
 #include "vkh.h"
+#include "vkh_allocator_stats.h"
+#include "vkh_allocator_pool.h"
+#include "pipeline_compiler.h"
+#include "culling.h"
+
 namespace App
 {
 	uint32_t matId = 0;
+	uint32_t meshId = 0;
+
+	//how much device memory the defragmenter is allowed to move in a single frame
+	const VkDeviceSize DEFRAG_BYTES_PER_FRAME = 4 * 1024 * 1024;
+
+	//total device memory streamed textures can grow into
+	const VkDeviceSize TEXTURE_STREAMING_BUDGET = 64 * 1024 * 1024;
 
 	void init()
 	{
 		Rendering::init();
 		//Texture::make("../data/textures/test_texture.jpg");
 		Material::initGlobalShaderData();
+
+		//deferred materials and keyword variants draw with this until their own pipeline is built
+		Material::setFallbackMaterial(Material::make("../data/materials/fallback.mat"));
+
 		uint32_t fruits = Texture::make("../data/textures/fruits.png");
 		matId = Material::make("../data/materials/raymarch_primitives.mat");
 
-		Material::setTexture(matId, "testSampler", fruits);
+		Material::setTexture(matId, "testSampler"_h, fruits);
 
-		Mesh::quad(2.0f, 2.0f);
+		meshId = Mesh::quad(2.0f, 2.0f);
 
-		printf("Total allocation count: %i\n", vkh::GContext.allocator.numAllocs());
+		vkh::AllocatorStats allocStats;
+		vkh::allocators::collectStats(allocStats);
+		printf("Total allocation count: %i (%i device memory blocks, %.3f fragmentation)\n", 
+			allocStats.total.allocCount, allocStats.total.blockCount, allocStats.total.fragmentation);
 	}
 
 	void tick(float deltaTime)
 	{
-		Rendering::draw(matId);
+		Rendering::draw(matId, meshId);
+		Texture::tickStreaming(TEXTURE_STREAMING_BUDGET);
+		vkh::allocators::pool::tickDefrag(DEFRAG_BYTES_PER_FRAME);
+		vkh::allocators::tickFrameStats();
 	}
 
 	void kill()
 	{
-		
+		//the compile, streaming and culling threads have to be joined before the program exits
+		PipelineCompiler::shutdown();
+		Texture::shutdown();
+		Culling::shutdown();
+		Material::destroy();
+
+		vkh::AllocatorStats allocStats;
+		vkh::allocators::collectStats(allocStats);
+		vkh::allocators::dumpStatsToJSON(allocStats, "../data/_generated/alloc_stats.json");
 	}
 }
\ No newline at end of file
@@ -2,8 +2,16 @@
 
 #include "texture.h"
 #include "asset_rdata_types.h"
+#include "dds_format.h"
+#include "file_utils.h"
 #include "hash.h"
+#include "image_utils.h"
+#include "material.h"
+#include "vkh_allocator_pool.h"
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <thread>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb\stb_image.h>
@@ -14,11 +22,33 @@ struct TextureAsset
 	uint32_t width;
 	uint32_t height;
 	uint32_t numChannels;
+	uint32_t fullMipLevels;
+
+	//texture ids are a 32 bit hash of the path, which can collide, this is what tells two paths apart
+	uint64_t pathKey;
+
+	//streaming - the resident image only holds mips residentBaseMip to fullMipLevels-1,
+	//higher mips are decoded from path again when they're needed
+	bool streamed;
+	char path[256];
+	uint32_t residentBaseMip;
+	uint32_t desiredBaseMip;
+};
+
+//an image or view that frames submitted before it was replaced can still be sampling through a material's
+//descriptors. Only image, view and deviceMemory are used, and any of them can be null
+struct RetiredImage
+{
+	TextureRenderData rData;
+	uint64_t lastFrame;
 };
 
 struct TextureStorage
 {
 	std::map<uint32_t, TextureAsset> data;
+
+	//in the order they were retired
+	std::vector<RetiredImage> retired;
 };
 
 TextureStorage texStorage;
@@ -26,78 +56,702 @@ TextureStorage texStorage;
 
 namespace Texture
 {
+	//transfer src is needed for blitting mips, and so the defragmenter can copy out of these
+	const VkImageUsageFlags TEXTURE_IMAGE_USAGE = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	//streamed textures start with every mip that's this size or smaller
+	const uint32_t STREAMING_INITIAL_MIP_SIZE = 64;
+
+	//enough for a 2^31 texel wide image
+	const uint32_t MAX_MIP_LEVELS = 32;
+
 	TextureRenderData* getRenderData(uint32_t texId)
 	{
 		return &texStorage.data[texId].rData;
 	}
 
-	uint32_t make(const char* filepath)
+	void retireImage(VkImage image, VkImageView view, const vkh::Allocation& memory)
 	{
-		uint32_t newId = hash(filepath);
-		if (texStorage.data.find(newId) != texStorage.data.end())
+		RetiredImage retired = {};
+		retired.rData.image = image;
+		retired.rData.view = view;
+		retired.rData.deviceMemory = memory;
+		retired.lastFrame = vkh::GContext.lastFrameSerial;
+		texStorage.retired.push_back(retired);
+	}
+
+	void releaseRetiredImages()
+	{
+		//frames retired later are never finished before ones retired earlier, so stop at the first still in use
+		uint32_t released = 0;
+		for (; released < texStorage.retired.size(); ++released)
 		{
-			return newId;
+			RetiredImage& retired = texStorage.retired[released];
+			if (!vkh::frameCompleted(vkh::GContext, retired.lastFrame)) break;
+
+			if (retired.rData.view != VK_NULL_HANDLE) vkDestroyImageView(vkh::GContext.device, retired.rData.view, nullptr);
+			if (retired.rData.image != VK_NULL_HANDLE) vkDestroyImage(vkh::GContext.device, retired.rData.image, nullptr);
+			if (retired.rData.deviceMemory.handle != VK_NULL_HANDLE) vkh::freeDeviceMemory(retired.rData.deviceMemory);
 		}
 
+		texStorage.retired.erase(texStorage.retired.begin(), texStorage.retired.begin() + released);
+	}
+
+	void onTextureRelocated(void* userData, const vkh::allocators::pool::Relocation& relocation)
+	{
+		uint32_t texId = (uint32_t)(uintptr_t)userData;
+		TextureRenderData& rData = texStorage.data[texId].rData;
+
+		//the allocator takes care of the old image, but the view is ours
+		retireImage(VK_NULL_HANDLE, rData.view, vkh::Allocation());
+
+		rData.image = relocation.newResources[0].image;
+		rData.deviceMemory = relocation.newMemory;
+		vkh::createImageView(rData.view, rData.mipLevels, rData.image, rData.format);
+
+		Material::patchImageDescriptors(texId);
+	}
 
-		TextureAsset t;
+	void registerForRelocation(uint32_t texId, const TextureAsset& t)
+	{
+		vkh::allocators::pool::RelocatableResource relocatable = {};
+		relocatable.image = t.rData.image;
+		relocatable.imageUsage = TEXTURE_IMAGE_USAGE;
+		relocatable.imageFormat = t.rData.format;
+		relocatable.imageWidth = ImageUtils::mipDimension(t.width, t.residentBaseMip);
+		relocatable.imageHeight = ImageUtils::mipDimension(t.height, t.residentBaseMip);
+		relocatable.imageMipLevels = t.rData.mipLevels;
+		relocatable.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		int texWidth, texHeight, texChannels;
+		vkh::allocators::pool::registerRelocatable(t.rData.deviceMemory, &relocatable, 1, onTextureRelocated, (void*)(uintptr_t)texId);
+	}
 
-		//STBI_rgb_alpha forces an alpha even if the image doesn't have one
-		stbi_uc* pixels = stbi_load(filepath, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	VkDeviceSize residentSize(const TextureAsset& t, uint32_t baseMip)
+	{
+		VkDeviceSize size = 0;
+		for (uint32_t mip = baseMip; mip < t.fullMipLevels; ++mip)
+		{
+			size += ImageUtils::rgba8MipSize(t.width, t.height, mip);
+		}
+		return size;
+	}
 
-		checkf(pixels, "Could not load image");
+	//has to be kept until the command buffer copying out of it has executed
+	struct StagingBuffer
+	{
+		VkBuffer buffer;
+		vkh::Allocation memory;
+	};
 
-		VkDeviceSize imageSize = texWidth * texHeight * 4;
+	void destroyStagingBuffer(StagingBuffer& staging)
+	{
+		vkDestroyBuffer(vkh::GContext.device, staging.buffer, nullptr);
+		vkh::freeDeviceMemory(staging.memory);
+	}
 
-		VkBuffer stagingBuffer;
-		vkh::Allocation stagingBufferMemory;
+	//creates outData's image with mipLevels levels and records uploading the first uploadedMips of them from data,
+	//which holds each mip tightly packed, largest first. Leaves the uploaded levels in TRANSFER_DST_OPTIMAL
+	void recordImageUpload(TextureRenderData& outData, StagingBuffer& outStaging, const uint8_t* data, const VkDeviceSize* mipSizes, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t uploadedMips, vkh::VkhCommandBuffer& cmd)
+	{
+		VkDeviceSize imageSize = 0;
+		for (uint32_t mip = 0; mip < uploadedMips; ++mip)
+		{
+			imageSize += mipSizes[mip];
+		}
 
-		vkh::createBuffer(stagingBuffer,
-			stagingBufferMemory,
+		vkh::createBuffer(outStaging.buffer,
+			outStaging.memory,
 			imageSize,
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-		void* data;
-		vkMapMemory(vkh::GContext.device, stagingBufferMemory.handle, stagingBufferMemory.offset, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(vkh::GContext.device, stagingBufferMemory.handle);
-
-		stbi_image_free(pixels);
-
-		t.width = texWidth;
-		t.height = texHeight;
-		t.numChannels = texChannels;
-		t.rData.format = VK_FORMAT_R8G8B8A8_UNORM;
+		memcpy(outStaging.memory.mapped, data, static_cast<size_t>(imageSize));
 
 		//VK image format must match buffer
-		vkh::createImage(t.rData.image,
-			t.width, t.height,
-			VK_FORMAT_R8G8B8A8_UNORM,
+		vkh::createImage(outData.image,
+			width, height,
+			mipLevels,
+			outData.format,
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+			TEXTURE_IMAGE_USAGE);
 
-		vkh::allocBindImageToMem(t.rData.deviceMemory,
-			t.rData.image,
+		vkh::allocBindImageToMem(outData.deviceMemory,
+			outData.image,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		vkh::transitionImageLayout(t.rData.image, t.rData.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-		vkh::copyBufferToImage(stagingBuffer, t.rData.image, t.width, t.height);
+		vkh::transitionImageLayout(outData.image, outData.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, cmd);
+
+		VkDeviceSize bufferOffset = 0;
+		for (uint32_t mip = 0; mip < uploadedMips; ++mip)
+		{
+			vkh::copyBufferToImage(outStaging.buffer, bufferOffset, outData.image, ImageUtils::mipDimension(width, mip), ImageUtils::mipDimension(height, mip), mip, cmd);
+			bufferOffset += mipSizes[mip];
+		}
+	}
+
+	void createImageAndUpload(TextureRenderData& outData, const uint8_t* data, const VkDeviceSize* mipSizes, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t uploadedMips)
+	{
+		StagingBuffer staging;
+		vkh::VkhCommandBuffer cmd = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Graphics);
+		recordImageUpload(outData, staging, data, mipSizes, width, height, mipLevels, uploadedMips, cmd);
+		vkh::submitScratchCommandBuffer(cmd);
+		destroyStagingBuffer(staging);
+	}
+
+	//the cpu half of createMippedImage, which doesn't touch vulkan so it can run on the streaming thread. Returns
+	//uploadedMips levels starting at baseMip, tightly packed in a malloc'd buffer, and fills outMipSizes
+	uint8_t* buildUploadMips(const stbi_uc* pixels, uint32_t width, uint32_t height, uint32_t baseMip, uint32_t uploadedMips, VkDeviceSize* outMipSizes)
+	{
+		VkDeviceSize imageSize = 0;
+		for (uint32_t mip = 0; mip < uploadedMips; ++mip)
+		{
+			outMipSizes[mip] = ImageUtils::rgba8MipSize(width, height, baseMip + mip);
+			imageSize += outMipSizes[mip];
+		}
+
+		//downsampling reads back the previous mip, so build the chain in regular memory
+		//rather than in the mapped staging buffer
+		uint8_t* mipData = (uint8_t*)malloc(imageSize);
+		ImageUtils::buildRGBA8MipChain(pixels, width, height, baseMip, baseMip + uploadedMips - 1, mipData);
+		return mipData;
+	}
+
+	//if the format can be blitted, only the top level goes through the staging buffer and the rest are generated on the gpu
+	uint32_t uploadedMipCount(VkFormat format, uint32_t mipLevels)
+	{
+		return vkh::formatSupportsLinearBlit(format) ? 1 : mipLevels;
+	}
+
+	//the gpu half of createMippedImage, mipData is what buildUploadMips made for the same mips
+	void recordMippedUpload(TextureRenderData& outData, StagingBuffer& outStaging, const uint8_t* mipData, const VkDeviceSize* mipSizes, uint32_t width, uint32_t height, uint32_t baseMip, uint32_t fullMipLevels, vkh::VkhCommandBuffer& cmd)
+	{
+		uint32_t mipLevels = fullMipLevels - baseMip;
+		uint32_t baseWidth = ImageUtils::mipDimension(width, baseMip);
+		uint32_t baseHeight = ImageUtils::mipDimension(height, baseMip);
+
+		bool gpuMips = vkh::formatSupportsLinearBlit(outData.format);
+		uint32_t uploadedMips = uploadedMipCount(outData.format, mipLevels);
+
+		recordImageUpload(outData, outStaging, mipData, mipSizes, baseWidth, baseHeight, mipLevels, uploadedMips, cmd);
+
+		if (gpuMips)
+		{
+			vkh::generateMipmaps(outData.image, outData.format, baseWidth, baseHeight, mipLevels, cmd);
+		}
+		else
+		{
+			vkh::transitionImageLayout(outData.image, outData.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels, cmd);
+		}
+
+		vkh::createImageView(outData.view, mipLevels, outData.image, outData.format);
+		outData.mipLevels = mipLevels;
+	}
+
+	void uploadMippedImage(TextureRenderData& outData, const uint8_t* mipData, const VkDeviceSize* mipSizes, uint32_t width, uint32_t height, uint32_t baseMip, uint32_t fullMipLevels)
+	{
+		StagingBuffer staging;
+		vkh::VkhCommandBuffer cmd = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Graphics);
+		recordMippedUpload(outData, staging, mipData, mipSizes, width, height, baseMip, fullMipLevels, cmd);
+		vkh::submitScratchCommandBuffer(cmd);
+		destroyStagingBuffer(staging);
+	}
+
+	//creates an image holding mips baseMip to fullMipLevels-1 of pixels. If the format can be blitted,
+	//only the top level goes through the staging buffer and the rest are generated on the gpu,
+	//otherwise the whole chain is built on the cpu
+	void createMippedImage(TextureRenderData& outData, const stbi_uc* pixels, uint32_t width, uint32_t height, uint32_t baseMip, uint32_t fullMipLevels)
+	{
+		VkDeviceSize mipSizes[MAX_MIP_LEVELS];
+		uint32_t uploadedMips = uploadedMipCount(outData.format, fullMipLevels - baseMip);
+
+		uint8_t* mipData = buildUploadMips(pixels, width, height, baseMip, uploadedMips, mipSizes);
+		uploadMippedImage(outData, mipData, mipSizes, width, height, baseMip, fullMipLevels);
+		free(mipData);
+	}
+
+	VkFormat vkFormatForDDS(DDS::Format format)
+	{
+		switch (format)
+		{
+			case DDS::FORMAT_BC1_UNORM: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+			case DDS::FORMAT_BC3_UNORM: return VK_FORMAT_BC3_UNORM_BLOCK;
+			case DDS::FORMAT_BC5_UNORM: return VK_FORMAT_BC5_UNORM_BLOCK;
+			case DDS::FORMAT_BC7_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK;
+			default: checkf(0, "Unsupported DDS format, cook textures with TexturePipeline"); return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	//cooked textures already contain every mip, so the blocks are uploaded as is
+	void createImageFromDDS(TextureAsset& t, const char* filepath)
+	{
+		checkf(vkh::GContext.gpu.features.textureCompressionBC, "Device doesn't support BC compressed textures");
+
+		BinaryBuffer* file = loadBinaryFile(filepath);
+		checkf(file, "Could not load image");
+
+		const size_t headersSize = sizeof(uint32_t) + sizeof(DDS::Header) + sizeof(DDS::HeaderDX10);
+		checkf(file->size >= headersSize, "DDS file is truncated");
+
+		uint32_t magic;
+		DDS::Header header;
+		DDS::HeaderDX10 headerDX10;
+
+		memcpy(&magic, file->data, sizeof(uint32_t));
+		memcpy(&header, file->data + sizeof(uint32_t), sizeof(DDS::Header));
+		memcpy(&headerDX10, file->data + sizeof(uint32_t) + sizeof(DDS::Header), sizeof(DDS::HeaderDX10));
+
+		checkf(magic == DDS::MAGIC, "File is not a DDS");
+		checkf(header.pixelFormat.fourCC == DDS::FOURCC_DX10, "Only DDS files with a DX10 header are supported");
+		checkf(headerDX10.resourceDimension == DDS::RESOURCE_DIMENSION_TEXTURE2D && headerDX10.arraySize == 1, "Only single 2D DDS textures are supported");
+
+		t.width = header.width;
+		t.height = header.height;
+		t.numChannels = 4;
+		t.fullMipLevels = header.mipMapCount > 0 ? header.mipMapCount : 1;
+		t.rData.format = vkFormatForDDS(headerDX10.format);
+
+		checkf(t.fullMipLevels <= MAX_MIP_LEVELS, "DDS file has too many mips");
+
+		VkDeviceSize mipSizes[MAX_MIP_LEVELS];
+		VkDeviceSize imageSize = 0;
+		for (uint32_t mip = 0; mip < t.fullMipLevels; ++mip)
+		{
+			mipSizes[mip] = DDS::mipSize(headerDX10.format, ImageUtils::mipDimension(t.width, mip), ImageUtils::mipDimension(t.height, mip));
+			imageSize += mipSizes[mip];
+		}
+
+		checkf(file->size - headersSize >= imageSize, "DDS file is truncated");
+
+		createImageAndUpload(t.rData, (const uint8_t*)file->data + headersSize, mipSizes, t.width, t.height, t.fullMipLevels, t.fullMipLevels);
+		vkh::transitionImageLayout(t.rData.image, t.rData.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, t.fullMipLevels);
+
+		vkh::createImageView(t.rData.view, t.fullMipLevels, t.rData.image, t.rData.format);
+		t.rData.mipLevels = t.fullMipLevels;
+
+		freeBinaryBuffer(file);
+	}
+
+	//finds the id for a path, either the one it's already loaded under or the first free one at or after its hash.
+	//Returns true if the texture already exists
+	bool findTextureId(const char* path, uint32_t& outId, uint64_t& outPathKey)
+	{
+		outPathKey = hash64(path);
+
+		for (outId = hash(path); texStorage.data.count(outId) > 0; ++outId)
+		{
+			if (texStorage.data[outId].pathKey == outPathKey) return true;
+			printf("Texture id collision between %s and an existing texture, using the next free id\n", path);
+		}
+		return false;
+	}
+
+	bool isDDSPath(const char* filepath)
+	{
+		size_t len = strlen(filepath);
+		return len > 4 && strcmp(filepath + len - 4, ".dds") == 0;
+	}
+
+	uint32_t makeInternal(const char* filepath, bool streamed)
+	{
+		uint32_t newId;
+		uint64_t pathKey;
+		if (findTextureId(filepath, newId, pathKey))
+		{
+			return newId;
+		}
+
+		TextureAsset t = {};
+		t.pathKey = pathKey;
+
+		if (isDDSPath(filepath))
+		{
+			checkf(!streamed, "Streaming isn't supported for cooked textures");
+			createImageFromDDS(t, filepath);
+		}
+		else
+		{
+			int texWidth, texHeight, texChannels;
+
+			//STBI_rgb_alpha forces an alpha even if the image doesn't have one
+			stbi_uc* pixels = stbi_load(filepath, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+			checkf(pixels, "Could not load image");
+
+			t.width = texWidth;
+			t.height = texHeight;
+			t.numChannels = texChannels;
+			t.fullMipLevels = vkh::mipLevelsForExtent(t.width, t.height);
+			t.rData.format = VK_FORMAT_R8G8B8A8_UNORM;
+
+			if (streamed)
+			{
+				checkf(strlen(filepath) < sizeof(t.path), "Streamed texture path is too long");
+				snprintf(t.path, sizeof(t.path), "%s", filepath);
 
-		vkh::transitionImageLayout(t.rData.image, t.rData.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				uint32_t largest = t.width > t.height ? t.width : t.height;
+				while (t.residentBaseMip < t.fullMipLevels - 1 && (largest >> t.residentBaseMip) > STREAMING_INITIAL_MIP_SIZE)
+				{
+					t.residentBaseMip++;
+				}
 
-		vkh::createImageView(t.rData.view, 1, t.rData.image, t.rData.format);
-		vkh::createTexSampler(t.rData.sampler);
+				t.streamed = true;
+			}
 
-		vkDestroyBuffer(vkh::GContext.device, stagingBuffer, nullptr);
-		vkh::freeDeviceMemory(stagingBufferMemory);
+			createMippedImage(t.rData, pixels, t.width, t.height, t.residentBaseMip, t.fullMipLevels);
+			stbi_image_free(pixels);
+		}
+
+		//the sampler covers the full chain even when streaming, the view limits it to what's resident
+		vkh::createTexSampler(t.rData.sampler, t.fullMipLevels);
+		t.rData.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 		texStorage.data.insert(std::pair<uint32_t, TextureAsset>(newId, t));
+		registerForRelocation(newId, t);
+
 		return newId;
 	}
 
+	uint32_t make(const char* filepath)
+	{
+		return makeInternal(filepath, false);
+	}
+
+	uint32_t makeStreamed(const char* filepath)
+	{
+		return makeInternal(filepath, true);
+	}
+
+	uint32_t makeStorage(const char* name, uint32_t width, uint32_t height, VkFormat format)
+	{
+		uint32_t newId;
+		uint64_t pathKey;
+		bool exists = findTextureId(name, newId, pathKey);
+		checkf(!exists, "A texture with this name already exists");
+
+		TextureAsset t = {};
+		t.pathKey = pathKey;
+		t.width = width;
+		t.height = height;
+		t.fullMipLevels = 1;
+		t.rData.format = format;
+		t.rData.mipLevels = 1;
+		t.rData.layout = VK_IMAGE_LAYOUT_GENERAL;
+
+		vkh::createImage(t.rData.image, width, height, 1, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+		vkh::allocBindImageToMem(t.rData.deviceMemory, t.rData.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		vkh::createImageView(t.rData.view, 1, t.rData.image, format);
+		vkh::createTexSampler(t.rData.sampler, 1);
+
+		//transitionImageLayout only knows about upload layouts, so this does its own barrier
+		vkh::VkhCommandBuffer scratch = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Graphics);
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = t.rData.image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(scratch.buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkh::submitScratchCommandBuffer(scratch);
+
+		//not registered with the defragmenter, since the relocation copy assumes a read only image
+		texStorage.data.insert(std::pair<uint32_t, TextureAsset>(newId, t));
+		return newId;
+	}
+
+	void requestMipLevel(uint32_t texId, uint32_t mipLevel)
+	{
+		TextureAsset& t = texStorage.data[texId];
+		checkf(t.streamed, "Requesting a mip level for a texture that isn't streamed");
+
+		t.desiredBaseMip = mipLevel < t.fullMipLevels ? mipLevel : t.fullMipLevels - 1;
+	}
+
+	//stbi_load and building the cpu side of the mip chain happen on this thread, so a tick never stalls on the disk
+	//or on decoding. Only one restream is in flight at a time, and everything here is only touched with the lock held
+	struct StreamingJob
+	{
+		uint32_t texId;
+		char path[256];
+		uint32_t width;
+		uint32_t height;
+		uint32_t baseMip;
+		uint32_t uploadedMips;
+
+		//filled in by the thread, null if the image couldn't be loaded
+		uint8_t* mipData;
+		VkDeviceSize mipSizes[MAX_MIP_LEVELS];
+	};
+
+	struct StreamingState
+	{
+		std::mutex lock;
+		std::condition_variable wake;
+		std::thread thread;
+		bool threadRunning;
+		bool stopping;
+
+		bool jobQueued;		//set until tickStreaming has swapped the result in
+		bool jobDone;
+		StreamingJob job;
+	};
+
+	StreamingState streaming;
+
+	//the upload of a decoded job, submitted to the graphics queue without waiting. The new image is swapped in once
+	//uploadFence has signalled and every frame submitted before the upload has finished, the same as a defragmentation
+	//move. Only touched from tickStreaming, so it doesn't need the lock
+	struct StreamingUpload
+	{
+		bool inFlight;
+		uint32_t texId;
+		uint32_t baseMip;
+		TextureRenderData rData;
+		StagingBuffer staging;
+		VkCommandBuffer cmd;
+		VkFence fence;
+		uint64_t waitForFrame;
+	};
+
+	StreamingUpload upload;
+
+	void streamingThread()
+	{
+		std::unique_lock<std::mutex> guard(streaming.lock);
+
+		while (true)
+		{
+			streaming.wake.wait(guard, []() { return streaming.stopping || (streaming.jobQueued && !streaming.jobDone); });
+			if (streaming.stopping) break;
+
+			StreamingJob job = streaming.job;
+			guard.unlock();
+
+			int texWidth, texHeight, texChannels;
+			stbi_uc* pixels = stbi_load(job.path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+			job.mipData = nullptr;
+			if (pixels && (uint32_t)texWidth == job.width && (uint32_t)texHeight == job.height)
+			{
+				job.mipData = buildUploadMips(pixels, job.width, job.height, job.baseMip, job.uploadedMips, job.mipSizes);
+			}
+			stbi_image_free(pixels);
+
+			guard.lock();
+			streaming.job = job;
+			streaming.jobDone = true;
+		}
+	}
+
+	void startRestream(uint32_t texId, const TextureAsset& t, uint32_t newBaseMip)
+	{
+		std::lock_guard<std::mutex> guard(streaming.lock);
+
+		//nothing runs on the thread until a texture actually needs restreaming
+		if (!streaming.threadRunning)
+		{
+			streaming.stopping = false;
+			streaming.threadRunning = true;
+			streaming.thread = std::thread(streamingThread);
+		}
+
+		StreamingJob& job = streaming.job;
+		job.texId = texId;
+		snprintf(job.path, sizeof(job.path), "%s", t.path);
+		job.width = t.width;
+		job.height = t.height;
+		job.baseMip = newBaseMip;
+		job.uploadedMips = uploadedMipCount(t.rData.format, t.fullMipLevels - newBaseMip);
+		job.mipData = nullptr;
+
+		streaming.jobQueued = true;
+		streaming.jobDone = false;
+		streaming.wake.notify_one();
+	}
+
+	//creates the new image for what the streaming thread decoded and submits its upload
+	void submitRestreamUpload(const StreamingJob& job)
+	{
+		checkf(job.mipData, "Could not load streamed image, or it changed size on disk");
+
+		if (upload.fence == VK_NULL_HANDLE)
+		{
+			vkh::createFence(upload.fence, vkh::GContext.device);
+		}
+
+		TextureAsset& t = texStorage.data[job.texId];
+		upload.texId = job.texId;
+		upload.baseMip = job.baseMip;
+
+		//keeps the format, sampler and layout, the rest is replaced
+		upload.rData = t.rData;
+
+		vkh::VkhCommandBuffer cmd = vkh::beginScratchCommandBuffer(vkh::ECommandPoolType::Graphics);
+		recordMippedUpload(upload.rData, upload.staging, job.mipData, job.mipSizes, t.width, t.height, job.baseMip, t.fullMipLevels, cmd);
+		free(job.mipData);
+
+		vkEndCommandBuffer(cmd.buffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cmd.buffer;
+
+		VkResult res = vkQueueSubmit(vkh::GContext.deviceQueues.graphicsQueue, 1, &submitInfo, upload.fence);
+		checkf(res == VK_SUCCESS, "Failed to submit streamed texture upload");
+
+		upload.cmd = cmd.buffer;
+		upload.inFlight = true;
+		upload.waitForFrame = vkh::GContext.lastFrameSerial;
+	}
+
+	//swaps a finished upload in for the texture's current image
+	void finishRestream()
+	{
+		vkFreeCommandBuffers(vkh::GContext.device, vkh::GContext.gfxCommandPool, 1, &upload.cmd);
+		vkResetFences(vkh::GContext.device, 1, &upload.fence);
+		destroyStagingBuffer(upload.staging);
+		upload.inFlight = false;
+
+		TextureAsset& t = texStorage.data[upload.texId];
+		TextureRenderData oldData = t.rData;
+
+		t.rData = upload.rData;
+		t.residentBaseMip = upload.baseMip;
+
+		Material::patchImageDescriptors(upload.texId);
+
+		//frames submitted before the descriptors were patched can still be sampling the old image, it's destroyed once
+		//they've finished. Unregistering now keeps the defragmenter from moving it in the meantime
+		vkh::allocators::pool::unregisterRelocatable(oldData.deviceMemory);
+		retireImage(oldData.image, oldData.view, oldData.deviceMemory);
+
+		registerForRelocation(upload.texId, t);
+	}
+
+	void tickStreaming(uint64_t budgetBytes)
+	{
+		releaseRetiredImages();
+
+		//nothing here waits on the gpu. A finished upload is swapped in, a finished decode is uploaded, and nothing
+		//new starts until the restream in flight has been swapped in
+		if (upload.inFlight)
+		{
+			if (vkGetFenceStatus(vkh::GContext.device, upload.fence) == VK_SUCCESS && vkh::frameCompleted(vkh::GContext, upload.waitForFrame))
+			{
+				finishRestream();
+			}
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> guard(streaming.lock);
+			if (streaming.jobQueued)
+			{
+				if (!streaming.jobDone) return;
+
+				StreamingJob job = streaming.job;
+				streaming.jobQueued = false;
+				streaming.jobDone = false;
+				guard.unlock();
+
+				submitRestreamUpload(job);
+				return;
+			}
+		}
+
+		VkDeviceSize residentBytes = 0;
+		for (auto& texPair : texStorage.data)
+		{
+			TextureAsset& t = texPair.second;
+			if (t.streamed) residentBytes += residentSize(t, t.residentBaseMip);
+		}
+
+		uint32_t targetId = 0;
+		TextureAsset* target = nullptr;
+		uint32_t newBaseMip = 0;
+
+		//shrinking goes first, since it frees up budget for everything else
+		for (auto& texPair : texStorage.data)
+		{
+			TextureAsset& t = texPair.second;
+			if (t.streamed && t.desiredBaseMip > t.residentBaseMip)
+			{
+				targetId = texPair.first;
+				target = &t;
+				newBaseMip = t.residentBaseMip + 1;
+				break;
+			}
+		}
+
+		//otherwise grow whichever texture is furthest from the mip it wants, if the next level fits
+		if (!target)
+		{
+			uint32_t largestGap = 0;
+			for (auto& texPair : texStorage.data)
+			{
+				TextureAsset& t = texPair.second;
+				if (!t.streamed || t.desiredBaseMip >= t.residentBaseMip) continue;
+
+				uint32_t gap = t.residentBaseMip - t.desiredBaseMip;
+				VkDeviceSize growth = ImageUtils::rgba8MipSize(t.width, t.height, t.residentBaseMip - 1);
+
+				if (gap > largestGap && residentBytes + growth <= budgetBytes)
+				{
+					largestGap = gap;
+					targetId = texPair.first;
+					target = &t;
+					newBaseMip = t.residentBaseMip - 1;
+				}
+			}
+		}
+
+		if (target)
+		{
+			startRestream(targetId, *target, newBaseMip);
+		}
+	}
+
+	void shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> guard(streaming.lock);
+			streaming.stopping = true;
+			streaming.wake.notify_one();
+		}
+
+		if (streaming.threadRunning)
+		{
+			streaming.thread.join();
+			streaming.threadRunning = false;
+		}
+
+		//a decode that finished after the last tick is never going to be uploaded
+		if (streaming.jobQueued && streaming.jobDone)
+		{
+			free(streaming.job.mipData);
+		}
+		streaming.jobQueued = false;
+		streaming.jobDone = false;
+
+		if (upload.inFlight || texStorage.retired.size() > 0)
+		{
+			vkDeviceWaitIdle(vkh::GContext.device);
+			if (upload.inFlight) finishRestream();
+			releaseRetiredImages();
+		}
+
+		if (upload.fence != VK_NULL_HANDLE)
+		{
+			vkDestroyFence(vkh::GContext.device, upload.fence, nullptr);
+			upload.fence = VK_NULL_HANDLE;
+		}
+	}
 
 	void destroy(uint32_t texId)
 	{
@@ -1,4 +1,5 @@
 #pragma once
+#include "vkh.h"
 
 struct TextureRenderData;
 struct TextureAsset;
@@ -7,6 +8,28 @@ namespace Texture
 {
 	uint32_t make(const char* filepath);
 	
+	//streamed textures start with only their small mips resident (nothing bigger than 
+	//STREAMING_INITIAL_MIP_SIZE), and grow towards the mip requested for them as tickStreaming
+	//finds room in its budget 
+	uint32_t makeStreamed(const char* filepath);
+
+	//an empty single mip image for compute shaders to write to, kept in VK_IMAGE_LAYOUT_GENERAL so it can 
+	//be bound as a storage image or sampled. The name is only used to generate the id
+	uint32_t makeStorage(const char* name, uint32_t width, uint32_t height, VkFormat format);
+
+	//the largest mip the texture should have resident, 0 is the full size image. Requesting 
+	//a smaller mip than what's resident will shrink the texture on the next tick
+	void requestMipLevel(uint32_t texId, uint32_t mipLevel);
+
+	//grows or shrinks at most one streamed texture by one mip level, keeping the total size of
+	//all streamed textures under budgetBytes. The texture is decoded on a background thread, and
+	//uploaded and swapped in by later ticks without waiting on the gpu. Images and views replaced by streaming or defragmentation are
+	//destroyed here too, once the frames that could be sampling them have finished. Call once per
+	//frame, outside of any command buffer recording
+	void tickStreaming(uint64_t budgetBytes);
+
+	//decoding for streamed textures happens on a background thread, which has to be joined before the program exits
+	void shutdown();
 
 	TextureRenderData* getRenderData(uint32_t texId);
 
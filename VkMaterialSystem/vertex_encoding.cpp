@@ -0,0 +1,161 @@
+//doesn't include stdafx.h so MeshPipeline can build this file too
+#include "vertex_encoding.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace VertexEncoding
+{
+	uint32_t vertexStride(EVertexLayout layout)
+	{
+		switch (layout)
+		{
+			case EVertexLayout::Full: return sizeof(MeshFormat::PackedVertex);
+			case EVertexLayout::Compact: return sizeof(CompactVertex);
+			default: return 0;
+		}
+	}
+
+	uint16_t floatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(float));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t floatExponent = (bits >> 23) & 0xFF;
+		uint32_t mantissa = bits & 0x7FFFFF;
+		int32_t exponent = (int32_t)floatExponent - 127 + 15;
+
+		//inf and nan
+		if (floatExponent == 0xFF) return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+		//too big for a half, clamp to inf
+		if (exponent >= 31) return (uint16_t)(sign | 0x7C00);
+
+		//denormal, or too small for a half at all
+		if (exponent <= 0)
+		{
+			if (exponent < -10) return (uint16_t)sign;
+
+			mantissa |= 0x800000;
+			uint32_t shift = (uint32_t)(14 - exponent);
+			uint32_t half = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1) half++;
+			return (uint16_t)(sign | half);
+		}
+
+		//rounding can carry into the exponent, which is still the right answer
+		uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+		if (mantissa & 0x1000) half++;
+		return (uint16_t)half;
+	}
+
+	int16_t toSnorm16(float value)
+	{
+		value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+		return (int16_t)lroundf(value * 32767.0f);
+	}
+
+	void octahedralEncode(const float* normal, int16_t* outEncoded)
+	{
+		float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+		if (l1 == 0.0f)
+		{
+			outEncoded[0] = 0;
+			outEncoded[1] = 0;
+			return;
+		}
+
+		float x = normal[0] / l1;
+		float y = normal[1] / l1;
+
+		//fold the lower hemisphere over the diagonals
+		if (normal[2] < 0.0f)
+		{
+			float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+
+		outEncoded[0] = toSnorm16(x);
+		outEncoded[1] = toSnorm16(y);
+	}
+
+	void computeBounds(const MeshFormat::PackedVertex* vertices, uint32_t vertexCount, float* outMin, float* outMax)
+	{
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			outMin[c] = vertexCount > 0 ? FLT_MAX : 0.0f;
+			outMax[c] = vertexCount > 0 ? -FLT_MAX : 0.0f;
+		}
+
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				outMin[c] = vertices[i].pos[c] < outMin[c] ? vertices[i].pos[c] : outMin[c];
+				outMax[c] = vertices[i].pos[c] > outMax[c] ? vertices[i].pos[c] : outMax[c];
+			}
+		}
+	}
+
+	void positionScaleBias(const float* boundsMin, const float* boundsMax, float* outScale, float* outBias)
+	{
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			outBias[c] = (boundsMin[c] + boundsMax[c]) * 0.5f;
+			outScale[c] = (boundsMax[c] - boundsMin[c]) * 0.5f;
+		}
+	}
+
+	void encodeCompact(const MeshFormat::PackedVertex* vertices, uint32_t vertexCount, const float* boundsMin, const float* boundsMax, CompactVertex* outVertices)
+	{
+		float scale[3];
+		float bias[3];
+		positionScaleBias(boundsMin, boundsMax, scale, bias);
+
+		//flat axes have no range to quantize into, everything on them sits on the bias
+		float invScale[3];
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			invScale[c] = scale[c] > 0.0f ? 1.0f / scale[c] : 0.0f;
+		}
+
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			const MeshFormat::PackedVertex& src = vertices[i];
+			CompactVertex& dst = outVertices[i];
+
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				dst.pos[c] = toSnorm16((src.pos[c] - bias[c]) * invScale[c]);
+			}
+			dst.pos[3] = 32767;
+
+			dst.uv[0] = floatToHalf(src.uv[0]);
+			dst.uv[1] = floatToHalf(src.uv[1]);
+
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				float col = src.col[c] < 0.0f ? 0.0f : (src.col[c] > 1.0f ? 1.0f : src.col[c]);
+				dst.col[c] = (uint8_t)lroundf(col * 255.0f);
+			}
+
+			octahedralEncode(src.normal, dst.normal);
+		}
+	}
+
+	bool fitsInShortIndices(uint32_t vertexCount)
+	{
+		return vertexCount <= 65536;
+	}
+
+	void narrowIndices(const uint32_t* indices, uint32_t indexCount, uint16_t* outIndices)
+	{
+		for (uint32_t i = 0; i < indexCount; ++i)
+		{
+			outIndices[i] = (uint16_t)indices[i];
+		}
+	}
+}
\ No newline at end of file
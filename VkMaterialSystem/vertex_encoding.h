@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include "mesh_asset_format.h"
+
+//converts full float vertices to the smaller layouts. Shared with MeshPipeline, so
+//this can't depend on anything in the rest of the engine
+namespace VertexEncoding
+{
+	//positions are snorm16 inside the mesh's bounds, so the shader needs to apply the mesh's
+	//position scale / bias to get them back. w is always 1. Normals are octahedral encoded
+	struct CompactVertex
+	{
+		int16_t pos[4];
+		uint16_t uv[2];		//half floats
+		uint8_t col[4];
+		int16_t normal[2];
+	};
+
+	static_assert(sizeof(CompactVertex) == 20, "CompactVertex has picked up padding");
+
+	uint32_t vertexStride(EVertexLayout layout);
+
+	uint16_t floatToHalf(float value);
+	void octahedralEncode(const float* normal, int16_t* outEncoded);
+
+	void computeBounds(const MeshFormat::PackedVertex* vertices, uint32_t vertexCount, float* outMin, float* outMax);
+
+	//scale and bias that map the [-1, 1] snorm range back onto the bounds
+	void positionScaleBias(const float* boundsMin, const float* boundsMax, float* outScale, float* outBias);
+
+	void encodeCompact(const MeshFormat::PackedVertex* vertices, uint32_t vertexCount, const float* boundsMin, const float* boundsMax, CompactVertex* outVertices);
+
+	//16 bit indices halve index bandwidth, and can address any mesh with up to 65536 vertices
+	bool fitsInShortIndices(uint32_t vertexCount);
+	void narrowIndices(const uint32_t* indices, uint32_t indexCount, uint16_t* outIndices);
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "vkh.h"
 #include "file_utils.h"
+#include "vkh_initializers.h"
 #include "vkh_allocator_passthrough.h"
 #include "vkh_allocator_pool.h"
 namespace vkh
@@ -11,11 +12,12 @@ namespace vkh
 	void createWindowsInstance(VkInstance& outInstance, const char* applicationName);
 	void createWin32Surface(VkhSurface& outSurface, VkInstance& vkInstance, HINSTANCE win32Instance, HWND wndHdl);
 	void getDiscretePhysicalDevice(VkhPhysicalDevice& outDevice, VkInstance& inInstance, const VkhSurface& surface);
-	void createLogicalDevice(VkDevice& outDevice, VkhDeviceQueues& outqueues, const VkhPhysicalDevice& physDevice);
-	void createSwapchainForSurface(VkhSwapChain& outSwapChain, VkhPhysicalDevice& physDevice, const VkDevice& lDevice, const VkhSurface& surface);
+	void createLogicalDevice(VkDevice& outDevice, VkhDeviceQueues& outqueues, VkhDeviceExtensions& outExtensions, const VkhPhysicalDevice& physDevice);
+	void createSwapchainForSurface(VkhSwapChain& outSwapChain, VkhPhysicalDevice& physDevice, const VkDevice& lDevice, const VkhSurface& surface, VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
 	void createCommandPool(VkCommandPool& outPool, const VkDevice& lDevice, const VkhPhysicalDevice& physDevice, uint32_t queueFamilyIdx);
 	uint32_t getMemoryType(const VkPhysicalDevice& device, uint32_t typeFilter, VkMemoryPropertyFlags properties);
 	void createImageView(VkImageView& outView, VkFormat imageFormat, VkImageAspectFlags aspectMask, uint32_t mipCount, const VkImage& imageHdl, const VkDevice& device);
+	void createImageViewForMips(VkImageView& outView, VkFormat imageFormat, VkImageAspectFlags aspectMask, uint32_t baseMip, uint32_t mipCount, const VkImage& imageHdl, const VkDevice& device);
 
 	VkDebugReportCallbackEXT callback;
 
@@ -38,7 +40,7 @@ namespace vkh
 		createWindowsInstance(outContext.instance, applicationName);
 		createWin32Surface(outContext.surface, outContext.instance, Instance, wndHdl);
 		getDiscretePhysicalDevice(outContext.gpu, outContext.instance, outContext.surface);
-		createLogicalDevice(outContext.device, outContext.deviceQueues, outContext.gpu);
+		createLogicalDevice(outContext.device, outContext.deviceQueues, outContext.extensions, outContext.gpu);
 		
 		vkh::allocators::pool::activate(&outContext);
 		
@@ -50,16 +52,19 @@ namespace vkh
 		//since we're only creating one of these for each material, this means we'll support 128 materials
 
 		std::vector<VkDescriptorType> types;
-		types.reserve(3);
+		types.reserve(9);
 		types.push_back(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
 		types.push_back(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
 		types.push_back(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		types.push_back(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		types.push_back(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		types.push_back(VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER);
+		types.push_back(VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER);
+		types.push_back(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+		types.push_back(VK_DESCRIPTOR_TYPE_SAMPLER);
 
 		std::vector<uint32_t> counts;
-		counts.reserve(3);
-		counts.push_back(128);
-		counts.push_back(128);
-		counts.push_back(128);
+		counts.resize(types.size(), 128);
 
 		createDescriptorPool(outContext.descriptorPool, outContext.device, types, counts);
 
@@ -71,6 +76,8 @@ namespace vkh
 		{
 			createFence(outContext.frameFences[i], outContext.device);
 		}
+		outContext.frameSerials.resize(outContext.frameFences.size(), 0);
+		outContext.lastFrameSerial = 0;
 	}
 
 	void waitForFence(VkFence& fence, const VkDevice& device)
@@ -84,6 +91,34 @@ namespace vkh
 		}
 	}
 
+	void waitForFrame(VkhContext& context, uint32_t imageIndex)
+	{
+		//fences start unsignaled, so there's nothing to wait for until one has been submitted
+		if (context.frameSerials[imageIndex] != 0)
+		{
+			vkWaitForFences(context.device, 1, &context.frameFences[imageIndex], VK_TRUE, UINT64_MAX);
+		}
+		vkResetFences(context.device, 1, &context.frameFences[imageIndex]);
+	}
+
+	uint64_t markFrameSubmitted(VkhContext& context, uint32_t imageIndex)
+	{
+		context.frameSerials[imageIndex] = ++context.lastFrameSerial;
+		return context.lastFrameSerial;
+	}
+
+	bool frameCompleted(const VkhContext& context, uint64_t serial)
+	{
+		//a fence is waited on before it's submitted again, so only the last frame submitted with each one can still be running
+		for (uint32_t i = 0; i < context.frameFences.size(); ++i)
+		{
+			uint64_t frameSerial = context.frameSerials[i];
+			if (frameSerial == 0 || frameSerial > serial) continue;
+			if (vkGetFenceStatus(context.device, context.frameFences[i]) != VK_SUCCESS) return false;
+		}
+		return true;
+	}
+
 	void createFence(VkFence& outFence, VkDevice& device)
 	{
 		VkFenceCreateInfo fenceInfo = {};
@@ -421,7 +456,23 @@ namespace vkh
 		assert(foundGfx && foundPresent && foundTransfer);
 	}
 
-	void createLogicalDevice(VkDevice& outDevice, VkhDeviceQueues& outqueues, const VkhPhysicalDevice& physDevice)
+	bool deviceSupportsExtension(const VkPhysicalDevice& gpu, const char* extensionName)
+	{
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions;
+		availableExtensions.resize(extensionCount);
+		vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, availableExtensions.data());
+
+		for (uint32_t i = 0; i < extensionCount; ++i)
+		{
+			if (strcmp(availableExtensions[i].extensionName, extensionName) == 0) return true;
+		}
+		return false;
+	}
+
+	void createLogicalDevice(VkDevice& outDevice, VkhDeviceQueues& outqueues, VkhDeviceExtensions& outExtensions, const VkhPhysicalDevice& physDevice)
 	{
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::vector<uint32_t> uniqueQueueFamilies;
@@ -460,9 +511,37 @@ namespace vkh
 		std::vector<const char*> deviceExtensions;
 		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+		//optional, lets the allocator give large images their own VkDeviceMemory when the driver asks for it
+		outExtensions = {};
+		outExtensions.dedicatedAllocation = deviceSupportsExtension(physDevice.device, VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME)
+			&& deviceSupportsExtension(physDevice.device, VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
+
+		if (outExtensions.dedicatedAllocation)
+		{
+			deviceExtensions.push_back(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
+			deviceExtensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+		}
+
+		//optional, lets gpu culling compact its draws and draw however many survived with one call
+		bool drawIndirectCountKHR = deviceSupportsExtension(physDevice.device, "VK_KHR_draw_indirect_count");
+		bool drawIndirectCountAMD = !drawIndirectCountKHR && deviceSupportsExtension(physDevice.device, VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+		if (drawIndirectCountKHR) deviceExtensions.push_back("VK_KHR_draw_indirect_count");
+		if (drawIndirectCountAMD) deviceExtensions.push_back(VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+		//indirect draws put the object index in firstInstance, and issue every object's draw from one command
+		deviceFeatures.multiDrawIndirect = physDevice.features.multiDrawIndirect;
+		deviceFeatures.drawIndirectFirstInstance = physDevice.features.drawIndirectFirstInstance;
+
+		//needed to load cooked .dds textures
+		deviceFeatures.textureCompressionBC = physDevice.features.textureCompressionBC;
+
+		//materials can ask for wireframe ("polygonMode": "line")
+		deviceFeatures.fillModeNonSolid = physDevice.features.fillModeNonSolid;
+
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
@@ -501,9 +580,24 @@ namespace vkh
 		vkGetDeviceQueue(outDevice, physDevice.transferQueueFamilyIdx, 0, &outqueues.transferQueue);
 		vkGetDeviceQueue(outDevice, physDevice.presentQueueFamilyIdx, 0, &outqueues.presentQueue);
 
+		if (outExtensions.dedicatedAllocation)
+		{
+			outExtensions.getBufferMemoryRequirements2 = (PFN_vkGetBufferMemoryRequirements2KHR)vkGetDeviceProcAddr(outDevice, "vkGetBufferMemoryRequirements2KHR");
+			outExtensions.getImageMemoryRequirements2 = (PFN_vkGetImageMemoryRequirements2KHR)vkGetDeviceProcAddr(outDevice, "vkGetImageMemoryRequirements2KHR");
+			outExtensions.dedicatedAllocation = outExtensions.getBufferMemoryRequirements2 && outExtensions.getImageMemoryRequirements2;
+		}
+
+		if (drawIndirectCountKHR)
+		{
+			outExtensions.drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountAMD)vkGetDeviceProcAddr(outDevice, "vkCmdDrawIndexedIndirectCountKHR");
+		}
+		else if (drawIndirectCountAMD)
+		{
+			outExtensions.drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountAMD)vkGetDeviceProcAddr(outDevice, "vkCmdDrawIndexedIndirectCountAMD");
+		}
 	}
 
-	void createSwapchainForSurface(VkhSwapChain& outSwapChain, VkhPhysicalDevice& physDevice, const VkDevice& lDevice, const VkhSurface& surface)
+	void createSwapchainForSurface(VkhSwapChain& outSwapChain, VkhPhysicalDevice& physDevice, const VkDevice& lDevice, const VkhSurface& surface, VkSwapchainKHR oldSwapChain)
 	{
 		//choose the surface format to use
 		VkSurfaceFormatKHR desiredFormat;
@@ -602,7 +696,9 @@ namespace vkh
 		createInfo.presentMode = desiredPresentMode;
 		createInfo.clipped = VK_TRUE;
 		createInfo.pNext = NULL;
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+
+		//when resizing, passing the old swap chain lets the driver hand its resources over to the new one
+		createInfo.oldSwapchain = oldSwapChain;
 
 		VkResult res = vkCreateSwapchainKHR(lDevice, &createInfo, nullptr, &outSwapChain.swapChain);
 		assert(res == VK_SUCCESS);
@@ -624,12 +720,45 @@ namespace vkh
 		}
 	}
 
+	void recreateSwapchain(VkhContext& context)
+	{
+		VkhSwapChain oldSwapChain = context.swapChain;
+		createSwapchainForSurface(context.swapChain, context.gpu, context.device, context.surface, oldSwapChain.swapChain);
+
+		//the old swap chain is retired by creating the new one, but destroying it with a present still queued on it isn't 
+		//allowed. The caller has to have waited on the queue it presents from (and anything rendering to its images)
+		for (VkImageView view : oldSwapChain.imageViews)
+		{
+			vkDestroyImageView(context.device, view, nullptr);
+		}
+		vkDestroySwapchainKHR(context.device, oldSwapChain.swapChain, nullptr);
+
+		//the new swap chain can come back with more images than the old one
+		while (context.frameFences.size() < context.swapChain.imageViews.size())
+		{
+			VkFence fence;
+			createFence(fence, context.device);
+			context.frameFences.push_back(fence);
+			context.frameSerials.push_back(0);
+		}
+	}
+
 	void createImageView(VkImageView& outView, uint32_t mipCount, const VkImage& image, VkFormat format)
 	{
 		createImageView(outView, format, VK_IMAGE_ASPECT_COLOR_BIT, mipCount, image, GContext.device);
 	}
 
 	void createImageView(VkImageView& outView, VkFormat imageFormat, VkImageAspectFlags aspectMask, uint32_t mipCount, const VkImage& imageHdl, const VkDevice& device)
+	{
+		createImageViewForMips(outView, imageFormat, aspectMask, 0, mipCount, imageHdl, device);
+	}
+
+	void createImageViewForMips(VkImageView& outView, VkFormat format, VkImageAspectFlags aspectMask, uint32_t baseMip, uint32_t mipCount, const VkImage& image)
+	{
+		createImageViewForMips(outView, format, aspectMask, baseMip, mipCount, image, GContext.device);
+	}
+
+	void createImageViewForMips(VkImageView& outView, VkFormat imageFormat, VkImageAspectFlags aspectMask, uint32_t baseMip, uint32_t mipCount, const VkImage& imageHdl, const VkDevice& device)
 	{
 		VkImageViewCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -643,7 +772,7 @@ namespace vkh
 		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 
 		createInfo.subresourceRange.aspectMask = aspectMask;
-		createInfo.subresourceRange.baseMipLevel = 0;
+		createInfo.subresourceRange.baseMipLevel = baseMip;
 		createInfo.subresourceRange.levelCount = mipCount;
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
@@ -855,24 +984,22 @@ namespace vkh
 		VkResult res = vkCreateBuffer(device, &bufferInfo, nullptr, &outBuffer);
 		assert(res == VK_SUCCESS);
 
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(device, outBuffer, &memRequirements);
-
+		uint32_t memoryTypeBits;
 		AllocationCreateInfo allocInfo = {};
-		allocInfo.size = memRequirements.size;
-		allocInfo.memoryTypeIndex = getMemoryType(gpu, memRequirements.memoryTypeBits, properties);
+		getMemoryRequirements(allocInfo, memoryTypeBits, outBuffer, device);
+		allocInfo.memoryTypeIndex = getMemoryType(gpu, memoryTypeBits, properties);
 		allocInfo.usage = properties;
 
 		GContext.allocator.alloc(bufferMemory, allocInfo);
 		vkBindBufferMemory(device, outBuffer, bufferMemory.handle, bufferMemory.offset);
 	}
 
-	void createImage(VkImage& outImage, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage)
+	void createImage(VkImage& outImage, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage)
 	{
-		createImage(outImage, width, height, format, tiling, usage, GContext.device);
+		createImage(outImage, width, height, mipLevels, format, tiling, usage, GContext.device);
 	}
 
-	void createImage(VkImage& outImage, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, const VkDevice& device)
+	void createImage(VkImage& outImage, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, const VkDevice& device)
 	{
 		VkImageCreateInfo imageInfo = {};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -880,7 +1007,7 @@ namespace vkh
 		imageInfo.extent.width = width;
 		imageInfo.extent.height = height;
 		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = 1;
+		imageInfo.mipLevels = mipLevels;
 		imageInfo.arrayLayers = 1;
 		imageInfo.format = format;
 		imageInfo.tiling = tiling;
@@ -898,20 +1025,107 @@ namespace vkh
 		allocBindImageToMem(outMem, image, properties, GContext.device, GContext.gpu.device);
 	}
 
-	void allocBindImageToMem(Allocation& outMem, const VkImage& image, VkMemoryPropertyFlags properties, const VkDevice& device, const VkPhysicalDevice& gpu)
+	void getMemoryRequirements(AllocationCreateInfo& outInfo, uint32_t& outMemoryTypeBits, const VkBuffer& buffer, const VkDevice& device)
 	{
 		VkMemoryRequirements memRequirements;
-		vkGetImageMemoryRequirements(device, image, &memRequirements);
+		outInfo.tiling = EResourceTiling::Linear;
+
+		if (GContext.extensions.dedicatedAllocation)
+		{
+			VkMemoryDedicatedRequirementsKHR dedicatedReqs = {};
+			dedicatedReqs.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+
+			VkMemoryRequirements2KHR memReqs2 = {};
+			memReqs2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+			memReqs2.pNext = &dedicatedReqs;
+
+			VkBufferMemoryRequirementsInfo2KHR reqInfo = {};
+			reqInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2_KHR;
+			reqInfo.buffer = buffer;
 
-		AllocationCreateInfo createInfo;
-		createInfo.size = memRequirements.size;
-		createInfo.memoryTypeIndex = getMemoryType(gpu, memRequirements.memoryTypeBits, properties);
+			GContext.extensions.getBufferMemoryRequirements2(device, &reqInfo, &memReqs2);
+			memRequirements = memReqs2.memoryRequirements;
+
+			outInfo.prefersDedicated = dedicatedReqs.prefersDedicatedAllocation;
+			outInfo.requiresDedicated = dedicatedReqs.requiresDedicatedAllocation;
+			outInfo.dedicatedBuffer = buffer;
+		}
+		else
+		{
+			vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+		}
+
+		outInfo.size = memRequirements.size;
+		outInfo.alignment = memRequirements.alignment;
+		outMemoryTypeBits = memRequirements.memoryTypeBits;
+	}
+
+	void getMemoryRequirements(AllocationCreateInfo& outInfo, uint32_t& outMemoryTypeBits, const VkImage& image, VkImageTiling tiling, const VkDevice& device)
+	{
+		VkMemoryRequirements memRequirements;
+		outInfo.tiling = tiling == VK_IMAGE_TILING_OPTIMAL ? EResourceTiling::Optimal : EResourceTiling::Linear;
+
+		if (GContext.extensions.dedicatedAllocation)
+		{
+			VkMemoryDedicatedRequirementsKHR dedicatedReqs = {};
+			dedicatedReqs.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+
+			VkMemoryRequirements2KHR memReqs2 = {};
+			memReqs2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+			memReqs2.pNext = &dedicatedReqs;
+
+			VkImageMemoryRequirementsInfo2KHR reqInfo = {};
+			reqInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2_KHR;
+			reqInfo.image = image;
+
+			GContext.extensions.getImageMemoryRequirements2(device, &reqInfo, &memReqs2);
+			memRequirements = memReqs2.memoryRequirements;
+
+			outInfo.prefersDedicated = dedicatedReqs.prefersDedicatedAllocation;
+			outInfo.requiresDedicated = dedicatedReqs.requiresDedicatedAllocation;
+			outInfo.dedicatedImage = image;
+		}
+		else
+		{
+			vkGetImageMemoryRequirements(device, image, &memRequirements);
+		}
+
+		outInfo.size = memRequirements.size;
+		outInfo.alignment = memRequirements.alignment;
+		outMemoryTypeBits = memRequirements.memoryTypeBits;
+	}
+
+	//all images created through createImage are currently VK_IMAGE_TILING_OPTIMAL, 
+	//if that changes the tiling will need to be passed in here
+	void allocBindImageToMem(Allocation& outMem, const VkImage& image, VkMemoryPropertyFlags properties, const VkDevice& device, const VkPhysicalDevice& gpu)
+	{
+		uint32_t memoryTypeBits;
+		AllocationCreateInfo createInfo = {};
+		getMemoryRequirements(createInfo, memoryTypeBits, image, VK_IMAGE_TILING_OPTIMAL, device);
+		createInfo.memoryTypeIndex = getMemoryType(gpu, memoryTypeBits, properties);
 		createInfo.usage = properties;
 
 		allocateDeviceMemory(outMem, createInfo);
 		vkBindImageMemory(device, image, outMem.handle, outMem.offset);
 	}
 
+	//the contents of a transient image are undefined at the start of firstUse, 
+	//so any render pass using one must use LOAD_OP_CLEAR / DONT_CARE and an UNDEFINED initial layout
+	void allocBindTransientImageToMem(Allocation& outMem, const VkImage& image, uint32_t firstUse, uint32_t lastUse, const VkDevice& device, const VkPhysicalDevice& gpu)
+	{
+		uint32_t memoryTypeBits;
+		AllocationCreateInfo createInfo = {};
+		getMemoryRequirements(createInfo, memoryTypeBits, image, VK_IMAGE_TILING_OPTIMAL, device);
+		createInfo.memoryTypeIndex = getMemoryType(gpu, memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		createInfo.usage = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		createInfo.transient = VK_TRUE;
+		createInfo.firstUse = firstUse;
+		createInfo.lastUse = lastUse;
+
+		allocateDeviceMemory(outMem, createInfo);
+		vkBindImageMemory(device, image, outMem.handle, outMem.offset);
+	}
+
 	VkFormat depthFormat()
 	{
 		return VK_FORMAT_D32_SFLOAT;
@@ -922,16 +1136,27 @@ namespace vkh
 		createImage(outBuffer.handle,
 			width,
 			height,
+			1,
 			depthFormat(),
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 			device);
 
-		allocBindImageToMem(outBuffer.imageMemory, outBuffer.handle, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, device, gpu);
+		//the main pass (0) clears this, and the last thing to read it is gpu culling building its depth pyramid right
+		//after (1). Nothing needs it from one frame to the next, so other render targets can have its memory outside of that
+		allocBindTransientImageToMem(outBuffer.imageMemory, outBuffer.handle, 0, 1, device, gpu);
 
 		createImageView(outBuffer.view, depthFormat(), VK_IMAGE_ASPECT_DEPTH_BIT, 1, outBuffer.handle, device);
 	}
 
+	void destroyRenderBuffer(VkhRenderBuffer& buffer, const VkDevice& device)
+	{
+		vkDestroyImageView(device, buffer.view, nullptr);
+		vkDestroyImage(device, buffer.handle, nullptr);
+		freeDeviceMemory(buffer.imageMemory);
+		buffer = {};
+	}
+
 	uint32_t getMemoryType(const VkPhysicalDevice& device, uint32_t memoryTypeBitsRequirement, VkMemoryPropertyFlags requiredProperties)
 	{
 		VkPhysicalDeviceMemoryProperties memProperties;
@@ -1032,6 +1257,32 @@ namespace vkh
 
 	}
 
+	void createComputePipeline(VkPipeline& outPipeline, const VkPipelineLayout& layout, const VkShaderModule& shader, const VkDevice& lDevice, const VkSpecializationInfo* specInfo)
+	{
+		VkPipelineShaderStageCreateInfo stageInfo = shaderPipelineStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT);
+		stageInfo.module = shader;
+		stageInfo.pSpecializationInfo = specInfo;
+
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage = stageInfo;
+		pipelineInfo.layout = layout;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineInfo.basePipelineIndex = -1;
+
+		VkResult res = vkCreateComputePipelines(lDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &outPipeline);
+		assert(res == VK_SUCCESS);
+	}
+
+	void createComputePipeline(VkPipeline& outPipeline, const VkPipelineLayout& layout, const char* shaderPath, const VkDevice& lDevice)
+	{
+		//the module isn't needed once the pipeline exists
+		VkShaderModule shader;
+		createShaderModule(shader, shaderPath, lDevice);
+		createComputePipeline(outPipeline, layout, shader, lDevice);
+		vkDestroyShaderModule(lDevice, shader, nullptr);
+	}
+
 	void createDefaultViewportForSwapChain(VkViewport& outViewport, const VkhSwapChain& swapChain)
 	{
 		outViewport = {};
@@ -1176,10 +1427,15 @@ namespace vkh
 		vkFreeCommandBuffers(GContext.device, pool, 1, &commandBuffer.buffer);
 	}
 
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels)
 	{
 		VkhCommandBuffer commandBuffer = beginScratchCommandBuffer(ECommandPoolType::Graphics);
+		transitionImageLayout(image, format, oldLayout, newLayout, mipLevels, commandBuffer);
+		submitScratchCommandBuffer(commandBuffer);
+	}
 
+	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, VkhCommandBuffer& commandBuffer)
+	{
 		VkImageMemoryBarrier barrier = {};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.oldLayout = oldLayout;
@@ -1192,7 +1448,7 @@ namespace vkh
 		barrier.image = image;
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		barrier.subresourceRange.baseMipLevel = 0;
-		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.levelCount = mipLevels;
 		barrier.subresourceRange.baseArrayLayer = 0;
 		barrier.subresourceRange.layerCount = 1;
 
@@ -1231,23 +1487,29 @@ namespace vkh
 			0, nullptr,
 			1, &barrier
 		);
-
-
-		submitScratchCommandBuffer(commandBuffer);
-
 	}
 
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+	{
+		copyBufferToImage(buffer, 0, image, width, height, 0);
+	}
+
+	void copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevel)
 	{
 		VkhCommandBuffer commandBuffer = beginScratchCommandBuffer(ECommandPoolType::Transfer);
+		copyBufferToImage(buffer, bufferOffset, image, width, height, mipLevel, commandBuffer);
+		submitScratchCommandBuffer(commandBuffer);
+	}
 
+	void copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevel, VkhCommandBuffer& commandBuffer)
+	{
 		VkBufferImageCopy region = {};
-		region.bufferOffset = 0;
+		region.bufferOffset = bufferOffset;
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.mipLevel = mipLevel;
 		region.imageSubresource.baseArrayLayer = 0;
 		region.imageSubresource.layerCount = 1;
 
@@ -1263,14 +1525,105 @@ namespace vkh
 			1,
 			&region
 		);
+	}
 
-		submitScratchCommandBuffer(commandBuffer);
 
+	uint32_t mipLevelsForExtent(uint32_t width, uint32_t height)
+	{
+		uint32_t largest = width > height ? width : height;
+		uint32_t levels = 1;
+		while (largest > 1)
+		{
+			largest >>= 1;
+			levels++;
+		}
+		return levels;
+	}
+
+	bool formatSupportsLinearBlit(VkFormat format)
+	{
+		VkFormatProperties formatProps;
+		vkGetPhysicalDeviceFormatProperties(GContext.gpu.device, format, &formatProps);
 
+		const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		return (formatProps.optimalTilingFeatures & required) == required;
 	}
 
+	void generateMipmaps(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels)
+	{
+		//blits need a graphics queue
+		VkhCommandBuffer commandBuffer = beginScratchCommandBuffer(ECommandPoolType::Graphics);
+		generateMipmaps(image, format, width, height, mipLevels, commandBuffer);
+		submitScratchCommandBuffer(commandBuffer);
+	}
+
+	void generateMipmaps(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkhCommandBuffer& commandBuffer)
+	{
+		checkf(formatSupportsLinearBlit(format), "Trying to generate mipmaps for a format that can't be blitted with linear filtering");
+		checkf(commandBuffer.owningPool == ECommandPoolType::Graphics, "Blits need a graphics queue");
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image = image;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.subresourceRange.levelCount = 1;
+
+		int32_t mipWidth = (int32_t)width;
+		int32_t mipHeight = (int32_t)height;
+
+		for (uint32_t i = 1; i < mipLevels; ++i)
+		{
+			//the previous level is the source for this blit, and is done being written to
+			barrier.subresourceRange.baseMipLevel = i - 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+			vkCmdPipelineBarrier(commandBuffer.buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+			int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+			VkImageBlit blit = {};
+			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+			blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+			blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+			blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+
+			vkCmdBlitImage(commandBuffer.buffer,
+				image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit,
+				VK_FILTER_LINEAR);
+
+			//and now it can be sampled
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+			vkCmdPipelineBarrier(commandBuffer.buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			mipWidth = nextWidth;
+			mipHeight = nextHeight;
+		}
+
+		//the last level is never used as a blit source, so it's still a transfer dst
+		barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer.buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
 
-	void createTexSampler(VkSampler& outSampler)
+	void createTexSampler(VkSampler& outSampler, uint32_t mipLevels)
 	{
 		VkSamplerCreateInfo samplerInfo = {};
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -1293,7 +1646,7 @@ namespace vkh
 		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 		samplerInfo.mipLodBias = 0.0f;
 		samplerInfo.minLod = 0.0f;
-		samplerInfo.maxLod = 0.0f;
+		samplerInfo.maxLod = (float)mipLevels;
 
 		VkResult res = vkCreateSampler(GContext.device, &samplerInfo, nullptr, &outSampler);
 		assert(res == VK_SUCCESS);
@@ -8,6 +8,7 @@ namespace vkh
 {
 	const uint32_t INVALID_QUEUE_FAMILY_IDX = -1;
 	struct VkhContext; 
+	struct AllocatorStats;
 
 	enum ECommandPoolType
 	{
@@ -16,13 +17,26 @@ namespace vkh
 		Present
 	};
 
+	//buffers and linear images can't share a bufferImageGranularity page with optimal images,
+	//so allocators that suballocate need to know which kind of resource they're placing
+	enum EResourceTiling
+	{
+		Linear,
+		Optimal
+	};
+
 	struct Allocation
 	{
 		VkDeviceMemory handle;
 		uint32_t type;
 		uint32_t id;
+		uint32_t pool; //allocator specific, identifies where id came from
 		VkDeviceSize size;
 		VkDeviceSize offset;
+
+		//host visible memory is mapped once by the allocator and stays mapped, this points at the start of the
+		//allocation (not its VkDeviceMemory). Null for memory the cpu can't see. Never vkMapMemory an allocation yourself
+		void* mapped;
 	};
 	
 	struct AllocationCreateInfo
@@ -30,6 +44,21 @@ namespace vkh
 		VkMemoryPropertyFlags usage;
 		uint32_t memoryTypeIndex;
 		VkDeviceSize size;
+		VkDeviceSize alignment;
+		EResourceTiling tiling;
+
+		//set from VkMemoryDedicatedRequirementsKHR if VK_KHR_dedicated_allocation is enabled,
+		//the resource handles are chained into the allocation if it ends up dedicated
+		VkBool32 prefersDedicated;
+		VkBool32 requiresDedicated;
+		VkImage dedicatedImage;
+		VkBuffer dedicatedBuffer;
+
+		//transient allocations may share memory with other transient allocations as long
+		//as their [firstUse, lastUse] ranges (ie: render pass indices) don't overlap
+		VkBool32 transient;
+		uint32_t firstUse;
+		uint32_t lastUse;
 	};
 
 	struct AllocatorInterface
@@ -39,6 +68,7 @@ namespace vkh
 		void(*free)(Allocation&);
 		size_t(*allocatedSize)(uint32_t);
 		uint32_t(*numAllocs)();
+		void(*stats)(AllocatorStats&);
 	};
 
 	struct VkhSurface
@@ -104,6 +134,17 @@ namespace vkh
 		VkQueue		presentQueue;
 	};
 
+	struct VkhDeviceExtensions
+	{
+		bool										dedicatedAllocation;
+		PFN_vkGetBufferMemoryRequirements2KHR		getBufferMemoryRequirements2;
+		PFN_vkGetImageMemoryRequirements2KHR		getImageMemoryRequirements2;
+
+		//from VK_KHR_draw_indirect_count, or VK_AMD_draw_indirect_count if that's all there is.
+		//Both have the same signature. Null if the device supports neither
+		PFN_vkCmdDrawIndexedIndirectCountAMD		drawIndexedIndirectCount;
+	};
+
 	struct VkhContext
 	{
 		VkInstance				instance;
@@ -111,11 +152,17 @@ namespace vkh
 		VkhPhysicalDevice		gpu;
 		VkDevice				device;
 		VkhDeviceQueues			deviceQueues;
+		VkhDeviceExtensions		extensions;
 		VkhSwapChain			swapChain;
 		VkCommandPool			gfxCommandPool;
 		VkCommandPool			transferCommandPool;
 		VkCommandPool			presentCommandPool;
 		std::vector<VkFence>	frameFences;
+
+		//frames are numbered from 1 as they're submitted, this holds the number of the last one submitted with
+		//each frame fence (0 if there hasn't been one yet)
+		std::vector<uint64_t>	frameSerials;
+		uint64_t				lastFrameSerial;
 		VkSemaphore				imageAvailableSemaphore;
 		VkSemaphore				renderFinishedSemaphore;
 		AllocatorInterface		allocator;
@@ -139,6 +186,11 @@ namespace vkh
 
 	void createWin32Context(VkhContext& outContext, uint32_t width, uint32_t height, HINSTANCE Instance, HWND wndHdl, const char* applicationName);
 
+	//replaces the context's swap chain with one sized to the surface's current extent, which can't be 0 (a minimized window).
+	//Nothing else is touched, framebuffers on the old swap chain's image views need to be destroyed first, and the queues 
+	//rendering to and presenting its images have to be idle
+	void recreateSwapchain(VkhContext& context);
+
 	void createCommandBuffer(VkCommandBuffer& outBuffers, VkCommandPool& pool, const VkDevice& lDevice);
 	void createFrameBuffers(std::vector<VkFramebuffer>& outBuffers, const VkhSwapChain& swapChain, const VkImageView* depthBufferView, const VkRenderPass& renderPass, const VkDevice& device);
 
@@ -146,10 +198,11 @@ namespace vkh
 	void createBuffer(VkBuffer& outBuffer, Allocation& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
 	void createBuffer(VkBuffer& outBuffer, Allocation& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const VkPhysicalDevice& gpu, const VkDevice& device);
 
-	void createImage(VkImage& outImage, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage);
-	void createImage(VkImage& outImage, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, const VkDevice& device);
+	void createImage(VkImage& outImage, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage);
+	void createImage(VkImage& outImage, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, const VkDevice& device);
 
 	void createDepthBuffer(VkhRenderBuffer& outBuffer, uint32_t width, uint32_t height, const VkDevice& device, const VkPhysicalDevice& gpu);
+	void destroyRenderBuffer(VkhRenderBuffer& buffer, const VkDevice& device);
 	void createVkSemaphore(VkSemaphore& outSemaphore, const VkDevice& device);
 
 	void createRenderPass(VkRenderPass& outPass, std::vector<VkAttachmentDescription>& colorAttachments, VkAttachmentDescription* depthAttachment, const VkDevice& device);
@@ -163,12 +216,29 @@ namespace vkh
 	void freeDeviceMemory(Allocation& mem);
 	void allocBindImageToMem(Allocation& outMem, const VkImage& image, VkMemoryPropertyFlags properties);
 	void allocBindImageToMem(Allocation& outMem, const VkImage& image, VkMemoryPropertyFlags properties, const VkDevice& device, const VkPhysicalDevice& gpu);
+	void allocBindTransientImageToMem(Allocation& outMem, const VkImage& image, uint32_t firstUse, uint32_t lastUse, const VkDevice& device, const VkPhysicalDevice& gpu);
+
+	//fills out size, alignment and dedicated allocation info, but not the memory type or usage
+	void getMemoryRequirements(AllocationCreateInfo& outInfo, uint32_t& outMemoryTypeBits, const VkBuffer& buffer, const VkDevice& device);
+	void getMemoryRequirements(AllocationCreateInfo& outInfo, uint32_t& outMemoryTypeBits, const VkImage& image, VkImageTiling tiling, const VkDevice& device);
 
 	void waitForFence(VkFence& fence, const VkDevice& device);
 
+	//blocks until the last frame submitted with this image's fence has finished, and resets the fence for the next one
+	void waitForFrame(VkhContext& context, uint32_t imageIndex);
+	uint64_t markFrameSubmitted(VkhContext& context, uint32_t imageIndex);
+
+	//true once every frame up to and including this serial has finished, without blocking. Anything the gpu might still
+	//be using can be released once this returns true for context.lastFrameSerial as it was when the thing stopped being used
+	bool frameCompleted(const VkhContext& context, uint64_t serial);
+
 	void createShaderModule(VkShaderModule& outModule, const char* binaryData, size_t dataSize, const VkDevice& lDevice);
 	void createShaderModule(VkShaderModule& outModule, const char* filepath, const VkDevice& lDevice);
 
+	//compute pipelines only need a layout and a shader, entry point is always main
+	void createComputePipeline(VkPipeline& outPipeline, const VkPipelineLayout& layout, const VkShaderModule& shader, const VkDevice& lDevice, const VkSpecializationInfo* specInfo = nullptr);
+	void createComputePipeline(VkPipeline& outPipeline, const VkPipelineLayout& layout, const char* shaderPath, const VkDevice& lDevice);
+
 	void createDefaultViewportForSwapChain(VkViewport& outViewport, const VkhSwapChain& swapChain);
 	void createDefaultColorBlendStateCreateInfo(VkPipelineColorBlendStateCreateInfo& outInfo, const VkPipelineColorBlendAttachmentState& blendState);
 	void createMultisampleStateCreateInfo(VkPipelineMultisampleStateCreateInfo& outInfo, uint32_t sampleCount);
@@ -178,13 +248,34 @@ namespace vkh
 
 	VkhCommandBuffer beginScratchCommandBuffer(ECommandPoolType type);
 	void submitScratchCommandBuffer(VkhCommandBuffer& buffer);
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+	//the upload helpers below that take a command buffer only record into it, the others record
+	//into a scratch command buffer and wait for its queue to go idle after submitting it
+	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
+	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, VkhCommandBuffer& commandBuffer);
 
 	//assumes VkImage is in format _OPTIMZAL
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+	void copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevel);
+	void copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevel, VkhCommandBuffer& commandBuffer);
+
+	//the number of levels in a full mip chain, down to 1x1
+	uint32_t mipLevelsForExtent(uint32_t width, uint32_t height);
+
+	//blitting needs the format to support linear filtering as a blit source and destination 
+	bool formatSupportsLinearBlit(VkFormat format);
+
+	//fills mips 1 to mipLevels-1 by blitting down from mip 0. Expects every level to be in 
+	//TRANSFER_DST_OPTIMAL with mip 0 already uploaded, and leaves them all in SHADER_READ_ONLY_OPTIMAL.
+	//the image needs TRANSFER_SRC usage
+	void generateMipmaps(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels);
+	void generateMipmaps(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkhCommandBuffer& commandBuffer);
 
 	void createImageView(VkImageView& outView, uint32_t mipCount, const VkImage& image, VkFormat format);
-	void createTexSampler(VkSampler& outSampler);
+
+	//a view of mips [baseMip, baseMip + mipCount), for binding single levels of an image as storage images
+	void createImageViewForMips(VkImageView& outView, VkFormat format, VkImageAspectFlags aspectMask, uint32_t baseMip, uint32_t mipCount, const VkImage& image);
+	void createTexSampler(VkSampler& outSampler, uint32_t mipLevels);
 
 	size_t getUniformBufferAlignment();
 	uint32_t getMemoryType(const VkPhysicalDevice& device, uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -2,13 +2,16 @@
 #include "vkh_allocator_passthrough.h"
 #include "vkh.h"
 #include "vkh_initializers.h"
+#include "vkh_allocator_stats.h"
 
 namespace vkh::allocators::passthrough
 {
 	struct AllocatorState
 	{
 		size_t* memTypeAllocSizes;
+		uint32_t* memTypeAllocCounts;
 		uint32_t totalAllocs;
+		uint32_t sizeHistogram[ALLOC_HISTOGRAM_BUCKETS];
 
 		VkhContext* context;
 	};
@@ -21,8 +24,9 @@ namespace vkh::allocators::passthrough
 	void free(Allocation& handle);
 	size_t allocatedSize(uint32_t memoryType);
 	uint32_t numAllocs();
+	void stats(AllocatorStats& outStats);
 
-	AllocatorInterface allocImpl = { activate, alloc, free, allocatedSize, numAllocs };
+	AllocatorInterface allocImpl = { activate, alloc, free, allocatedSize, numAllocs, stats };
 
 	void activate(VkhContext* context)
 	{
@@ -33,11 +37,13 @@ namespace vkh::allocators::passthrough
 		vkGetPhysicalDeviceMemoryProperties(context->gpu.device, &memProperties);
 
 		state.memTypeAllocSizes = (size_t*)calloc(1, sizeof(size_t) * memProperties.memoryTypeCount);
+		state.memTypeAllocCounts = (uint32_t*)calloc(1, sizeof(uint32_t) * memProperties.memoryTypeCount);
 	}
 
 	void deactivate(VkhContext* context)
 	{
 		::free(state.memTypeAllocSizes);
+		::free(state.memTypeAllocCounts);
 	}
 
 	//IMPLEMENTATION
@@ -47,6 +53,8 @@ namespace vkh::allocators::passthrough
 	{
 		state.totalAllocs++;
 		state.memTypeAllocSizes[createInfo.memoryTypeIndex] += createInfo.size;
+		state.memTypeAllocCounts[createInfo.memoryTypeIndex]++;
+		state.sizeHistogram[allocators::histogramBucket(createInfo.size)]++;
 
 		VkMemoryAllocateInfo allocInfo = vkh::memoryAllocateInfo(createInfo.size, createInfo.memoryTypeIndex);
 		VkResult res = vkAllocateMemory(state.context->device, &allocInfo, nullptr, &(outAlloc.handle));
@@ -54,16 +62,26 @@ namespace vkh::allocators::passthrough
 		outAlloc.size = createInfo.size;
 		outAlloc.type = createInfo.memoryTypeIndex;
 		outAlloc.offset = 0;
+		outAlloc.mapped = nullptr;
 
 		checkf(res != VK_ERROR_OUT_OF_DEVICE_MEMORY, "Out of device memory");
 		checkf(res != VK_ERROR_TOO_MANY_OBJECTS, "Attempting to create too many allocations")
 		checkf(res == VK_SUCCESS, "Error allocating memory in passthrough allocator");
+
+		//every allocation has its memory to itself, so it can stay mapped until it's freed
+		if (createInfo.usage & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			res = vkMapMemory(state.context->device, outAlloc.handle, 0, VK_WHOLE_SIZE, 0, &outAlloc.mapped);
+			checkf(res == VK_SUCCESS, "Failed to map host visible memory");
+		}
 	}
 
 	void free(Allocation& allocation)
 	{
 		state.totalAllocs--;
 		state.memTypeAllocSizes[allocation.type] -= allocation.size;
+		state.memTypeAllocCounts[allocation.type]--;
+		state.sizeHistogram[allocators::histogramBucket(allocation.size)]--;
 		vkFreeMemory(state.context->device, (allocation.handle), nullptr);
 	}
 
@@ -76,4 +94,24 @@ namespace vkh::allocators::passthrough
 	{
 		return state.totalAllocs;
 	}
+
+	//every allocation gets its own VkDeviceMemory, so there's never any free space
+	//inside a block, and the block count is always the same as the alloc count
+	void stats(AllocatorStats& outStats)
+	{
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(state.context->gpu.device, &memProperties);
+
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+		{
+			MemoryUsageStats& typeStats = outStats.memoryTypes[i];
+			typeStats.bytesReserved = state.memTypeAllocSizes[i];
+			typeStats.bytesUsed = state.memTypeAllocSizes[i];
+			typeStats.blockCount = state.memTypeAllocCounts[i];
+			typeStats.allocCount = state.memTypeAllocCounts[i];
+		}
+
+		memcpy(outStats.sizeHistogram, state.sizeHistogram, sizeof(state.sizeHistogram));
+		allocators::finalizeStats(outStats, memProperties);
+	}
 }
\ No newline at end of file
@@ -2,19 +2,55 @@
 #include "vkh_allocator_pool.h"
 #include "vkh.h"
 #include "vkh_initializers.h"
+#include "vkh_allocator_stats.h"
 #include <vector>
 #include "array.h"
 
 namespace vkh::allocators::pool
 {
+	//which part of the allocator an Allocation came from, stored in Allocation::pool
+	enum EPoolKind
+	{
+		POOL_LINEAR,		//buffers and linear images, suballocated from shared blocks
+		POOL_OPTIMAL,		//optimal images, kept apart from linear resources so we never pay for bufferImageGranularity
+		POOL_OWN_MEMORY,	//dedicated allocations, one VkDeviceMemory each
+		POOL_TRANSIENT,		//render targets that alias each other when their lifetimes don't overlap
+	};
+
+	//images at least this big get their own VkDeviceMemory if the driver prefers it,
+	//smaller ones aren't worth burning an allocation on
+	const VkDeviceSize DEDICATED_IMAGE_MIN_SIZE = 4 * 1024 * 1024;
+
+	//blocks less full than this are candidates for evacuation by the defragmenter
+	const float DEFRAG_MAX_BLOCK_OCCUPANCY = 0.5f;
+	const uint32_t INVALID_RELOCATABLE = 0xFFFFFFFF;
+
 	struct OffsetSize { uint64_t offset; uint64_t size; };
 	struct BlockSpanIndexPair { uint32_t blockIdx; uint32_t spanIdx; };
 
+	struct LiveAllocation
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		VkDeviceSize alignment;
+		uint32_t relocatable; //index into state.relocatables, or INVALID_RELOCATABLE if this allocation is pinned
+	};
+
 	struct DeviceMemoryBlock
 	{
 		Allocation mem;
+
+		//free spans, kept sorted by offset so neighbours can be merged on free
 		std::vector<OffsetSize> layout;
-		bool pageReserved;
+
+		//only tracked so the defragmenter knows what has to be moved out of a block
+		std::vector<LiveAllocation> allocations;
+
+		bool evacuating;	//nothing new gets placed in a block the defragmenter is emptying
+		bool released;		//the VkDeviceMemory has been freed, and this slot can be reused
+
+		//blocks of host visible memory are mapped when they're made, every allocation in them shares the mapping
+		void* mapped;
 	};
 
 	struct MemoryPool
@@ -22,90 +58,211 @@ namespace vkh::allocators::pool
 		std::vector<DeviceMemoryBlock> blocks;
 	};
 
+	struct TransientResident
+	{
+		uint32_t memoryType;
+		uint32_t blockIdx;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t firstUse;
+		uint32_t lastUse;
+		bool live;
+	};
+
+	struct RelocatableEntry
+	{
+		Allocation memory;
+		std::vector<RelocatableResource> resources;
+		RelocationCallback callback;
+		void* userData;
+		bool live;
+		bool writtenSinceCopy;
+	};
+
+	struct PendingMove
+	{
+		uint32_t relocatable;
+		Allocation oldMemory;
+		Allocation newMemory;
+		std::vector<RelocatableResource> newResources;
+
+		//set once the owner has switched over, the old resources are kept until frames are done with them
+		bool committed;
+		std::vector<RelocatableResource> oldResources;
+	};
+
+	//the block currently being emptied, this can take several frames depending on the budget
+	struct DefragState
+	{
+		bool evacuating;
+		EResourceTiling tiling;
+		uint32_t memoryType;
+		uint32_t blockIdx;
+
+		//copies submitted by an earlier tick. They're committed once copyFence has signalled and every frame submitted
+		//before the copies has finished, then retired (old resources destroyed) once every frame submitted before the
+		//commit has finished, since those can still be reading the old resources through the owners' descriptors
+		bool copiesInFlight;
+		bool retiring;
+		bool outOfSpace;
+		bool abandoned;
+		uint64_t waitForFrame;
+		VkFence copyFence;
+		VkCommandBuffer copyCmd;
+		std::vector<PendingMove> moves;
+
+		//if a block couldn't be emptied, don't try again until something has been allocated or freed
+		uint64_t failedAtGeneration;
+	};
+
 	struct AllocatorState
 	{
 		VkhContext* context;
 
+		std::vector<VkMemoryPropertyFlags> memTypeFlags;
 		std::vector<size_t> memTypeAllocSizes;
+		std::vector<uint32_t> memTypeAllocCounts;
 		uint32_t totalAllocs;
+		uint32_t totalBlocks;
+		uint32_t sizeHistogram[ALLOC_HISTOGRAM_BUCKETS];
 
-		uint32_t pageSize;
 		VkDeviceSize memoryBlockMinSize;
 
-		std::vector<MemoryPool> memPools;
+		//indexed by EResourceTiling, then memory type
+		std::vector<MemoryPool> memPools[2];
+
+		//own memory allocations aren't kept in a list, we only need these for stats
+		std::vector<VkDeviceSize> ownMemorySizes;
+		std::vector<uint32_t> ownMemoryCounts;
+
+		//transient blocks are indexed by memory type, residents by Allocation::id
+		std::vector<std::vector<Allocation>> transientBlocks;
+		std::vector<TransientResident> transientResidents;
+		std::vector<uint32_t> freeTransientResidents;
+
+		std::vector<RelocatableEntry> relocatables;
+		std::vector<uint32_t> freeRelocatables;
+		DefragState defrag;
+		uint64_t allocGeneration;
 	};
 
 	AllocatorState state;
 
-	//ALLOCATOR INTERFACE / INSTALLATION 
+	//ALLOCATOR INTERFACE / INSTALLATION
 	void activate(VkhContext* context);
 	void alloc(Allocation& outAlloc, AllocationCreateInfo createInfo);
 	void free(Allocation& handle);
 	size_t allocatedSize(uint32_t memoryType);
 	uint32_t numAllocs();
+	void stats(AllocatorStats& outStats);
 
-	AllocatorInterface allocImpl = { activate, alloc, free, allocatedSize, numAllocs };
+	AllocatorInterface allocImpl = { activate, alloc, free, allocatedSize, numAllocs, stats };
 
-	void activate(VkhContext* context) 
+	void activate(VkhContext* context)
 	{
 		context->allocator = allocImpl;
 		state.context = context;
 
 		VkPhysicalDeviceMemoryProperties memProperties;
 		vkGetPhysicalDeviceMemoryProperties(context->gpu.device, &memProperties);
-		
-		state.memTypeAllocSizes.resize(memProperties.memoryTypeCount); 
-		state.memPools.resize(memProperties.memoryTypeCount);
-		
-		state.pageSize = context->gpu.deviceProps.limits.bufferImageGranularity;
-		state.memoryBlockMinSize = state.pageSize * 10;
+
+		state.memTypeFlags.resize(memProperties.memoryTypeCount);
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+		{
+			state.memTypeFlags[i] = memProperties.memoryTypes[i].propertyFlags;
+		}
+
+		state.memTypeAllocSizes.resize(memProperties.memoryTypeCount);
+		state.memTypeAllocCounts.resize(memProperties.memoryTypeCount);
+		state.memPools[EResourceTiling::Linear].resize(memProperties.memoryTypeCount);
+		state.memPools[EResourceTiling::Optimal].resize(memProperties.memoryTypeCount);
+		state.ownMemorySizes.resize(memProperties.memoryTypeCount);
+		state.ownMemoryCounts.resize(memProperties.memoryTypeCount);
+		state.transientBlocks.resize(memProperties.memoryTypeCount);
+
+		state.memoryBlockMinSize = context->gpu.deviceProps.limits.bufferImageGranularity * 10;
 	}
 
-	uint32_t addBlockToPool(VkDeviceSize size, uint32_t memoryType, bool fitToAlloc)
+	VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
 	{
-		VkDeviceSize newPoolSize = size * 2;
-		newPoolSize = newPoolSize < state.memoryBlockMinSize ? state.memoryBlockMinSize : newPoolSize;
-		
-		VkMemoryAllocateInfo info = vkh::memoryAllocateInfo(newPoolSize, memoryType);
+		return ((value + alignment - 1) / alignment) * alignment;
+	}
+
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, const AllocationCreateInfo* dedicatedInfo)
+	{
+		VkMemoryAllocateInfo info = vkh::memoryAllocateInfo(size, memoryType);
+
+		VkMemoryDedicatedAllocateInfoKHR dedicatedAllocInfo = {};
+		if (dedicatedInfo && state.context->extensions.dedicatedAllocation)
+		{
+			dedicatedAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR;
+			dedicatedAllocInfo.image = dedicatedInfo->dedicatedImage;
+			dedicatedAllocInfo.buffer = dedicatedInfo->dedicatedBuffer;
+			info.pNext = &dedicatedAllocInfo;
+		}
+
+		VkDeviceMemory handle;
+		VkResult res = vkAllocateMemory(state.context->device, &info, nullptr, &handle);
 
-		DeviceMemoryBlock newBlock = {};
-		VkResult res = vkAllocateMemory(state.context->device, &info, nullptr, &newBlock.mem.handle);
-	
 		checkf(res != VK_ERROR_OUT_OF_DEVICE_MEMORY, "Out of device memory");
 		checkf(res != VK_ERROR_TOO_MANY_OBJECTS, "Attempting to create too many allocations")
-		checkf(res == VK_SUCCESS, "Error allocating memory in passthrough allocator");
+		checkf(res == VK_SUCCESS, "Error allocating memory in pool allocator");
 
-		newBlock.mem.type = memoryType;
-		newBlock.mem.size = newPoolSize;
+		return handle;
+	}
 
-		MemoryPool& pool = state.memPools[memoryType];
-		pool.blocks.push_back(newBlock);
-		
-		pool.blocks[pool.blocks.size() - 1].layout.push_back({ 0, newPoolSize });
+	//a VkDeviceMemory can only be mapped once at a time, so host visible memory is mapped here for the whole of its
+	//life and every allocation inside it is handed a pointer into that mapping
+	void* mapIfHostVisible(VkDeviceMemory handle, uint32_t memoryType)
+	{
+		if (!(state.memTypeFlags[memoryType] & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) return nullptr;
 
-		state.totalAllocs++;
-				
-		return pool.blocks.size() - 1;
+		void* mapped;
+		VkResult res = vkMapMemory(state.context->device, handle, 0, VK_WHOLE_SIZE, 0, &mapped);
+		checkf(res == VK_SUCCESS, "Failed to map host visible memory");
+		return mapped;
 	}
 
-	void markChunkOfMemoryBlockUsed(uint32_t memoryType, BlockSpanIndexPair indices, VkDeviceSize size)
+	uint32_t addBlockToPool(MemoryPool& pool, VkDeviceSize size, uint32_t memoryType)
 	{
-		MemoryPool& pool = state.memPools[memoryType];
+		VkDeviceSize newPoolSize = size * 2;
+		newPoolSize = newPoolSize < state.memoryBlockMinSize ? state.memoryBlockMinSize : newPoolSize;
+
+		DeviceMemoryBlock newBlock = {};
+		newBlock.mem.handle = allocateDeviceMemory(newPoolSize, memoryType, nullptr);
+		newBlock.mem.type = memoryType;
+		newBlock.mem.size = newPoolSize;
+		newBlock.mapped = mapIfHostVisible(newBlock.mem.handle, memoryType);
+		newBlock.layout.push_back({ 0, newPoolSize });
+
+		state.totalBlocks++;
+
+		//block indices are handed out as Allocation::id, so slots are reused rather than erased
+		for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+		{
+			if (pool.blocks[i].released)
+			{
+				pool.blocks[i] = newBlock;
+				return i;
+			}
+		}
 
-		pool.blocks[indices.blockIdx].layout[indices.spanIdx].offset += size;
-		pool.blocks[indices.blockIdx].layout[indices.spanIdx].size -= size;
+		pool.blocks.push_back(newBlock);
+		return (uint32_t)pool.blocks.size() - 1;
 	}
 
-	bool findFreeChunkForAllocation(BlockSpanIndexPair& outIndexPair, uint32_t memoryType, VkDeviceSize size, bool needsWholePage)
+	bool findFreeChunkForAllocation(BlockSpanIndexPair& outIndexPair, MemoryPool& pool, VkDeviceSize size, VkDeviceSize alignment)
 	{
-		MemoryPool& pool = state.memPools[memoryType];
-		
 		for (uint32_t i = 0; i < pool.blocks.size(); ++i)
 		{
+			if (pool.blocks[i].evacuating || pool.blocks[i].released) continue;
+
 			for (uint32_t j = 0; j < pool.blocks[i].layout.size(); ++j)
 			{
-				bool validOffset = needsWholePage ? pool.blocks[i].layout[j].offset == 0 : true;
-				if (pool.blocks[i].layout[j].size >= size && validOffset)
+				OffsetSize& span = pool.blocks[i].layout[j];
+				VkDeviceSize padding = alignUp(span.offset, alignment) - span.offset;
+
+				if (span.size >= size + padding)
 				{
 					outIndexPair.blockIdx = i;
 					outIndexPair.spanIdx = j;
@@ -116,79 +273,818 @@ namespace vkh::allocators::pool
 		return false;
 	}
 
-	void alloc(Allocation& outAlloc, AllocationCreateInfo createInfo)
+	//carves [alignedOffset, alignedOffset + size) out of a free span, any alignment padding
+	//in front of it stays in the free list and gets merged back in when the allocation is freed
+	VkDeviceSize markChunkOfMemoryBlockUsed(DeviceMemoryBlock& block, uint32_t spanIdx, VkDeviceSize size, VkDeviceSize alignment)
+	{
+		OffsetSize span = block.layout[spanIdx];
+		VkDeviceSize alignedOffset = alignUp(span.offset, alignment);
+		VkDeviceSize padding = alignedOffset - span.offset;
+		OffsetSize remainder = { alignedOffset + size, span.size - padding - size };
+
+		if (padding > 0)
+		{
+			block.layout[spanIdx].size = padding;
+			if (remainder.size > 0)
+			{
+				block.layout.insert(block.layout.begin() + spanIdx + 1, remainder);
+			}
+		}
+		else if (remainder.size > 0)
+		{
+			block.layout[spanIdx] = remainder;
+		}
+		else
+		{
+			block.layout.erase(block.layout.begin() + spanIdx);
+		}
+
+		return alignedOffset;
+	}
+
+	void returnChunkToMemoryBlock(DeviceMemoryBlock& block, VkDeviceSize offset, VkDeviceSize size)
+	{
+		std::vector<OffsetSize>& layout = block.layout;
+
+		uint32_t insertIdx = 0;
+		while (insertIdx < layout.size() && layout[insertIdx].offset < offset) insertIdx++;
+
+		layout.insert(layout.begin() + insertIdx, { offset, size });
+
+		//merge with the following span first, so insertIdx stays valid
+		if (insertIdx + 1 < layout.size() && layout[insertIdx].offset + layout[insertIdx].size == layout[insertIdx + 1].offset)
+		{
+			layout[insertIdx].size += layout[insertIdx + 1].size;
+			layout.erase(layout.begin() + insertIdx + 1);
+		}
+
+		if (insertIdx > 0 && layout[insertIdx - 1].offset + layout[insertIdx - 1].size == layout[insertIdx].offset)
+		{
+			layout[insertIdx - 1].size += layout[insertIdx].size;
+			layout.erase(layout.begin() + insertIdx);
+		}
+	}
+
+	bool lifetimesOverlap(const TransientResident& resident, uint32_t firstUse, uint32_t lastUse)
+	{
+		return resident.firstUse <= lastUse && firstUse <= resident.lastUse;
+	}
+
+	bool memoryOverlaps(const TransientResident& resident, VkDeviceSize offset, VkDeviceSize size)
+	{
+		return resident.offset < offset + size && offset < resident.offset + resident.size;
+	}
+
+	//first fit over the candidate offsets that matter: the start of the block, and the end of
+	//every resident that is alive at the same time as the new allocation
+	bool findTransientOffset(VkDeviceSize& outOffset, uint32_t memoryType, uint32_t blockIdx, const AllocationCreateInfo& createInfo)
+	{
+		const Allocation& block = state.transientBlocks[memoryType][blockIdx];
+
+		auto fits = [&](VkDeviceSize offset)
+		{
+			if (offset + createInfo.size > block.size) return false;
+
+			for (const TransientResident& other : state.transientResidents)
+			{
+				if (!other.live || other.memoryType != memoryType || other.blockIdx != blockIdx) continue;
+				if (lifetimesOverlap(other, createInfo.firstUse, createInfo.lastUse) && memoryOverlaps(other, offset, createInfo.size))
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		if (fits(0))
+		{
+			outOffset = 0;
+			return true;
+		}
+
+		for (const TransientResident& other : state.transientResidents)
+		{
+			if (!other.live || other.memoryType != memoryType || other.blockIdx != blockIdx) continue;
+			if (!lifetimesOverlap(other, createInfo.firstUse, createInfo.lastUse)) continue;
+
+			VkDeviceSize candidate = alignUp(other.offset + other.size, createInfo.alignment);
+			if (fits(candidate))
+			{
+				outOffset = candidate;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void allocTransient(Allocation& outAlloc, const AllocationCreateInfo& createInfo)
 	{
 		uint32_t memoryType = createInfo.memoryTypeIndex;
-		VkDeviceSize size = createInfo.size;
+		std::vector<Allocation>& blocks = state.transientBlocks[memoryType];
+
+		VkDeviceSize offset = 0;
+		uint32_t blockIdx = 0;
+		bool found = false;
+
+		while (!found && blockIdx < blocks.size())
+		{
+			found = findTransientOffset(offset, memoryType, blockIdx, createInfo);
+			if (!found) blockIdx++;
+		}
+
+		if (!found)
+		{
+			//transient blocks are sized to the first thing placed in them, render targets
+			//tend to come in a handful of sizes so later ones usually fit
+			Allocation newBlock = {};
+			newBlock.handle = allocateDeviceMemory(createInfo.size, memoryType, nullptr);
+			newBlock.type = memoryType;
+			newBlock.size = createInfo.size;
+			blocks.push_back(newBlock);
+
+			state.totalBlocks++;
+			offset = 0;
+		}
 
-		MemoryPool& pool = state.memPools[memoryType];
-		//make sure we always alloc a multiple of pageSize
-		VkDeviceSize requestedAllocSize = ((size / state.pageSize) + 1) * state.pageSize;
-		state.memTypeAllocSizes[memoryType] += requestedAllocSize;
+		TransientResident resident = { memoryType, blockIdx, offset, createInfo.size, createInfo.firstUse, createInfo.lastUse, true };
+
+		uint32_t residentIdx;
+		if (state.freeTransientResidents.size() > 0)
+		{
+			residentIdx = state.freeTransientResidents.back();
+			state.freeTransientResidents.pop_back();
+			state.transientResidents[residentIdx] = resident;
+		}
+		else
+		{
+			residentIdx = (uint32_t)state.transientResidents.size();
+			state.transientResidents.push_back(resident);
+		}
+
+		outAlloc.handle = blocks[blockIdx].handle;
+		outAlloc.offset = offset;
+		outAlloc.id = residentIdx;
+	}
+
+	bool shouldUseOwnMemory(const AllocationCreateInfo& createInfo)
+	{
+		if (createInfo.requiresDedicated) return true;
+
+		bool isImage = createInfo.dedicatedImage != VK_NULL_HANDLE;
+		return createInfo.prefersDedicated && isImage && createInfo.size >= DEDICATED_IMAGE_MIN_SIZE;
+	}
 
+	bool suballocate(Allocation& outAlloc, EResourceTiling tiling, uint32_t memoryType, VkDeviceSize size, VkDeviceSize alignment, bool allowNewBlock)
+	{
+		MemoryPool& pool = state.memPools[tiling][memoryType];
 		BlockSpanIndexPair location;
 
-		bool needsOwnPage = createInfo.usage != VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-		bool found = findFreeChunkForAllocation(location, memoryType, requestedAllocSize, needsOwnPage);
+		bool found = findFreeChunkForAllocation(location, pool, size, alignment);
 
 		if (!found)
 		{
-			location = { addBlockToPool(requestedAllocSize, memoryType, needsOwnPage), 0 };
+			if (!allowNewBlock) return false;
+
+			//every block starts at offset 0, which satisfies any alignment
+			location = { addBlockToPool(pool, size, memoryType), 0 };
 		}
 
-		pool.blocks[location.blockIdx].pageReserved = needsOwnPage;
+		DeviceMemoryBlock& block = pool.blocks[location.blockIdx];
 
-		outAlloc.handle = pool.blocks[location.blockIdx].mem.handle;
+		outAlloc.handle = block.mem.handle;
+		outAlloc.offset = markChunkOfMemoryBlockUsed(block, location.spanIdx, size, alignment);
+		outAlloc.id = location.blockIdx;
+		outAlloc.pool = tiling == EResourceTiling::Optimal ? POOL_OPTIMAL : POOL_LINEAR;
 		outAlloc.size = size;
-		outAlloc.offset = pool.blocks[location.blockIdx].layout[location.spanIdx].offset;
 		outAlloc.type = memoryType;
-		outAlloc.id = location.blockIdx;
+		outAlloc.mapped = block.mapped ? (uint8_t*)block.mapped + outAlloc.offset : nullptr;
+
+		block.allocations.push_back({ outAlloc.offset, size, alignment, INVALID_RELOCATABLE });
+		return true;
+	}
+
+	void trackAlloc(uint32_t memoryType, VkDeviceSize size)
+	{
+		state.memTypeAllocSizes[memoryType] += size;
+		state.memTypeAllocCounts[memoryType]++;
+		state.totalAllocs++;
+		state.sizeHistogram[allocators::histogramBucket(size)]++;
+		state.allocGeneration++;
+	}
+
+	void untrackAlloc(uint32_t memoryType, VkDeviceSize size)
+	{
+		state.memTypeAllocSizes[memoryType] -= size;
+		state.memTypeAllocCounts[memoryType]--;
+		state.totalAllocs--;
+		state.sizeHistogram[allocators::histogramBucket(size)]--;
+		state.allocGeneration++;
+	}
+
+	DeviceMemoryBlock& blockForAllocation(const Allocation& allocation)
+	{
+		EResourceTiling tiling = allocation.pool == POOL_OPTIMAL ? EResourceTiling::Optimal : EResourceTiling::Linear;
+		return state.memPools[tiling][allocation.type].blocks[allocation.id];
+	}
 
-		markChunkOfMemoryBlockUsed(memoryType, location, requestedAllocSize);
+	LiveAllocation* findLiveAllocation(const Allocation& allocation)
+	{
+		DeviceMemoryBlock& block = blockForAllocation(allocation);
+		for (LiveAllocation& live : block.allocations)
+		{
+			if (live.offset == allocation.offset) return &live;
+		}
+		return nullptr;
+	}
+
+	void alloc(Allocation& outAlloc, AllocationCreateInfo createInfo)
+	{
+		uint32_t memoryType = createInfo.memoryTypeIndex;
+		VkDeviceSize size = createInfo.size;
+		createInfo.alignment = createInfo.alignment > 0 ? createInfo.alignment : 1;
+
+		trackAlloc(memoryType, size);
+
+		outAlloc.size = size;
+		outAlloc.type = memoryType;
+
+		if (shouldUseOwnMemory(createInfo))
+		{
+			outAlloc.handle = allocateDeviceMemory(size, memoryType, &createInfo);
+			outAlloc.offset = 0;
+			outAlloc.id = 0;
+			outAlloc.pool = POOL_OWN_MEMORY;
+			outAlloc.mapped = mapIfHostVisible(outAlloc.handle, memoryType);
+
+			state.ownMemorySizes[memoryType] += size;
+			state.ownMemoryCounts[memoryType]++;
+			return;
+		}
+
+		if (createInfo.transient)
+		{
+			//aliased memory has no contents worth reading back, so it's never mapped
+			checkf(!(createInfo.usage & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT), "Transient allocations can't be host visible");
+			outAlloc.mapped = nullptr;
+			outAlloc.pool = POOL_TRANSIENT;
+			allocTransient(outAlloc, createInfo);
+			return;
+		}
+
+		suballocate(outAlloc, createInfo.tiling, memoryType, size, createInfo.alignment, true);
 	}
 
 	void free(Allocation& allocation)
 	{
-		VkDeviceSize requestedAllocSize = ((allocation.size / state.pageSize) + 1) * state.pageSize;
+		untrackAlloc(allocation.type, allocation.size);
+
+		switch (allocation.pool)
+		{
+			case POOL_OWN_MEMORY:
+			{
+				state.ownMemorySizes[allocation.type] -= allocation.size;
+				state.ownMemoryCounts[allocation.type]--;
+				vkFreeMemory(state.context->device, allocation.handle, nullptr);
+			}break;
+
+			case POOL_TRANSIENT:
+			{
+				//transient blocks are kept around even when empty, since whatever was in them
+				//is usually about to be recreated (ie: on resize)
+				state.transientResidents[allocation.id].live = false;
+				state.freeTransientResidents.push_back(allocation.id);
+			}break;
+
+			default:
+			{
+				DeviceMemoryBlock& block = blockForAllocation(allocation);
+
+				for (uint32_t i = 0; i < block.allocations.size(); ++i)
+				{
+					if (block.allocations[i].offset == allocation.offset)
+					{
+						uint32_t relocatable = block.allocations[i].relocatable;
+						if (relocatable != INVALID_RELOCATABLE && state.relocatables[relocatable].live)
+						{
+							state.relocatables[relocatable].live = false;
+							state.freeRelocatables.push_back(relocatable);
+						}
+
+						block.allocations.erase(block.allocations.begin() + i);
+						break;
+					}
+				}
+
+				returnChunkToMemoryBlock(block, allocation.offset, allocation.size);
+			}break;
+		}
+	}
+
+	size_t allocatedSize(uint32_t memoryType)
+	{
+		return state.memTypeAllocSizes[memoryType];
+	}
+
+	uint32_t numAllocs()
+	{
+		return state.totalAllocs;
+	}
+
+	void stats(AllocatorStats& outStats)
+	{
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(state.context->gpu.device, &memProperties);
+
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
+		{
+			MemoryUsageStats& typeStats = outStats.memoryTypes[i];
+			typeStats.bytesUsed = state.memTypeAllocSizes[i];
+			typeStats.allocCount = state.memTypeAllocCounts[i];
+
+			typeStats.bytesReserved += state.ownMemorySizes[i];
+			typeStats.blockCount += state.ownMemoryCounts[i];
+
+			for (std::vector<MemoryPool>& pools : state.memPools)
+			{
+				for (DeviceMemoryBlock& block : pools[i].blocks)
+				{
+					if (block.released) continue;
+
+					typeStats.bytesReserved += block.mem.size;
+					typeStats.blockCount++;
+
+					for (OffsetSize& span : block.layout)
+					{
+						typeStats.bytesFree += span.size;
+						typeStats.largestFreeSpan = span.size > typeStats.largestFreeSpan ? span.size : typeStats.largestFreeSpan;
+					}
+				}
+			}
+
+			//aliased allocations overlap, so count transient memory as used up to the highest
+			//live resident in each block instead of summing allocation sizes
+			for (uint32_t blockIdx = 0; blockIdx < state.transientBlocks[i].size(); ++blockIdx)
+			{
+				VkDeviceSize highWater = 0;
+				for (const TransientResident& resident : state.transientResidents)
+				{
+					if (!resident.live || resident.memoryType != i || resident.blockIdx != blockIdx) continue;
+
+					typeStats.bytesUsed -= resident.size;
+					highWater = resident.offset + resident.size > highWater ? resident.offset + resident.size : highWater;
+				}
+
+				VkDeviceSize blockFree = state.transientBlocks[i][blockIdx].size - highWater;
+
+				typeStats.bytesUsed += highWater;
+				typeStats.bytesReserved += state.transientBlocks[i][blockIdx].size;
+				typeStats.bytesFree += blockFree;
+				typeStats.largestFreeSpan = blockFree > typeStats.largestFreeSpan ? blockFree : typeStats.largestFreeSpan;
+				typeStats.blockCount++;
+			}
+		}
+
+		memcpy(outStats.sizeHistogram, state.sizeHistogram, sizeof(state.sizeHistogram));
+		allocators::finalizeStats(outStats, memProperties);
+	}
+
+	void registerRelocatable(const Allocation& memory, const RelocatableResource* resources, uint32_t resourceCount, RelocationCallback callback, void* userData)
+	{
+		//dedicated and transient memory is never moved, so there's nothing to track
+		if (memory.pool != POOL_LINEAR && memory.pool != POOL_OPTIMAL) return;
+
+		LiveAllocation* live = findLiveAllocation(memory);
+		checkf(live, "Registering an allocation that isn't live");
+
+		RelocatableEntry entry;
+		entry.memory = memory;
+		entry.resources.assign(resources, resources + resourceCount);
+		entry.callback = callback;
+		entry.userData = userData;
+		entry.live = true;
+		entry.writtenSinceCopy = false;
+
+		uint32_t idx;
+		if (state.freeRelocatables.size() > 0)
+		{
+			idx = state.freeRelocatables.back();
+			state.freeRelocatables.pop_back();
+			state.relocatables[idx] = entry;
+		}
+		else
+		{
+			idx = (uint32_t)state.relocatables.size();
+			state.relocatables.push_back(entry);
+		}
+
+		live->relocatable = idx;
+	}
+
+	void unregisterRelocatable(const Allocation& memory)
+	{
+		if (memory.pool != POOL_LINEAR && memory.pool != POOL_OPTIMAL) return;
+
+		LiveAllocation* live = findLiveAllocation(memory);
+		if (live && live->relocatable != INVALID_RELOCATABLE)
+		{
+			state.relocatables[live->relocatable].live = false;
+			state.freeRelocatables.push_back(live->relocatable);
+			live->relocatable = INVALID_RELOCATABLE;
+		}
+	}
+
+	void markRelocatableWritten(const Allocation& memory)
+	{
+		if (memory.pool != POOL_LINEAR && memory.pool != POOL_OPTIMAL) return;
+
+		LiveAllocation* live = findLiveAllocation(memory);
+		if (live && live->relocatable != INVALID_RELOCATABLE)
+		{
+			state.relocatables[live->relocatable].writtenSinceCopy = true;
+		}
+	}
 
-		OffsetSize span = {allocation.offset, requestedAllocSize };
+	void releaseBlock(DeviceMemoryBlock& block)
+	{
+		//freeing memory unmaps it too
+		vkFreeMemory(state.context->device, block.mem.handle, nullptr);
+		block.mem.handle = VK_NULL_HANDLE;
+		block.mapped = nullptr;
+		block.mem.size = 0;
+		block.layout.clear();
+		block.evacuating = false;
+		block.released = true;
 
-		MemoryPool& pool = state.memPools[allocation.type];
-		pool.blocks[allocation.id].pageReserved = false;
+		state.totalBlocks--;
+	}
 
+	//picks the emptiest block that can be fully moved into the free space of the other
+	//blocks in its pool. Blocks with pinned (unregistered) allocations are skipped
+	bool pickBlockToEvacuate()
+	{
+		DefragState& defrag = state.defrag;
+		float bestOccupancy = DEFRAG_MAX_BLOCK_OCCUPANCY;
 		bool found = false;
 
-		uint32_t numLayoutMems = pool.blocks[allocation.id].layout.size();
-		for (uint32_t j = 0; j < numLayoutMems; ++j)
+		if (defrag.failedAtGeneration == state.allocGeneration) return false;
+
+		for (uint32_t tiling = 0; tiling < 2; ++tiling)
+		{
+			for (uint32_t memoryType = 0; memoryType < state.memPools[tiling].size(); ++memoryType)
+			{
+				MemoryPool& pool = state.memPools[tiling][memoryType];
+
+				VkDeviceSize poolFree = 0;
+				uint32_t poolBlocks = 0;
+				for (DeviceMemoryBlock& block : pool.blocks)
+				{
+					if (block.released) continue;
+					poolBlocks++;
+					for (OffsetSize& span : block.layout) poolFree += span.size;
+				}
+
+				//never empty the last block of a pool, it would just get allocated again
+				if (poolBlocks < 2) continue;
+
+				for (uint32_t blockIdx = 0; blockIdx < pool.blocks.size(); ++blockIdx)
+				{
+					DeviceMemoryBlock& block = pool.blocks[blockIdx];
+					if (block.released) continue;
+
+					VkDeviceSize used = 0;
+					bool movable = true;
+					for (LiveAllocation& live : block.allocations)
+					{
+						used += live.size;
+						movable &= live.relocatable != INVALID_RELOCATABLE;
+					}
+
+					VkDeviceSize blockFree = block.mem.size - used;
+					float occupancy = (float)((double)used / (double)block.mem.size);
+
+					if (movable && occupancy < bestOccupancy && poolFree - blockFree >= used)
+					{
+						bestOccupancy = occupancy;
+						defrag.tiling = (EResourceTiling)tiling;
+						defrag.memoryType = memoryType;
+						defrag.blockIdx = blockIdx;
+						found = true;
+					}
+				}
+			}
+		}
+
+		if (found)
+		{
+			defrag.evacuating = true;
+			state.memPools[defrag.tiling][defrag.memoryType].blocks[defrag.blockIdx].evacuating = true;
+		}
+
+		return found;
+	}
+
+	//the copies run on the graphics queue after whatever frames were submitted before them, so the source has to
+	//wait for those frames' writes, and goes back to its usual layout afterwards since frames keep using it until commit
+	void recordImageCopy(VkCommandBuffer cmd, const RelocatableResource& src, const RelocatableResource& dst)
+	{
+		VkImageMemoryBarrier barriers[2] = {};
+		for (VkImageMemoryBarrier& barrier : barriers)
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.levelCount = src.imageMipLevels;
+			barrier.subresourceRange.layerCount = 1;
+		}
+
+		barriers[0].image = src.image;
+		barriers[0].oldLayout = src.imageLayout;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		barriers[1].image = dst.image;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+		std::vector<VkImageCopy> regions;
+		regions.resize(src.imageMipLevels);
+		for (uint32_t mip = 0; mip < src.imageMipLevels; ++mip)
+		{
+			VkImageCopy& region = regions[mip];
+			region = {};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+			region.extent.width = src.imageWidth >> mip > 0 ? src.imageWidth >> mip : 1;
+			region.extent.height = src.imageHeight >> mip > 0 ? src.imageHeight >> mip : 1;
+			region.extent.depth = 1;
+		}
+
+		vkCmdCopyImage(cmd, src.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, src.imageMipLevels, regions.data());
+
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].newLayout = src.imageLayout;
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].newLayout = dst.imageLayout;
+		barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+	}
+
+	//creates copies of the old resources bound to the new memory, and records copying their contents over
+	void recordMove(PendingMove& move, RelocatableEntry& entry, VkCommandBuffer cmd)
+	{
+		const VkDevice& device = state.context->device;
+		move.oldMemory = entry.memory;
+		move.newResources = entry.resources;
+		entry.writtenSinceCopy = false;
+
+		for (uint32_t i = 0; i < entry.resources.size(); ++i)
+		{
+			const RelocatableResource& src = entry.resources[i];
+			RelocatableResource& dst = move.newResources[i];
+
+			if (src.buffer != VK_NULL_HANDLE)
+			{
+				vkh::createBuffer(dst.buffer, src.bufferSize, src.bufferUsage, 0);
+				vkBindBufferMemory(device, dst.buffer, move.newMemory.handle, move.newMemory.offset + src.bufferOffset);
+
+				VkBufferCopy region = { 0, 0, src.bufferSize };
+				vkCmdCopyBuffer(cmd, src.buffer, dst.buffer, 1, &region);
+			}
+			else
+			{
+				vkh::createImage(dst.image, src.imageWidth, src.imageHeight, src.imageMipLevels, src.imageFormat, VK_IMAGE_TILING_OPTIMAL, src.imageUsage);
+				vkBindImageMemory(device, dst.image, move.newMemory.handle, move.newMemory.offset);
+
+				recordImageCopy(cmd, src, dst);
+			}
+		}
+	}
+
+	void destroyResources(std::vector<RelocatableResource>& resources)
+	{
+		for (RelocatableResource& res : resources)
 		{
-			if (pool.blocks[allocation.id].layout[j].offset == requestedAllocSize +allocation.offset)
+			if (res.buffer != VK_NULL_HANDLE) vkDestroyBuffer(state.context->device, res.buffer, nullptr);
+			if (res.image != VK_NULL_HANDLE) vkDestroyImage(state.context->device, res.image, nullptr);
+		}
+	}
+
+	//the owner may have let go of the allocation, or written to it after the copy was recorded, while the copy
+	//was in flight. Nothing new is placed in an evacuating block, so a live entry at the same memory is the same one
+	bool moveIsStillValid(const PendingMove& move)
+	{
+		const RelocatableEntry& entry = state.relocatables[move.relocatable];
+		return entry.live && !entry.writtenSinceCopy && entry.memory.handle == move.oldMemory.handle && entry.memory.offset == move.oldMemory.offset;
+	}
+
+	void commitMove(PendingMove& move)
+	{
+		RelocatableEntry& entry = state.relocatables[move.relocatable];
+		Allocation oldMemory = entry.memory;
+
+		Relocation relocation;
+		relocation.oldMemory = oldMemory;
+		relocation.newMemory = move.newMemory;
+		relocation.oldResources = entry.resources.data();
+		relocation.newResources = move.newResources.data();
+		relocation.resourceCount = (uint32_t)entry.resources.size();
+
+		entry.callback(entry.userData, relocation);
+		move.oldResources = entry.resources;
+		move.committed = true;
+
+		//hand the registration over to the new allocation before the old one is freed,
+		//otherwise free would treat this as the owner releasing the resource
+		findLiveAllocation(oldMemory)->relocatable = INVALID_RELOCATABLE;
+		findLiveAllocation(move.newMemory)->relocatable = move.relocatable;
+
+		entry.memory = move.newMemory;
+		entry.resources = move.newResources;
+	}
+
+	void abandonMove(PendingMove& move)
+	{
+		destroyResources(move.newResources);
+		free(move.newMemory);
+	}
+
+	void submitCopies(VkDeviceSize byteBudget)
+	{
+		DefragState& defrag = state.defrag;
+		DeviceMemoryBlock& block = state.memPools[defrag.tiling][defrag.memoryType].blocks[defrag.blockIdx];
+
+		if (defrag.copyFence == VK_NULL_HANDLE)
+		{
+			vkh::createFence(defrag.copyFence, state.context->device);
+		}
+
+		defrag.moves.clear();
+		defrag.outOfSpace = false;
+		VkDeviceSize bytesRecorded = 0;
+
+		VkhCommandBuffer cmd = beginScratchCommandBuffer(ECommandPoolType::Graphics);
+
+		//buffers can have been written by any frame submitted before this
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(cmd.buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		for (LiveAllocation& live : block.allocations)
+		{
+			if (bytesRecorded > 0 && bytesRecorded + live.size > byteBudget) break;
+
+			//unregistered since the block was picked, which pins it where it is
+			if (live.relocatable == INVALID_RELOCATABLE)
+			{
+				defrag.outOfSpace = true;
+				break;
+			}
+
+			PendingMove move;
+			move.relocatable = live.relocatable;
+			move.committed = false;
+
+			//never make a new block here, that would defeat the point
+			if (!suballocate(move.newMemory, defrag.tiling, defrag.memoryType, live.size, live.alignment, false))
 			{
-				pool.blocks[allocation.id].layout[j].offset = allocation.offset;
-				pool.blocks[allocation.id].layout[j].size += requestedAllocSize;
-				found = true;
+				defrag.outOfSpace = true;
 				break;
 			}
+
+			trackAlloc(defrag.memoryType, live.size);
+			recordMove(move, state.relocatables[live.relocatable], cmd.buffer);
+
+			defrag.moves.push_back(move);
+			bytesRecorded += live.size;
 		}
 
-		if (!found)
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		vkCmdPipelineBarrier(cmd.buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkEndCommandBuffer(cmd.buffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cmd.buffer;
+
+		VkResult res = vkQueueSubmit(state.context->deviceQueues.graphicsQueue, 1, &submitInfo, defrag.copyFence);
+		checkf(res == VK_SUCCESS, "Failed to submit defragmentation copies");
+
+		defrag.copyCmd = cmd.buffer;
+		defrag.copiesInFlight = true;
+		defrag.waitForFrame = state.context->lastFrameSerial;
+	}
+
+	void commitCopies()
+	{
+		DefragState& defrag = state.defrag;
+
+		vkFreeCommandBuffers(state.context->device, state.context->gfxCommandPool, 1, &defrag.copyCmd);
+		vkResetFences(state.context->device, 1, &defrag.copyFence);
+		defrag.copiesInFlight = false;
+
+		defrag.abandoned = false;
+		for (PendingMove& move : defrag.moves)
 		{
-			state.memPools[allocation.type].blocks[allocation.id].layout.push_back(span);
-			state.memTypeAllocSizes[allocation.type] -= requestedAllocSize;
+			if (moveIsStillValid(move))
+			{
+				commitMove(move);
+			}
+			else
+			{
+				//a move whose owner wrote to it goes around again, one that was released just doesn't need moving.
+				//Only the copies have touched the new resources, so they can go right away
+				abandonMove(move);
+				defrag.abandoned = true;
+			}
 		}
+
+		defrag.retiring = true;
+		defrag.waitForFrame = state.context->lastFrameSerial;
 	}
 
-	size_t allocatedSize(uint32_t memoryType)
+	void retireMoves()
 	{
-		return state.memTypeAllocSizes[memoryType];
+		DefragState& defrag = state.defrag;
+		DeviceMemoryBlock& block = state.memPools[defrag.tiling][defrag.memoryType].blocks[defrag.blockIdx];
+
+		for (PendingMove& move : defrag.moves)
+		{
+			if (!move.committed) continue;
+			destroyResources(move.oldResources);
+			free(move.oldMemory);
+		}
+		defrag.moves.clear();
+		defrag.retiring = false;
+
+		if (block.allocations.size() == 0)
+		{
+			releaseBlock(block);
+			defrag.evacuating = false;
+		}
+		else if (defrag.outOfSpace && !defrag.abandoned)
+		{
+			//fragmentation elsewhere or a newly pinned allocation means the rest won't move, give up on this block for now
+			block.evacuating = false;
+			defrag.evacuating = false;
+			defrag.failedAtGeneration = state.allocGeneration;
+		}
 	}
 
-	uint32_t numAllocs()
+	void tickDefrag(VkDeviceSize byteBudget)
 	{
-		return state.totalAllocs;
+		DefragState& defrag = state.defrag;
+
+		//nothing here waits, each step just doesn't happen until the gpu work it depends on is done
+		if (defrag.copiesInFlight)
+		{
+			if (vkGetFenceStatus(state.context->device, defrag.copyFence) == VK_SUCCESS && vkh::frameCompleted(*state.context, defrag.waitForFrame))
+			{
+				commitCopies();
+			}
+			return;
+		}
+
+		if (defrag.retiring)
+		{
+			if (!vkh::frameCompleted(*state.context, defrag.waitForFrame)) return;
+			retireMoves();
+		}
+
+		if (!defrag.evacuating && !pickBlockToEvacuate()) return;
+		submitCopies(byteBudget);
 	}
 
 	void deactivate(VkhContext* context)
 	{
+		DefragState& defrag = state.defrag;
+		if (defrag.copiesInFlight || defrag.retiring)
+		{
+			vkDeviceWaitIdle(context->device);
+			if (defrag.copiesInFlight) commitCopies();
+			retireMoves();
+		}
+
+		if (defrag.copyFence != VK_NULL_HANDLE)
+		{
+			vkDestroyFence(context->device, defrag.copyFence, nullptr);
+			defrag.copyFence = VK_NULL_HANDLE;
+		}
 	}
 
 }
\ No newline at end of file
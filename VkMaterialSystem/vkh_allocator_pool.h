@@ -1,9 +1,66 @@
 #pragma once
-struct VkhContext;
+#include "vkh.h"
 
 //perhaps the only good part of c++17: nested namespaces, woohoo!
 namespace vkh::allocators::pool
 {
 	void activate(VkhContext* context);
 	void deactivate(VkhContext* context);
+
+	//DEFRAGMENTATION
+
+	//describes a resource bound to a relocatable allocation, so the defragmenter can recreate it
+	//somewhere else. Only one of buffer / image should be set
+	struct RelocatableResource
+	{
+		VkBuffer			buffer;
+		VkBufferUsageFlags	bufferUsage;
+		VkDeviceSize		bufferSize;
+		VkDeviceSize		bufferOffset;	//offset from the start of the allocation
+
+		VkImage				image;
+		VkImageUsageFlags	imageUsage;
+		VkFormat			imageFormat;
+		uint32_t			imageWidth;
+		uint32_t			imageHeight;
+		uint32_t			imageMipLevels;
+		VkImageLayout		imageLayout;	//the layout the image is kept in between uses
+	};
+
+	struct Relocation
+	{
+		Allocation oldMemory;
+		Allocation newMemory;
+
+		//same order as the array the allocation was registered with
+		const RelocatableResource* oldResources;
+		const RelocatableResource* newResources;
+		uint32_t resourceCount;
+	};
+
+	//called once an allocation's contents have been copied to their new location. The owner
+	//needs to switch to the new handles and rewrite any descriptors pointing at the old ones.
+	//Frames submitted before the call can still be using the old resources, the allocator destroys
+	//them (and frees the old memory) once those frames have finished, and the owner has to hold on
+	//to anything of its own it replaces (views etc) the same way
+	typedef void(*RelocationCallback)(void* userData, const Relocation& relocation);
+
+	//allocations have to be registered before the defragmenter will move them, blocks that
+	//contain an unregistered allocation are never evacuated. Buffers and images need to have
+	//been created with TRANSFER_SRC usage, since the defragmenter copies out of them
+	void registerRelocatable(const Allocation& memory, const RelocatableResource* resources, uint32_t resourceCount, RelocationCallback callback, void* userData);
+	void unregisterRelocatable(const Allocation& memory);
+
+	//owners that write to a registered allocation after creating it need to call this, so a move
+	//that copied the old contents before the write is thrown away instead of committed
+	void markRelocatableWritten(const Allocation& memory);
+
+	//does one step of defragmentation, without ever waiting on the gpu. With nothing in flight, this records
+	//up to byteBudget bytes of copies out of a mostly empty block and submits them to the graphics queue.
+	//Once those copies and the frames submitted before them have finished, a later call commits them (the
+	//owners' callbacks switch to the new resources), and once the frames submitted before the commit have
+	//finished, another retires the old resources and memory. Copies share the graphics queue with frames, so
+	//anything that waits for frames in flight before destroying a resource also waits for the copies reading
+	//from it. Call once per frame, outside of any recording
+	void tickDefrag(VkDeviceSize byteBudget);
 }
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "stdafx.h"
+#include "vkh_allocator_stats.h"
+#include "vkh.h"
+
+#include <rapidjson\prettywriter.h>
+#include <rapidjson\stringbuffer.h>
+
+namespace vkh::allocators
+{
+	uint32_t histogramBucket(VkDeviceSize size)
+	{
+		uint32_t bucket = 0;
+		while (size > 1 && bucket < ALLOC_HISTOGRAM_BUCKETS - 1)
+		{
+			size >>= 1;
+			bucket++;
+		}
+		return bucket;
+	}
+
+	float fragmentationForUsage(const MemoryUsageStats& usage)
+	{
+		if (usage.bytesFree == 0) return 0.0f;
+		return 1.0f - (float)((double)usage.largestFreeSpan / (double)usage.bytesFree);
+	}
+
+	void accumulateUsage(MemoryUsageStats& dst, const MemoryUsageStats& src)
+	{
+		dst.bytesReserved += src.bytesReserved;
+		dst.bytesUsed += src.bytesUsed;
+		dst.bytesFree += src.bytesFree;
+		dst.blockCount += src.blockCount;
+		dst.allocCount += src.allocCount;
+		dst.largestFreeSpan = src.largestFreeSpan > dst.largestFreeSpan ? src.largestFreeSpan : dst.largestFreeSpan;
+	}
+
+	void finalizeStats(AllocatorStats& stats, const VkPhysicalDeviceMemoryProperties& memProps)
+	{
+		stats.memoryTypeCount = memProps.memoryTypeCount;
+		stats.memoryHeapCount = memProps.memoryHeapCount;
+
+		memset(&stats.memoryHeaps[0], 0, sizeof(stats.memoryHeaps));
+		memset(&stats.total, 0, sizeof(stats.total));
+
+		for (uint32_t i = 0; i < stats.memoryTypeCount; ++i)
+		{
+			MemoryUsageStats& typeStats = stats.memoryTypes[i];
+			typeStats.fragmentation = fragmentationForUsage(typeStats);
+
+			accumulateUsage(stats.memoryHeaps[memProps.memoryTypes[i].heapIndex], typeStats);
+			accumulateUsage(stats.total, typeStats);
+		}
+
+		for (uint32_t i = 0; i < stats.memoryHeapCount; ++i)
+		{
+			stats.memoryHeaps[i].fragmentation = fragmentationForUsage(stats.memoryHeaps[i]);
+		}
+
+		stats.total.fragmentation = fragmentationForUsage(stats.total);
+	}
+
+	void collectStats(AllocatorStats& outStats)
+	{
+		memset(&outStats, 0, sizeof(AllocatorStats));
+		GContext.allocator.stats(outStats);
+	}
+
+	void computeUsageDelta(MemoryUsageDelta& outDelta, const MemoryUsageStats& prev, const MemoryUsageStats& cur)
+	{
+		outDelta.bytesReserved = (int64_t)cur.bytesReserved - (int64_t)prev.bytesReserved;
+		outDelta.bytesUsed = (int64_t)cur.bytesUsed - (int64_t)prev.bytesUsed;
+		outDelta.blockCount = (int32_t)cur.blockCount - (int32_t)prev.blockCount;
+		outDelta.allocCount = (int32_t)cur.allocCount - (int32_t)prev.allocCount;
+		outDelta.fragmentation = cur.fragmentation - prev.fragmentation;
+	}
+
+	void computeStatsDelta(AllocatorStatsDelta& outDelta, const AllocatorStats& prev, const AllocatorStats& cur)
+	{
+		for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+		{
+			computeUsageDelta(outDelta.memoryTypes[i], prev.memoryTypes[i], cur.memoryTypes[i]);
+		}
+
+		for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; ++i)
+		{
+			computeUsageDelta(outDelta.memoryHeaps[i], prev.memoryHeaps[i], cur.memoryHeaps[i]);
+		}
+
+		computeUsageDelta(outDelta.total, prev.total, cur.total);
+
+		for (uint32_t i = 0; i < ALLOC_HISTOGRAM_BUCKETS; ++i)
+		{
+			outDelta.sizeHistogram[i] = (int32_t)cur.sizeHistogram[i] - (int32_t)prev.sizeHistogram[i];
+		}
+	}
+
+	bool isDeltaEmpty(const AllocatorStatsDelta& delta)
+	{
+		//per type and per heap deltas always sum to the total, so the histogram and total are enough
+		if (delta.total.bytesReserved || delta.total.bytesUsed || delta.total.blockCount || delta.total.allocCount)
+		{
+			return false;
+		}
+
+		for (uint32_t i = 0; i < ALLOC_HISTOGRAM_BUCKETS; ++i)
+		{
+			if (delta.sizeHistogram[i]) return false;
+		}
+
+		return true;
+	}
+
+	void writeUsage(rapidjson::PrettyWriter<rapidjson::StringBuffer>& writer, const MemoryUsageStats& usage)
+	{
+		writer.Key("bytes_reserved");
+		writer.Uint64(usage.bytesReserved);
+		writer.Key("bytes_used");
+		writer.Uint64(usage.bytesUsed);
+		writer.Key("bytes_free");
+		writer.Uint64(usage.bytesFree);
+		writer.Key("largest_free_span");
+		writer.Uint64(usage.largestFreeSpan);
+		writer.Key("block_count");
+		writer.Uint(usage.blockCount);
+		writer.Key("alloc_count");
+		writer.Uint(usage.allocCount);
+		writer.Key("fragmentation");
+		writer.Double(usage.fragmentation);
+	}
+
+	void dumpStatsToJSON(const AllocatorStats& stats, const char* filepath)
+	{
+		using namespace rapidjson;
+		StringBuffer s;
+		PrettyWriter<StringBuffer> writer(s);
+
+		writer.StartObject();
+
+		writer.Key("total");
+		writer.StartObject();
+		writeUsage(writer, stats.total);
+		writer.EndObject();
+
+		writer.Key("memory_heaps");
+		writer.StartArray();
+		for (uint32_t i = 0; i < stats.memoryHeapCount; ++i)
+		{
+			writer.StartObject();
+			writer.Key("heap");
+			writer.Uint(i);
+			writeUsage(writer, stats.memoryHeaps[i]);
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.Key("memory_types");
+		writer.StartArray();
+		for (uint32_t i = 0; i < stats.memoryTypeCount; ++i)
+		{
+			writer.StartObject();
+			writer.Key("type");
+			writer.Uint(i);
+			writer.Key("heap");
+			writer.Uint(GContext.gpu.memProps.memoryTypes[i].heapIndex);
+			writeUsage(writer, stats.memoryTypes[i]);
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		//buckets are written as the lower bound of their size range
+		writer.Key("size_histogram");
+		writer.StartArray();
+		for (uint32_t i = 0; i < ALLOC_HISTOGRAM_BUCKETS; ++i)
+		{
+			if (stats.sizeHistogram[i] == 0) continue;
+
+			writer.StartObject();
+			writer.Key("min_size");
+			writer.Uint64(1ull << i);
+			writer.Key("count");
+			writer.Uint(stats.sizeHistogram[i]);
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.EndObject();
+
+		FILE* file;
+		fopen_s(&file, filepath, "w");
+		checkf(file, "Could not open allocator stats file for writing");
+
+		int res = fputs(s.GetString(), file);
+		checkf(res != EOF, "Error writing allocator stats file");
+		fclose(file);
+	}
+
+	void tickFrameStats()
+	{
+		static AllocatorStats prevStats = {};
+		static uint64_t frameIdx = 0;
+
+		AllocatorStats curStats;
+		collectStats(curStats);
+
+		//don't report the first frame, everything allocated at startup would show up as a delta
+		if (frameIdx > 0)
+		{
+			AllocatorStatsDelta delta;
+			computeStatsDelta(delta, prevStats, curStats);
+
+			if (!isDeltaEmpty(delta))
+			{
+				printf("[ALLOCATOR] frame %llu: allocs %+i, used %+lld bytes, reserved %+lld bytes, blocks %+i, fragmentation %.3f\n",
+					frameIdx,
+					delta.total.allocCount,
+					delta.total.bytesUsed,
+					delta.total.bytesReserved,
+					delta.total.blockCount,
+					curStats.total.fragmentation);
+			}
+		}
+
+		prevStats = curStats;
+		frameIdx++;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+#include "vkh.h"
+
+namespace vkh
+{
+	//bucket i of the size histogram counts live allocations with a size in [2^i, 2^(i+1))
+	const uint32_t ALLOC_HISTOGRAM_BUCKETS = 32;
+
+	struct MemoryUsageStats
+	{
+		VkDeviceSize	bytesReserved;		//memory requested from the driver
+		VkDeviceSize	bytesUsed;			//memory handed out to live allocations
+		VkDeviceSize	bytesFree;			//sum of all free spans inside reserved memory
+		VkDeviceSize	largestFreeSpan;
+		uint32_t		blockCount;			//number of VkDeviceMemory objects
+		uint32_t		allocCount;			//number of live allocations
+		float			fragmentation;		//1 - largestFreeSpan / bytesFree, 0 if there is no free memory
+	};
+
+	struct AllocatorStats
+	{
+		MemoryUsageStats	memoryTypes[VK_MAX_MEMORY_TYPES];
+		MemoryUsageStats	memoryHeaps[VK_MAX_MEMORY_HEAPS];
+		MemoryUsageStats	total;
+		uint32_t			memoryTypeCount;
+		uint32_t			memoryHeapCount;
+		uint32_t			sizeHistogram[ALLOC_HISTOGRAM_BUCKETS];
+	};
+
+	struct MemoryUsageDelta
+	{
+		int64_t		bytesReserved;
+		int64_t		bytesUsed;
+		int32_t		blockCount;
+		int32_t		allocCount;
+		float		fragmentation;
+	};
+
+	struct AllocatorStatsDelta
+	{
+		MemoryUsageDelta	memoryTypes[VK_MAX_MEMORY_TYPES];
+		MemoryUsageDelta	memoryHeaps[VK_MAX_MEMORY_HEAPS];
+		MemoryUsageDelta	total;
+		int32_t				sizeHistogram[ALLOC_HISTOGRAM_BUCKETS];
+	};
+}
+
+namespace vkh::allocators
+{
+	uint32_t histogramBucket(VkDeviceSize size);
+
+	//allocators only need to fill out the memoryTypes array and the histogram,
+	//this rolls those up into the per heap and total stats
+	void finalizeStats(AllocatorStats& stats, const VkPhysicalDeviceMemoryProperties& memProps);
+
+	void collectStats(AllocatorStats& outStats);
+	void computeStatsDelta(AllocatorStatsDelta& outDelta, const AllocatorStats& prev, const AllocatorStats& cur);
+	bool isDeltaEmpty(const AllocatorStatsDelta& delta);
+
+	void dumpStatsToJSON(const AllocatorStats& stats, const char* filepath);
+
+	//call once per frame, logs any change in allocator state since the previous frame
+	//so that leaks and fragmentation show up during long running sessions
+	void tickFrameStats();
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//reads the compact vertex layout: snorm16 positions inside the mesh's bounds, half float uvs,
+//unorm8 colours and octahedral normals. Rendering sets posScale / posBias from the mesh being drawn
+layout(binding = 0, set = 0)uniform GLOBAL_DATA
+{
+	float time;
+	vec4 mouse;
+	vec2 resolution;
+	mat4 viewMatrix;
+	vec4 worldSpaceCameraPos;
+}global;
+
+layout(push_constant) uniform PER_OBJECT
+{
+	vec4 posScale;
+	vec4 posBias;
+}pc;
+
+layout(location = 0) in vec4 vertex;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec4 color;
+layout(location = 3) in vec2 octNormal;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragUV;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+//undoes VertexEncoding::octahedralEncode, the lower hemisphere is folded over the diagonals
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+	{
+		vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(n.yx)) * signs;
+	}
+	return normalize(n);
+}
+
+void main()
+{
+	vec3 pos = vertex.xyz * pc.posScale.xyz + pc.posBias.xyz;
+	gl_Position = global.viewMatrix * vec4(pos, 1.0);
+
+	vec3 normal = octahedralDecode(octNormal);
+	fragColor = vec4(color.rgb * (0.5 + 0.5 * max(normal.y, 0.0)), color.a);
+	fragUV = uv;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//built once per combination of STRIPES and VIGNETTE when ShaderPipeline is given the material folder.
+//Every variant has to take the same inputs, so global is used whether or not a keyword needs it
+layout(binding = 0, set = 0)uniform GLOBAL_DATA
+{
+	float time;
+	vec4 mouse;
+	vec2 resolution;
+	mat4 viewMatrix;
+	vec4 worldSpaceCameraPos;
+}global;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 fragUV;
+
+void main()
+{
+	vec2 uv = fragUV / global.resolution;
+	vec3 color = vec3(uv, 0.5);
+
+#ifdef STRIPES
+	color *= 0.75 + 0.25 * step(0.5, fract(uv.x * 16.0 + global.time));
+#endif
+
+#ifdef VIGNETTE
+	vec2 centered = uv - 0.5;
+	color *= 1.0 - dot(centered, centered) * 1.5;
+#endif
+
+	outColor = vec4(color, 1.0);
+}
\ No newline at end of file
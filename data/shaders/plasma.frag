@@ -0,0 +1,28 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//a few layered sine waves, cheap to run but enough of a shader to show a deferred pipeline coming in
+layout(binding = 0, set = 0)uniform GLOBAL_DATA
+{
+	float time;
+	vec4 mouse;
+	vec2 resolution;
+	mat4 viewMatrix;
+	vec4 worldSpaceCameraPos;
+}global;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 fragUV;
+
+void main()
+{
+	vec2 p = fragUV / global.resolution * 8.0;
+	float t = global.time;
+
+	float v = sin(p.x + t);
+	v += sin((p.y + t) * 0.5);
+	v += sin((p.x + p.y + t) * 0.5);
+	v += sin(length(p - 4.0) + t);
+
+	outColor = vec4(0.5 + 0.5 * sin(v), 0.5 + 0.5 * sin(v + 2.094), 0.5 + 0.5 * sin(v + 4.188), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//about the cheapest pipeline there is to build, so it's ready long before any deferred one
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 fragUV;
+
+void main()
+{
+	outColor = vec4(0.2, 0.2, 0.2, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//ringCount is both a static uniform and a specialization constant. The material's specializeFromStaticUniforms
+//copies the uniform's value into the constant, and the ring loop reads the constant so the driver can unroll it
+layout(constant_id = 0) const float ringCount = 4.0;
+
+layout(binding = 0, set = 0)uniform GLOBAL_DATA
+{
+	float time;
+	vec4 mouse;
+	vec2 resolution;
+	mat4 viewMatrix;
+	vec4 worldSpaceCameraPos;
+}global;
+
+layout(binding = 0, set = 2) uniform Instance
+{
+	vec4 ringColor;
+	float ringCount;
+}inst_data;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 fragUV;
+
+void main()
+{
+	vec2 uv = fragUV / global.resolution - 0.5;
+	float d = length(uv) * 2.0;
+
+	float rings = 0.0;
+	for (float i = 1.0; i <= ringCount; i += 1.0)
+	{
+		rings += smoothstep(0.02, 0.0, abs(d - i / ringCount));
+	}
+
+	outColor = vec4(inst_data.ringColor.rgb * rings, 1.0);
+}
\ No newline at end of file
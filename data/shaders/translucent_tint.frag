@@ -0,0 +1,16 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//the material's render state blends this over whatever's behind it, alpha comes from the tint
+layout(binding = 0, set = 2) uniform Instance
+{
+	vec4 tint;
+}inst_data;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 fragUV;
+
+void main()
+{
+	outColor = inst_data.tint;
+}
\ No newline at end of file